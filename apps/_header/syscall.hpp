@@ -8,12 +8,48 @@ const uint64_t kSyscallListDir = 3;
 const uint64_t kSyscallReadFile = 4;
 const uint64_t kSyscallRead = 5;
 const uint64_t kSyscallWrite = 6;
+const uint64_t kSyscallSeek = 7;
+const uint64_t kSyscallPRead = 8;
+const uint64_t kSyscallPWrite = 9;
 const uint64_t kSyscallYield = 10;
 const uint64_t kSyscallTaskExit = 11;
 const uint64_t kSyscallSpawn = 20;
 const uint64_t kSyscallOpen = 21;
 const uint64_t kSyscallClose = 22;
 const uint64_t kSyscallDeleteFile = 23;
+const uint64_t kSyscallMemInfo = 30;
+
+// Open のフラグ (kernel/sys/std/file_descriptor.hpp と合わせる)
+const int kOpenWrite = 1 << 0;    // 書き込みを許可する
+const int kOpenCreate = 1 << 1;   // 存在しなければ作る
+const int kOpenTruncate = 1 << 2; // サイズ0にしてから開く
+const int kOpenAppend = 1 << 3;   // 書き込みは常に末尾へ
+
+// Seek の基準位置
+const int kSeekSet = 0;
+const int kSeekCur = 1;
+const int kSeekEnd = 2;
+
+// メモリ使用状況 (kernel/memory/memory_manager.hpp の MemoryStats と合わせる)
+struct MemInfo
+{
+    uint64_t total_frames;  // 管理対象の総フレーム数 (1フレーム = 4KB)
+    uint64_t usable_frames; // 使用可能なフレーム数
+    uint64_t free_frames;
+    // 用途別の使用フレーム数
+    // [0]未使用 [1]その他 [2]カーネルヒープ [3]ページテーブル
+    // [4]スタック [5]DMA [6]ユーザー [7]ファイルシステム
+    uint64_t owner_frames[8];
+    uint64_t free_blocks[16]; // 次数(2^n フレーム)ごとの空きブロック数
+    uint64_t largest_free_block;
+    uint64_t region_count;
+    struct
+    {
+        uint64_t start;
+        uint64_t frames;
+        uint64_t free_frames;
+    } regions[16];
+};
 
 // システムコール発行 (引数0個)
 inline uint64_t Syscall0(uint64_t syscall_number)
@@ -50,6 +86,19 @@ inline uint64_t Syscall3(uint64_t syscall_number, uint64_t arg1, uint64_t arg2,
     return ret;
 }
 
+// システムコール発行 (引数4個, 4個目は R10 で渡す)
+inline uint64_t Syscall4(uint64_t syscall_number, uint64_t arg1, uint64_t arg2,
+                         uint64_t arg3, uint64_t arg4)
+{
+    uint64_t ret;
+    register uint64_t r10 __asm__("r10") = arg4;
+    __asm__ volatile("syscall"
+                     : "=a"(ret), "+r"(r10)
+                     : "a"(syscall_number), "D"(arg1), "S"(arg2), "d"(arg3)
+                     : "rcx", "r11", "r8", "r9", "memory");
+    return ret;
+}
+
 // ラッパー関数
 inline void PutChar(char c)
 {
@@ -71,6 +120,24 @@ inline int Write(int fd, const void *buf, int len)
     return (int)Syscall3(kSyscallWrite, fd, (uint64_t)buf, len);
 }
 
+// ファイルの読み書き位置を変える (戻り値: 新しい位置, -1で失敗)
+inline int64_t Seek(int fd, int64_t offset, int whence)
+{
+    return (int64_t)Syscall3(kSyscallSeek, fd, (uint64_t)offset, whence);
+}
+
+// 読み書き位置を変えずに offset から読む
+inline int PRead(int fd, void *buf, int len, uint64_t offset)
+{
+    return (int)Syscall4(kSyscallPRead, fd, (uint64_t)buf, len, offset);
+}
+
+// 読み書き位置を変えずに offset へ書く
+inline int PWrite(int fd, const void *buf, int len, uint64_t offset)
+{
+    return (int)Syscall4(kSyscallPWrite, fd, (uint64_t)buf, len, offset);
+}
+
 // 文字列を標準出力に書き込む
 inline void Print(const char *s)
 {
@@ -98,7 +165,7 @@ inline uint64_t Spawn(const char *path, int argc, char **argv)
     return Syscall3(kSyscallSpawn, (uint64_t)path, argc, (uint64_t)argv);
 }
 
-// ファイルをオープンする (戻り値: fd, -1で失敗)
+// ファイルをオープンする (flags: kOpenWrite など, 戻り値: fd, -1で失敗)
 inline int Open(const char *path, int flags = 0)
 {
     return (int)Syscall3(kSyscallOpen, (uint64_t)path, flags, 0);
@@ -116,6 +183,12 @@ inline int DeleteFile(const char *path)
     return (int)Syscall1(kSyscallDeleteFile, (uint64_t)path);
 }
 
+// メモリ使用状況を取得する (戻り値: 0で成功)
+inline int GetMemInfo(MemInfo *info)
+{
+    return (int)Syscall3(kSyscallMemInfo, (uint64_t)info, sizeof(MemInfo), 0);
+}
+
 // CPUを自発的に手放す
 inline void Yield()
 {
@@ -46,9 +46,9 @@ bool ElfLoader::LoadElf(const char *filename, uint64_t *entry_point_out)
     }
 
     uint32_t buf_size = 1024 * 1024;
-    void *file_buf = MemoryManager::Allocate(buf_size);
+    void *file_buf = MemoryManager::Allocate(buf_size, 4096);
 
-    uint32_t file_size = fs->ReadFile(filename, file_buf, buf_size);
+    uint32_t file_size = fs->ReadFileDirect(filename, file_buf, buf_size);
 
     if (file_size == 0)
     {
@@ -101,7 +101,8 @@ bool ElfLoader::LoadElf(const char *filename, uint64_t *entry_point_out)
             if (!PageManager::AllocateVirtual(start_page, alloc_size,
                                               PageManager::kPresent |
                                                   PageManager::kWritable |
-                                                  PageManager::kUser))
+                                                  PageManager::kUser,
+                                              MemoryOwner::kUser))
             {
                 kprintf("Memory allocation failed at %lx\n", vaddr_start);
                 MemoryManager::Free(file_buf, buf_size);
@@ -154,14 +155,14 @@ Task *ElfLoader::CreateProcess(const char *filename, int argc, char **argv)
     }
 
     uint32_t buf_size = 1024 * 1024; // 1MB
-    void *file_buf = MemoryManager::Allocate(buf_size);
+    void *file_buf = MemoryManager::Allocate(buf_size, 4096);
     if (!file_buf)
     {
         kprintf("[ElfLoader] Failed to allocate file buffer\n");
         return nullptr;
     }
 
-    uint32_t file_size = fs->ReadFile(filename_copy, file_buf, buf_size);
+    uint32_t file_size = fs->ReadFileDirect(filename_copy, file_buf, buf_size);
     if (file_size == 0)
     {
         kprintf("[ElfLoader] Failed to read file: %s\n", filename_copy);
@@ -221,14 +222,14 @@ Task *ElfLoader::CreateProcess(const char *filename, int argc, char **argv)
     }
 
     uint32_t buf_size = 1024 * 1024; // 1MB
-    void *file_buf = MemoryManager::Allocate(buf_size);
+    void *file_buf = MemoryManager::Allocate(buf_size, 4096);
     if (!file_buf)
     {
         kprintf("[ElfLoader] Failed to allocate file buffer\n");
         return nullptr;
     }
 
-    uint32_t file_size = fs->ReadFile(filename_copy, file_buf, buf_size);
+    uint32_t file_size = fs->ReadFileDirect(filename_copy, file_buf, buf_size);
     if (file_size == 0)
     {
         kprintf("[ElfLoader] Failed to read file: %s\n", filename_copy);
@@ -302,7 +303,8 @@ Task *ElfLoader::CreateProcess(const char *filename, int argc, char **argv)
             if (!PageManager::AllocateVirtual(start_page, alloc_size,
                                               PageManager::kPresent |
                                                   PageManager::kWritable |
-                                                  PageManager::kUser))
+                                                  PageManager::kUser,
+                                              MemoryOwner::kUser))
             {
                 kprintf("[C++ELF] ERROR: alloc failed at %lx\n", vaddr_start);
                 load_success = false;
@@ -419,9 +421,9 @@ bool ElfLoader::LoadAndRun(const char *filename, int argc, char **argv)
     }
 
     uint32_t buf_size = 1024 * 1024;
-    void *file_buf = MemoryManager::Allocate(buf_size);
+    void *file_buf = MemoryManager::Allocate(buf_size, 4096);
 
-    uint32_t file_size = fs->ReadFile(filename, file_buf, buf_size);
+    uint32_t file_size = fs->ReadFileDirect(filename, file_buf, buf_size);
 
     if (file_size == 0)
     {
@@ -472,7 +474,8 @@ bool ElfLoader::LoadAndRun(const char *filename, int argc, char **argv)
             if (!PageManager::AllocateVirtual(start_page, alloc_size,
                                               PageManager::kPresent |
                                                   PageManager::kWritable |
-                                                  PageManager::kUser))
+                                                  PageManager::kUser,
+                                              MemoryOwner::kUser))
             {
                 kprintf("Memory allocation failed at %lx\n", vaddr_start);
                 MemoryManager::Free(file_buf, buf_size);
@@ -500,7 +503,8 @@ bool ElfLoader::LoadAndRun(const char *filename, int argc, char **argv)
     if (!PageManager::AllocateVirtual(stack_addr - stack_size, stack_size,
                                       PageManager::kPresent |
                                           PageManager::kWritable |
-                                          PageManager::kUser))
+                                          PageManager::kUser,
+                                      MemoryOwner::kUser))
     {
         kprintf("Failed to allocate user stack.\n");
         return false;
@@ -48,8 +48,11 @@ extern "C"
      */
     bool page_allocate_virtual(uint64_t vaddr, uint64_t size, uint64_t flags)
     {
+        // ユーザー権限のないマッピングはカーネル用として数える
+        MemoryOwner owner = (flags & PageManager::kUser) ? MemoryOwner::kUser
+                                                         : MemoryOwner::kOther;
         return PageManager::AllocateVirtual(vaddr, static_cast<size_t>(size),
-                                            flags);
+                                            flags, owner);
     }
 
     /**
@@ -0,0 +1,695 @@
+#include "block_device.hpp"
+#include "cxx.hpp"
+#include "memory/memory_manager.hpp"
+#include "printk.hpp"
+
+bool BlockDevice::WriteZeroes(uint64_t lba, uint32_t count)
+{
+    // 0のバッファを転送サイズとDMA境界に収まる大きさで繰り返し書く
+    const uint32_t kZeroBufferBytes = 64 * 1024;
+    uint32_t block_size = GetBlockSize();
+    uint32_t bytes = kZeroBufferBytes;
+    uint32_t boundary = GetDmaBoundary();
+    if (boundary != 0 && boundary < bytes)
+        bytes = boundary;
+    uint32_t chunk = bytes / block_size;
+    if (chunk > GetMaxTransferBlocks())
+        chunk = GetMaxTransferBlocks();
+    if (chunk == 0)
+        chunk = 1;
+    bytes = chunk * block_size;
+
+    // バッファの大きさで揃えて境界をまたがないようにする
+    uint8_t *zero = static_cast<uint8_t *>(
+        MemoryManager::Allocate(bytes, kZeroBufferBytes, MemoryOwner::kDMA));
+    if (!zero)
+        return false;
+    memset(zero, 0, bytes);
+
+    bool ok = true;
+    while (ok && count > 0)
+    {
+        uint32_t n = (count < chunk) ? count : chunk;
+        ok = Write(lba, zero, n);
+        lba += n;
+        count -= n;
+    }
+    MemoryManager::Free(zero, bytes);
+    return ok;
+}
+
+BlockCache::BlockCache(BlockDevice *dev, uint32_t capacity)
+    : dev_(dev), capacity_(capacity), hash_mask_(0), entries_(nullptr),
+      buckets_(nullptr), lru_head_(nullptr), lru_tail_(nullptr),
+      sync_list_(nullptr), data_(nullptr), bounce_(nullptr), dirty_count_(0),
+      hits_(0), misses_(0)
+{
+    block_size_ = dev_->GetBlockSize();
+    if (block_size_ == 0)
+        block_size_ = 512;
+
+    // 先読み中に同じ単位のエントリを追い出さないよう、最低限の容量を確保する
+    if (capacity_ < kMaxTransferBlocks * 2)
+        capacity_ = kMaxTransferBlocks * 2;
+
+    data_ = static_cast<uint8_t *>(MemoryManager::Allocate(
+        static_cast<size_t>(capacity_) * block_size_, 4096,
+        MemoryOwner::kFileSystem));
+    bounce_ = static_cast<uint8_t *>(MemoryManager::Allocate(
+        kMaxTransferBlocks * block_size_, 4096, MemoryOwner::kFileSystem));
+    if (!data_ || !bounce_)
+    {
+        kprintf("[BlockCache] Out of memory. Caching disabled.\n");
+        if (data_)
+            MemoryManager::Free(data_, static_cast<size_t>(capacity_) * block_size_);
+        if (bounce_)
+            MemoryManager::Free(bounce_, kMaxTransferBlocks * block_size_);
+        data_ = nullptr;
+        bounce_ = nullptr;
+        capacity_ = 0;
+        return;
+    }
+
+    uint32_t buckets = 1;
+    while (buckets < capacity_)
+        buckets <<= 1;
+    hash_mask_ = buckets - 1;
+
+    entries_ = new Entry[capacity_];
+    buckets_ = new Entry *[buckets];
+    sync_list_ = new Entry *[capacity_];
+    for (uint32_t i = 0; i < buckets; ++i)
+        buckets_[i] = nullptr;
+
+    // 最初はすべて無効なエントリとしてLRUリストに並べる
+    for (uint32_t i = 0; i < capacity_; ++i)
+    {
+        Entry *entry = &entries_[i];
+        entry->lba = 0;
+        entry->data = data_ + static_cast<size_t>(i) * block_size_;
+        entry->hash_next = nullptr;
+        entry->lru_prev = (i > 0) ? &entries_[i - 1] : nullptr;
+        entry->lru_next = (i + 1 < capacity_) ? &entries_[i + 1] : nullptr;
+        entry->valid = false;
+        entry->dirty = false;
+    }
+    lru_head_ = &entries_[0];
+    lru_tail_ = &entries_[capacity_ - 1];
+}
+
+BlockCache::~BlockCache()
+{
+    if (capacity_ == 0)
+        return;
+
+    if (!Sync())
+        kprintf("[BlockCache] Warning: failed to write back %d blocks.\n",
+                dirty_count_);
+
+    MemoryManager::Free(data_, static_cast<size_t>(capacity_) * block_size_);
+    MemoryManager::Free(bounce_, kMaxTransferBlocks * block_size_);
+    delete[] entries_;
+    delete[] buckets_;
+    delete[] sync_list_;
+}
+
+uint32_t BlockCache::HashOf(uint64_t lba) const
+{
+    return static_cast<uint32_t>((lba * 0x9E3779B97F4A7C15ULL) >> 32) & hash_mask_;
+}
+
+BlockCache::Entry *BlockCache::Lookup(uint64_t lba)
+{
+    for (Entry *entry = buckets_[HashOf(lba)]; entry; entry = entry->hash_next)
+    {
+        if (entry->lba == lba)
+            return entry;
+    }
+    return nullptr;
+}
+
+void BlockCache::HashRemove(Entry *entry)
+{
+    Entry **link = &buckets_[HashOf(entry->lba)];
+    while (*link && *link != entry)
+        link = &(*link)->hash_next;
+    if (*link)
+        *link = entry->hash_next;
+    entry->hash_next = nullptr;
+}
+
+void BlockCache::Touch(Entry *entry)
+{
+    if (entry == lru_head_)
+        return;
+
+    // リストから外す
+    entry->lru_prev->lru_next = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        lru_tail_ = entry->lru_prev;
+
+    // 先頭に付け直す
+    entry->lru_prev = nullptr;
+    entry->lru_next = lru_head_;
+    lru_head_->lru_prev = entry;
+    lru_head_ = entry;
+}
+
+void BlockCache::Drop(uint64_t lba, uint32_t count)
+{
+    // 範囲が容量より大きければ、ブロックごとに探すより全エントリを見る方が速い
+    bool scan = count > capacity_;
+    uint32_t n = scan ? capacity_ : count;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        Entry *entry = scan ? &entries_[i] : Lookup(lba + i);
+        if (!entry || !entry->valid || entry->lba < lba || entry->lba - lba >= count)
+            continue;
+
+        if (entry->dirty)
+        {
+            entry->dirty = false;
+            dirty_count_--;
+        }
+        HashRemove(entry);
+        entry->valid = false;
+
+        // 空いたエントリは次の Insert で使われるようLRU末尾へ移す
+        if (entry != lru_tail_)
+        {
+            if (entry->lru_prev)
+                entry->lru_prev->lru_next = entry->lru_next;
+            else
+                lru_head_ = entry->lru_next;
+            entry->lru_next->lru_prev = entry->lru_prev;
+            entry->lru_prev = lru_tail_;
+            entry->lru_next = nullptr;
+            lru_tail_->lru_next = entry;
+            lru_tail_ = entry;
+        }
+    }
+}
+
+bool BlockCache::WriteBack(Entry *entry)
+{
+    if (!dev_->Write(entry->lba, entry->data, 1))
+        return false;
+    entry->dirty = false;
+    dirty_count_--;
+    return true;
+}
+
+BlockCache::Entry *BlockCache::Insert(uint64_t lba)
+{
+    Entry *entry = lru_tail_;
+    if (entry->valid)
+    {
+        if (entry->dirty && !WriteBack(entry))
+        {
+            kprintf("[BlockCache] Error: write back of LBA %lu failed.\n",
+                    entry->lba);
+            return nullptr;
+        }
+        HashRemove(entry);
+    }
+
+    entry->lba = lba;
+    entry->valid = true;
+    entry->dirty = false;
+
+    uint32_t bucket = HashOf(lba);
+    entry->hash_next = buckets_[bucket];
+    buckets_[bucket] = entry;
+
+    Touch(entry);
+    return entry;
+}
+
+BlockCache::Entry *BlockCache::Fill(uint64_t lba)
+{
+    misses_++;
+
+    // 先読み単位ごとまとめて読み込む (FATセクタを順に辿る場合に効く)
+    uint64_t start = lba & ~static_cast<uint64_t>(kReadAheadBlocks - 1);
+    if (dev_->Read(start, bounce_, kReadAheadBlocks))
+    {
+        // 読み込み時点でキャッシュにあったブロック (dirty かもしれない) は取り込まない
+        // (途中で追い出されて書き戻されると、bounce_ の内容の方が古くなる)
+        uint32_t cached = 0;
+        for (uint32_t i = 0; i < kReadAheadBlocks; ++i)
+        {
+            if (Lookup(start + i))
+                cached |= 1U << i;
+        }
+
+        Entry *target = nullptr;
+        for (uint32_t i = 0; i < kReadAheadBlocks; ++i)
+        {
+            if (cached & (1U << i))
+                continue;
+            Entry *entry = Insert(start + i);
+            if (!entry)
+                continue;
+            memcpy(entry->data, bounce_ + i * block_size_, block_size_);
+            if (start + i == lba)
+                target = entry;
+        }
+        if (target)
+            Touch(target);
+        return target;
+    }
+
+    // 先読みに失敗した場合 (デバイス末尾など) は1ブロックだけ読む
+    if (!dev_->Read(lba, bounce_, 1))
+        return nullptr;
+    Entry *entry = Insert(lba);
+    if (entry)
+        memcpy(entry->data, bounce_, block_size_);
+    return entry;
+}
+
+bool BlockCache::Read(uint64_t lba, void *buffer, uint32_t count)
+{
+    if (capacity_ == 0)
+        return dev_->Read(lba, buffer, count);
+
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+
+    // 大きな読み込みはデバイスから直接読み、キャッシュ上の新しい内容を重ねる
+    if (count >= kBypassBlocks)
+    {
+        if (!dev_->Read(lba, buffer, count))
+            return false;
+        if (dirty_count_ == 0)
+            return true;
+        for (uint32_t i = 0; i < capacity_; ++i)
+        {
+            Entry *entry = &entries_[i];
+            if (entry->valid && entry->dirty && entry->lba >= lba &&
+                entry->lba < lba + count)
+            {
+                memcpy(out + (entry->lba - lba) * block_size_, entry->data,
+                       block_size_);
+            }
+        }
+        return true;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Entry *entry = Lookup(lba + i);
+        if (entry)
+        {
+            hits_++;
+            Touch(entry);
+        }
+        else
+        {
+            entry = Fill(lba + i);
+            if (!entry)
+                return false;
+        }
+        memcpy(out + static_cast<size_t>(i) * block_size_, entry->data,
+               block_size_);
+    }
+    return true;
+}
+
+bool BlockCache::Write(uint64_t lba, const void *buffer, uint32_t count)
+{
+    if (capacity_ == 0)
+        return dev_->Write(lba, buffer, count);
+
+    const uint8_t *in = static_cast<const uint8_t *>(buffer);
+
+    // 大きな書き込みはデバイスへ直接書き、キャッシュ済みのブロックを更新する
+    if (count >= kBypassBlocks)
+    {
+        if (!dev_->Write(lba, buffer, count))
+            return false;
+        for (uint32_t i = 0; i < capacity_; ++i)
+        {
+            Entry *entry = &entries_[i];
+            if (!entry->valid || entry->lba < lba || entry->lba >= lba + count)
+                continue;
+            memcpy(entry->data, in + (entry->lba - lba) * block_size_,
+                   block_size_);
+            if (entry->dirty)
+            {
+                entry->dirty = false;
+                dirty_count_--;
+            }
+        }
+        return true;
+    }
+
+    // ブロック全体を上書きするので、ミスしてもデバイスから読む必要はない
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Entry *entry = Lookup(lba + i);
+        if (entry)
+            Touch(entry);
+        else if (!(entry = Insert(lba + i)))
+            return false;
+
+        memcpy(entry->data, in + static_cast<size_t>(i) * block_size_,
+               block_size_);
+        if (!entry->dirty)
+        {
+            entry->dirty = true;
+            dirty_count_++;
+        }
+    }
+
+    // dirty が溜まりすぎたら、1ブロックずつ追い出される前にまとめて書き戻す
+    if (dirty_count_ > capacity_ / 2)
+        return Sync();
+    return true;
+}
+
+bool BlockCache::Sync()
+{
+    if (capacity_ == 0 || dirty_count_ == 0)
+        return dev_->Sync();
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < capacity_; ++i)
+    {
+        if (entries_[i].valid && entries_[i].dirty)
+            sync_list_[n++] = &entries_[i];
+    }
+
+    // LBA順に並べる (挿入ソート)
+    for (uint32_t i = 1; i < n; ++i)
+    {
+        Entry *entry = sync_list_[i];
+        uint32_t j = i;
+        while (j > 0 && sync_list_[j - 1]->lba > entry->lba)
+        {
+            sync_list_[j] = sync_list_[j - 1];
+            j--;
+        }
+        sync_list_[j] = entry;
+    }
+
+    // 連続するLBAをまとめて1回の転送で書き戻す
+    // (下位がまとめられるなら、転送サイズで分けた分も含めて1つにしてもらう)
+    dev_->Plug();
+    bool ok = true;
+    uint32_t i = 0;
+    while (i < n)
+    {
+        uint32_t j = i + 1;
+        while (j < n && j - i < kMaxTransferBlocks &&
+               sync_list_[j]->lba == sync_list_[j - 1]->lba + 1)
+        {
+            j++;
+        }
+
+        uint32_t run = j - i;
+        if (run == 1)
+        {
+            ok &= WriteBack(sync_list_[i]);
+        }
+        else
+        {
+            for (uint32_t k = 0; k < run; ++k)
+                memcpy(bounce_ + k * block_size_, sync_list_[i + k]->data,
+                       block_size_);
+
+            if (dev_->Write(sync_list_[i]->lba, bounce_, run))
+            {
+                for (uint32_t k = 0; k < run; ++k)
+                    sync_list_[i + k]->dirty = false;
+                dirty_count_ -= run;
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+        i = j;
+    }
+
+    ok &= dev_->Unplug();
+
+    if (!ok)
+        kprintf("[BlockCache] Error: Sync left %d dirty blocks.\n", dirty_count_);
+    return dev_->Sync() && ok;
+}
+
+bool BlockCache::Discard(const BlockRange *ranges, uint32_t range_count)
+{
+    // dirty でも書き戻さない (捨てる内容を書いても意味がない)
+    if (capacity_ != 0)
+    {
+        for (uint32_t i = 0; i < range_count; ++i)
+            Drop(ranges[i].lba, ranges[i].count);
+    }
+    return dev_->Discard(ranges, range_count);
+}
+
+bool BlockCache::WriteZeroes(uint64_t lba, uint32_t count)
+{
+    // 次に読むときにデバイスから0を読み直す
+    if (capacity_ != 0)
+        Drop(lba, count);
+    return dev_->WriteZeroes(lba, count);
+}
+
+RequestQueue::RequestQueue(BlockDevice *dev)
+    : dev_(dev), plug_depth_(0), request_count_(0), queued_blocks_(0),
+      writes_(0), dispatches_(0)
+{
+    block_size_ = dev_->GetBlockSize();
+    if (block_size_ == 0)
+        block_size_ = 512;
+}
+
+RequestQueue::~RequestQueue()
+{
+    if (!Dispatch())
+        kprintf("[RequestQueue] Warning: failed to write queued requests.\n");
+}
+
+void RequestQueue::FreeBuffer(Request &request)
+{
+    MemoryManager::Free(request.data,
+                        static_cast<size_t>(request.capacity) * block_size_);
+    request.data = nullptr;
+}
+
+bool RequestQueue::Overlaps(uint64_t lba, uint32_t count) const
+{
+    for (uint32_t i = 0; i < request_count_; ++i)
+    {
+        const Request &request = requests_[i];
+        if (request.lba >= lba + count)
+            break;
+        if (request.lba + request.count > lba)
+            return true;
+    }
+    return false;
+}
+
+bool RequestQueue::WriteRange(uint64_t lba, const uint8_t *data, uint32_t count)
+{
+    uint32_t max_blocks = dev_->GetMaxTransferBlocks();
+    uint32_t boundary = dev_->GetDmaBoundary();
+    bool ok = true;
+    while (count > 0)
+    {
+        uint32_t chunk = (count < max_blocks) ? count : max_blocks;
+        if (boundary != 0)
+        {
+            // バッファが境界をまたがないところで切る
+            uintptr_t addr = reinterpret_cast<uintptr_t>(data);
+            uint32_t room = (boundary - (addr & (boundary - 1))) / block_size_;
+            if (room != 0 && chunk > room)
+                chunk = room;
+        }
+        ok &= dev_->Write(lba, data, chunk);
+        dispatches_++;
+        lba += chunk;
+        data += static_cast<size_t>(chunk) * block_size_;
+        count -= chunk;
+    }
+    return ok;
+}
+
+bool RequestQueue::Dispatch()
+{
+    // 要求は常にLBA順に並べてあるので、前から流せばデバイス上を一方向に進む
+    bool ok = true;
+    for (uint32_t i = 0; i < request_count_; ++i)
+    {
+        Request &request = requests_[i];
+        ok &= WriteRange(request.lba, request.data, request.count);
+        FreeBuffer(request);
+    }
+    request_count_ = 0;
+    queued_blocks_ = 0;
+
+    if (!ok)
+        kprintf("[RequestQueue] Error: failed to dispatch queued writes.\n");
+    return ok;
+}
+
+bool RequestQueue::Read(uint64_t lba, void *buffer, uint32_t count)
+{
+    // 溜めている内容の方が新しいので、重なる場合は先に書き出す
+    if (Overlaps(lba, count) && !Dispatch())
+        return false;
+    return dev_->Read(lba, buffer, count);
+}
+
+bool RequestQueue::Write(uint64_t lba, const void *buffer, uint32_t count)
+{
+    if (count == 0)
+        return true;
+    writes_++;
+
+    const uint8_t *in = static_cast<const uint8_t *>(buffer);
+    if (plug_depth_ == 0 || count >= kBypassBlocks)
+    {
+        // 溜めている古い内容が後から上書きしないよう、重なるものは先に流す
+        if (Overlaps(lba, count) && !Dispatch())
+            return false;
+        return WriteRange(lba, in, count);
+    }
+
+    // 隣接する・重なる要求の範囲 [first, last) (LBA順なので連続している)
+    uint32_t first = 0;
+    while (first < request_count_ &&
+           requests_[first].lba + requests_[first].count < lba)
+        first++;
+    uint32_t last = first;
+    while (last < request_count_ && requests_[last].lba <= lba + count)
+        last++;
+
+    uint64_t start = lba;
+    uint64_t end = lba + count;
+    uint32_t absorbed = 0; // まとめる要求のブロック数
+    if (first < last)
+    {
+        if (requests_[first].lba < start)
+            start = requests_[first].lba;
+        uint64_t last_end = requests_[last - 1].lba + requests_[last - 1].count;
+        if (last_end > end)
+            end = last_end;
+        for (uint32_t i = first; i < last; ++i)
+            absorbed += requests_[i].count;
+    }
+    uint32_t merged = static_cast<uint32_t>(end - start);
+
+    // 溜めきれなければ、ここまでの要求を流してからこの書き込みだけを積む
+    if ((first == last && request_count_ == kMaxRequests) ||
+        queued_blocks_ - absorbed + merged > kMaxQueuedBlocks)
+    {
+        if (!Dispatch())
+            return false;
+        first = last = 0;
+        start = lba;
+        merged = count;
+        absorbed = 0;
+    }
+
+    Request *target;
+    if (first < last && requests_[first].lba == start &&
+        merged <= requests_[first].capacity)
+    {
+        // 先頭の要求のバッファに収まるなら、その場で伸ばす (順に追記する場合)
+        target = &requests_[first];
+        for (uint32_t i = first + 1; i < last; ++i)
+        {
+            memcpy(target->data + (requests_[i].lba - start) * block_size_,
+                   requests_[i].data,
+                   static_cast<size_t>(requests_[i].count) * block_size_);
+            FreeBuffer(requests_[i]);
+        }
+    }
+    else
+    {
+        uint32_t unit_blocks = (kBufferUnit > block_size_) ? kBufferUnit / block_size_ : 1;
+        uint32_t capacity = (merged + unit_blocks - 1) / unit_blocks * unit_blocks;
+        uint8_t *data = static_cast<uint8_t *>(MemoryManager::Allocate(
+            static_cast<size_t>(capacity) * block_size_, 4096, MemoryOwner::kDMA));
+        if (!data)
+        {
+            // メモリがなければ溜めずに書く
+            return Dispatch() && WriteRange(lba, in, count);
+        }
+
+        for (uint32_t i = first; i < last; ++i)
+        {
+            memcpy(data + (requests_[i].lba - start) * block_size_,
+                   requests_[i].data,
+                   static_cast<size_t>(requests_[i].count) * block_size_);
+            FreeBuffer(requests_[i]);
+        }
+
+        // まとめた要求の場所を空ける (まとめるものがなければ first に差し込む)
+        if (first == last)
+        {
+            for (uint32_t i = request_count_; i > first; --i)
+                requests_[i] = requests_[i - 1];
+            request_count_++;
+            last = first + 1;
+        }
+        target = &requests_[first];
+        target->data = data;
+        target->capacity = capacity;
+    }
+
+    // まとめた要求を1つ残して詰める
+    if (last > first + 1)
+    {
+        uint32_t removed = last - first - 1;
+        for (uint32_t i = first + 1; i + removed < request_count_; ++i)
+            requests_[i] = requests_[i + removed];
+        request_count_ -= removed;
+    }
+
+    target->lba = start;
+    target->count = merged;
+    memcpy(target->data + (lba - start) * block_size_, in,
+           static_cast<size_t>(count) * block_size_);
+    queued_blocks_ = queued_blocks_ - absorbed + merged;
+    return true;
+}
+
+bool RequestQueue::Unplug()
+{
+    if (plug_depth_ == 0 || --plug_depth_ > 0)
+        return true;
+    return Dispatch();
+}
+
+bool RequestQueue::Sync()
+{
+    return Dispatch() && dev_->Sync();
+}
+
+bool RequestQueue::Discard(const BlockRange *ranges, uint32_t range_count)
+{
+    // 溜めている書き込みが後から範囲を上書きしないよう、重なるなら先に流す
+    for (uint32_t i = 0; i < range_count; ++i)
+    {
+        if (Overlaps(ranges[i].lba, ranges[i].count))
+        {
+            if (!Dispatch())
+                return false;
+            break;
+        }
+    }
+    return dev_->Discard(ranges, range_count);
+}
+
+bool RequestQueue::WriteZeroes(uint64_t lba, uint32_t count)
+{
+    if (Overlaps(lba, count) && !Dispatch())
+        return false;
+    return dev_->WriteZeroes(lba, count);
+}
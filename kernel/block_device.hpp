@@ -1,6 +1,13 @@
 #pragma once
 #include <stdint.h>
 
+// 連続したブロックの範囲 (Discard で使う)
+struct BlockRange
+{
+    uint64_t lba;
+    uint32_t count;
+};
+
 class BlockDevice
 {
 public:
@@ -10,4 +17,194 @@ public:
     virtual bool Write(uint64_t lba, const void *buffer, uint32_t count) = 0;
 
     virtual uint32_t GetBlockSize() const = 0;
-};
\ No newline at end of file
+
+    // 1回の Read/Write で転送できる最大ブロック数
+    virtual uint32_t GetMaxTransferBlocks() const { return 128; }
+
+    // 1回の転送のバッファがまたいではいけないアドレス境界 (バイト, 0なら制約なし)
+    virtual uint32_t GetDmaBoundary() const { return 0; }
+
+    // 書き込みを溜めている実装は、ここでデバイスへ書き戻す
+    virtual bool Sync() { return true; }
+
+    // 書き込みをまとめる区間の開始と終了 (入れ子にできる)
+    // 対応する実装は、最も外側の Unplug() までの書き込みを溜めてまとめて流す
+    virtual void Plug() {}
+    virtual bool Unplug() { return true; }
+
+    // 範囲の内容がもう要らないことをデバイスに伝える (TRIM)
+    // 以後その範囲を読んだ結果は決まらない。対応しないデバイスでは何もしない
+    virtual bool Discard(const BlockRange *ranges, uint32_t range_count)
+    {
+        return true;
+    }
+    // 範囲を0で埋める (既定の実装は0のバッファを書く)
+    virtual bool WriteZeroes(uint64_t lba, uint32_t count);
+};
+
+// スコープの間、dev への書き込みをまとめる
+class BlockPlug
+{
+public:
+    explicit BlockPlug(BlockDevice *dev) : dev_(dev) { dev_->Plug(); }
+    ~BlockPlug() { dev_->Unplug(); }
+
+    BlockPlug(const BlockPlug &) = delete;
+    BlockPlug &operator=(const BlockPlug &) = delete;
+
+private:
+    BlockDevice *dev_;
+};
+
+// ライトバック方式のブロックキャッシュ
+// 下位の BlockDevice を包み、小さな読み書きをブロック単位でキャッシュする。
+// 書き込みは dirty として保持し、LRUで追い出されるときか Sync() で書き戻す。
+// 大きな転送はキャッシュを通さず直接デバイスへ流す。
+class BlockCache : public BlockDevice
+{
+public:
+    static const uint32_t kDefaultCapacity = 1024; // 512Bブロックで512KB
+
+    BlockCache(BlockDevice *dev, uint32_t capacity = kDefaultCapacity);
+    ~BlockCache() override; // dirty ブロックは書き戻してから解放する
+
+    bool Read(uint64_t lba, void *buffer, uint32_t count) override;
+    bool Write(uint64_t lba, const void *buffer, uint32_t count) override;
+    uint32_t GetBlockSize() const override { return block_size_; }
+    uint32_t GetMaxTransferBlocks() const override
+    {
+        return dev_->GetMaxTransferBlocks();
+    }
+    uint32_t GetDmaBoundary() const override { return dev_->GetDmaBoundary(); }
+
+    // dirty ブロックをLBA順に並べ、連続する範囲をまとめて書き戻す
+    bool Sync() override;
+    void Plug() override { dev_->Plug(); }
+    bool Unplug() override { return dev_->Unplug(); }
+    // 範囲のキャッシュを捨ててから下位へ渡す
+    bool Discard(const BlockRange *ranges, uint32_t range_count) override;
+    bool WriteZeroes(uint64_t lba, uint32_t count) override;
+
+    BlockDevice *GetDevice() const { return dev_; }
+
+    uint64_t GetHits() const { return hits_; }
+    uint64_t GetMisses() const { return misses_; }
+    uint32_t GetDirtyCount() const { return dirty_count_; }
+
+private:
+    // ミス時にまとめて読み込むブロック数 (アライン単位)
+    static const uint32_t kReadAheadBlocks = 8;
+    // 書き戻し・先読みで一度に転送する最大ブロック数
+    static const uint32_t kMaxTransferBlocks = 32;
+    // これ以上のブロック数の転送はキャッシュを迂回する
+    static const uint32_t kBypassBlocks = 64;
+
+    struct Entry
+    {
+        uint64_t lba;
+        uint8_t *data;
+        Entry *hash_next;
+        Entry *lru_prev; // lru_head_ 側が最近使ったもの
+        Entry *lru_next;
+        bool valid;
+        bool dirty;
+    };
+
+    Entry *Lookup(uint64_t lba);
+    // 空きまたはLRU末尾のエントリを lba 用に確保する (dirty なら先に書き戻す)
+    Entry *Insert(uint64_t lba);
+    void HashRemove(Entry *entry);
+    void Touch(Entry *entry);
+    // [lba, lba + count) のエントリを書き戻さずに無効にする
+    void Drop(uint64_t lba, uint32_t count);
+    bool WriteBack(Entry *entry);
+    // lba を含む先読み単位をまとめて読み込み、lba のエントリを返す
+    Entry *Fill(uint64_t lba);
+    uint32_t HashOf(uint64_t lba) const;
+
+    BlockDevice *dev_;
+    uint32_t block_size_;
+    uint32_t capacity_;
+    uint32_t hash_mask_;
+
+    Entry *entries_;
+    Entry **buckets_;
+    Entry *lru_head_;
+    Entry *lru_tail_;
+    Entry **sync_list_;    // Sync 時のソート用 (capacity_ 個)
+    uint8_t *data_;        // capacity_ * block_size_
+    uint8_t *bounce_;      // kMaxTransferBlocks * block_size_
+    uint32_t dirty_count_;
+
+    uint64_t hits_;
+    uint64_t misses_;
+};
+
+// 下位の BlockDevice の前に置く書き込み要求のキュー
+// Plug() している間の小さな書き込みはデバイスへ出さずに内容をコピーして溜め、
+// 隣接する・重なる要求を1つにまとめる (後から書いた内容が勝つ)。
+// 最も外側の Unplug() か Sync() で、LBA順にまとめた要求を流す。
+// 溜めている範囲を読む場合や、溜めきれない場合は先に流す。
+// Plug() していないときの書き込みは、そのままデバイスへ渡す。
+class RequestQueue : public BlockDevice
+{
+public:
+    static const uint32_t kMaxRequests = 64;       // 溜める要求の数
+    static const uint32_t kMaxQueuedBlocks = 2048; // 溜めるブロック数の合計
+
+    explicit RequestQueue(BlockDevice *dev);
+    ~RequestQueue() override; // 溜めている要求は流してから解放する
+
+    bool Read(uint64_t lba, void *buffer, uint32_t count) override;
+    bool Write(uint64_t lba, const void *buffer, uint32_t count) override;
+    uint32_t GetBlockSize() const override { return block_size_; }
+    uint32_t GetMaxTransferBlocks() const override
+    {
+        return dev_->GetMaxTransferBlocks();
+    }
+    uint32_t GetDmaBoundary() const override { return dev_->GetDmaBoundary(); }
+
+    bool Sync() override;
+    void Plug() override { plug_depth_++; }
+    bool Unplug() override;
+    // 重なる要求を流してから下位へ渡す
+    bool Discard(const BlockRange *ranges, uint32_t range_count) override;
+    bool WriteZeroes(uint64_t lba, uint32_t count) override;
+
+    BlockDevice *GetDevice() const { return dev_; }
+
+    uint64_t GetWriteCount() const { return writes_; }       // 受け付けた書き込み
+    uint64_t GetDispatchCount() const { return dispatches_; } // デバイスへ出した書き込み
+
+private:
+    // これ以上のブロック数の書き込みは溜めずに直接流す (コピーの方が高くつく)
+    static const uint32_t kBypassBlocks = 64;
+    // 要求のバッファはこの単位で確保し、後ろへの追記はなるべくその場で伸ばす
+    static const uint32_t kBufferUnit = 4096;
+
+    struct Request
+    {
+        uint64_t lba;
+        uint32_t count;
+        uint32_t capacity; // data に入るブロック数
+        uint8_t *data;
+    };
+
+    // 溜めた要求をLBA順に流す
+    bool Dispatch();
+    // デバイスの転送サイズと境界の制約に合わせて分けて書く
+    bool WriteRange(uint64_t lba, const uint8_t *data, uint32_t count);
+    bool Overlaps(uint64_t lba, uint32_t count) const;
+    void FreeBuffer(Request &request);
+
+    BlockDevice *dev_;
+    uint32_t block_size_;
+    uint32_t plug_depth_;
+
+    Request requests_[kMaxRequests]; // LBA順で、互いに重ならず隣接もしない
+    uint32_t request_count_;
+    uint32_t queued_blocks_;
+
+    uint64_t writes_;
+    uint64_t dispatches_;
+};
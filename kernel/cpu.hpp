@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include "apic.hpp"
+
+// per-CPUデータの配列サイズ (これを超えるAPIC IDは剰余で畳み込む)
+const int kMaxCPUs = 16;
+
+// 現在のCPUのLocal APIC ID
+// g_lapic の用意前 (メモリ初期化など) は BSP しか動いていないので 0 を返す
+static inline uint32_t GetCurrentApicID()
+{
+    if (!g_lapic)
+        return 0;
+    return g_lapic->GetID();
+}
+
+// per-CPUデータの添字として使うCPU番号 (0 .. kMaxCPUs-1)
+static inline int GetCurrentCPUIndex()
+{
+    return static_cast<int>(GetCurrentApicID() % kMaxCPUs);
+}
+
+// 起動しているCPUの数 (CPUごとに資源を用意するときに使う)
+// AP の起動処理も MADT の解析もまだ無く、動いているのは BSP だけなので常に 1
+// SMP に対応したら、実際に起動した AP の数を足すこと
+static inline int GetOnlineCPUCount()
+{
+    return 1;
+}
@@ -3,6 +3,36 @@
 
 #include "cxx.hpp"
 
+namespace
+{
+    // ERMS対応CPUでは rep movsb/stosb が最速 (InitializeMemoryFunctions で設定)
+    bool g_has_erms = false;
+
+    // これより短いコピーは rep 命令の立ち上がりコストの方が大きい
+    const size_t kRepThreshold = 256;
+
+    // アラインされていない8バイトアクセス用 (x86では許される)
+    typedef uint64_t __attribute__((may_alias, aligned(1))) UnalignedWord;
+
+    inline void RepMovsb(void *dest, const void *src, size_t n)
+    {
+        __asm__ volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(n) : : "memory");
+    }
+
+    inline void CopyForward(unsigned char *d, const unsigned char *s, size_t n)
+    {
+        while (n >= 8)
+        {
+            *reinterpret_cast<UnalignedWord *>(d) = *reinterpret_cast<const UnalignedWord *>(s);
+            d += 8;
+            s += 8;
+            n -= 8;
+        }
+        while (n--)
+            *d++ = *s++;
+    }
+} // namespace
+
 extern "C"
 {
     // 純粋仮想関数エラー (virtual function call error)
@@ -42,18 +72,118 @@ extern "C"
 
     void *memcpy(void *dest, const void *src, size_t n)
     {
-        char *d = (char *)dest;
-        const char *s = (const char *)src;
-        while (n--)
-            *d++ = *s++;
+        unsigned char *d = static_cast<unsigned char *>(dest);
+        const unsigned char *s = static_cast<const unsigned char *>(src);
+
+        if (n >= kRepThreshold)
+        {
+            if (g_has_erms)
+            {
+                RepMovsb(d, s, n);
+                return dest;
+            }
+            // ERMSが無いCPUでは8バイト単位の rep movsq + 端数
+            size_t words = n / 8;
+            __asm__ volatile("rep movsq" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+            n &= 7;
+        }
+        CopyForward(d, s, n);
         return dest;
     }
 
     void *memset(void *s, int c, size_t n)
     {
-        unsigned char *p = (unsigned char *)s;
+        unsigned char *p = static_cast<unsigned char *>(s);
+        uint64_t pattern = 0x0101010101010101ULL * static_cast<unsigned char>(c);
+
+        if (n >= kRepThreshold)
+        {
+            if (g_has_erms)
+            {
+                __asm__ volatile("rep stosb" : "+D"(p), "+c"(n) : "a"(c) : "memory");
+                return s;
+            }
+            size_t words = n / 8;
+            __asm__ volatile("rep stosq" : "+D"(p), "+c"(words) : "a"(pattern) : "memory");
+            n &= 7;
+        }
+
+        while (n >= 8)
+        {
+            *reinterpret_cast<UnalignedWord *>(p) = pattern;
+            p += 8;
+            n -= 8;
+        }
         while (n--)
-            *p++ = (unsigned char)c;
+            *p++ = static_cast<unsigned char>(c);
         return s;
     }
-}
\ No newline at end of file
+
+    void *memmove(void *dest, const void *src, size_t n)
+    {
+        unsigned char *d = static_cast<unsigned char *>(dest);
+        const unsigned char *s = static_cast<const unsigned char *>(src);
+
+        // 前方コピーで壊れないなら memcpy と同じ経路を使う
+        if (d <= s || d >= s + n)
+            return memcpy(dest, src, n);
+
+        // 後ろが重なっている場合は末尾から8バイトずつコピーする
+        d += n;
+        s += n;
+        while (n >= 8)
+        {
+            d -= 8;
+            s -= 8;
+            n -= 8;
+            *reinterpret_cast<UnalignedWord *>(d) = *reinterpret_cast<const UnalignedWord *>(s);
+        }
+        while (n--)
+            *--d = *--s;
+        return dest;
+    }
+
+    int memcmp(const void *lhs, const void *rhs, size_t n)
+    {
+        const unsigned char *a = static_cast<const unsigned char *>(lhs);
+        const unsigned char *b = static_cast<const unsigned char *>(rhs);
+
+        // 8バイト単位で比較し、違いが見つかったワードだけバイト単位で調べる
+        while (n >= 8)
+        {
+            if (*reinterpret_cast<const UnalignedWord *>(a) !=
+                *reinterpret_cast<const UnalignedWord *>(b))
+                break;
+            a += 8;
+            b += 8;
+            n -= 8;
+        }
+        while (n--)
+        {
+            if (*a != *b)
+                return *a - *b;
+            a++;
+            b++;
+        }
+        return 0;
+    }
+}
+
+void InitializeMemoryFunctions()
+{
+    // CPUID.(EAX=07H, ECX=0):EBX[bit 9] = ERMS (Enhanced REP MOVSB/STOSB)
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+    uint32_t max_leaf = eax;
+
+    if (max_leaf >= 7)
+    {
+        __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+        g_has_erms = (ebx >> 9) & 1;
+    }
+}
+
+bool HasERMS()
+{
+    return g_has_erms;
+}
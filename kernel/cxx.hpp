@@ -6,4 +6,12 @@ extern "C"
 {
     void *memcpy(void *dest, const void *src, size_t n);
     void *memset(void *s, int c, size_t n);
-}
\ No newline at end of file
+    void *memmove(void *dest, const void *src, size_t n);
+    int memcmp(const void *lhs, const void *rhs, size_t n);
+}
+
+// CPUIDを見て memcpy/memset の実装を選ぶ (起動時に1回呼ぶ)
+void InitializeMemoryFunctions();
+
+// ERMS (Enhanced REP MOVSB/STOSB) が使えるか
+bool HasERMS();
\ No newline at end of file
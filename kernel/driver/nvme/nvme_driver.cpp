@@ -1,6 +1,10 @@
 #include "driver/nvme/nvme_driver.hpp"
+#include "memory/dma.hpp"
+#include "cxx.hpp"
 #include "memory/memory_manager.hpp"
 #include "printk.hpp"
+#include "task/scheduler.hpp"
+#include "task/task_manager.hpp"
 
 namespace NVMe
 {
@@ -8,21 +12,138 @@ namespace NVMe
 
     Driver::Driver(uintptr_t mmio_base)
         : regs_(reinterpret_cast<volatile Registers *>(mmio_base)),
-          admin_sq_(nullptr), admin_cq_(nullptr),
-          sq_tail_(0), cq_head_(0), phase_(1),
-          io_sq_(nullptr), io_cq_(nullptr),
-          io_sq_tail_(0), io_cq_head_(0), io_phase_(1)
-    { // Phaseは1初期化
-
-        // ドアベルレジスタの位置を計算
-        // Admin SQ Tail Doorbell = MMIO Start + 0x1000
-        // Admin CQ Head Doorbell = MMIO Start + 0x1000 + (1 * Stride)
-        // ※QEMUや一般的なPCではStride=4bytesなので +4
-        uintptr_t base = reinterpret_cast<uintptr_t>(regs_);
-        sq_doorbell_ = reinterpret_cast<volatile uint32_t *>(base + 0x1000);
-        cq_doorbell_ = reinterpret_cast<volatile uint32_t *>(base + 0x1004);
-        io_sq_doorbell_ = reinterpret_cast<volatile uint32_t *>(base + 0x1008);
-        io_cq_doorbell_ = reinterpret_cast<volatile uint32_t *>(base + 0x100C);
+          io_queue_count_(0)
+    {
+        // ドアベルレジスタの間隔: CAP.DSTRD (bit 35:32) から 4 << DSTRD バイト
+        doorbell_stride_ = 4U << ((regs_->cap >> 32) & 0xF);
+    }
+
+    namespace
+    {
+        const uint32_t kPageSize = 4096;
+
+        size_t PrpListBytes(const QueuePair &queue)
+        {
+            return static_cast<size_t>(queue.depth) * kMaxPrpListEntries * sizeof(uint64_t);
+        }
+
+        void FreeQueuePair(QueuePair &queue)
+        {
+            if (queue.sq)
+                MemoryManager::Free(queue.sq, sizeof(SubmissionQueueEntry) * queue.depth);
+            if (queue.cq)
+                MemoryManager::Free(queue.cq, sizeof(CompletionQueueEntry) * queue.depth);
+            if (queue.prp_lists)
+                MemoryManager::Free(queue.prp_lists, PrpListBytes(queue));
+            queue.sq = nullptr;
+            queue.cq = nullptr;
+            queue.prp_lists = nullptr;
+        }
+
+        // segments の offset から size バイトを指すPRPを作る
+        // ページごとのアドレスを prp_list に並べ、PRP1/PRP2 を設定する
+        // (PRPで表せない区間の並びなら false)
+        bool BuildPRPs(SubmissionQueueEntry &cmd, const Segment *segments, uint32_t segment_count,
+                       uint64_t offset, uint32_t size, uint64_t *prp_list)
+        {
+            uint32_t i = 0;
+            while (i < segment_count && offset >= segments[i].length)
+                offset -= segments[i++].length;
+
+            uint32_t n = 0;
+            uint64_t remaining = size;
+            for (; i < segment_count && remaining > 0; ++i)
+            {
+                uint64_t addr = segments[i].addr + offset;
+                uint64_t len = segments[i].length - offset;
+                if (len > remaining)
+                    len = remaining;
+                offset = 0;
+
+                // 先頭は4バイト境界、2つ目以降の区間はページの先頭から
+                if ((n == 0 && (addr & 3)) || (n > 0 && (addr & (kPageSize - 1))))
+                    return false;
+
+                // ページごとに1エントリ
+                uint64_t end = addr + len;
+                while (addr < end)
+                {
+                    if (n >= kMaxPrpListEntries)
+                        return false;
+                    prp_list[n++] = addr;
+                    addr = (addr & ~static_cast<uint64_t>(kPageSize - 1)) + kPageSize;
+                }
+
+                remaining -= len;
+                // 続きがあるなら、この区間はページの末尾まで
+                if (remaining > 0 && (end & (kPageSize - 1)))
+                    return false;
+            }
+            if (remaining > 0 || n == 0)
+                return false;
+
+            cmd.data_ptr[0] = prp_list[0]; // PRP1
+            if (n == 1)
+            {
+                cmd.data_ptr[1] = 0;
+            }
+            else if (n == 2)
+            {
+                // 全体で2ページなら PRP2 は「PRP Listへのポインタ」ではなく「データの続き」を直接指す
+                cmd.data_ptr[1] = prp_list[1];
+            }
+            else
+            {
+                // 3ページ以上なら、2ページ目以降のエントリを PRP List として渡す
+                cmd.data_ptr[1] = reinterpret_cast<uint64_t>(&prp_list[1]);
+                DmaSyncForDevice(&prp_list[1], (n - 1) * sizeof(uint64_t));
+            }
+            return true;
+        }
+    }
+
+    bool Driver::InitQueuePair(QueuePair &queue, uint16_t id)
+    {
+        queue.id = id;
+        queue.depth = queue_depth_;
+        queue.sq = static_cast<SubmissionQueueEntry *>(
+            MemoryManager::Allocate(sizeof(SubmissionQueueEntry) * queue.depth, 4096, MemoryOwner::kDMA));
+        queue.cq = static_cast<CompletionQueueEntry *>(
+            MemoryManager::Allocate(sizeof(CompletionQueueEntry) * queue.depth, 4096, MemoryOwner::kDMA));
+        // PRPリストはコマンドIDごとに1ページを最初から用意しておく (投入のたびに確保しない)
+        // Admin コマンドのデータは1ページなのでいらない
+        queue.prp_lists = nullptr;
+        if (id != 0)
+        {
+            queue.prp_lists = static_cast<uint64_t *>(
+                MemoryManager::Allocate(PrpListBytes(queue), 4096, MemoryOwner::kDMA));
+        }
+        if (!queue.sq || !queue.cq || (id != 0 && !queue.prp_lists))
+        {
+            FreeQueuePair(queue);
+            return false;
+        }
+        memset(queue.sq, 0, sizeof(SubmissionQueueEntry) * queue.depth);
+        memset(queue.cq, 0, sizeof(CompletionQueueEntry) * queue.depth);
+
+        queue.sq_tail = 0;
+        queue.cq_head = 0;
+        queue.phase = 1;
+
+        for (uint32_t i = 0; i < kMaxQueueDepth; ++i)
+            queue.inflight[i] = nullptr;
+        queue.free_ids = (queue.depth >= 64) ? ~0ULL : (1ULL << queue.depth) - 1;
+        queue.inflight_count = 0;
+        // MSI-X テーブルのエントリ番号はキューIDと同じにする
+        queue.interrupts = id < interrupt_vectors_;
+
+        // ドアベルの位置
+        // SQ y Tail Doorbell = 0x1000 + (2y) * stride
+        // CQ y Head Doorbell = 0x1000 + (2y + 1) * stride
+        uintptr_t base = reinterpret_cast<uintptr_t>(regs_) + 0x1000;
+        queue.sq_doorbell = reinterpret_cast<volatile uint32_t *>(base + (2 * id) * doorbell_stride_);
+        queue.cq_doorbell = reinterpret_cast<volatile uint32_t *>(base + (2 * id + 1) * doorbell_stride_);
+        return true;
     }
 
     void Driver::Initialize()
@@ -32,32 +153,22 @@ namespace NVMe
         // コントローラを無効化 (リセット)
         DisableController();
 
+        // キューの深さはコントローラの上限 CAP.MQES (0始まり) を超えられない
+        uint32_t max_entries = static_cast<uint32_t>(regs_->cap & 0xFFFF) + 1;
+        if (queue_depth_ > max_entries)
+            queue_depth_ = max_entries;
+
         // Admin Queue用のメモリを確保
-        // Submission Queue
-        admin_sq_ = static_cast<SubmissionQueueEntry *>(
-            MemoryManager::Allocate(sizeof(SubmissionQueueEntry) * queue_depth_, 4096));
-        // Completion Queue
-        admin_cq_ = static_cast<CompletionQueueEntry *>(
-            MemoryManager::Allocate(sizeof(CompletionQueueEntry) * queue_depth_, 4096));
-
-        if (!admin_sq_ || !admin_cq_)
+        if (!InitQueuePair(admin_queue_, 0))
         {
             kprintf("[NVMe] Memory Allocation Failed!\n");
             while (1)
                 ;
         }
 
-        uint8_t *p = reinterpret_cast<uint8_t *>(admin_sq_);
-        for (size_t i = 0; i < sizeof(SubmissionQueueEntry) * queue_depth_; ++i)
-            p[i] = 0;
-
-        p = reinterpret_cast<uint8_t *>(admin_cq_);
-        for (size_t i = 0; i < sizeof(CompletionQueueEntry) * queue_depth_; ++i)
-            p[i] = 0;
-
         // レジスタにキューのアドレスとサイズを教える
-        regs_->asq = reinterpret_cast<uint64_t>(admin_sq_);
-        regs_->acq = reinterpret_cast<uint64_t>(admin_cq_);
+        regs_->asq = reinterpret_cast<uint64_t>(admin_queue_.sq);
+        regs_->acq = reinterpret_cast<uint64_t>(admin_queue_.cq);
 
         // AQA (Admin Queue Attributes)
         // 16-27bit: ACQS (Completion Queue Size - 1)
@@ -79,65 +190,23 @@ namespace NVMe
 
         // データを受け取るためのメモリを確保 (4KB, アライメント4KB)
         auto *identify_data = static_cast<IdentifyControllerData *>(
-            MemoryManager::Allocate(sizeof(IdentifyControllerData), 4096));
-
-        // コマンドを作成 (Submission Queueに書き込む)
-        SubmissionQueueEntry &cmd = admin_sq_[sq_tail_];
+            MemoryManager::Allocate(sizeof(IdentifyControllerData), 4096, MemoryOwner::kDMA));
 
-        // メモリクリア
-        uint8_t *p = reinterpret_cast<uint8_t *>(&cmd);
-        for (size_t i = 0; i < sizeof(cmd); ++i)
-            p[i] = 0;
-
-        cmd.opcode = 0x06;  // Identify
-        cmd.command_id = 1; // 適当なID
+        SubmissionQueueEntry cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = 0x06; // Identify
 
         // Identify Controller (CNS=1)
-        // cdw10のBit 0を1にするのではない。CNSフィールドはByte 0。
         // spec: CDW10[07:00] = CNS (Controller or Namespace Structure)
         cmd.cdw10 = 1;
 
         // データ転送先アドレス (PRP1)
         cmd.data_ptr[0] = reinterpret_cast<uint64_t>(identify_data);
 
-        // ドアベルを鳴らす (SQ Tailを進める)
-        sq_tail_++;
-        if (sq_tail_ >= queue_depth_)
-            sq_tail_ = 0; // リングバッファ
-        *sq_doorbell_ = sq_tail_;
-
-        // 完了を待つ (ポーリング)
         kprintf("[NVMe] Polling for completion...");
-
-        while (true)
-        {
-            // Completion Queueの現在のHeadを見る
-            volatile CompletionQueueEntry &cqe = admin_cq_[cq_head_];
-
-            // Phase Tag (Statusフィールドの最上位ビット) を確認
-            // Controllerが書き込むと、このビットが現在のphase_と一致する
-            uint16_t status = cqe.status;
-            uint8_t p_bit = (status >> 1) & 1; // Phase Tag (bit 16 in little endian layout?)
-            // ※ packed structのstatusはuint16_tなので、bit 0 は "Phase Tag"
-            // NVMe Spec: Status Field is 16bits. Bit 0 is Phase Tag (P).
-
-            if ((status & 1) == phase_)
-            {
-                break;
-            }
-            __asm__ volatile("pause");
-        }
+        SendAdminCommand(cmd);
         kprintf(" Done.\n");
 
-        // 完了キューを進める
-        cq_head_++;
-        if (cq_head_ >= queue_depth_)
-        {
-            cq_head_ = 0;
-            phase_ = !phase_;
-        }
-        *cq_doorbell_ = cq_head_;
-
         // 結果表示
         char model[41];
         for (int i = 0; i < 40; ++i)
@@ -152,14 +221,31 @@ namespace NVMe
         kprintf("[NVMe] Model : %s\n", model);
         kprintf("[NVMe] Serial: %s\n", serial);
 
+        // 最大転送サイズ: MDTS は最小ページサイズ(CAP.MPSMIN)の2のべき乗倍 (0 = 制限なし)
+        // PRPリスト1ページで表せる範囲にも収める (先頭がページ途中だと1エントリ多く要る)
+        uint64_t min_page_size = 1ULL << (12 + ((regs_->cap >> 48) & 0xF));
+        uint64_t max_bytes = static_cast<uint64_t>(kMaxPrpListEntries - 1) * kPageSize;
+        if (identify_data->mdts != 0 &&
+            (min_page_size << identify_data->mdts) < max_bytes)
+        {
+            max_bytes = min_page_size << identify_data->mdts;
+        }
+        max_transfer_bytes_ = static_cast<uint32_t>(max_bytes);
+        kprintf("[NVMe] Max Transfer: %d KB\n", max_transfer_bytes_ / 1024);
+
+        volatile_cache_ = (identify_data->vwc & 1) != 0;
+        oncs_ = identify_data->oncs;
+        kprintf("[NVMe] Deallocate: %s, Write Zeroes: %s, Volatile Write Cache: %s\n",
+                (oncs_ & kOncsDatasetManagement) ? "yes" : "no",
+                (oncs_ & kOncsWriteZeroes) ? "yes" : "no",
+                volatile_cache_ ? "yes" : "no");
+
         MemoryManager::Free(identify_data, sizeof(IdentifyControllerData));
 
         auto *ns_data = static_cast<IdentifyNamespaceData *>(
-            MemoryManager::Allocate(sizeof(IdentifyNamespaceData), 4096));
-
-        for (size_t i = 0; i < sizeof(cmd); ++i)
-            p[i] = 0;
+            MemoryManager::Allocate(sizeof(IdentifyNamespaceData), 4096, MemoryOwner::kDMA));
 
+        memset(&cmd, 0, sizeof(cmd));
         cmd.opcode = 0x06;        // Identify
         cmd.nsid = namespace_id_; // NSID=1
         cmd.cdw10 = 0;            // CNS=0 (Identify Namespace)
@@ -173,176 +259,331 @@ namespace NVMe
         uint8_t ds = ns_data->lbaf[lbaf_idx].ds; // 2の乗数 (9=512, 12=4096)
 
         lba_size_ = 1 << ds;
+        // DLFEAT bit 3: Write Zeroes の Deallocate ビットに対応し、解除した範囲は0として読める
+        zeroes_deallocate_ = (ns_data->dlfeat & (1 << 3)) != 0;
         kprintf("[NVMe] LBA Size: %d bytes (Total Blocks: %lld)\n", lba_size_, ns_data->nsze);
 
         MemoryManager::Free(ns_data, sizeof(IdentifyNamespaceData));
     }
 
-    void Driver::CreateIOQueues()
+    bool Driver::SetupInterrupts(const PCI::Device &dev)
     {
-        kprintf("[NVMe] Creating I/O Queues...\n");
-
-        // メモリ確保 (4KBアライメント)
-        io_sq_ = static_cast<SubmissionQueueEntry *>(
-            MemoryManager::Allocate(sizeof(SubmissionQueueEntry) * queue_depth_, 4096));
-        io_cq_ = static_cast<CompletionQueueEntry *>(
-            MemoryManager::Allocate(sizeof(CompletionQueueEntry) * queue_depth_, 4096));
+        // Admin Queue (ID 0) と I/O キュー (起動しているCPUの数) の分だけベクタを用意する
+        int queues = WantedIOQueues();
+        uint8_t vectors[kMaxIOQueues + 1];
+        for (int i = 0; i <= queues; ++i)
+            vectors[i] = kInterruptVectorBase + i;
+
+        int count = PCI::SetupMSIX(dev, vectors, queues + 1);
+        if (count <= 0)
+        {
+            kprintf("[NVMe] MSI-X unavailable. Using polling.\n");
+            return false;
+        }
+        interrupt_vectors_ = count;
+        // Admin Queue の完了割り込みは常にエントリ0に来る
+        admin_queue_.interrupts = true;
+        return true;
+    }
 
-        // メモリクリア
-        uint8_t *p = reinterpret_cast<uint8_t *>(io_sq_);
-        for (size_t i = 0; i < sizeof(SubmissionQueueEntry) * queue_depth_; ++i)
-            p[i] = 0;
-        p = reinterpret_cast<uint8_t *>(io_cq_);
-        for (size_t i = 0; i < sizeof(CompletionQueueEntry) * queue_depth_; ++i)
-            p[i] = 0;
+    void Driver::HandleInterrupt(uint16_t queue_id)
+    {
+        if (queue_id == 0)
+            ProcessCompletions(admin_queue_);
+        else if (queue_id <= io_queue_count_)
+            ProcessCompletions(io_queues_[queue_id - 1]);
+    }
 
-        // --- Step A: Create I/O Completion Queue (Opcode 0x05) ---
-        SubmissionQueueEntry cmd_cq;
-        // 構造体を0クリアする処理を入れるのが安全
-        p = reinterpret_cast<uint8_t *>(&cmd_cq);
-        for (size_t i = 0; i < sizeof(cmd_cq); ++i)
-            p[i] = 0;
+    void Driver::CreateIOQueues()
+    {
+        kprintf("[NVMe] Creating I/O Queues...\n");
 
-        cmd_cq.opcode = 0x05;
-        cmd_cq.data_ptr[0] = reinterpret_cast<uint64_t>(io_cq_); // 物理アドレス
+        // --- Step 0: Set Features (Number of Queues) ---
+        // 起動しているCPUの数だけ要求し、コントローラが認めた数だけ使う
+        // (キューの組ごとにSQ/CQとPRPリストのDMAメモリを確保するので、使わない分は作らない)
+        uint32_t wanted = WantedIOQueues();
+        SubmissionQueueEntry cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = 0x09; // Set Features
+        cmd.cdw10 = 0x07;  // Feature ID: Number of Queues
+        // CDW11: [31:16] CQ数 - 1, [15:0] SQ数 - 1
+        cmd.cdw11 = ((wanted - 1) << 16) | (wanted - 1);
+
+        uint32_t count = 1;
+        uint32_t granted;
+        if (SendAdminCommand(cmd, &granted))
+        {
+            // 完了エントリの DW0 に割り当てられた数が同じ形式で入る
+            uint32_t sq_count = (granted & 0xFFFF) + 1;
+            uint32_t cq_count = (granted >> 16) + 1;
+            count = (sq_count < cq_count) ? sq_count : cq_count;
+            if (count > wanted)
+                count = wanted;
+        }
 
-        // CDW10: [31:16] Queue Size (0-based), [15:0] Queue ID
-        cmd_cq.cdw10 = ((queue_depth_ - 1) << 16) | 1;
+        io_queue_count_ = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            QueuePair &queue = io_queues_[i];
+            uint16_t id = static_cast<uint16_t>(i + 1);
+            if (!InitQueuePair(queue, id))
+                break;
 
-        // CDW11: [1] Physically Contiguous (PC) = 1 (連続領域), [0] Interrupt Enabled = 1
-        // ※今回はポーリングなので割り込み(IEN)は0でもいいが、作法としてPC=1は必須
-        cmd_cq.cdw11 = 1;
+            // --- Step A: Create I/O Completion Queue (Opcode 0x05) ---
+            memset(&cmd, 0, sizeof(cmd));
+            cmd.opcode = 0x05;
+            cmd.data_ptr[0] = reinterpret_cast<uint64_t>(queue.cq); // 物理アドレス
+            // CDW10: [31:16] Queue Size (0-based), [15:0] Queue ID
+            cmd.cdw10 = ((queue.depth - 1) << 16) | id;
+            // CDW11: [31:16] Interrupt Vector, [1] Interrupts Enabled, [0] Physically Contiguous = 1
+            if (queue.interrupts)
+                cmd.cdw11 = (static_cast<uint32_t>(id) << 16) | 2 | 1;
+            else
+                cmd.cdw11 = 1;
+            bool ok = SendAdminCommand(cmd);
+
+            // --- Step B: Create I/O Submission Queue (Opcode 0x01) ---
+            if (ok)
+            {
+                memset(&cmd, 0, sizeof(cmd));
+                cmd.opcode = 0x01;
+                cmd.data_ptr[0] = reinterpret_cast<uint64_t>(queue.sq);
+                // CDW10: [31:16] Queue Size, [15:0] Queue ID
+                cmd.cdw10 = ((queue.depth - 1) << 16) | id;
+                // CDW11: [31:16] Completion Queue ID (同じIDのCQと組にする), [0] PC=1
+                cmd.cdw11 = (static_cast<uint32_t>(id) << 16) | 1;
+                ok = SendAdminCommand(cmd);
+            }
 
-        SendAdminCommand(cmd_cq);
+            if (!ok)
+            {
+                FreeQueuePair(queue);
+                break;
+            }
+            io_queue_count_++;
+        }
 
-        // --- Step B: Create I/O Submission Queue (Opcode 0x01) ---
-        SubmissionQueueEntry cmd_sq;
-        p = reinterpret_cast<uint8_t *>(&cmd_sq);
-        for (size_t i = 0; i < sizeof(cmd_sq); ++i)
-            p[i] = 0;
+        if (io_queue_count_ == 0)
+            kprintf("[NVMe] Error: Failed to create I/O queues.\n");
+        else
+            kprintf("[NVMe] %d I/O Queue Pairs Created (Depth %d, Doorbell Stride %d).\n",
+                    io_queue_count_, queue_depth_, doorbell_stride_);
+    }
 
-        cmd_sq.opcode = 0x01;
-        cmd_sq.data_ptr[0] = reinterpret_cast<uint64_t>(io_sq_);
+    uint32_t Driver::GetMaxTransferBlocks() const
+    {
+        // コマンドのブロック数 (CDW12 NLB) は16ビット
+        uint32_t blocks = max_transfer_bytes_ / lba_size_;
+        return (blocks > 0x10000) ? 0x10000 : blocks;
+    }
 
-        // CDW10: [31:16] Queue Size, [15:0] Queue ID
-        cmd_sq.cdw10 = ((queue_depth_ - 1) << 16) | 1;
+    void Driver::PrepareIO(uint8_t opcode, uint64_t lba, uint32_t count, Request *req)
+    {
+        SubmissionQueueEntry &cmd = req->cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = opcode;
+        cmd.nsid = namespace_id_;
 
-        // CDW11: [16:31] Completion Queue ID (関連付けるCQ), [1] PC=1, [0] QPRI=0
-        // CQ ID = 1 とペアにする
-        cmd_sq.cdw11 = (1 << 16) | 1;
+        cmd.cdw10 = lba & 0xFFFFFFFF;
+        cmd.cdw11 = (lba >> 32) & 0xFFFFFFFF;
+        cmd.cdw12 = (count - 1) & 0xFFFF;
+    }
 
-        SendAdminCommand(cmd_sq);
+    bool Driver::SubmitRead(uint64_t lba, void *buffer, uint32_t count, Request *req)
+    {
+        if (count == 0 || count > GetMaxTransferBlocks() || io_queue_count_ == 0)
+            return false;
 
-        kprintf("[NVMe] I/O Queues Created (ID=1).\n");
+        PrepareIO(0x02, lba, count, req); // Read
+        Segment segment = {reinterpret_cast<uint64_t>(buffer), count * lba_size_};
+        // 投入するCPUごとのキューを使い、コア間でキューを取り合わないようにする
+        return SubmitRequest(CurrentQueue(), req, &segment, 1, 0, segment.length);
     }
 
-    uint64_t *SetupPRPs(SubmissionQueueEntry &cmd, const void *buffer, uint32_t size)
+    bool Driver::SubmitWrite(uint64_t lba, const void *buffer, uint32_t count, Request *req)
     {
-        uint64_t addr = reinterpret_cast<uint64_t>(buffer);
-        cmd.data_ptr[0] = addr; // PRP1
+        if (count == 0 || count > GetMaxTransferBlocks() || io_queue_count_ == 0)
+            return false;
 
-        const uint32_t page_size = 4096;
-        uint32_t offset = addr & (page_size - 1);
-        uint32_t page_capacity = page_size - offset;
+        PrepareIO(0x01, lba, count, req); // Write
+        Segment segment = {reinterpret_cast<uint64_t>(buffer), count * lba_size_};
+        DmaSyncForDevice(buffer, segment.length);
+        return SubmitRequest(CurrentQueue(), req, &segment, 1, 0, segment.length);
+    }
 
-        if (size <= page_capacity)
+    bool Driver::Transfer(uint8_t opcode, uint64_t lba, const Segment *segments, uint32_t segment_count,
+                          uint32_t count)
+    {
+        if (count == 0)
         {
-            cmd.data_ptr[1] = 0;
-            return nullptr;
+            kprintf("[NVMe] Warning: %s called with count 0. Ignored.\n", opcode == 0x02 ? "Read" : "Write");
+            return false;
         }
-
-        // --- 修正ポイント ---
-
-        uint32_t remaining = size - page_capacity;
-
-        // 次のページ（2ページ目）の物理アドレス
-        uint64_t next_page_addr = (addr & ~(uint64_t)(page_size - 1)) + page_size;
-
-        // 残りが1ページ以内に収まる場合 (つまり全体で2ページ)
-        // PRP2 は「PRP Listへのポインタ」ではなく「データの続き」を直接指す
-        if (remaining <= page_size)
+        if (io_queue_count_ == 0)
+            return false;
+
+        uint64_t size = static_cast<uint64_t>(count) * lba_size_;
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < segment_count; ++i)
+            total += segments[i].length;
+        if (total < size)
         {
-            cmd.data_ptr[1] = next_page_addr;
-            return nullptr;
+            kprintf("[NVMe] Error: Buffer too small for %u blocks\n", count);
+            return false;
+        }
+        if (opcode == 0x01) // Write
+        {
+            for (uint32_t i = 0; i < segment_count; ++i)
+                DmaSyncForDevice(reinterpret_cast<const void *>(segments[i].addr), segments[i].length);
         }
 
-        // --- 3ページ以上必要な場合のみ PRP List を作成 ---
-
-        uint32_t num_pages = (remaining + page_size - 1) / page_size;
-        uint64_t *prp_list = static_cast<uint64_t *>(MemoryManager::Allocate(page_size, page_size));
+        // MDTS ごとのコマンドに分け、kMaxSplitRequests 個まで同時に投入しておく
+        Request requests[kMaxSplitRequests];
+        uint32_t max_blocks = GetMaxTransferBlocks();
+        uint32_t submitted = 0;
+        uint32_t completed = 0;
+        uint64_t offset = 0;
+        bool ok = true;
+        while (count > 0)
+        {
+            if (submitted - completed == kMaxSplitRequests)
+                ok &= Wait(&requests[completed++ % kMaxSplitRequests]);
+            if (!ok)
+                break;
 
-        cmd.data_ptr[1] = reinterpret_cast<uint64_t>(prp_list);
+            uint32_t chunk = (count < max_blocks) ? count : max_blocks;
+            Request &req = requests[submitted % kMaxSplitRequests];
+            PrepareIO(opcode, lba, chunk, &req);
+            if (!SubmitRequest(CurrentQueue(), &req, segments, segment_count, offset, chunk * lba_size_))
+            {
+                kprintf("[NVMe] Error: Buffer layout cannot be described by PRPs\n");
+                ok = false;
+                break;
+            }
+            submitted++;
+            lba += chunk;
+            count -= chunk;
+            offset += static_cast<uint64_t>(chunk) * lba_size_;
+        }
+        // 投入済みのものはすべて待つ (失敗していてもスタック上の要求を残して戻れない)
+        while (completed < submitted)
+            ok &= Wait(&requests[completed++ % kMaxSplitRequests]);
 
-        uint64_t current_page = next_page_addr;
-        for (uint32_t i = 0; i < num_pages; ++i)
+        if (ok && opcode == 0x02) // Read
         {
-            prp_list[i] = current_page;
-            current_page += page_size;
+            for (uint32_t i = 0; i < segment_count; ++i)
+                DmaSyncForCpu(reinterpret_cast<const void *>(segments[i].addr), segments[i].length);
         }
-
-        return prp_list;
+        return ok;
     }
 
-    void Driver::ReadLBA(uint64_t lba, void *buffer, uint16_t count)
+    bool Driver::ReadLBA(uint64_t lba, void *buffer, uint32_t count)
     {
-        if (count == 0)
-        {
-            kprintf("[NVMe] Warning: Read called with count 0. Ignored.\n");
-            return;
-        }
         // kprintf("[NVMe DEBUG] Read LBA: %lx, Buf: %lx, Cnt: %d\n", lba, (uint64_t)buffer, count);
-        SubmissionQueueEntry cmd;
-        uint8_t *p = reinterpret_cast<uint8_t *>(&cmd);
-        for (size_t i = 0; i < sizeof(cmd); ++i)
-            p[i] = 0;
+        Segment segment = {reinterpret_cast<uint64_t>(buffer), count * lba_size_};
+        return Transfer(0x02, lba, &segment, 1, count); // Read
+    }
 
-        cmd.opcode = 0x02; // Read
-        cmd.nsid = namespace_id_;
+    bool Driver::WriteLBA(uint64_t lba, const void *buffer, uint32_t count)
+    {
+        // kprintf("[NVMe DEBUG] Write LBA: %lx, Buf: %lx, Cnt: %d\n", lba, (uint64_t)buffer, count);
+        Segment segment = {reinterpret_cast<uint64_t>(buffer), count * lba_size_};
+        return Transfer(0x01, lba, &segment, 1, count); // Write
+    }
 
-        cmd.cdw10 = lba & 0xFFFFFFFF;
-        cmd.cdw11 = (lba >> 32) & 0xFFFFFFFF;
-        cmd.cdw12 = (count - 1) & 0xFFFF;
+    bool Driver::ReadSG(uint64_t lba, const Segment *segments, uint32_t segment_count, uint32_t count)
+    {
+        return Transfer(0x02, lba, segments, segment_count, count); // Read
+    }
 
-        uint32_t size = count * lba_size_;
-        uint64_t *prp_list = SetupPRPs(cmd, buffer, size);
+    bool Driver::WriteSG(uint64_t lba, const Segment *segments, uint32_t segment_count, uint32_t count)
+    {
+        return Transfer(0x01, lba, segments, segment_count, count); // Write
+    }
 
-        SendIOCommand(cmd);
+    bool Driver::Sync()
+    {
+        // キャッシュがなければ、完了した書き込みはすでに不揮発
+        if (!volatile_cache_)
+            return true;
+        if (io_queue_count_ == 0)
+            return false;
 
-        if (prp_list != nullptr)
-        {
-            MemoryManager::Free(prp_list, 4096);
-        }
+        SubmissionQueueEntry cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = 0x00; // Flush
+        cmd.nsid = namespace_id_;
+        return Submit(CurrentQueue(), cmd, nullptr);
     }
 
-    void Driver::WriteLBA(uint64_t lba, const void *buffer, uint16_t count)
+    bool Driver::Deallocate(const BlockRange *ranges, uint32_t range_count)
     {
-        if (count == 0)
+        // 割り当て解除はヒントにすぎないので、対応していなければ成功として扱う
+        if (!(oncs_ & kOncsDatasetManagement))
+            return true;
+        if (io_queue_count_ == 0)
+            return false;
+
+        auto *list = static_cast<DatasetRange *>(
+            MemoryManager::Allocate(kMaxDatasetRanges * sizeof(DatasetRange), kPageSize, MemoryOwner::kDMA));
+        if (!list)
+            return false;
+
+        // 1つのコマンドに kMaxDatasetRanges 個ずつ範囲をまとめる
+        bool ok = true;
+        uint32_t i = 0;
+        while (ok && i < range_count)
         {
-            kprintf("[NVMe] Warning: Write called with count 0. Ignored.\n");
-            return;
+            uint32_t n = 0;
+            for (; i < range_count && n < kMaxDatasetRanges; ++i)
+            {
+                if (ranges[i].count == 0)
+                    continue;
+                list[n].attributes = 0;
+                list[n].length = ranges[i].count;
+                list[n].lba = ranges[i].lba;
+                n++;
+            }
+            if (n == 0)
+                break;
+            DmaSyncForDevice(list, n * sizeof(DatasetRange));
+
+            SubmissionQueueEntry cmd;
+            memset(&cmd, 0, sizeof(cmd));
+            cmd.opcode = 0x09; // Dataset Management
+            cmd.nsid = namespace_id_;
+            cmd.data_ptr[0] = reinterpret_cast<uint64_t>(list);
+            cmd.cdw10 = n - 1;  // NR: 範囲の数 (0始まり)
+            cmd.cdw11 = 1 << 2; // AD: Deallocate
+            ok = Submit(CurrentQueue(), cmd, nullptr);
         }
-        // kprintf("[NVMe DEBUG] Write LBA: %lx, Buf: %lx, Cnt: %d\n", lba, (uint64_t)buffer, count);
-        SubmissionQueueEntry cmd;
-        uint8_t *p = reinterpret_cast<uint8_t *>(&cmd);
-        for (size_t i = 0; i < sizeof(cmd); ++i)
-            p[i] = 0;
-
-        cmd.opcode = 0x01; // Write
-        cmd.nsid = namespace_id_;
-
-        cmd.cdw10 = lba & 0xFFFFFFFF;
-        cmd.cdw11 = (lba >> 32) & 0xFFFFFFFF;
-        cmd.cdw12 = (count - 1) & 0xFFFF;
-
-        uint32_t size = count * lba_size_;
-        uint64_t *prp_list = SetupPRPs(cmd, buffer, size);
 
-        SendIOCommand(cmd);
+        MemoryManager::Free(list, kMaxDatasetRanges * sizeof(DatasetRange));
+        return ok;
+    }
 
-        if (prp_list != nullptr)
+    bool Driver::WriteZeroesLBA(uint64_t lba, uint32_t count)
+    {
+        if (!(oncs_ & kOncsWriteZeroes))
+            return BlockDevice::WriteZeroes(lba, count);
+        if (io_queue_count_ == 0)
+            return false;
+
+        // データ転送がないので MDTS に縛られず、1コマンドで NLB の上限まで送れる
+        // Write Zeroes はすぐ終わるので、分割した分は1つずつ待つ
+        bool ok = true;
+        while (ok && count > 0)
         {
-            MemoryManager::Free(prp_list, 4096);
+            uint32_t chunk = (count < 0x10000) ? count : 0x10000;
+            Request req;
+            PrepareIO(0x08, lba, chunk, &req); // Write Zeroes
+            if (zeroes_deallocate_)
+                req.cmd.cdw12 |= 1U << 25; // DEAC: 0を書く代わりに割り当てを解除してよい
+            ok = SubmitRequest(CurrentQueue(), &req) && Wait(&req);
+            lba += chunk;
+            count -= chunk;
         }
+        return ok;
     }
 
     void Driver::DisableController()
@@ -400,83 +641,219 @@ namespace NVMe
         kprintf(" Done.\n");
     }
 
-    void Driver::SendAdminCommand(SubmissionQueueEntry &cmd)
+    uint16_t Driver::ReserveSlot(QueuePair &queue, Request *req)
+    {
+        req->queue = &queue;
+        req->waiter = nullptr;
+        req->done = false;
+        req->status = 0;
+        req->result = 0;
+
+        uint64_t flags = queue.lock.LockIrqSave();
+        // 処理中のコマンドは depth - 1 個まで (SQが一杯と空を区別するため1つ空ける)
+        while (queue.inflight_count >= queue.depth - 1)
+        {
+            queue.lock.UnlockIrqRestore(flags);
+            if (ProcessCompletions(queue) == 0)
+                __asm__ volatile("pause");
+            flags = queue.lock.LockIrqSave();
+        }
+
+        // コマンドIDは完了エントリから要求を引くための添字 (PRPリストもIDで選ぶ)
+        uint16_t id = static_cast<uint16_t>(__builtin_ctzll(queue.free_ids));
+        queue.free_ids &= ~(1ULL << id);
+        queue.inflight[id] = req;
+        queue.inflight_count++;
+        queue.lock.UnlockIrqRestore(flags);
+        return id;
+    }
+
+    void Driver::ReleaseSlot(QueuePair &queue, uint16_t id)
+    {
+        uint64_t flags = queue.lock.LockIrqSave();
+        queue.inflight[id] = nullptr;
+        queue.free_ids |= 1ULL << id;
+        queue.inflight_count--;
+        queue.lock.UnlockIrqRestore(flags);
+    }
+
+    void Driver::PostSlot(QueuePair &queue, uint16_t id, Request *req)
     {
-        __asm__ volatile("wbinvd");
-        // SQにコマンド配置
-        admin_sq_[sq_tail_] = cmd;
+        uint64_t flags = queue.lock.LockIrqSave();
+        req->cmd.command_id = id;
+        queue.sq[queue.sq_tail] = req->cmd;
+        DmaSyncForDevice(&queue.sq[queue.sq_tail], sizeof(SubmissionQueueEntry));
 
         // ドアベルを鳴らす
-        sq_tail_++;
-        if (sq_tail_ >= queue_depth_)
-            sq_tail_ = 0;
-        *sq_doorbell_ = sq_tail_;
+        queue.sq_tail++;
+        if (queue.sq_tail >= queue.depth)
+            queue.sq_tail = 0;
+        WriteDoorbell(queue.sq_doorbell, queue.sq_tail);
+        queue.lock.UnlockIrqRestore(flags);
+    }
 
-        // 完了待ち (ポーリング)
-        while (true)
+    bool Driver::SubmitRequest(QueuePair &queue, Request *req, const Segment *segments,
+                               uint32_t segment_count, uint64_t offset, uint32_t size)
+    {
+        uint16_t id = ReserveSlot(queue, req);
+        if (segments)
         {
-            volatile CompletionQueueEntry &cqe = admin_cq_[cq_head_];
-            if ((cqe.status & 1) == phase_)
-                break;
-            __asm__ volatile("pause");
+            uint64_t *prp_list = queue.prp_lists + static_cast<size_t>(id) * kMaxPrpListEntries;
+            if (!BuildPRPs(req->cmd, segments, segment_count, offset, size, prp_list))
+            {
+                ReleaseSlot(queue, id);
+                return false;
+            }
         }
+        PostSlot(queue, id, req);
+        return true;
+    }
+
+    uint32_t Driver::ProcessCompletions(QueuePair &queue)
+    {
+        Request *callbacks[kMaxQueueDepth];
+        uint32_t callback_count = 0;
+        uint32_t count = 0;
+        bool advanced = false;
 
-        // CQ更新
-        cq_head_++;
-        if (cq_head_ >= queue_depth_)
+        uint64_t flags = queue.lock.LockIrqSave();
+        while (true)
         {
-            cq_head_ = 0;
-            phase_ = !phase_;
-        }
-        *cq_doorbell_ = cq_head_;
+            volatile CompletionQueueEntry &cqe = queue.cq[queue.cq_head];
+            // Phase Tagチェック (Bit 0): 一致しなければまだ届いていない
+            if ((cqe.status & 1) != queue.phase)
+                break;
+            DmaSyncForCpu(&cqe, sizeof(CompletionQueueEntry));
 
-        // エラーチェック (Status Fieldが0以外ならエラー)
-        volatile CompletionQueueEntry &cqe_done = admin_cq_[cq_head_ == 0 ? queue_depth_ - 1 : cq_head_ - 1];
-        if ((cqe_done.status >> 1) != 0)
-        { // Phase bit以外を見る
-            kprintf("[NVMe] Admin Command Failed! Status=%x\n", cqe_done.status);
+            uint16_t id = cqe.command_id;
+            Request *req = (id < kMaxQueueDepth) ? queue.inflight[id] : nullptr;
+            if (req)
+            {
+                req->status = cqe.status >> 1;
+                req->result = cqe.dw0;
+                queue.inflight[id] = nullptr;
+                queue.free_ids |= 1ULL << id;
+                queue.inflight_count--;
+                count++;
+
+                if (req->status != 0)
+                {
+                    kprintf("[NVMe] %s Command Failed! Queue=%d Opcode=%x Status=%x\n",
+                            queue.id == 0 ? "Admin" : "I/O", queue.id, req->cmd.opcode, req->status);
+                }
+
+                if (req->callback)
+                {
+                    callbacks[callback_count++] = req;
+                }
+                else
+                {
+                    // Wait は同じロックの中で waiter を設定してから眠るので、
+                    // ここで done を立てて起こせば取りこぼさない
+                    // (done を立てた後は待っている側が req を捨てるかもしれないので、先に読む)
+                    Task *waiter = req->waiter;
+                    __atomic_store_n(&req->done, true, __ATOMIC_RELEASE);
+                    if (waiter)
+                        TaskManager::WakeTask(waiter);
+                }
+            }
+
+            // CQ更新
+            queue.cq_head++;
+            if (queue.cq_head >= queue.depth)
+            {
+                queue.cq_head = 0;
+                queue.phase = !queue.phase;
+            }
+            advanced = true;
         }
+        // 回収した分はまとめて1回のドアベルで返す
+        if (advanced)
+            WriteDoorbell(queue.cq_doorbell, queue.cq_head);
+        queue.lock.UnlockIrqRestore(flags);
+
+        // コールバックはロックの外で呼ぶ (コールバックから次の要求を投入できる)
+        for (uint32_t i = 0; i < callback_count; ++i)
+            callbacks[i]->callback(callbacks[i], callbacks[i]->context);
+        return count;
     }
 
-    void Driver::SendIOCommand(SubmissionQueueEntry &cmd)
+    uint32_t Driver::Poll()
     {
-        // kprintf("[NVMe CMD] Op:%x NSID:%d PRP1:%lx CDW10:%x CDW12:%x\n", cmd.opcode, cmd.nsid, cmd.data_ptr[0], cmd.cdw10, cmd.cdw12);
-        __asm__ volatile("wbinvd");
+        if (io_queue_count_ == 0)
+            return 0;
+        return ProcessCompletions(CurrentQueue());
+    }
 
-        // I/O SQに配置
-        io_sq_[io_sq_tail_] = cmd;
+    bool Driver::CanSleep(const QueuePair &queue) const
+    {
+        return queue.interrupts && Scheduler::IsEnabled() &&
+               TaskManager::GetCurrentTask() != nullptr;
+    }
 
-        // I/O SQ Doorbellを鳴らす
-        io_sq_tail_++;
-        if (io_sq_tail_ >= queue_depth_)
-            io_sq_tail_ = 0;
-        *io_sq_doorbell_ = io_sq_tail_;
+    bool Driver::Wait(Request *req)
+    {
+        QueuePair &queue = *req->queue;
 
-        // I/O CQで完了待ち
-        while (true)
+        // 短い待ちは眠るより回収を繰り返す方が速い
+        bool can_sleep = CanSleep(queue);
+        for (uint32_t i = 0; !__atomic_load_n(&req->done, __ATOMIC_ACQUIRE); ++i)
         {
-            volatile CompletionQueueEntry &cqe = io_cq_[io_cq_head_];
-            // Phase Tagチェック (Bit 0)
-            if ((cqe.status & 1) == io_phase_)
-                break;
-            __asm__ volatile("pause");
-        }
+            if (!can_sleep || i < hybrid_poll_spins_)
+            {
+                if (ProcessCompletions(queue) == 0)
+                    __asm__ volatile("pause");
+                continue;
+            }
 
-        // I/O CQ更新
-        io_cq_head_++;
-        if (io_cq_head_ >= queue_depth_)
-        {
-            io_cq_head_ = 0;
-            io_phase_ = !io_phase_;
-        }
-        *io_cq_doorbell_ = io_cq_head_;
+            // 完了の回収と同じロックの中で確かめて waiter を設定する
+            // (確かめてから眠るまでに完了しても、回収する側が必ず起こす)
+            uint64_t flags = queue.lock.LockIrqSave();
+            if (!(flags & (1 << 9)))
+            {
+                // 割り込み禁止のまま呼ばれた場合は起こしてもらえないのでポーリングに戻る
+                can_sleep = false;
+                queue.lock.UnlockIrqRestore(flags);
+                continue;
+            }
+            if (__atomic_load_n(&req->done, __ATOMIC_ACQUIRE))
+            {
+                queue.lock.UnlockIrqRestore(flags);
+                continue;
+            }
 
-        // エラーチェック
-        volatile CompletionQueueEntry &cqe_done = io_cq_[io_cq_head_ == 0 ? queue_depth_ - 1 : io_cq_head_ - 1];
-        if ((cqe_done.status >> 1) != 0)
-        {
-            kprintf("[NVMe] I/O Command Failed! Status=%x\n", cqe_done.status);
+            Task *task = TaskManager::GetCurrentTask();
+            req->waiter = task;
+            TaskManager::BlockTask(task);
+            // 割り込みは禁止したままロックだけ外して切り替える
+            queue.lock.Unlock();
+            Scheduler::Schedule(true);
+            // 切り替える先がなく戻ってきた場合は実行中に戻す
+            if (task->state != TaskState::RUNNING)
+            {
+                TaskManager::RemoveFromReadyQueue(task);
+                task->state = TaskState::RUNNING;
+            }
+            RestoreInterrupts(flags);
         }
+        return req->status == 0;
+    }
+
+    bool Driver::Submit(QueuePair &queue, SubmissionQueueEntry &cmd, uint32_t *result)
+    {
+        Request req;
+        req.cmd = cmd;
+        SubmitRequest(queue, &req);
+        if (!Wait(&req))
+            return false;
+        if (result)
+            *result = req.result;
+        return true;
+    }
+
+    bool Driver::SendAdminCommand(SubmissionQueueEntry &cmd, uint32_t *result)
+    {
+        return Submit(admin_queue_, cmd, result);
     }
 
 }
\ No newline at end of file
@@ -4,9 +4,23 @@
 #include "driver/nvme/nvme_reg.hpp"
 #include "driver/nvme/nvme_queue.hpp"
 #include "block_device.hpp"
+#include "cpu.hpp"
+#include "pci/pci.hpp"
 
 namespace NVMe
 {
+    // PRPリストは1ページ(512エントリ)までしか作らない
+    const uint32_t kMaxPrpListEntries = 512;
+    // 大きな転送を分割したとき、同時に投入しておくコマンドの数
+    const uint32_t kMaxSplitRequests = 8;
+    // I/Oキューの組の最大数 (CPUごとに1つ)
+    const int kMaxIOQueues = kMaxCPUs;
+    // 完了割り込みのベクタ (キューID ごとに kInterruptVectorBase + ID)
+    const uint8_t kInterruptVectorBase = 0x60;
+    // 眠る前に完了をポーリングする回数の既定値
+    const uint32_t kDefaultHybridPollSpins = 1000;
+    // Dataset Management 1回で渡せる範囲の数 (4KBの1ページに収まる)
+    const uint32_t kMaxDatasetRanges = 256;
 
     class Driver : public BlockDevice
     {
@@ -17,54 +31,130 @@ namespace NVMe
         void Initialize();
         void IdentifyController();
 
+        // キューごとに MSI-X のベクタを割り当てる (CreateIOQueues より前に呼ぶ)
+        // 失敗した場合はポーリングで動く
+        bool SetupInterrupts(const PCI::Device &dev);
+        // コントローラと I/O キューの数を取り決め、CPUごとにキューの組を作る
         void CreateIOQueues();
-
-        void ReadLBA(uint64_t lba, void *buffer, uint16_t count);
-        void WriteLBA(uint64_t lba, const void *buffer, uint16_t count);
+        // 完了割り込みのハンドラから呼ぶ
+        void HandleInterrupt(uint16_t queue_id);
+
+        // 完了を待つ同期版 (成功なら true)
+        // 最大転送サイズ (MDTS) を超える転送は分割し、まとめて投入する
+        bool ReadLBA(uint64_t lba, void *buffer, uint32_t count);
+        bool WriteLBA(uint64_t lba, const void *buffer, uint32_t count);
+        // 連続していない複数の区間を、LBAの連続した count ブロックとして読み書きする
+        // 2つ目以降の区間はページ先頭から始まり、最後以外の区間はページ末尾まで続くこと
+        // (先頭の区間は4バイト境界ならどこからでもよい)
+        bool ReadSG(uint64_t lba, const Segment *segments, uint32_t segment_count, uint32_t count);
+        bool WriteSG(uint64_t lba, const Segment *segments, uint32_t segment_count, uint32_t count);
+        // 範囲の割り当てを解除する (Dataset Management の Deallocate, いわゆるTRIM)
+        // コントローラが対応していなければ何もしない
+        bool Deallocate(const BlockRange *ranges, uint32_t range_count);
+        // データを転送せずに範囲を0にする (Write Zeroes)
+        // 対応していなければ0のバッファを書く
+        bool WriteZeroesLBA(uint64_t lba, uint32_t count);
+
+        // --- 非同期I/O ---
+        // 要求をキューに入れてすぐに戻る (キューが一杯なら完了を回収して空きを待つ)
+        // 完了は req->callback で知らせるか、callback がなければ Wait で待つ
+        // count は GetMaxTransferBlocks() 以下 (1つのコマンドで転送する)
+        bool SubmitRead(uint64_t lba, void *buffer, uint32_t count, Request *req);
+        bool SubmitWrite(uint64_t lba, const void *buffer, uint32_t count, Request *req);
+        // 現在のCPUのキューに届いている完了をまとめて回収する (戻り値: 回収した数)
+        uint32_t Poll();
+        // callback なしで投入した要求の完了を待つ (成功なら true)
+        // 割り込みが使えるタスクからなら、少しポーリングした後は完了割り込みまで眠る
+        bool Wait(Request *req);
+        // 眠る前にポーリングする回数 (0 なら最初から眠る)
+        void SetHybridPollSpins(uint32_t spins) { hybrid_poll_spins_ = spins; }
 
         bool Read(uint64_t lba, void *buffer, uint32_t count) override
         {
-            ReadLBA(lba, buffer, count);
-            return true;
+            return ReadLBA(lba, buffer, count);
         }
 
         bool Write(uint64_t lba, const void *buffer, uint32_t count) override
         {
-            WriteLBA(lba, buffer, count);
-            return true;
+            return WriteLBA(lba, buffer, count);
+        }
+
+        bool Discard(const BlockRange *ranges, uint32_t range_count) override
+        {
+            return Deallocate(ranges, range_count);
+        }
+
+        bool WriteZeroes(uint64_t lba, uint32_t count) override
+        {
+            return WriteZeroesLBA(lba, count);
         }
 
-        uint32_t GetBlockSize() const override { return 0; }
+        uint32_t GetBlockSize() const override { return lba_size_; }
+        // 揮発性の書き込みキャッシュがあれば Flush で不揮発メモリへ書き出させる
+        // (完了した書き込みだけが対象なので、呼ぶ前に書き込みの完了を待っておく)
+        bool Sync() override;
+        // 1つのコマンドで転送できるブロック数 (Read/Write はこれを超えても分割して転送する)
+        uint32_t GetMaxTransferBlocks() const override;
+
+        uint32_t GetIOQueueCount() const { return io_queue_count_; }
 
     private:
         volatile Registers *regs_; // MMIOレジスタへのアクセサ
 
-        SubmissionQueueEntry *admin_sq_;
-        CompletionQueueEntry *admin_cq_;
-        uint16_t sq_tail_; // 次に命令を書く場所
-        uint16_t cq_head_; // 次に完了を確認する場所
-        uint8_t phase_;    // 完了キューのPhase Tag (1から始まる)
-        volatile uint32_t *sq_doorbell_;
-        volatile uint32_t *cq_doorbell_;
-
-        SubmissionQueueEntry *io_sq_;
-        CompletionQueueEntry *io_cq_;
-        uint16_t io_sq_tail_;
-        uint16_t io_cq_head_;
-        uint8_t io_phase_;
-        volatile uint32_t *io_sq_doorbell_;
-        volatile uint32_t *io_cq_doorbell_;
+        QueuePair admin_queue_;
+        QueuePair io_queues_[kMaxIOQueues];
+        uint32_t io_queue_count_; // 作成できた I/O キューの組の数
 
-        const uint16_t queue_depth_ = 32; // キューのサイズ
+        uint16_t queue_depth_ = 32; // キューのサイズ (CAP.MQES と kMaxQueueDepth 以下)
+        uint32_t doorbell_stride_;  // ドアベルレジスタの間隔 (CAP.DSTRD から求める)
 
         uint32_t namespace_id_ = 1; // 通常は1
         uint32_t lba_size_ = 512;   // デフォルト512B (Identifyで更新)
+        uint32_t max_transfer_bytes_ = 128 * 1024; // MDTS (Identifyで更新)
+        uint16_t oncs_ = 0;                        // 対応している任意のコマンド (Identifyで更新)
+        bool volatile_cache_ = false;              // 揮発性の書き込みキャッシュがあるか (VWC)
+        bool zeroes_deallocate_ = false; // Write Zeroes で割り当て解除してよいか (DLFEAT)
+
+        uint32_t interrupt_vectors_ = 0; // 割り当てた MSI-X ベクタの数 (0 = ポーリングのみ)
+        uint32_t hybrid_poll_spins_ = kDefaultHybridPollSpins;
 
         void DisableController();
         void EnableController();
 
-        void SendAdminCommand(SubmissionQueueEntry &cmd);
-        void SendIOCommand(SubmissionQueueEntry &cmd);
+        // キューのメモリを確保し、ドアベルの位置を計算する
+        bool InitQueuePair(QueuePair &queue, uint16_t id);
+        // 作る I/O キューの組の数 (起動しているCPUの数, kMaxIOQueues まで)
+        static int WantedIOQueues()
+        {
+            int cpus = GetOnlineCPUCount();
+            return (cpus < kMaxIOQueues) ? cpus : kMaxIOQueues;
+        }
+        // 投入するCPUのキューを選ぶ
+        QueuePair &CurrentQueue()
+        {
+            return io_queues_[GetCurrentCPUIndex() % io_queue_count_];
+        }
+        // Read/Write のコマンドを req に用意する (PRPは投入時に作る)
+        void PrepareIO(uint8_t opcode, uint64_t lba, uint32_t count, Request *req);
+        // MDTS ごとに分割して投入し、すべての完了を待つ
+        bool Transfer(uint8_t opcode, uint64_t lba, const Segment *segments, uint32_t segment_count,
+                      uint32_t count);
+        // 空いているコマンドIDを予約する (キューが一杯なら完了を回収して空きを待つ)
+        uint16_t ReserveSlot(QueuePair &queue, Request *req);
+        void ReleaseSlot(QueuePair &queue, uint16_t id);
+        // 予約したIDでSQに書き、ドアベルを鳴らす
+        void PostSlot(QueuePair &queue, uint16_t id, Request *req);
+        // 投入する (segments があれば、その offset から size バイト分のPRPをIDのリストに作る)
+        bool SubmitRequest(QueuePair &queue, Request *req, const Segment *segments = nullptr,
+                           uint32_t segment_count = 0, uint64_t offset = 0, uint32_t size = 0);
+        // 届いている完了エントリを回収し、ドアベルは最後に1回だけ鳴らす
+        uint32_t ProcessCompletions(QueuePair &queue);
+        // 完了割り込みで起こしてもらえる状況か
+        bool CanSleep(const QueuePair &queue) const;
+        // コマンドを投入して完了を待つ (result には完了エントリの DW0 が入る)
+        bool Submit(QueuePair &queue, SubmissionQueueEntry &cmd, uint32_t *result);
+
+        bool SendAdminCommand(SubmissionQueueEntry &cmd, uint32_t *result = nullptr);
     };
 
     extern Driver *g_nvme;
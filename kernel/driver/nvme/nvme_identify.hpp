@@ -21,9 +21,22 @@ namespace NVMe
         uint32_t rtd3r;         // 84-87: RTD3 Resume Latency
         uint32_t rtd3e;         // 88-91: RTD3 Entry Latency
         uint32_t oaes;          // 92-95: OAES
-        uint8_t reserved[3996]; // 96-4095: 残りは省略
+        uint8_t reserved[424];  // 96-519: 省略
+        uint16_t oncs;          // 520-521: Optional NVM Command Support
+        uint16_t fuses;         // 522-523: Fused Operation Support
+        uint8_t fna;            // 524: Format NVM Attributes
+        uint8_t vwc;            // 525: Volatile Write Cache (bit 0: あり)
+        uint8_t reserved2[3570]; // 526-4095: 残りは省略
     } __attribute__((packed));
 
+    static_assert(offsetof(IdentifyControllerData, oncs) == 520, "Offset mismatch: oncs");
+    static_assert(offsetof(IdentifyControllerData, vwc) == 525, "Offset mismatch: vwc");
+    static_assert(sizeof(IdentifyControllerData) == 4096, "Size mismatch: IdentifyControllerData must be 4096 bytes");
+
+    // ONCS のビット
+    const uint16_t kOncsDatasetManagement = 1 << 2; // Dataset Management (Deallocate)
+    const uint16_t kOncsWriteZeroes = 1 << 3;       // Write Zeroes
+
     struct IdentifyNamespaceData
     {
         uint64_t nsze;         // 0-7: Namespace Size (総セクタ数)
@@ -32,7 +45,9 @@ namespace NVMe
         uint8_t nsfeat;        // 24: Namespace Features
         uint8_t nlbaf;         // 25: Number of LBA Formats
         uint8_t flbas;         // 26: Formatted LBA Size
-        uint8_t reserved[101]; // 簡易パディング
+        uint8_t reserved1[6];  // 27-32: 省略
+        uint8_t dlfeat;        // 33: Deallocate Logical Block Features
+        uint8_t reserved[94];  // 簡易パディング
 
         // LBA Format Data (16個分ある)
         // ここにセクタサイズ情報が入っている
@@ -1,5 +1,8 @@
 #pragma once
 #include <stdint.h>
+#include "sync/spinlock.hpp"
+
+struct Task;
 
 namespace NVMe
 {
@@ -35,4 +38,67 @@ namespace NVMe
         uint32_t cdw15;
     } __attribute__((packed));
 
+    // スキャッター・ギャザー転送の1区間 (物理アドレス == 仮想アドレス)
+    struct Segment
+    {
+        uint64_t addr;
+        uint32_t length; // バイト数
+    };
+
+    // Dataset Management コマンドに渡す範囲1つ分 (16 bytes)
+    struct DatasetRange
+    {
+        uint32_t attributes; // Context Attributes (使わない)
+        uint32_t length;     // ブロック数
+        uint64_t lba;
+    } __attribute__((packed));
+
+    // 1つのキューの深さの上限 (コマンドIDを64ビットのビットマップで管理する)
+    const uint16_t kMaxQueueDepth = 64;
+
+    struct QueuePair;
+    struct Request;
+
+    // 要求が完了したときに呼ばれる関数
+    // 呼び出した後はドライバは req に触らないので、ここで解放してもよい
+    // 完了割り込みの中から呼ばれることがあるので、眠ったり長く処理したりしないこと
+    typedef void (*CompletionCallback)(Request *req, void *context);
+
+    // 非同期に投入するコマンド1つ分
+    // 完了するまで呼び出し元が持っておく (Wait で待つならスタック上でもよい)
+    struct Request
+    {
+        SubmissionQueueEntry cmd;
+        CompletionCallback callback = nullptr; // nullptr なら Wait で完了を待つ
+        void *context = nullptr;
+
+        // 以下はドライバが設定する
+        QueuePair *queue = nullptr;   // 投入したキュー
+        bool done = false;            // 完了したら true (callback がないとき)
+        Task *waiter = nullptr;       // 完了割り込みで起こすタスク
+        uint16_t status = 0;          // 完了ステータス (Phase Tag を除く, 0 = 成功)
+        uint32_t result = 0;          // 完了エントリの DW0
+    };
+
+    // 送信キューと完了キューの組 (Admin用に1つ、I/O用にCPUごとに1つ)
+    struct QueuePair
+    {
+        uint16_t id; // キューID (0 = Admin)
+        uint16_t depth;
+        SubmissionQueueEntry *sq;
+        CompletionQueueEntry *cq;
+        uint16_t sq_tail; // 次に命令を書く場所
+        uint16_t cq_head; // 次に完了を確認する場所
+        uint8_t phase;    // 完了キューのPhase Tag (1から始まる)
+        volatile uint32_t *sq_doorbell;
+        volatile uint32_t *cq_doorbell;
+        SpinLock lock;   // 投入・回収の排他 (完了割り込みからも取る)
+        bool interrupts; // 完了を MSI-X 割り込みで知らせるか
+
+        Request *inflight[kMaxQueueDepth]; // コマンドIDごとの処理中の要求
+        uint64_t *prp_lists;               // コマンドIDごとに1ページずつのPRPリスト (I/Oキューのみ)
+        uint64_t free_ids;                 // 空いているコマンドIDのビットマップ
+        uint16_t inflight_count;
+    };
+
 }
\ No newline at end of file
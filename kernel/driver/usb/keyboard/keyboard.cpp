@@ -46,7 +46,7 @@ bool Keyboard::Initialize()
         return false;
     }
 
-    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(256, 64));
+    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(256, 64, MemoryOwner::kDMA));
     ConfigurationDescriptor *cd =
         reinterpret_cast<ConfigurationDescriptor *>(buf);
 
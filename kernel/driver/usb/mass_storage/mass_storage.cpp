@@ -1,5 +1,6 @@
 #include "mass_storage.hpp"
 #include "driver/usb/usb.hpp"
+#include "memory/dma_pool.hpp"
 #include "memory/memory_manager.hpp"
 #include "printk.hpp"
 
@@ -11,6 +12,8 @@ namespace USB
         : controller_(controller), slot_id_(slot_id), ep_bulk_in_(0), ep_bulk_out_(0),
           total_blocks_(0), block_size_(0)
     {
+        // CBW(31B)/CSW(13B)/READ CAPACITYの応答(8B)は毎コマンド確保するので、プールで使い回す
+        bot_pool_ = new DmaPool("msc-bot", 64, 64, 4096);
     }
 
     bool MassStorage::Initialize()
@@ -18,7 +21,7 @@ namespace USB
         kprintf("[MSC] Initializing Slot %d...\n", slot_id_);
 
         // 1. コンフィギュレーションディスクリプタを取得してエンドポイントを探す
-        uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(1024, 64)); // 少し大きめに確保
+        uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(1024, 64, MemoryOwner::kDMA)); // 少し大きめに確保
         if (!controller_->ControlIn(slot_id_, 0x80, 6, 0x0200, 0, 9, buf))        // まずHeaderだけ
         {
             MemoryManager::Free(buf, 1024);
@@ -107,7 +110,7 @@ namespace USB
         uint8_t cmd[16] = {0};
         cmd[0] = 0x25;
 
-        uint8_t *data = static_cast<uint8_t *>(MemoryManager::Allocate(8, 64));
+        uint8_t *data = static_cast<uint8_t *>(bot_pool_->Allocate());
 
         if (!SendCBW(1, 8, 0x80, 0, 10, cmd))
             return false;
@@ -124,7 +127,7 @@ namespace USB
         total_blocks_ = last_lba + 1;
         block_size_ = blk_sz;
 
-        MemoryManager::Free(data, 8);
+        bot_pool_->Free(data);
         return true;
     }
 
@@ -157,7 +160,7 @@ namespace USB
 
     bool MassStorage::SendCBW(uint32_t tag, uint32_t data_len, uint8_t flags, uint8_t lun, uint8_t cmd_len, const uint8_t *cmd)
     {
-        CommandBlockWrapper *cbw = static_cast<CommandBlockWrapper *>(MemoryManager::Allocate(sizeof(CommandBlockWrapper), 64));
+        CommandBlockWrapper *cbw = static_cast<CommandBlockWrapper *>(bot_pool_->Allocate());
         cbw->signature = 0x43425355; // USBC
         cbw->tag = tag;
         cbw->data_transfer_length = data_len;
@@ -172,7 +175,7 @@ namespace USB
         while (controller_->PollEndpoint(slot_id_, ep_bulk_out_) == -1)
             ;
 
-        MemoryManager::Free(cbw, sizeof(CommandBlockWrapper));
+        bot_pool_->Free(cbw);
         return ret;
     }
 
@@ -188,7 +191,7 @@ namespace USB
 
     bool MassStorage::ReceiveCSW(uint32_t tag)
     {
-        CommandStatusWrapper *csw = static_cast<CommandStatusWrapper *>(MemoryManager::Allocate(sizeof(CommandStatusWrapper), 64));
+        CommandStatusWrapper *csw = static_cast<CommandStatusWrapper *>(bot_pool_->Allocate());
 
         bool ret = controller_->SendNormalTRB(slot_id_, ep_bulk_in_, csw, 13);
         while (controller_->PollEndpoint(slot_id_, ep_bulk_in_) == -1)
@@ -200,7 +203,7 @@ namespace USB
             ret = false;
         }
 
-        MemoryManager::Free(csw, sizeof(CommandStatusWrapper));
+        bot_pool_->Free(csw);
         return ret;
     }
 }
\ No newline at end of file
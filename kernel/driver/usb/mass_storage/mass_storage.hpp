@@ -3,6 +3,8 @@
 #include "block_device.hpp"
 #include <stdint.h>
 
+class DmaPool;
+
 namespace USB
 {
     // Bulk-Only Transport (BOT) 用の構造体定義
@@ -28,6 +30,8 @@ namespace USB
     class MassStorage : public BlockDevice
     {
     public:
+        static const uint32_t kMaxTransferBytes = 64 * 1024;
+
         MassStorage(XHCI::Controller *controller, uint8_t slot_id);
 
         bool Read(uint64_t lba, void *buffer, uint32_t count) override
@@ -42,6 +46,14 @@ namespace USB
 
         uint32_t GetBlockSize() const override { return block_size_; }
 
+        // データ転送は1個のNormal TRBで行うため、TRBの上限(64KB)に収める
+        // (バッファも64KB境界をまたがないこと)
+        uint32_t GetMaxTransferBlocks() const override
+        {
+            return block_size_ ? kMaxTransferBytes / block_size_ : 0;
+        }
+        uint32_t GetDmaBoundary() const override { return kMaxTransferBytes; }
+
         bool Initialize();
 
         bool ReadSectors(uint64_t lba, uint32_t num_sectors, void *buffer);
@@ -57,6 +69,8 @@ namespace USB
         uint64_t total_blocks_;
         uint32_t block_size_;
 
+        DmaPool *bot_pool_; // CBW/CSW用の小さなDMAバッファ
+
         // BOTプロトコル用ヘルパー
         bool SendCBW(uint32_t tag, uint32_t data_len, uint8_t flags, uint8_t lun, uint8_t cmd_len, const uint8_t *cmd);
         bool ReceiveCSW(uint32_t tag);
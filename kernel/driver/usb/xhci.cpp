@@ -1,6 +1,8 @@
 #include "xhci.hpp"
 #include "driver/usb/keyboard/keyboard.hpp"
 #include "driver/usb/mass_storage/mass_storage.hpp"
+#include "memory/dma.hpp"
+#include "memory/dma_pool.hpp"
 #include "memory/memory_manager.hpp"
 #include "pci/pci.hpp"
 #include "printk.hpp"
@@ -13,8 +15,8 @@ namespace USB::XHCI
 const uint8_t kCapIdLegacySupport = 1;
 
 Controller::Controller(const PCI::Device &dev)
-    : pci_dev_(dev), mmio_base_(0), dcs_(1), pcs_(1), cmd_ring_index_(0),
-      event_ring_index_(0)
+    : pci_dev_(dev), mmio_base_(0), ring_pool_(nullptr), ctx_pool_(nullptr),
+      dcs_(1), pcs_(1), cmd_ring_index_(0), event_ring_index_(0)
 {
     for (int slot = 0; slot < 256; ++slot)
     {
@@ -63,7 +65,7 @@ void Controller::RingDoorbell(uint8_t target, uint32_t value)
     // Target 0: Host Controller (Command Ring)
     // Target 1-255: Device Slot
     uintptr_t addr = db_regs_base_ + (4 * target);
-    *reinterpret_cast<volatile uint32_t *>(addr) = value;
+    WriteDoorbell(reinterpret_cast<volatile uint32_t *>(addr), value);
 }
 
 void Controller::Initialize()
@@ -121,18 +123,18 @@ void Controller::Initialize()
 
     // サイズは (MaxSlots + 1) * 8 バイト。64バイトアライメント必須。
     dcbaa_ = static_cast<uint64_t *>(
-        MemoryManager::Allocate((max_slots_ + 1) * 8, 64));
+        MemoryManager::Allocate((max_slots_ + 1) * 8, 64, MemoryOwner::kDMA));
     for (int i = 0; i <= max_slots_; ++i)
         dcbaa_[i] = 0;
 
     if (max_scratchpads > 0)
     {
         uint64_t *scratchpad_array = static_cast<uint64_t *>(
-            MemoryManager::Allocate(max_scratchpads * 8, 64));
+            MemoryManager::Allocate(max_scratchpads * 8, 64, MemoryOwner::kDMA));
 
         for (uint32_t i = 0; i < max_scratchpads; ++i)
         {
-            void *buf = MemoryManager::AllocateFrame();
+            void *buf = MemoryManager::AllocateFrame(MemoryOwner::kDMA);
             scratchpad_array[i] = reinterpret_cast<uint64_t>(buf);
         }
         dcbaa_[0] = reinterpret_cast<uint64_t>(scratchpad_array);
@@ -150,14 +152,14 @@ void Controller::Initialize()
     config |= max_slots_; // サポートする最大スロット数を有効化
     WriteOpReg(0x38, config);
 
-    // とりあえずTRB 32個分確保 (サイズ=32*16=512bytes)。64バイトアライメント。
-    command_ring_ =
-        static_cast<TRB *>(MemoryManager::Allocate(sizeof(TRB) * 32, 64));
-    {
-        uint8_t *p = reinterpret_cast<uint8_t *>(command_ring_);
-        for (size_t i = 0; i < sizeof(TRB) * 32; ++i)
-            p[i] = 0;
-    }
+    // リングとコンテキストは小さいので、DMAプールでページを共有する
+    // リング: 64バイトアライメント、64KB境界をまたがない
+    // コンテキスト: 64バイトアライメント、ページ境界をまたがない
+    ring_pool_ = new DmaPool("xhci-ring", sizeof(TRB) * 32, 64, 0x10000);
+    ctx_pool_ = new DmaPool("xhci-ctx", sizeof(InputContext), 64, 4096);
+
+    // とりあえずTRB 32個分確保 (サイズ=32*16=512bytes)。
+    command_ring_ = static_cast<TRB *>(ring_pool_->Allocate());
 
     TRB &link_trb = command_ring_[31]; // 32個目のTRB
     link_trb.parameter =
@@ -172,17 +174,11 @@ void Controller::Initialize()
     WriteOpReg(0x1C, (crcr_phys >> 32));
 
     // Event Ring (TRB x 32)
-    event_ring_ =
-        static_cast<TRB *>(MemoryManager::Allocate(sizeof(TRB) * 32, 64));
-    {
-        uint8_t *p = reinterpret_cast<uint8_t *>(event_ring_);
-        for (size_t i = 0; i < sizeof(TRB) * 32; ++i)
-            p[i] = 0;
-    }
+    event_ring_ = static_cast<TRB *>(ring_pool_->Allocate());
 
     // ERST (Event Ring Segment Table) - セグメント1つだけ使う
-    erst_ = static_cast<EventRingSegmentTableEntry *>(
-        MemoryManager::Allocate(sizeof(EventRingSegmentTableEntry) * 1, 64));
+    // 64バイトアライメントが必要なので、リング用プールから切り出す
+    erst_ = static_cast<EventRingSegmentTableEntry *>(ring_pool_->Allocate());
     erst_[0].ring_segment_base_address =
         reinterpret_cast<uint64_t>(event_ring_);
     erst_[0].ring_segment_size = 32; // TRB数
@@ -276,7 +272,7 @@ void Controller::Initialize()
                                     "[xHCI - ms] Mass Storage initialized!\n");
 
                                 uint8_t *sec0 =
-                                    (uint8_t *)MemoryManager::Allocate(512, 64);
+                                    (uint8_t *)MemoryManager::Allocate(512, 64, MemoryOwner::kDMA);
                                 if (g_mass_storage->ReadSectors(0, 1, sec0))
                                 {
                                     kprintf("Sector 0 Dump: %x %x ...\n",
@@ -301,22 +297,14 @@ bool Controller::ConfigureEndpoint(uint8_t slot_id, uint8_t ep_addr,
     if (transfer_rings_[slot_id][dci] == nullptr)
     {
         transfer_rings_[slot_id][dci] =
-            static_cast<TRB *>(MemoryManager::Allocate(sizeof(TRB) * 32, 64));
-        uint8_t *p = reinterpret_cast<uint8_t *>(transfer_rings_[slot_id][dci]);
-        for (size_t i = 0; i < sizeof(TRB) * 32; ++i)
-            p[i] = 0;
+            static_cast<TRB *>(ring_pool_->Allocate());
 
         ring_cycle_state_[slot_id][dci] = 1;
         ring_index_[slot_id][dci] = 0;
     }
 
-    InputContext *input_ctx = static_cast<InputContext *>(
-        MemoryManager::Allocate(sizeof(InputContext), 64));
-    {
-        uint8_t *p = reinterpret_cast<uint8_t *>(input_ctx);
-        for (size_t i = 0; i < sizeof(InputContext); ++i)
-            p[i] = 0;
-    }
+    InputContext *input_ctx =
+        static_cast<InputContext *>(ctx_pool_->Allocate());
 
     // Input Control Context
     // Add Context Flags (Bit 0=SlotCtx, Bit DCI=対象EP)
@@ -358,15 +346,15 @@ bool Controller::ConfigureEndpoint(uint8_t slot_id, uint8_t ep_addr,
     // Type=12 (Configure Endpoint)
     trb.control = (pcs_ & 1) | (12 << 10) | (slot_id << 24);
 
-    __asm__ volatile("wbinvd");
+    DmaSyncForDevice(&trb, sizeof(TRB));
     cmd_ring_index_++;
     RingDoorbell(0, 0);
 
     int timeout = 1000000;
     while (timeout > 0)
     {
-        __asm__ volatile("wbinvd");
         volatile TRB &event = event_ring_[event_ring_index_];
+        DmaSyncForCpu(&event, sizeof(TRB));
         uint32_t control = event.control;
 
         if ((control & 1) == dcs_)
@@ -378,7 +366,7 @@ bool Controller::ConfigureEndpoint(uint8_t slot_id, uint8_t ep_addr,
             if ((trb_type == 32 || trb_type == 33) && param == command_trb_ptr)
             {
                 uint32_t code = (event.status >> 24) & 0xFF;
-                MemoryManager::Free(input_ctx, sizeof(InputContext));
+                ctx_pool_->Free(input_ctx);
 
                 if (code == 1)
                 {
@@ -400,7 +388,7 @@ bool Controller::ConfigureEndpoint(uint8_t slot_id, uint8_t ep_addr,
         }
     }
 
-    MemoryManager::Free(input_ctx, sizeof(InputContext));
+    ctx_pool_->Free(input_ctx);
     kprintf("[xHCI] Configure Endpoint Timeout.\n");
     return false;
 }
@@ -443,8 +431,8 @@ bool Controller::ControlIn(uint8_t slot_id, uint8_t req_type, uint8_t request,
     int timeout = 1000000;
     while (timeout > 0)
     {
-        __asm__ volatile("wbinvd");
         volatile TRB &event = event_ring_[event_ring_index_];
+        DmaSyncForCpu(&event, sizeof(TRB));
         uint32_t control = event.control;
 
         if ((control & 1) == dcs_)
@@ -554,7 +542,7 @@ bool Controller::SendNormalTRB(uint8_t slot_id, uint8_t ep_addr, void *data_buf,
         ring_index_[slot_id][dci] = 0;
     }
 
-    __asm__ volatile("wbinvd");
+    DmaSyncForDevice(&trb, sizeof(TRB));
     RingDoorbell(slot_id, dci);
 
     return true;
@@ -632,25 +620,13 @@ void Controller::BiosHandoff()
 
 bool Controller::AddressDevice(uint8_t slot_id, int port_id, int speed)
 {
-    DeviceContext *out_ctx = static_cast<DeviceContext *>(
-        MemoryManager::Allocate(sizeof(DeviceContext), 64));
-
-    {
-        uint8_t *p = reinterpret_cast<uint8_t *>(out_ctx);
-        for (size_t i = 0; i < sizeof(DeviceContext); ++i)
-            p[i] = 0;
-    }
+    DeviceContext *out_ctx =
+        static_cast<DeviceContext *>(ctx_pool_->Allocate());
 
     dcbaa_[slot_id] = reinterpret_cast<uint64_t>(out_ctx);
 
-    InputContext *input_ctx = static_cast<InputContext *>(
-        MemoryManager::Allocate(sizeof(InputContext), 64));
-
-    {
-        uint8_t *p = reinterpret_cast<uint8_t *>(input_ctx);
-        for (size_t i = 0; i < sizeof(InputContext); ++i)
-            p[i] = 0;
-    }
+    InputContext *input_ctx =
+        static_cast<InputContext *>(ctx_pool_->Allocate());
 
     // --- Input Control Context の設定 ---
     // A0 (Slot Context) と A1 (Endpoint 0) を有効にする (Bit 0 と Bit 1)
@@ -666,13 +642,7 @@ bool Controller::AddressDevice(uint8_t slot_id, int port_id, int speed)
     // --- Endpoint Context 0 (Control Pipe) の設定 ---
     input_ctx->ep_contexts[0].ep_type = 4; // Control Endpoint (Bidirectional)
 
-    transfer_rings_[slot_id][1] =
-        static_cast<TRB *>(MemoryManager::Allocate(sizeof(TRB) * 32, 64));
-    {
-        uint8_t *p = reinterpret_cast<uint8_t *>(transfer_rings_[slot_id][1]);
-        for (size_t i = 0; i < sizeof(TRB) * 32; ++i)
-            p[i] = 0;
-    }
+    transfer_rings_[slot_id][1] = static_cast<TRB *>(ring_pool_->Allocate());
     uint64_t tr_phys = reinterpret_cast<uint64_t>(transfer_rings_[slot_id][1]);
     if (speed == 4)
         input_ctx->ep_contexts[0].max_packet_size = 512;
@@ -699,7 +669,7 @@ bool Controller::AddressDevice(uint8_t slot_id, int port_id, int speed)
     // Type=11 (Address Device), Slot IDを設定
     trb.control = (pcs_ & 1) | (TRB_ADDRESS_DEVICE << 10) | (slot_id << 24);
 
-    __asm__ volatile("wbinvd");
+    DmaSyncForDevice(&trb, sizeof(TRB));
     cmd_ring_index_++;
     RingDoorbell(0, 0);
 
@@ -710,8 +680,8 @@ bool Controller::AddressDevice(uint8_t slot_id, int port_id, int speed)
     int timeout = 1000000;
     while (timeout > 0)
     {
-        __asm__ volatile("wbinvd");
         volatile TRB &event = event_ring_[event_ring_index_];
+        DmaSyncForCpu(&event, sizeof(TRB));
         uint32_t control = event.control;
 
         if ((control & 1) == dcs_)
@@ -766,7 +736,7 @@ uint8_t Controller::EnableSlot()
 
     cmd_ring_index_++;
 
-    __asm__ volatile("wbinvd");
+    DmaSyncForDevice(&trb, sizeof(TRB));
 
     RingDoorbell(0, 0);
 
@@ -906,6 +876,7 @@ void Controller::ProcessInterrupt()
 {
     kprintf("[xHCI] ProcessInterrupt()\\n");
     volatile TRB &event = event_ring_[event_ring_index_];
+    DmaSyncForCpu(&event, sizeof(TRB));
     uint32_t control = event.control;
 
     if ((control & 1) == dcs_)
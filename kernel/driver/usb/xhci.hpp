@@ -2,6 +2,8 @@
 #include "pci/pci.hpp"
 #include <stdint.h>
 
+class DmaPool;
+
 namespace USB::XHCI
 {
 struct TRB
@@ -140,6 +142,9 @@ class Controller
     TRB *event_ring_;
     EventRingSegmentTableEntry *erst_;
 
+    DmaPool *ring_pool_; // TRBリング用 (512B, 64KB境界)
+    DmaPool *ctx_pool_;  // Input/Device Context用 (ページ境界)
+
     uint8_t dcs_;               // Dequeue Cycle State (Event Ring用)
     uint8_t pcs_;               // Producer Cycle State (Command Ring用)
     uint32_t cmd_ring_index_;   // Command Ringの書き込み位置
@@ -0,0 +1,179 @@
+#include "dentry_cache.hpp"
+#include "cxx.hpp"
+#include <std/string.hpp>
+
+namespace FileSystem
+{
+
+DentryCache::DentryCache() : hits_(0), misses_(0)
+{
+    Clear();
+}
+
+void DentryCache::Clear()
+{
+    for (uint32_t i = 0; i < kBuckets; ++i)
+        buckets_[i] = nullptr;
+
+    // すべて無効なエントリとしてLRUリストに並べる
+    for (uint32_t i = 0; i < kCapacity; ++i)
+    {
+        Entry *entry = &entries_[i];
+        entry->valid = false;
+        entry->hash_next = nullptr;
+        entry->lru_prev = (i > 0) ? &entries_[i - 1] : nullptr;
+        entry->lru_next = (i + 1 < kCapacity) ? &entries_[i + 1] : nullptr;
+    }
+    lru_head_ = &entries_[0];
+    lru_tail_ = &entries_[kCapacity - 1];
+}
+
+uint32_t DentryCache::HashOf(uint32_t parent, const char *key) const
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ parent;
+    for (; *key; ++key)
+    {
+        hash ^= static_cast<uint8_t>(*key);
+        hash *= 16777619u;
+    }
+    return hash & (kBuckets - 1);
+}
+
+DentryCache::Entry *DentryCache::Find(uint32_t parent, const char *key)
+{
+    if (strnlen(key, kMaxKeyLength + 1) > kMaxKeyLength)
+        return nullptr;
+
+    for (Entry *entry = buckets_[HashOf(parent, key)]; entry;
+         entry = entry->hash_next)
+    {
+        if (entry->parent == parent && strcmp(entry->name, key) == 0)
+            return entry;
+    }
+    return nullptr;
+}
+
+void DentryCache::Touch(Entry *entry)
+{
+    if (entry == lru_head_)
+        return;
+
+    entry->lru_prev->lru_next = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        lru_tail_ = entry->lru_prev;
+
+    entry->lru_prev = nullptr;
+    entry->lru_next = lru_head_;
+    lru_head_->lru_prev = entry;
+    lru_head_ = entry;
+}
+
+void DentryCache::Remove(Entry *entry)
+{
+    Entry **link = &buckets_[HashOf(entry->parent, entry->name)];
+    while (*link && *link != entry)
+        link = &(*link)->hash_next;
+    if (*link)
+        *link = entry->hash_next;
+    entry->hash_next = nullptr;
+    entry->valid = false;
+
+    // 無効になったエントリは次に再利用されるよう末尾へ回す
+    if (entry == lru_tail_)
+        return;
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        lru_head_ = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+
+    entry->lru_next = nullptr;
+    entry->lru_prev = lru_tail_;
+    lru_tail_->lru_next = entry;
+    lru_tail_ = entry;
+}
+
+DentryCache::Entry *DentryCache::Allocate(uint32_t parent, const char *key)
+{
+    size_t len = strnlen(key, kMaxKeyLength + 1);
+    if (len > kMaxKeyLength)
+        return nullptr;
+
+    Entry *entry = Find(parent, key);
+    if (!entry)
+    {
+        entry = lru_tail_;
+        if (entry->valid)
+            Remove(entry);
+
+        entry->parent = parent;
+        memcpy(entry->name, key, len + 1);
+        entry->valid = true;
+
+        uint32_t bucket = HashOf(parent, key);
+        entry->hash_next = buckets_[bucket];
+        buckets_[bucket] = entry;
+    }
+    Touch(entry);
+    return entry;
+}
+
+bool DentryCache::Lookup(uint32_t parent, const char *key, Dentry *out)
+{
+    Entry *entry = Find(parent, key);
+    if (!entry)
+    {
+        misses_++;
+        return false;
+    }
+    hits_++;
+    Touch(entry);
+    *out = entry->dentry;
+    return true;
+}
+
+void DentryCache::Insert(uint32_t parent, const char *key,
+                         const DirectoryEntry &dir_entry, uint64_t lba,
+                         uint32_t index)
+{
+    Entry *entry = Allocate(parent, key);
+    if (!entry)
+        return;
+    entry->dentry.negative = false;
+    entry->dentry.entry = dir_entry;
+    entry->dentry.lba = lba;
+    entry->dentry.index = index;
+}
+
+void DentryCache::InsertNegative(uint32_t parent, const char *key)
+{
+    Entry *entry = Allocate(parent, key);
+    if (entry)
+        entry->dentry.negative = true;
+}
+
+void DentryCache::InvalidateLocation(uint64_t lba, uint32_t index)
+{
+    for (uint32_t i = 0; i < kCapacity; ++i)
+    {
+        Entry *entry = &entries_[i];
+        if (entry->valid && !entry->dentry.negative &&
+            entry->dentry.lba == lba && entry->dentry.index == index)
+            Remove(entry);
+    }
+}
+
+void DentryCache::InvalidateDirectory(uint32_t parent)
+{
+    for (uint32_t i = 0; i < kCapacity; ++i)
+    {
+        Entry *entry = &entries_[i];
+        if (entry->valid && entry->parent == parent)
+            Remove(entry);
+    }
+}
+
+} // namespace FileSystem
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+
+#include "fat32_defs.hpp"
+
+namespace FileSystem
+{
+
+// ディレクトリエントリのキャッシュ (dcache)
+// (親ディレクトリのクラスタ, 大文字にした名前) をキーに、見つかったエントリと
+// その位置を覚えておく。存在しなかった名前も「負のエントリ」として覚える。
+// 1つのファイルを長い名前と別名の両方で引けるので、ディレクトリを書き換える側
+// (FAT32Driver) は位置かディレクトリ単位で Invalidate して整合性を保つ。
+class DentryCache
+{
+  public:
+    static const uint32_t kCapacity = 256;
+    // これより長い名前はキャッシュしない (Lookup は常にミス)
+    static const uint32_t kMaxKeyLength = 63;
+
+    struct Dentry
+    {
+        bool negative;        // true なら「存在しない」ことを表す
+        DirectoryEntry entry; // negative のときは未使用
+        uint64_t lba;         // エントリのあるセクタ
+        uint32_t index;       // セクタ内のエントリ番号 (0-15)
+    };
+
+    DentryCache();
+
+    // key: 大文字にした名前 (NameKey::upper)
+    bool Lookup(uint32_t parent, const char *key, Dentry *out);
+    void Insert(uint32_t parent, const char *key, const DirectoryEntry &entry,
+                uint64_t lba, uint32_t index);
+    void InsertNegative(uint32_t parent, const char *key);
+
+    // 指定した位置のエントリを書き換えたときに呼ぶ
+    void InvalidateLocation(uint64_t lba, uint32_t index);
+    // ディレクトリのクラスタが解放・再利用されるときに呼ぶ
+    void InvalidateDirectory(uint32_t parent);
+    void Clear();
+
+    uint64_t GetHits() const { return hits_; }
+    uint64_t GetMisses() const { return misses_; }
+
+  private:
+    struct Entry
+    {
+        uint32_t parent;
+        char name[kMaxKeyLength + 1];
+        bool valid;
+        Dentry dentry;
+        Entry *hash_next;
+        Entry *lru_prev; // lru_head_ 側が最近使ったもの
+        Entry *lru_next;
+    };
+
+    static const uint32_t kBuckets = 512;
+
+    uint32_t HashOf(uint32_t parent, const char *key) const;
+    Entry *Find(uint32_t parent, const char *key);
+    // LRU末尾のエントリを取り出してキーを設定する (長すぎる名前なら nullptr)
+    Entry *Allocate(uint32_t parent, const char *key);
+    void Remove(Entry *entry);
+    void Touch(Entry *entry);
+
+    Entry entries_[kCapacity];
+    Entry *buckets_[kBuckets];
+    Entry *lru_head_;
+    Entry *lru_tail_;
+
+    uint64_t hits_;
+    uint64_t misses_;
+};
+
+} // namespace FileSystem
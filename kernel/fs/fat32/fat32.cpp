@@ -15,7 +15,12 @@ namespace FileSystem
         kprintf("[Installer] Formatting Partition 1 as FAT32...\n");
 
         // バッファ確保
-        uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096));
+        uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096, MemoryOwner::kFileSystem));
+        if (!buf)
+        {
+            kprintf("[Format] Error: Cannot allocate buffer.\n");
+            return;
+        }
         memset(buf, 0, 512);
 
         // -----------------------------------------
@@ -35,6 +40,23 @@ namespace FileSystem
 
         kprintf("[Format] Total Sectors: %lld, FAT Size: %d sectors\n", part_sectors, fat_sz_sec);
 
+        // 以前の内容はすべて不要なので、パーティション全体の割り当てを解除しておく
+        // (SSDが空き領域を把握でき、書き込み性能が落ちにくい)
+        // 1つの範囲で表せるのは 0xFFFFFFFF ブロックまでなので分けて渡す
+        for (uint64_t done = 0; done < part_sectors;)
+        {
+            uint64_t rest = part_sectors - done;
+            BlockRange range = {kPartitionStartLBA + done,
+                                static_cast<uint32_t>((rest < 0xFFFFFFFF) ? rest : 0xFFFFFFFF)};
+            if (!NVMe::g_nvme->Discard(&range, 1))
+            {
+                kprintf("[Format] Error: Discard failed at LBA %lld.\n", range.lba);
+                MemoryManager::Free(buf, 512);
+                return;
+            }
+            done += range.count;
+        }
+
         // -----------------------------------------
         // 1. Boot Sector (BPB) 作成 & 書き込み
         // -----------------------------------------
@@ -117,19 +139,18 @@ namespace FileSystem
         uint64_t fat2_start = fat1_start + fat_sz_sec;
         NVMe::g_nvme->Write(fat2_start, buf, 1);
 
-        memset(buf, 0, 512);
-        // FAT1の残り (セクタ1から127まで)
-        for (uint32_t i = 1; i < 128; ++i)
-        {
-            NVMe::g_nvme->Write(fat1_start + i, buf, 1);
-        }
-        // FAT2の残り
-        for (uint32_t i = 1; i < 128; ++i)
+        // FATの残りをすべて0クリアする
+        // (ドライバはFAT全体を読み込んで空きクラスタを数えるため、ゴミが残っていてはいけない)
+        // Write Zeroes ならデータを転送せずにデバイス側で0にできる
+        if (!NVMe::g_nvme->WriteZeroes(fat1_start + 1, fat_sz_sec - 1) ||
+            !NVMe::g_nvme->WriteZeroes(fat2_start + 1, fat_sz_sec - 1))
         {
-            NVMe::g_nvme->Write(fat2_start + i, buf, 1);
+            kprintf("[Format] Error: Cannot clear FAT Tables.\n");
+            MemoryManager::Free(buf, 512);
+            return;
         }
 
-        kprintf("[Format] FAT Tables Initialized (Partial Clear).\n");
+        kprintf("[Format] FAT Tables Initialized.\n");
 
         // -----------------------------------------
         // 4. Root Directory 初期化 (Cluster 2)
@@ -139,13 +160,12 @@ namespace FileSystem
         uint64_t data_start_lba = kPartitionStartLBA + reserved_sectors + (num_fats * fat_sz_sec);
         // クラスタ2のLBA = Data Start + ((2 - 2) * SecPerClus) = Data Start
 
-        // 完全に空にする
-        memset(buf, 0, 512);
-
         // 1クラスタ分(8セクタ)を0クリア
-        for (int i = 0; i < sec_per_clus; ++i)
+        if (!NVMe::g_nvme->WriteZeroes(data_start_lba, sec_per_clus))
         {
-            NVMe::g_nvme->Write(data_start_lba + i, buf, 1);
+            kprintf("[Format] Error: Cannot clear Root Directory.\n");
+            MemoryManager::Free(buf, 512);
+            return;
         }
 
         kprintf("[Format] Root Directory Initialized.\n");
@@ -71,4 +71,18 @@ namespace FileSystem
         uint32_t file_size;
     } __attribute__((packed));
 
+    // 長いファイル名 (VFAT LFN) のエントリ (32 bytes, attr = 0x0F)
+    // 短い名前のエントリの直前に、名前の後ろの断片から順に並ぶ
+    struct LongNameEntry
+    {
+        uint8_t ord;          // 断片の番号 (1始まり, 0x40 は最後の断片)
+        uint16_t name1[5];    // UCS-2
+        uint8_t attr;         // 0x0F
+        uint8_t type;         // 0
+        uint8_t chksum;       // 短い名前のチェックサム
+        uint16_t name2[6];
+        uint16_t fst_clus_lo; // 0
+        uint16_t name3[2];
+    } __attribute__((packed));
+
 }
\ No newline at end of file
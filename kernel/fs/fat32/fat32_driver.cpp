@@ -12,14 +12,48 @@ FAT32Driver *g_fat32_driver = nullptr;
 FAT32Driver *g_system_fs = nullptr;
 
 FAT32Driver::FAT32Driver(BlockDevice *dev, uint64_t partition_lba)
-    : dev_(dev), part_lba_(partition_lba)
+    : dev_(dev), part_lba_(partition_lba), fat_chunks_(nullptr),
+      fat_chunk_count_(0), cluster_limit_(0),
+      fat_dirty_(nullptr), free_map_(nullptr), free_count_(0), next_free_(2),
+      fs_info_dirty_(false), meta_data_(nullptr), meta_count_(0),
+      pending_free_(nullptr), pending_free_count_(0), mirror_dirty_(nullptr),
+      mirror_lag_(0), io_clusters_(1)
 {
 }
 
+FAT32Driver::~FAT32Driver()
+{
+    if (!fat_chunks_)
+        return;
+
+    // 外す前に FAT2 以降も揃えておく
+    if (Commit())
+        MirrorFat();
+    FreeFatChunks();
+    if (meta_data_)
+        MemoryManager::Free(meta_data_, kMetaLogSectors * 512);
+    delete[] fat_dirty_;
+    delete[] free_map_;
+    delete[] pending_free_;
+    delete[] mirror_dirty_;
+}
+
 void FAT32Driver::Initialize()
 {
+    dcache_.Clear();
+
+    // セクタを読むバッファ (スタック上のものを含む) は512バイトのブロックを前提にしている
+    // 4Knのデバイスでは1ブロックの読み込みがバッファを越えて書き込むので、マウントしない
+    if (dev_->GetBlockSize() != 512)
+    {
+        kprintf("[FAT32] Error: Unsupported block size %d (only 512 is supported).\n",
+                dev_->GetBlockSize());
+        cluster_limit_ = 0;
+        return;
+    }
+
     // BPB (LBA 0) を読み込む
-    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096));
+    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096, MemoryOwner::kFileSystem));
     dev_->Read(part_lba_, buf, 1);
 
     FAT32_BPB *bpb = reinterpret_cast<FAT32_BPB *>(buf);
@@ -29,385 +63,1235 @@ void FAT32Driver::Initialize()
     kprintf("[FAT32 DEBUG] SecPerClus: %d\n", bpb->sec_per_clus);
     kprintf("[FAT32 DEBUG] ResSectors: %d\n", bpb->reserved_sec_cnt);
 
+    if (bpb->bytes_per_sec != 512)
+    {
+        kprintf("[FAT32] Error: Unsupported sector size %d.\n", bpb->bytes_per_sec);
+        cluster_limit_ = 0;
+        MemoryManager::Free(buf, 512);
+        return;
+    }
+
     // パラメータ取得
     sec_per_clus_ = bpb->sec_per_clus;
     reserved_sectors_ = bpb->reserved_sec_cnt;
     num_fats_ = bpb->num_fats;
     fat_sz32_ = bpb->fat_sz32;
     root_clus_ = bpb->root_clus;
+    uint32_t total_sectors = bpb->tot_sec32;
+    fs_info_lba_ = part_lba_ + (bpb->fs_info ? bpb->fs_info : 1);
+
+    // 連続したクラスタを1回のコマンドでまとめて転送する数 (デバイスの最大転送サイズ以内)
+    uint32_t max_blocks = dev_->GetMaxTransferBlocks();
+    if (max_blocks > kMaxIoSectors)
+        max_blocks = kMaxIoSectors;
+    io_clusters_ = sec_per_clus_ ? max_blocks / sec_per_clus_ : 1;
+    if (io_clusters_ == 0)
+        io_clusters_ = 1;
 
     // 領域開始位置の計算
     fat_start_lba_ = part_lba_ + reserved_sectors_;
     data_start_lba_ = fat_start_lba_ + (num_fats_ * fat_sz32_);
 
-    kprintf("[FAT32] Driver Initialized. ClusterSize=%d sectors\n",
-            sec_per_clus_);
+    // データ領域のクラスタ数 (FATのエントリ数を超えることはない)
+    uint32_t data_sectors =
+        total_sectors - reserved_sectors_ - num_fats_ * fat_sz32_;
+    cluster_limit_ = data_sectors / sec_per_clus_ + 2;
+    if (cluster_limit_ > fat_sz32_ * kFatEntriesPerSector)
+        cluster_limit_ = fat_sz32_ * kFatEntriesPerSector;
+
+    // FAT全体を読み込む
+    // FATはここへ直接読み書きするので、塊は転送単位 (64KB) の境界に揃えておく
+    // (USBマスストレージの転送は64KB境界をまたげない)
+    fat_chunk_count_ = (fat_sz32_ + kFatIoSectors - 1) / kFatIoSectors;
+    fat_chunks_ = new uint32_t *[fat_chunk_count_];
+    for (uint32_t i = 0; i < fat_chunk_count_; ++i)
+        fat_chunks_[i] = nullptr;
+    for (uint32_t i = 0; i < fat_chunk_count_; ++i)
+    {
+        fat_chunks_[i] = static_cast<uint32_t *>(MemoryManager::Allocate(
+            kFatIoSectors * 512, kFatIoSectors * 512, MemoryOwner::kFileSystem));
+        if (!fat_chunks_[i])
+        {
+            kprintf("[FAT32] Error: Cannot allocate FAT cache (%d sectors).\n",
+                    fat_sz32_);
+            FreeFatChunks();
+            cluster_limit_ = 0;
+            MemoryManager::Free(buf, 512);
+            return;
+        }
+    }
+    for (uint32_t sector = 0; sector < fat_sz32_; sector += kFatIoSectors)
+    {
+        uint32_t count = fat_sz32_ - sector;
+        if (count > kFatIoSectors)
+            count = kFatIoSectors;
+        if (!dev_->Read(fat_start_lba_ + sector, FatSector(sector), count))
+        {
+            kprintf("[FAT32] Error: Cannot read FAT (sector %d).\n", sector);
+            FreeFatChunks();
+            cluster_limit_ = 0;
+            MemoryManager::Free(buf, 512);
+            return;
+        }
+    }
+
+    fat_dirty_ = new uint64_t[(fat_sz32_ + 63) / 64];
+    memset(fat_dirty_, 0, ((fat_sz32_ + 63) / 64) * sizeof(uint64_t));
+    mirror_dirty_ = new uint64_t[(fat_sz32_ + 63) / 64];
+    memset(mirror_dirty_, 0, ((fat_sz32_ + 63) / 64) * sizeof(uint64_t));
+    mirror_lag_ = 0;
+
+    // FAT2 は遅れて書くので、前回反映する前に止まっていれば FAT1 と食い違っている
+    // 違うセクタを覚えておき、次に反映するときに直す
+    if (num_fats_ > 1)
+    {
+        uint8_t *fat2_buf = static_cast<uint8_t *>(MemoryManager::Allocate(
+            kFatIoSectors * 512, kFatIoSectors * 512, MemoryOwner::kFileSystem));
+        for (uint32_t sector = 0; fat2_buf && sector < fat_sz32_;
+             sector += kFatIoSectors)
+        {
+            uint32_t count = fat_sz32_ - sector;
+            if (count > kFatIoSectors)
+                count = kFatIoSectors;
+            if (!dev_->Read(fat_start_lba_ + fat_sz32_ + sector, fat2_buf, count))
+                break;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (memcmp(fat2_buf + i * 512,
+                           FatSector(sector + i), 512) != 0)
+                {
+                    mirror_dirty_[(sector + i) / 64] |= 1ULL << ((sector + i) % 64);
+                    mirror_lag_++;
+                }
+            }
+        }
+        if (fat2_buf)
+            MemoryManager::Free(fat2_buf, kFatIoSectors * 512);
+        if (mirror_lag_ != 0)
+            kprintf("[FAT32] FAT2 differs from FAT1 in %d sectors.\n",
+                    mirror_lag_);
+    }
+
+    meta_data_ = static_cast<uint8_t *>(MemoryManager::Allocate(
+        kMetaLogSectors * 512, 4096, MemoryOwner::kFileSystem));
+    meta_count_ = 0;
+
+    // 空きクラスタのビットマップを作る
+    free_map_ = new uint64_t[(cluster_limit_ + 63) / 64];
+    memset(free_map_, 0, ((cluster_limit_ + 63) / 64) * sizeof(uint64_t));
+    pending_free_ = new uint64_t[(cluster_limit_ + 63) / 64];
+    memset(pending_free_, 0, ((cluster_limit_ + 63) / 64) * sizeof(uint64_t));
+    pending_free_count_ = 0;
+    free_count_ = 0;
+    for (uint32_t cluster = 2; cluster < cluster_limit_; ++cluster)
+    {
+        if ((FatEntry(cluster) & 0x0FFFFFFF) == 0)
+        {
+            free_map_[cluster / 64] |= 1ULL << (cluster % 64);
+            free_count_++;
+        }
+    }
+
+    // FSInfo の nxt_free をヒントとして使う
+    // free_count は数え直した値が正しいが、書き戻すのは次にFATを変更したときでよい
+    dev_->Read(fs_info_lba_, buf, 1);
+    FAT32_FSInfo *fsinfo = reinterpret_cast<FAT32_FSInfo *>(buf);
+    next_free_ = 2;
+    if (fsinfo->lead_sig == 0x41615252 && fsinfo->struc_sig == 0x61417272 &&
+        fsinfo->nxt_free >= 2 && fsinfo->nxt_free < cluster_limit_)
+    {
+        next_free_ = fsinfo->nxt_free;
+    }
+
+    kprintf("[FAT32] Driver Initialized. ClusterSize=%d sectors, Free=%d/%d\n",
+            sec_per_clus_, free_count_, cluster_limit_ - 2);
     MemoryManager::Free(buf, 512);
 }
 
+void FAT32Driver::FreeFatChunks()
+{
+    for (uint32_t i = 0; i < fat_chunk_count_; ++i)
+    {
+        if (fat_chunks_[i])
+            MemoryManager::Free(fat_chunks_[i], kFatIoSectors * 512);
+    }
+    delete[] fat_chunks_;
+    fat_chunks_ = nullptr;
+    fat_chunk_count_ = 0;
+}
+
 uint64_t FAT32Driver::ClusterToLBA(uint32_t cluster)
 {
     // クラスタ2がデータ領域の先頭
     return data_start_lba_ + (uint64_t)(cluster - 2) * sec_per_clus_;
 }
 
-uint32_t FAT32Driver::AllocateCluster()
+void FAT32Driver::SetFatEntry(uint32_t cluster, uint32_t value)
 {
-    // FATテーブルを走査して空き(0x00000000)を探す
-    // ※本来はFSInfoを見て高速化すべきですが、今回はFATを先頭から読みます
+    if (cluster < 2 || cluster >= cluster_limit_)
+        return;
 
-    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096));
-    uint32_t *entries = reinterpret_cast<uint32_t *>(buf);
+    uint32_t &entry = FatEntry(cluster);
+    bool was_free = (entry & 0x0FFFFFFF) == 0;
+    bool now_free = (value & 0x0FFFFFFF) == 0;
 
-    // クラスタ2から探索開始 (FAT領域の先頭セクタだけ見る簡易実装)
-    // ※本気でやるならFAT領域全体をループする必要があります
-    dev_->Read(fat_start_lba_, buf, 1);
+    // 上位4ビットは予約なので保持する
+    entry = (entry & 0xF0000000) | (value & 0x0FFFFFFF);
+    uint32_t sector = cluster / kFatEntriesPerSector;
+    fat_dirty_[sector / 64] |= 1ULL << (sector % 64);
 
-    for (int i = 2; i < 128; ++i)
-    { // 1セクタには128個のエントリ (512/4)
-        if (entries[i] == 0)
+    uint64_t bit = 1ULL << (cluster % 64);
+    if (was_free && !now_free)
+    {
+        if (pending_free_[cluster / 64] & bit)
         {
-            // 空き発見！使用中(EOCC = 0x0FFFFFFF)マークをつけて保存
-            entries[i] = 0x0FFFFFFF;
-            dev_->Write(fat_start_lba_, buf, 1);
-            // FAT2(バックアップ)も更新
-            dev_->Write(fat_start_lba_ + fat_sz32_, buf, 1);
-
-            MemoryManager::Free(buf, 512);
-            return i;
+            // コミット前に解放を取り消した (空き数にはまだ数えていない)
+            pending_free_[cluster / 64] &= ~bit;
+            pending_free_count_--;
+            return;
         }
+        free_map_[cluster / 64] &= ~bit;
+        free_count_--;
+        fs_info_dirty_ = true;
+    }
+    else if (!was_free && now_free)
+    {
+        // 空きビットマップへ戻すのはコミット後 (Commit)
+        pending_free_[cluster / 64] |= bit;
+        pending_free_count_++;
     }
-
-    MemoryManager::Free(buf, 512);
-    kprintf("[FAT32] No free clusters found in first FAT sector!\n");
-    return 0; // Error
 }
 
-void FAT32Driver::LinkCluster(uint32_t current, uint32_t next)
+uint32_t FAT32Driver::FindFreeCluster()
 {
-    // FATテーブル内の current の位置に next を書き込む
-    // 1セクタ = 128エントリ
-    uint32_t sector_offset = current / 128;
-    uint32_t entry_offset = current % 128;
-
-    uint64_t target_lba = fat_start_lba_ + sector_offset;
+    if (free_count_ == 0)
+        return 0;
 
-    // セクタを読み込む
-    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096));
-    dev_->Read(target_lba, buf, 1);
+    // next_free_ から空きビットマップを64クラスタ単位で探し、末尾まで来たら先頭に戻る
+    uint32_t words = (cluster_limit_ + 63) / 64;
+    uint32_t start = next_free_ < cluster_limit_ ? next_free_ : 2;
+    for (uint32_t n = 0; n <= words; ++n)
+    {
+        uint32_t word = (start / 64 + n) % words;
+        uint64_t bits = free_map_[word];
+        if (n == 0)
+            bits &= ~0ULL << (start % 64); // 最初のワードは start 以降だけ
+        if (bits == 0)
+            continue;
+
+        uint32_t cluster = word * 64 + __builtin_ctzll(bits);
+        if (cluster >= 2 && cluster < cluster_limit_)
+            return cluster;
+    }
+    return 0;
+}
 
-    uint32_t *entries = reinterpret_cast<uint32_t *>(buf);
-    entries[entry_offset] = next; // リンク更新
+uint32_t FAT32Driver::AllocateClusterRun(uint32_t max_clusters, uint32_t *count)
+{
+    *count = 0;
+    uint32_t first = FindFreeCluster();
+    if (first == 0 && pending_free_count_ != 0)
+    {
+        // 解放待ちのクラスタを使えるようにする
+        Commit();
+        first = FindFreeCluster();
+    }
+    if (first == 0)
+    {
+        kprintf("[FAT32] No free clusters left!\n");
+        return 0; // Error
+    }
 
-    // 書き戻す
-    dev_->Write(target_lba, buf, 1);
+    // 見つけた空きクラスタから、続けて空いている分だけ伸ばす
+    uint32_t n = 1;
+    while (n < max_clusters && first + n < cluster_limit_ &&
+           IsClusterFree(first + n))
+    {
+        n++;
+    }
 
-    // バックアップFAT(FAT2)も更新
-    dev_->Write(target_lba + fat_sz32_, buf, 1);
+    // チェーンにつなぎ、最後に使用中(EOC = 0x0FFFFFFF)マークをつける
+    for (uint32_t i = 0; i < n; ++i)
+        SetFatEntry(first + i, (i + 1 < n) ? first + i + 1 : 0x0FFFFFFF);
 
-    MemoryManager::Free(buf, 512);
+    next_free_ = first + n;
+    *count = n;
+    return first;
 }
 
-uint32_t FAT32Driver::GetNextCluster(uint32_t current_cluster)
+uint32_t FAT32Driver::AllocateCluster()
 {
-    uint32_t sector_offset = current_cluster / 128; // 1セクタに128エントリ
-    uint32_t entry_offset = current_cluster % 128;
-
-    uint64_t target_lba = fat_start_lba_ + sector_offset;
-
-    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096));
-    dev_->Read(target_lba, buf, 1);
+    uint32_t count;
+    return AllocateClusterRun(1, &count);
+}
 
-    uint32_t *entries = reinterpret_cast<uint32_t *>(buf);
-    uint32_t next = entries[entry_offset] & 0x0FFFFFFF; // 下位28ビットが有効
+void FAT32Driver::LinkCluster(uint32_t current, uint32_t next)
+{
+    // FATテーブル内の current の位置に next を書き込む (書き戻しは Sync 時)
+    SetFatEntry(current, next);
+}
 
-    MemoryManager::Free(buf, 512);
-    return next;
+uint32_t FAT32Driver::GetNextCluster(uint32_t current_cluster)
+{
+    if (current_cluster >= cluster_limit_)
+        return 0x0FFFFFFF;
+    return FatEntry(current_cluster) & 0x0FFFFFFF; // 下位28ビットが有効
 }
 
-void FAT32Driver::FreeChain(uint32_t start_cluster)
+uint32_t FAT32Driver::GetExtent(uint32_t cluster, uint32_t max_clusters,
+                                uint32_t *next)
 {
-    // クラスタ番号が有効範囲にある限りループ
-    uint32_t current = start_cluster;
-    while (current >= 2 && current < 0x0FFFFFF8)
+    uint32_t n = 1;
+    uint32_t current = cluster;
+    uint32_t following = GetNextCluster(current);
+    while (n < max_clusters && following == current + 1)
     {
-        // 次のクラスタを覚えておく
-        uint32_t next = GetNextCluster(current);
-
-        // 現在のクラスタを「空き(0)」にする
-        // LinkCluster(current, 0)
-        // は「currentの位置に0を書く」ので解放と同じ意味
-        LinkCluster(current, 0);
-
-        // 次へ進む
-        current = next;
+        current = following;
+        following = GetNextCluster(current);
+        n++;
     }
+    *next = following;
+    return n;
 }
 
-bool FAT32Driver::IsNameEqual(const char *entry_name, const char *target_name)
+uint8_t *FAT32Driver::AllocateIoBuffer(uint32_t bytes)
 {
-    // entry_name: "KERNEL  ELF" (11文字固定, スペース埋め)
-    // target_name: "kernel.elf" (ユーザ入力) または "SYSTEM  LOG" (8.3形式)
+    // USBマスストレージは1回の転送バッファが64KB境界をまたげないので、
+    // 64KBまではサイズ以上の2のべき乗境界に揃えておく
+    size_t align = 4096;
+    while (align < bytes && align < 64 * 1024)
+        align <<= 1;
+    return static_cast<uint8_t *>(
+        MemoryManager::Allocate(bytes, align, MemoryOwner::kFileSystem));
+}
 
-    char converted[11];
-    memset(converted, ' ', 11);
+uint32_t FAT32Driver::WriteNewClusters(uint32_t prev_cluster,
+                                       const uint8_t *data, uint32_t size,
+                                       uint32_t *first_cluster)
+{
+    *first_cluster = 0;
+    if (size == 0)
+        return prev_cluster;
 
-    // target_name の長さを計算
-    int len = 0;
-    while (target_name[len])
-        len++;
+    uint32_t cluster_bytes = sec_per_clus_ * 512;
+    uint32_t total_clusters = (size + cluster_bytes - 1) / cluster_bytes;
+    uint32_t buf_clusters =
+        (total_clusters < io_clusters_) ? total_clusters : io_clusters_;
+    uint8_t *buf = AllocateIoBuffer(buf_clusters * cluster_bytes);
+    if (!buf)
+    {
+        kprintf("[FAT32] Error: Cannot allocate write buffer.\n");
+        return 0;
+    }
 
-    // 11文字でドットがない場合は既に8.3形式と判断
-    if (len == 11)
+    uint32_t last_cluster = prev_cluster;
+    uint32_t offset = 0;
+    bool ok = true;
+    while (offset < size)
     {
-        bool has_dot = false;
-        for (int k = 0; k < 11; k++)
+        // 残りを収めるのに必要なだけ、連続したクラスタをまとめて確保する
+        uint32_t remaining = size - offset;
+        uint32_t want = (remaining + cluster_bytes - 1) / cluster_bytes;
+        if (want > buf_clusters)
+            want = buf_clusters;
+
+        uint32_t got;
+        uint32_t run = AllocateClusterRun(want, &got);
+        if (run == 0)
         {
-            if (target_name[k] == '.')
-            {
-                has_dot = true;
-                break;
-            }
+            kprintf("[FAT32] Error: Disk Full!\n");
+            ok = false;
+            break;
         }
-        if (!has_dot)
+
+        if (*first_cluster == 0)
+            *first_cluster = run;
+        if (last_cluster != 0)
+            LinkCluster(last_cluster, run);
+
+        // 連続したクラスタには1回のコマンドで書き込む (端数は0埋め)
+        uint32_t run_bytes = got * cluster_bytes;
+        uint32_t len = (remaining < run_bytes) ? remaining : run_bytes;
+        memcpy(buf, data + offset, len);
+        memset(buf + len, 0, run_bytes - len);
+        if (!dev_->Write(ClusterToLBA(run), buf, got * sec_per_clus_))
         {
-            // 大文字変換しながらコピー
-            for (int k = 0; k < 11; k++)
-            {
-                char c = target_name[k];
-                if (c >= 'a' && c <= 'z')
-                    c -= 32;
-                converted[k] = c;
-            }
-            // 比較
-            for (int k = 0; k < 11; ++k)
-            {
-                if (entry_name[k] != converted[k])
-                    return false;
-            }
-            return true;
+            kprintf("[FAT32] Error: Failed to write clusters at %d.\n", run);
+            ok = false;
+            break;
         }
-    }
 
-    // 従来のドット区切り形式の処理
-    int i = 0; // target_name index
-    int j = 0; // converted index
+        last_cluster = run + got - 1;
+        offset += len;
+    }
+    MemoryManager::Free(buf, buf_clusters * cluster_bytes);
 
-    // 1. ベース名部分 (ドットの前まで)
-    while (target_name[i] && target_name[i] != '.')
+    if (!ok)
     {
-        if (j < 8)
+        // 途中まで作ったチェーンを元に戻す
+        if (*first_cluster != 0)
         {
-            char c = target_name[i];
-            // 小文字 -> 大文字変換
-            if (c >= 'a' && c <= 'z')
-                c -= 32;
-            converted[j++] = c;
+            if (prev_cluster != 0)
+                LinkCluster(prev_cluster, 0x0FFFFFFF);
+            FreeChain(*first_cluster);
+            *first_cluster = 0;
         }
-        i++;
+        return 0;
     }
+    return last_cluster;
+}
 
-    // 2. ドットがあれば拡張子部分へ
-    if (target_name[i] == '.')
+uint32_t FAT32Driver::NextDirtyRun(const uint64_t *bitmap, uint32_t *sector) const
+{
+    uint32_t start = *sector;
+    while (start < fat_sz32_ && !(bitmap[start / 64] & (1ULL << (start % 64))))
     {
-        i++;   // ドットをスキップ
-        j = 8; // 拡張子エリアへ移動
-        while (target_name[i])
-        {
-            if (j < 11)
-            {
-                char c = target_name[i];
-                if (c >= 'a' && c <= 'z')
-                    c -= 32;
-                converted[j++] = c;
-            }
-            i++;
-        }
+        // 64セクタ分まとめて飛ばす
+        if (start % 64 == 0 && bitmap[start / 64] == 0)
+            start += 64;
+        else
+            start++;
     }
+    if (start >= fat_sz32_)
+        return 0;
 
-    // 3. 比較
-    for (int k = 0; k < 11; ++k)
+    // 連続して dirty なセクタをまとめる (転送単位の境界はまたがない)
+    uint32_t run = 1;
+    while (start + run < fat_sz32_ && (start + run) % kFatIoSectors != 0 &&
+           (bitmap[(start + run) / 64] & (1ULL << ((start + run) % 64))))
     {
-        if (entry_name[k] != converted[k])
-            return false;
+        run++;
     }
-    return true;
+    *sector = start;
+    return run;
 }
 
-void FAT32Driver::AddDirectoryEntry(const char *name, uint32_t start_cluster,
-                                    uint32_t size, uint8_t attr,
-                                    uint32_t parent_cluster)
+bool FAT32Driver::SectorHasPendingFree(uint32_t sector) const
 {
-    // 親ディレクトリの開始クラスタを決定 (0ならルート)
-    uint32_t target_cluster =
-        (parent_cluster == 0) ? root_clus_ : parent_cluster;
-    uint64_t lba = ClusterToLBA(target_cluster);
-
-    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(512, 4096));
-
-    // 親ディレクトリの中身を走査 (簡易的に先頭クラスタのみ探索)
-    for (int s = 0; s < sec_per_clus_; ++s)
+    // 1セクタは128エントリ = pending_free_ の2ワード分
+    uint32_t words = (cluster_limit_ + 63) / 64;
+    uint32_t w = sector * (kFatEntriesPerSector / 64);
+    for (uint32_t i = 0; i < kFatEntriesPerSector / 64 && w + i < words; ++i)
     {
-        dev_->Read(lba + s, buf, 1);
-        DirectoryEntry *dir = reinterpret_cast<DirectoryEntry *>(buf);
-
-        for (int i = 0; i < 16; ++i)
-        {
-            if (dir[i].name[0] == 0x00 || (unsigned char)dir[i].name[0] == 0xE5)
-            {
-                // エントリ作成
-                memset(&dir[i], 0, 32);
-                memcpy(dir[i].name, name, 11);
-                dir[i].attr = attr; // [修正] 引数の属性を使う (ファイル:0x20,
-                                    // ディレクトリ:0x10)
-                dir[i].fst_clus_hi = (start_cluster >> 16) & 0xFFFF;
-                dir[i].fst_clus_lo = start_cluster & 0xFFFF;
-                dir[i].file_size = size;
-
-                dev_->Write(lba + s, buf, 1);
-                MemoryManager::Free(buf, 512);
-                return;
-            }
-        }
+        if (pending_free_[w + i] != 0)
+            return true;
     }
-    MemoryManager::Free(buf, 512);
-    kprintf("[FAT32] Directory full!\n");
+    return false;
 }
 
-bool FAT32Driver::FindDirectoryEntry(const char *name, uint32_t parent_cluster,
-                                     DirectoryEntry *found_entry)
+bool FAT32Driver::FlushFat(bool keep_freed)
 {
-    uint32_t current_cluster =
-        (parent_cluster == 0) ? root_clus_ : parent_cluster;
-    uint8_t *buf = static_cast<uint8_t *>(
-        MemoryManager::Allocate(sec_per_clus_ * 512, 4096));
-
-    int loop_safety = 0;
-    while (current_cluster < 0x0FFFFFF8 && current_cluster >= 2)
+    bool ok = true;
+    uint32_t sector = 0;
+    uint32_t run;
+    uint32_t *disk = nullptr; // FAT1 を読み直すバッファ (keep_freed のときだけ使う)
+    while ((run = NextDirtyRun(fat_dirty_, &sector)) != 0)
     {
-        if (loop_safety++ > 10000)
+        const uint32_t *src = FatSector(sector);
+        bool has_freed = false;
+        if (keep_freed)
         {
-            kprintf("[FAT32] Error: Directory cluster chain too long or loop "
-                    "detected.\n");
-            break;
+            for (uint32_t i = sector; i < sector + run && !has_freed; ++i)
+                has_freed = SectorHasPendingFree(i);
         }
 
-        uint64_t lba = ClusterToLBA(current_cluster);
-
-        if (!dev_->Read(lba, buf, sec_per_clus_))
+        if (has_freed)
         {
-            kprintf("[FAT32] Disk Read Error at LBA %lld\n", lba);
-            MemoryManager::Free(buf, sec_per_clus_ * 512);
-            return false;
+            // 解放待ちのクラスタはディスク上の値 (まだ使用中) を残し、それ以外だけ新しくする
+            if (!disk)
+                disk = static_cast<uint32_t *>(MemoryManager::Allocate(
+                    kFatIoSectors * 512, kFatIoSectors * 512, MemoryOwner::kFileSystem));
+            if (!disk || !dev_->Read(fat_start_lba_ + sector, disk, run))
+            {
+                ok = false;
+                sector += run;
+                continue;
+            }
+            uint32_t first = sector * kFatEntriesPerSector;
+            for (uint32_t i = 0; i < run * kFatEntriesPerSector; ++i)
+            {
+                uint32_t cluster = first + i;
+                if (cluster >= cluster_limit_ ||
+                    !(pending_free_[cluster / 64] & (1ULL << (cluster % 64))))
+                    disk[i] = src[i];
+            }
+            src = disk;
         }
 
-        DirectoryEntry *entries = reinterpret_cast<DirectoryEntry *>(buf);
-        int num_entries = (sec_per_clus_ * 512) / 32;
+        if (!dev_->Write(fat_start_lba_ + sector, src, run))
+        {
+            ok = false;
+            sector += run;
+            continue;
+        }
 
-        for (int i = 0; i < num_entries; ++i)
+        for (uint32_t i = sector; i < sector + run; ++i)
         {
-            // 0x00: これ以降エントリなし
-            if (entries[i].name[0] == 0x00)
+            uint64_t bit = 1ULL << (i % 64);
+            // 解放を含むセクタは、ディレクトリエントリを書いた後にもう一度書く
+            if (!(has_freed && SectorHasPendingFree(i)))
+                fat_dirty_[i / 64] &= ~bit;
+            if (num_fats_ > 1 && !(mirror_dirty_[i / 64] & bit))
             {
-                MemoryManager::Free(buf, sec_per_clus_ * 512);
-                return false;
+                mirror_dirty_[i / 64] |= bit;
+                mirror_lag_++;
             }
-            // 0xE5: 削除済み
-            if ((unsigned char)entries[i].name[0] == 0xE5)
-                continue;
-
-            // 属性チェック (ボリュームラベル等はスキップ)
-            if (entries[i].attr == 0x0F)
-                continue; // LFN (Long File Name) スキップ
+        }
+        sector += run;
+    }
+    if (disk)
+        MemoryManager::Free(disk, kFatIoSectors * 512);
+    return ok;
+}
 
-            if (IsNameEqual(entries[i].name, name))
-            {
-                *found_entry = entries[i]; // コピーして返す
-                MemoryManager::Free(buf, sec_per_clus_ * 512);
-                return true;
-            }
+bool FAT32Driver::MirrorFat()
+{
+    BlockPlug plug(dev_);
+    bool ok = true;
+    uint32_t sector = 0;
+    uint32_t run;
+    while ((run = NextDirtyRun(mirror_dirty_, &sector)) != 0)
+    {
+        // FAT1 と同じ内容を書く (FAT1 は書き戻し済みの内容)
+        const uint32_t *src = FatSector(sector);
+        bool written = true;
+        for (uint32_t copy = 1; copy < num_fats_; ++copy)
+        {
+            uint64_t lba = fat_start_lba_ + copy * fat_sz32_ + sector;
+            written &= dev_->Write(lba, src, run);
         }
 
-        // 次のクラスタへ (ディレクトリが複数クラスタにまたがる場合)
-        current_cluster = GetNextCluster(current_cluster);
+        if (written)
+        {
+            for (uint32_t i = sector; i < sector + run; ++i)
+                mirror_dirty_[i / 64] &= ~(1ULL << (i % 64));
+            mirror_lag_ -= run;
+        }
+        ok &= written;
+        sector += run;
     }
-
-    MemoryManager::Free(buf, sec_per_clus_ * 512);
-    return false;
+    return dev_->Sync() && ok;
 }
 
-uint32_t FAT32Driver::CreateDirectory(const char *name, uint32_t parent_cluster)
+bool FAT32Driver::FlushFsInfo()
 {
-    kprintf("[FAT32] Creating Directory: %s...\n", name);
+    if (!fs_info_dirty_)
+        return true;
 
-    // 1. ディレクトリ用のクラスタを確保
-    uint32_t new_cluster = AllocateCluster();
-    if (new_cluster == 0)
-        return 0;
+    uint8_t buf[512];
+    if (!dev_->Read(fs_info_lba_, buf, 1))
+        return false;
 
-    // 2. 確保したクラスタを0クリア (空のディレクトリにする)
-    uint64_t target_lba = ClusterToLBA(new_cluster);
-    uint32_t cluster_bytes = sec_per_clus_ * 512;
-    uint8_t *buf =
-        static_cast<uint8_t *>(MemoryManager::Allocate(cluster_bytes, 4096));
-    memset(buf, 0, cluster_bytes);
+    FAT32_FSInfo *fsinfo = reinterpret_cast<FAT32_FSInfo *>(buf);
+    if (fsinfo->lead_sig != 0x41615252 || fsinfo->struc_sig != 0x61417272)
+        return true; // FSInfo が無いボリュームでは何もしない
 
-    DirectoryEntry *dot_entries = reinterpret_cast<DirectoryEntry *>(buf);
+    fsinfo->free_count = free_count_;
+    fsinfo->nxt_free = next_free_;
+    if (!dev_->Write(fs_info_lba_, buf, 1))
+        return false;
+    fs_info_dirty_ = false;
+    return true;
+}
 
-    // Entry 0: "." (自分自身)
-    memset(&dot_entries[0], 0, 32);
-    memcpy(dot_entries[0].name, ".          ", 11); // "." + 10 spaces
-    dot_entries[0].attr = 0x10;                     // Directory
-    dot_entries[0].fst_clus_hi = (new_cluster >> 16) & 0xFFFF;
-    dot_entries[0].fst_clus_lo = new_cluster & 0xFFFF;
+bool FAT32Driver::ReadDirSectors(uint64_t lba, void *buffer, uint32_t count)
+{
+    if (!dev_->Read(lba, buffer, count))
+        return false;
 
-    // Entry 1: ".." (親ディレクトリ)
-    memset(&dot_entries[1], 0, 32);
-    memcpy(dot_entries[1].name, "..         ", 11); // ".." + 9 spaces
-    dot_entries[1].attr = 0x10;                     // Directory
-    // 親がルート(0)の場合はクラスタ0を指定 (FAT32の仕様)
-    uint32_t parent_ref = (parent_cluster == 0) ? 0 : parent_cluster;
-    dot_entries[1].fst_clus_hi = (parent_ref >> 16) & 0xFFFF;
-    dot_entries[1].fst_clus_lo = parent_ref & 0xFFFF;
+    // コミット前の変更を重ねる
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    for (uint32_t i = 0; i < meta_count_; ++i)
+    {
+        const MetaSector &meta = meta_log_[i];
+        if (meta.lba >= lba + count)
+            break;
+        if (meta.lba >= lba)
+            memcpy(out + (meta.lba - lba) * 512, meta_data_ + meta.slot * 512,
+                   512);
+    }
+    return true;
+}
 
-    dev_->Write(target_lba, buf, sec_per_clus_);
-    MemoryManager::Free(buf, cluster_bytes);
+bool FAT32Driver::WriteDirSector(uint64_t lba, const void *buffer)
+{
+    if (!meta_data_)
+        return dev_->Write(lba, buffer, 1);
+
+    // LBA順の位置を探す
+    uint32_t pos = 0;
+    while (pos < meta_count_ && meta_log_[pos].lba < lba)
+        pos++;
+    if (pos < meta_count_ && meta_log_[pos].lba == lba)
+    {
+        memcpy(meta_data_ + meta_log_[pos].slot * 512, buffer, 512);
+        return true;
+    }
 
-    // 3. FATチェーン終端
-    LinkCluster(new_cluster, 0x0FFFFFFF);
+    // 溜まりきったら、ここまでの変更をコミットしてから積む
+    if (meta_count_ == kMetaLogSectors)
+    {
+        if (!Commit())
+            return false;
+        pos = 0;
+    }
 
-    // 4. 親ディレクトリにこのディレクトリのエントリを追加
-    // 属性 0x10 (Directory), サイズ 0
-    AddDirectoryEntry(name, new_cluster, 0, 0x10, parent_cluster);
+    // スロットはコミットでまとめて空くので、使用中なのは常に [0, meta_count_)
+    uint32_t slot = meta_count_;
+    for (uint32_t i = meta_count_; i > pos; --i)
+        meta_log_[i] = meta_log_[i - 1];
 
-    return new_cluster;
+    meta_log_[pos].lba = lba;
+    meta_log_[pos].slot = slot;
+    meta_count_++;
+    memcpy(meta_data_ + slot * 512, buffer, 512);
+    return true;
 }
 
-uint32_t FAT32Driver::EnsureDirectory(const char *path)
+bool FAT32Driver::Commit()
 {
-    uint32_t current_cluster = root_clus_;
-
-    const char *p = path;
-    if (*p == '/')
-        p++;
-
-    char segment[16];
+    // 1. ファイルデータ (と新しいディレクトリのクラスタ)
+    // 2. FAT1 (新しいクラスタを使用中にする。解放したクラスタはまだ使用中のまま)
+    // 3. ディレクトリエントリ (新しいクラスタを指す / 削除した)
+    // 4. FAT1 (解放したクラスタを空きにする)
+    // の順で書き、それぞれの後にデバイスへ反映する。途中で止まっても、
+    // 使われていないクラスタが使用中に見えるだけで、壊れたチェーンや
+    // 空きとされたクラスタを指すエントリは残らない
+    // (各段の書き込みはまとめてLBA順に流し、Sync が段の区切りになる)
+    BlockPlug plug(dev_);
+    bool ok = dev_->Sync();
+    ok = ok && FlushFat(true) && dev_->Sync();
+    for (uint32_t i = 0; ok && i < meta_count_; ++i)
+        ok = dev_->Write(meta_log_[i].lba, meta_data_ + meta_log_[i].slot * 512, 1);
+    ok = ok && dev_->Sync();
+    if (!ok)
+    {
+        kprintf("[FAT32] Error: Failed to commit metadata.\n");
+        return false;
+    }
+    meta_count_ = 0;
+    if (pending_free_count_ != 0 && !(FlushFat() && dev_->Sync()))
+    {
+        kprintf("[FAT32] Error: Failed to commit freed clusters.\n");
+        return false;
+    }
 
-    while (*p)
+    // 5. 解放したクラスタを空きに戻し、FSInfo を更新する
+    // (どこからも指されなくなったので、再利用する前にデバイスへ不要だと伝える)
+    if (pending_free_count_ != 0)
     {
-        int i = 0;
-        while (*p && *p != '/' && i < 15)
+        DiscardFreedClusters();
+        uint32_t words = (cluster_limit_ + 63) / 64;
+        for (uint32_t w = 0; w < words; ++w)
         {
-            segment[i++] = *p++;
+            uint64_t bits = pending_free_[w];
+            if (bits == 0)
+                continue;
+            free_map_[w] |= bits;
+            free_count_ += __builtin_popcountll(bits);
+            pending_free_[w] = 0;
+
+            uint32_t first = w * 64 + __builtin_ctzll(bits);
+            if (first < next_free_)
+                next_free_ = first;
         }
-        segment[i] = '\0';
-        if (*p == '/')
-            p++;
+        pending_free_count_ = 0;
+        fs_info_dirty_ = true;
+    }
+    return FlushFsInfo() && dev_->Sync();
+}
 
-        if (i == 0)
-            break;
+void FAT32Driver::DiscardFreedClusters()
+{
+    BlockRange ranges[kDiscardRanges];
+    uint32_t count = 0;
+    bool ok = true;
 
-        DirectoryEntry entry;
+    uint32_t words = (cluster_limit_ + 63) / 64;
+    for (uint32_t w = 0; w < words; ++w)
+    {
+        uint64_t bits = pending_free_[w];
+        // ワード内の連続したビットごとに、クラスタの範囲を取り出す
+        while (bits != 0)
+        {
+            uint32_t start = __builtin_ctzll(bits);
+            uint64_t rest = bits >> start;
+            uint32_t len = (~rest == 0) ? 64 - start : __builtin_ctzll(~rest);
+            bits = (start + len >= 64) ? 0 : bits & (~0ULL << (start + len));
+
+            uint64_t lba = ClusterToLBA(w * 64 + start);
+            uint32_t blocks = len * sec_per_clus_;
+            // 直前の範囲に続くなら伸ばす (ワードをまたぐ連続した解放)
+            if (count > 0 && ranges[count - 1].lba + ranges[count - 1].count == lba &&
+                ranges[count - 1].count <= 0xFFFFFFFF - blocks)
+            {
+                ranges[count - 1].count += blocks;
+                continue;
+            }
+            if (count == kDiscardRanges)
+            {
+                ok &= dev_->Discard(ranges, count);
+                count = 0;
+            }
+            ranges[count].lba = lba;
+            ranges[count].count = blocks;
+            count++;
+        }
+    }
+    if (count > 0)
+        ok &= dev_->Discard(ranges, count);
+
+    // 失敗しても空き領域の内容が残るだけなので、コミットは失敗にしない
+    if (!ok)
+        kprintf("[FAT32] Warning: Failed to discard freed clusters.\n");
+}
+
+bool FAT32Driver::Sync()
+{
+    if (!fat_chunks_)
+        return dev_->Sync();
+
+    bool ok = Commit();
+    // FAT2 以降は FAT1 のバックアップなので、ある程度溜まるまで書かない
+    if (ok && mirror_lag_ >= kMirrorLagSectors)
+        ok = MirrorFat();
+    return ok;
+}
+
+void FAT32Driver::FreeChain(uint32_t start_cluster)
+{
+    // クラスタ番号が有効範囲にある限りループ
+    uint32_t current = start_cluster;
+    while (current >= 2 && current < 0x0FFFFFF8)
+    {
+        // 次のクラスタを覚えておく
+        uint32_t next = GetNextCluster(current);
+
+        // 現在のクラスタを「空き(0)」にする
+        // LinkCluster(current, 0)
+        // は「currentの位置に0を書く」ので解放と同じ意味
+        LinkCluster(current, 0);
+
+        // 次へ進む
+        current = next;
+    }
+}
+
+void FAT32Driver::OpenDirectory(uint32_t dir_cluster, DirCursor *cursor)
+{
+    cursor->cluster = (dir_cluster == 0) ? root_clus_ : dir_cluster;
+    cursor->last = cursor->cluster;
+    cursor->sector = 0;
+    cursor->index = 0;
+    cursor->steps = 0;
+    cursor->loaded = false;
+}
+
+DirectoryEntry *FAT32Driver::NextSlot(DirCursor *cursor, uint64_t *lba,
+                                      uint32_t *index)
+{
+    if (cursor->cluster == 0)
+        return nullptr;
+
+    if (cursor->index == 16)
+    {
+        cursor->index = 0;
+        cursor->loaded = false;
+        if (++cursor->sector == sec_per_clus_)
+        {
+            // 次のクラスタへ (ディレクトリが複数クラスタにまたがる場合)
+            if (++cursor->steps > 10000)
+            {
+                kprintf("[FAT32] Error: Directory cluster chain too long or "
+                        "loop detected.\n");
+                cursor->index = 16;
+                return nullptr;
+            }
+            uint32_t next = GetNextCluster(cursor->cluster);
+            cursor->sector = 0;
+            cursor->last = cursor->cluster;
+            cursor->cluster = (next >= 2 && next < 0x0FFFFFF8) ? next : 0;
+            if (cursor->cluster == 0)
+                return nullptr;
+        }
+    }
+
+    uint64_t sector_lba = ClusterToLBA(cursor->cluster) + cursor->sector;
+    if (!cursor->loaded)
+    {
+        if (!ReadDirSectors(sector_lba, cursor->buf, 1))
+        {
+            kprintf("[FAT32] Disk Read Error at LBA %lld\n", sector_lba);
+            return nullptr;
+        }
+        cursor->loaded = true;
+    }
+
+    *lba = sector_lba;
+    *index = cursor->index;
+    return reinterpret_cast<DirectoryEntry *>(cursor->buf) + cursor->index++;
+}
+
+bool FAT32Driver::NextRecord(DirCursor *cursor, DirRecord *record,
+                             const NameKey *key, bool want_name)
+{
+    // 読んでいる LFN の並びの状態
+    uint32_t next_ord = 0;    // 次に来るべき断片の番号 (0 なら並びの外)
+    bool complete = false;    // 断片1まで揃い、短い名前のエントリを待っている
+    bool matched = false;     // ここまでの断片が key と一致している
+    uint8_t checksum = 0;
+    uint32_t name_len = 0;
+    record->lfn_count = 0;
+
+    uint64_t lba;
+    uint32_t index;
+    DirectoryEntry *entry;
+    while ((entry = NextSlot(cursor, &lba, &index)) != nullptr)
+    {
+        uint8_t first = static_cast<uint8_t>(entry->name[0]);
+        // 0x00: これ以降エントリなし
+        if (first == 0x00)
+        {
+            cursor->cluster = 0;
+            return false;
+        }
+        // 0xE5: 削除済み
+        if (first == 0xE5)
+        {
+            next_ord = 0;
+            complete = false;
+            continue;
+        }
+
+        if (entry->attr == 0x0F)
+        {
+            const LongNameEntry *lfn =
+                reinterpret_cast<const LongNameEntry *>(entry);
+            uint32_t ord = lfn->ord & 0x1F;
+            if (lfn->ord & 0x40)
+            {
+                // 並びの先頭 (名前の最後の断片)
+                // 断片の数が違えば、名前を比べるまでもなく一致しない
+                if (ord == 0 || ord > kMaxLongNameEntries)
+                {
+                    next_ord = 0;
+                    complete = false;
+                    continue;
+                }
+                checksum = lfn->chksum;
+                matched = !key || key->lfn_entries == ord;
+                name_len = ord * kLongNameChars;
+                if (name_len > kMaxNameLength)
+                    name_len = kMaxNameLength;
+                record->lfn_count = 0;
+            }
+            else if (ord == 0 || ord != next_ord || lfn->chksum != checksum)
+            {
+                // 途中が欠けた並びは無視する
+                next_ord = 0;
+                complete = false;
+                continue;
+            }
+
+            record->lfn_lba[record->lfn_count] = lba;
+            record->lfn_index[record->lfn_count] = index;
+            record->lfn_count++;
+            if (key && matched)
+                matched = MatchLongNameEntry(*lfn, *key);
+            if (want_name)
+                DecodeLongNameEntry(*lfn, record->name, &name_len);
+            next_ord = ord - 1;
+            complete = (ord == 1);
+            continue;
+        }
+
+        // 短い名前のエントリ (直前の LFN はチェックサムが合うときだけこのファイルのもの)
+        bool has_lfn = complete && ShortNameChecksum(entry->name) == checksum;
+        next_ord = 0;
+        complete = false;
+        if (entry->attr & 0x08)
+            continue; // ボリュームラベル
+
+        if (key && !(has_lfn && matched) &&
+            !(key->has_short && memcmp(entry->name, key->name83, 11) == 0))
+            continue;
+
+        record->entry = *entry;
+        record->lba = lba;
+        record->index = index;
+        if (!has_lfn)
+            record->lfn_count = 0;
+        if (want_name)
+        {
+            if (has_lfn)
+                record->name[name_len] = '\0';
+            else
+                FormatName(*entry, record->name);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool FAT32Driver::FindRecord(const NameKey &key, uint32_t dir_cluster,
+                             DirRecord *record)
+{
+    DirCursor cursor;
+    OpenDirectory(dir_cluster, &cursor);
+    return NextRecord(&cursor, record, &key, false);
+}
+
+bool FAT32Driver::MakeShortAlias(const char *name, uint32_t dir_cluster,
+                                 char *name83)
+{
+    // 候補は "MYDOCU~1" から "MYDOCU~9" と、名前のハッシュを混ぜた
+    // "MY3F2A~1" から "MY3F2A~9"。ディレクトリを1回だけ走査し、
+    // 使われている番号を調べてから選ぶ
+    static const char kHex[] = "0123456789ABCDEF";
+    char bases[2][11];
+    int tails[2];
+    MakeShortBasis(name, bases[0]);
+    int basis_len = 0;
+    while (basis_len < 8 && bases[0][basis_len] != ' ')
+        basis_len++;
+
+    memcpy(bases[1], bases[0], 11);
+    uint16_t hash = NameHash(name);
+    int hash_at = (basis_len < 2) ? basis_len : 2;
+    for (int i = 0; i < 4; ++i)
+        bases[1][hash_at + i] = kHex[(hash >> (12 - i * 4)) & 0xF];
+
+    tails[0] = (basis_len < 6) ? basis_len : 6;
+    tails[1] = hash_at + 4;
+    for (int r = 0; r < 2; ++r)
+    {
+        memset(bases[r] + tails[r], ' ', 8 - tails[r]);
+        bases[r][tails[r]] = '~';
+    }
+
+    uint32_t used[2] = {0, 0}; // ビット n: "~n" が使われている
+    DirCursor cursor;
+    OpenDirectory(dir_cluster, &cursor);
+    uint64_t lba;
+    uint32_t index;
+    DirectoryEntry *entry;
+    while ((entry = NextSlot(&cursor, &lba, &index)) != nullptr)
+    {
+        if (entry->name[0] == 0x00)
+        {
+            cursor.cluster = 0;
+            break;
+        }
+        if (entry->attr == 0x0F || static_cast<uint8_t>(entry->name[0]) == 0xE5)
+            continue;
+
+        for (int r = 0; r < 2; ++r)
+        {
+            int t = tails[r];
+            char digit = entry->name[t + 1];
+            if (digit >= '1' && digit <= '9' &&
+                memcmp(entry->name, bases[r], t + 1) == 0 &&
+                memcmp(entry->name + t + 2, bases[r] + t + 2, 11 - t - 2) == 0)
+                used[r] |= 1U << (digit - '0');
+        }
+    }
+    if (cursor.cluster != 0)
+        return false; // 読み込みエラー
+
+    for (int r = 0; r < 2; ++r)
+    {
+        for (int n = 1; n <= 9; ++n)
+        {
+            if (used[r] & (1U << n))
+                continue;
+            memcpy(name83, bases[r], 11);
+            name83[tails[r] + 1] = '0' + n;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t FAT32Driver::ExtendDirectory(uint32_t last)
+{
+    uint32_t cluster = AllocateCluster();
+    if (cluster == 0)
+        return 0;
+    // 以前ディレクトリとして使われていたクラスタなら、古いキャッシュが残っている
+    dcache_.InvalidateDirectory(cluster);
+
+    uint32_t cluster_bytes = sec_per_clus_ * 512;
+    uint8_t *buf = AllocateIoBuffer(cluster_bytes);
+    bool ok = buf != nullptr;
+    if (ok)
+    {
+        memset(buf, 0, cluster_bytes);
+        ok = dev_->Write(ClusterToLBA(cluster), buf, sec_per_clus_);
+        MemoryManager::Free(buf, cluster_bytes);
+    }
+    if (!ok)
+    {
+        LinkCluster(cluster, 0);
+        return 0;
+    }
+
+    LinkCluster(last, cluster);
+    return cluster;
+}
+
+bool FAT32Driver::FindFreeSlots(uint32_t dir_cluster, uint32_t count,
+                                uint64_t *lbas, uint32_t *indexes)
+{
+    DirCursor cursor;
+    OpenDirectory(dir_cluster, &cursor);
+
+    uint32_t run = 0;
+    while (run < count)
+    {
+        uint64_t lba;
+        uint32_t index;
+        DirectoryEntry *entry = NextSlot(&cursor, &lba, &index);
+        if (!entry)
+        {
+            if (cursor.cluster != 0)
+                return false; // 読み込みエラー
+
+            // 最後まで空きが足りなければ、クラスタを足して続きから探す
+            uint32_t added = ExtendDirectory(cursor.last);
+            if (added == 0)
+                return false;
+            cursor.cluster = added;
+            cursor.sector = 0;
+            cursor.index = 0;
+            cursor.loaded = false;
+            continue;
+        }
+
+        uint8_t first = static_cast<uint8_t>(entry->name[0]);
+        if (first == 0x00 || first == 0xE5)
+        {
+            lbas[run] = lba;
+            indexes[run] = index;
+            run++;
+        }
+        else
+        {
+            run = 0;
+        }
+    }
+    return true;
+}
+
+bool FAT32Driver::WriteSlots(const DirectoryEntry *entries,
+                             const uint64_t *lbas, const uint32_t *indexes,
+                             uint32_t count)
+{
+    // 同じセクタのエントリはまとめて書き換える
+    uint8_t buf[512];
+    uint32_t i = 0;
+    while (i < count)
+    {
+        uint64_t lba = lbas[i];
+        if (!ReadDirSectors(lba, buf, 1))
+            return false;
+        for (; i < count && lbas[i] == lba; ++i)
+            memcpy(buf + indexes[i] * 32, &entries[i], 32);
+        if (!WriteDirSector(lba, buf))
+            return false;
+    }
+    return true;
+}
+
+bool FAT32Driver::AddDirectoryEntry(const char *name, uint32_t start_cluster,
+                                    uint32_t size, uint8_t attr,
+                                    uint32_t parent_cluster)
+{
+    // 親ディレクトリの開始クラスタを決定 (0ならルート)
+    uint32_t target_cluster =
+        (parent_cluster == 0) ? root_clus_ : parent_cluster;
+
+    if (!IsValidLongName(name))
+    {
+        kprintf("[FAT32] Invalid file name: %s\n", name);
+        return false;
+    }
+
+    // 8.3形式で表せない名前は、LFN エントリを短い名前のエントリの前に並べる
+    DirectoryEntry entries[kMaxLongNameEntries + 1];
+    uint32_t lfn_count = 0;
+    char name83[11];
+    uint8_t nt_res;
+    bool mixed_case;
+    if (!ParseShortName(name, name83, &nt_res, &mixed_case) || mixed_case)
+    {
+        if (!MakeShortAlias(name, target_cluster, name83))
+        {
+            kprintf("[FAT32] No short name available for %s\n", name);
+            return false;
+        }
+        nt_res = 0;
+
+        uint32_t length = strlen(name);
+        lfn_count = (length + kLongNameChars - 1) / kLongNameChars;
+        uint8_t checksum = ShortNameChecksum(name83);
+        for (uint32_t i = 0; i < lfn_count; ++i)
+        {
+            EncodeLongNameEntry(name, length, lfn_count - i, lfn_count,
+                                checksum,
+                                reinterpret_cast<LongNameEntry *>(&entries[i]));
+        }
+    }
+
+    DirectoryEntry *entry = &entries[lfn_count];
+    memset(entry, 0, 32);
+    memcpy(entry->name, name83, 11);
+    entry->attr = attr; // ファイル:0x20, ディレクトリ:0x10
+    entry->nt_res = nt_res;
+    entry->fst_clus_hi = (start_cluster >> 16) & 0xFFFF;
+    entry->fst_clus_lo = start_cluster & 0xFFFF;
+    entry->file_size = size;
+
+    uint64_t lbas[kMaxLongNameEntries + 1];
+    uint32_t indexes[kMaxLongNameEntries + 1];
+    if (!FindFreeSlots(target_cluster, lfn_count + 1, lbas, indexes))
+    {
+        kprintf("[FAT32] Directory full!\n");
+        return false;
+    }
+    if (!WriteSlots(entries, lbas, indexes, lfn_count + 1))
+        return false;
+
+    // 同じファイルを長い名前・別名・大文字小文字違いのどれでも引けるので、
+    // 「存在しない」と覚えた名前を含めてこのディレクトリのキャッシュを捨てる
+    dcache_.InvalidateDirectory(target_cluster);
+    return true;
+}
+
+bool FAT32Driver::FindDirectoryEntry(const char *name, uint32_t parent_cluster,
+                                     DirectoryEntry *found_entry,
+                                     uint64_t *entry_lba, uint32_t *entry_index)
+{
+    uint32_t dir_cluster = (parent_cluster == 0) ? root_clus_ : parent_cluster;
+
+    // 名前は一度だけ整え、キャッシュのキーと走査中の比較に使う
+    NameKey key;
+    if (!MakeNameKey(name, &key))
+        return false;
+
+    DentryCache::Dentry dentry;
+    if (dcache_.Lookup(dir_cluster, key.upper, &dentry))
+    {
+        if (dentry.negative)
+            return false;
+        *found_entry = dentry.entry;
+        if (entry_lba)
+            *entry_lba = dentry.lba;
+        if (entry_index)
+            *entry_index = dentry.index;
+        return true;
+    }
+
+    DirCursor cursor;
+    OpenDirectory(dir_cluster, &cursor);
+    DirRecord record;
+    if (!NextRecord(&cursor, &record, &key, false))
+    {
+        // 読み込みエラーではなく最後まで探した場合だけ「ない」と覚える
+        if (cursor.cluster == 0)
+            dcache_.InsertNegative(dir_cluster, key.upper);
+        return false;
+    }
+
+    *found_entry = record.entry; // コピーして返す
+    dcache_.Insert(dir_cluster, key.upper, record.entry, record.lba,
+                   record.index);
+    if (entry_lba)
+        *entry_lba = record.lba;
+    if (entry_index)
+        *entry_index = record.index;
+    return true;
+}
+
+uint32_t FAT32Driver::CreateDirectory(const char *name, uint32_t parent_cluster)
+{
+    kprintf("[FAT32] Creating Directory: %s...\n", name);
+
+    // 1. ディレクトリ用のクラスタを確保
+    uint32_t new_cluster = AllocateCluster();
+    if (new_cluster == 0)
+        return 0;
+    // 以前ディレクトリとして使われていたクラスタなら、古いキャッシュが残っている
+    dcache_.InvalidateDirectory(new_cluster);
+
+    // 2. 確保したクラスタを0クリア (空のディレクトリにする)
+    uint64_t target_lba = ClusterToLBA(new_cluster);
+    uint32_t cluster_bytes = sec_per_clus_ * 512;
+    uint8_t *buf =
+        static_cast<uint8_t *>(MemoryManager::Allocate(cluster_bytes, 4096, MemoryOwner::kFileSystem));
+    memset(buf, 0, cluster_bytes);
+
+    DirectoryEntry *dot_entries = reinterpret_cast<DirectoryEntry *>(buf);
+
+    // Entry 0: "." (自分自身)
+    memset(&dot_entries[0], 0, 32);
+    memcpy(dot_entries[0].name, ".          ", 11); // "." + 10 spaces
+    dot_entries[0].attr = 0x10;                     // Directory
+    dot_entries[0].fst_clus_hi = (new_cluster >> 16) & 0xFFFF;
+    dot_entries[0].fst_clus_lo = new_cluster & 0xFFFF;
+
+    // Entry 1: ".." (親ディレクトリ)
+    memset(&dot_entries[1], 0, 32);
+    memcpy(dot_entries[1].name, "..         ", 11); // ".." + 9 spaces
+    dot_entries[1].attr = 0x10;                     // Directory
+    // 親がルートの場合はクラスタ0を指定 (FAT32の仕様)
+    uint32_t parent_ref =
+        (parent_cluster == 0 || parent_cluster == root_clus_) ? 0
+                                                              : parent_cluster;
+    dot_entries[1].fst_clus_hi = (parent_ref >> 16) & 0xFFFF;
+    dot_entries[1].fst_clus_lo = parent_ref & 0xFFFF;
+
+    dev_->Write(target_lba, buf, sec_per_clus_);
+    MemoryManager::Free(buf, cluster_bytes);
+
+    // 3. FATチェーン終端
+    LinkCluster(new_cluster, 0x0FFFFFFF);
+
+    // 4. 親ディレクトリにこのディレクトリのエントリを追加
+    // 属性 0x10 (Directory), サイズ 0
+    if (!AddDirectoryEntry(name, new_cluster, 0, 0x10, parent_cluster))
+    {
+        FreeChain(new_cluster);
+        return 0;
+    }
+
+    return new_cluster;
+}
+
+uint32_t FAT32Driver::EnsureDirectory(const char *path)
+{
+    uint32_t current_cluster = root_clus_;
+
+    const char *p = path;
+    if (*p == '/')
+        p++;
+
+    char segment[kMaxNameLength + 1];
+
+    while (*p)
+    {
+        uint32_t i = 0;
+        while (*p && *p != '/' && i < kMaxNameLength)
+        {
+            segment[i++] = *p++;
+        }
+        segment[i] = '\0';
+        if (*p == '/')
+            p++;
+
+        if (i == 0)
+            break;
+
+        DirectoryEntry entry;
         if (FindDirectoryEntry(segment, current_cluster, &entry))
         {
             if (entry.attr & 0x10)
@@ -423,297 +1307,710 @@ uint32_t FAT32Driver::EnsureDirectory(const char *path)
         }
         else
         {
-            char name83[11];
-            To83Format(segment, name83);
-
-            uint32_t new_cluster = CreateDirectory(name83, current_cluster);
+            uint32_t new_cluster = CreateDirectory(segment, current_cluster);
             if (new_cluster == 0)
                 return 0;
 
-            current_cluster = new_cluster;
-        }
+            current_cluster = new_cluster;
+        }
+    }
+
+    return current_cluster;
+}
+
+void FAT32Driver::ListDirectory(uint32_t cluster)
+{
+    kprintf("Type     Size       Name\n");
+    kprintf("----     ----       ----\n");
+
+    DirCursor cursor;
+    OpenDirectory(cluster, &cursor);
+    DirRecord record;
+    while (NextRecord(&cursor, &record, nullptr, true))
+    {
+        const DirectoryEntry &entry = record.entry;
+        if (entry.attr & 0x10)
+            kprintf("DIR      ");
+        else
+            kprintf("FILE     ");
+
+        // サイズ表示 (簡易整列)
+        // ※sprintfがないので簡易表示
+        kprintf("%d ", entry.file_size);
+
+        // 位置合わせのためのスペース
+        if (entry.file_size < 1000000)
+            kprintf(" ");
+        if (entry.file_size < 1000)
+            kprintf("   ");
+
+        kprintf("%s\n", record.name);
+    }
+}
+
+uint32_t FAT32Driver::GetDirectoryCluster(const char *path,
+                                          uint32_t base_cluster)
+{
+    DirectoryEntry entry;
+    if (strcmp(path, "/") == 0)
+        return root_clus_;
+    if (path[0] == 0 || strcmp(path, ".") == 0)
+        return base_cluster == 0 ? root_clus_ : base_cluster;
+
+    if (GetFileEntry(path, &entry, base_cluster))
+    {
+        if (entry.attr & 0x10)
+        {
+            uint32_t clus = (entry.fst_clus_hi << 16) | entry.fst_clus_lo;
+            return (clus == 0) ? root_clus_ : clus;
+        }
+    }
+    return 0xFFFFFFFF;
+}
+
+bool FAT32Driver::GetFileEntry(const char *path, DirectoryEntry *ret_entry,
+                               uint32_t base_cluster)
+{
+    uint32_t current_cluster = base_cluster;
+    const char *p = path;
+
+    if (*p == '/')
+    {
+        current_cluster = root_clus_;
+        p++;
+    }
+    else if (current_cluster == 0)
+    {
+        current_cluster = root_clus_;
+    }
+
+    char name_buf[kMaxNameLength + 1];
+
+    while (*p)
+    {
+        uint32_t i = 0;
+        while (*p && *p != '/' && i < kMaxNameLength)
+        {
+            name_buf[i++] = *p++;
+        }
+        name_buf[i] = 0;
+
+        DirectoryEntry entry;
+        if (!FindDirectoryEntry(name_buf, current_cluster, &entry))
+        {
+            return false;
+        }
+
+        if (*p == 0)
+        {
+            *ret_entry = entry;
+            return true;
+        }
+
+        if (!(entry.attr & 0x10))
+        {
+            return false;
+        }
+        current_cluster = (entry.fst_clus_hi << 16) | entry.fst_clus_lo;
+        if (current_cluster == 0)
+            current_cluster = root_clus_;
+
+        if (*p == '/')
+            p++;
+    }
+    return false;
+}
+
+uint32_t FAT32Driver::GetFileSize(const char *path)
+{
+    DirectoryEntry entry;
+    if (GetFileEntry(path, &entry))
+    {
+        return entry.file_size;
+    }
+    return 0;
+}
+
+bool FAT32Driver::DeleteFile(const char *name, uint32_t parent_cluster)
+{
+    kprintf("[FAT32] Deleting file: %s...\n", name);
+
+    uint32_t dir_cluster = (parent_cluster == 0) ? root_clus_ : parent_cluster;
+    NameKey key;
+    DirRecord record;
+    if (!MakeNameKey(name, &key) || !FindRecord(key, dir_cluster, &record))
+    {
+        kprintf("[FAT32] File not found.\n");
+        return false;
+    }
+
+    uint32_t fst_clus =
+        (record.entry.fst_clus_hi << 16) | record.entry.fst_clus_lo;
+    bool is_dir = (record.entry.attr & 0x10) != 0;
+
+    // 1. LFN エントリと短い名前のエントリを「削除済み(0xE5)」にマークする
+    // (クラスタより先に外しておけば、コミットの途中で止まっても
+    //  エントリが解放済みのクラスタを指すことはない)
+    uint64_t lbas[kMaxLongNameEntries + 1];
+    uint32_t indexes[kMaxLongNameEntries + 1];
+    uint32_t count = record.lfn_count;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        lbas[i] = record.lfn_lba[i];
+        indexes[i] = record.lfn_index[i];
+    }
+    lbas[count] = record.lba;
+    indexes[count] = record.index;
+    count++;
+
+    // 同じセクタのエントリはまとめて書き換える
+    uint8_t buf[512];
+    for (uint32_t i = 0; i < count;)
+    {
+        uint64_t lba = lbas[i];
+        if (!ReadDirSectors(lba, buf, 1))
+            return false;
+        for (; i < count && lbas[i] == lba; ++i)
+            buf[indexes[i] * 32] = 0xE5;
+        if (!WriteDirSector(lba, buf))
+            return false;
+    }
+    // このファイルを指すキャッシュは、どの名前で引いたものか分からない
+    dcache_.InvalidateLocation(record.lba, record.index);
+
+    // 2. ファイルの実体(クラスタ)を解放する
+    if (fst_clus != 0)
+    {
+        FreeChain(fst_clus);
+        if (is_dir)
+            dcache_.InvalidateDirectory(fst_clus);
+    }
+
+    kprintf("[FAT32] File deleted.\n");
+    return true;
+}
+
+uint32_t FAT32Driver::ReadFile(const char *name, void *buffer,
+                               uint32_t buffer_size, uint32_t base_cluster)
+{
+    return ReadFileImpl(name, buffer, buffer_size, base_cluster, false);
+}
+
+uint32_t FAT32Driver::ReadFileDirect(const char *name, void *buffer,
+                                     uint32_t buffer_size,
+                                     uint32_t base_cluster)
+{
+    return ReadFileImpl(name, buffer, buffer_size, base_cluster, true);
+}
+
+bool FAT32Driver::ReadSectorsDirect(uint64_t lba, uint8_t *buffer,
+                                    uint32_t count)
+{
+    // 境界の制約がなければ1回で読む (count は io_clusters_ 分以下)
+    uint32_t boundary = dev_->GetDmaBoundary();
+    if (boundary == 0)
+        return dev_->Read(lba, buffer, count);
+
+    // 転送ごとにバッファが境界をまたがないよう分割する
+    while (count > 0)
+    {
+        uintptr_t addr = reinterpret_cast<uintptr_t>(buffer);
+        uint32_t chunk = (boundary - (addr & (boundary - 1))) / 512;
+        if (chunk > count)
+            chunk = count;
+        if (!dev_->Read(lba, buffer, chunk))
+            return false;
+        lba += chunk;
+        buffer += chunk * 512;
+        count -= chunk;
+    }
+    return true;
+}
+
+uint32_t FAT32Driver::ReadFileImpl(const char *name, void *buffer,
+                                   uint32_t buffer_size, uint32_t base_cluster,
+                                   bool direct)
+{
+    DirectoryEntry entry;
+    if (!GetFileEntry(name, &entry, base_cluster))
+        return 0;
+
+    if (entry.file_size > buffer_size)
+    {
+        kprintf("[FAT32] Error: Buffer too small (%d < %d)\n", buffer_size,
+                entry.file_size);
+        return 0;
+    }
+
+    uint32_t current_cluster = (entry.fst_clus_hi << 16) | entry.fst_clus_lo;
+    uint32_t bytes_remaining = entry.file_size;
+    uint32_t offset = 0;
+    uint8_t *out_ptr = static_cast<uint8_t *>(buffer);
+    uint32_t cluster_bytes = sec_per_clus_ * 512;
+    uint32_t total_clusters = (bytes_remaining + cluster_bytes - 1) / cluster_bytes;
+    uint32_t buf_clusters =
+        (total_clusters < io_clusters_) ? total_clusters : io_clusters_;
+    if (buf_clusters == 0)
+        return 0;
+
+    // 直接読めるのは、DMAのアライン要件 (NVMe: 4バイト) を満たすときだけ
+    // 境界の制約があるデバイス (USB) では、分割がセクタ単位になるよう512バイトに揃っていること
+    uintptr_t align_mask = (dev_->GetDmaBoundary() != 0) ? 511 : 3;
+    if (reinterpret_cast<uintptr_t>(buffer) & align_mask)
+        direct = false;
+
+    // 作業用バッファ (DMA先はカーネルのストレートマップ領域である必要がある)
+    // 直接読む場合は、バッファに収まらない末尾のためだけに必要になったら確保する
+    uint8_t *temp_buf = nullptr;
+    uint32_t temp_size = direct ? 512 : buf_clusters * cluster_bytes;
+    bool ok = true;
+
+    while (ok && bytes_remaining > 0 && current_cluster >= 2 &&
+           current_cluster < 0x0FFFFFF8)
+    {
+        // 番号が連続しているクラスタは1回のコマンドでまとめて読む
+        uint32_t want = (bytes_remaining + cluster_bytes - 1) / cluster_bytes;
+        if (want > buf_clusters)
+            want = buf_clusters;
+        uint32_t next_cluster;
+        uint32_t run = GetExtent(current_cluster, want, &next_cluster);
+
+        uint32_t run_bytes = run * cluster_bytes;
+        uint32_t copy_len =
+            (bytes_remaining > run_bytes) ? run_bytes : bytes_remaining;
+        uint64_t lba = ClusterToLBA(current_cluster);
+        uint32_t sectors = (copy_len + 511) / 512;
+
+        if (direct && buffer_size - offset >= sectors * 512)
+        {
+            // 呼び出し元のバッファへ直接転送する
+            ok = ReadSectorsDirect(lba, out_ptr + offset, sectors);
+        }
+        else
+        {
+            // 末尾のセクタだけがバッファからはみ出す場合、それ以外は直接読む
+            uint32_t head_sectors = (direct && copy_len >= 512) ? copy_len / 512 : 0;
+            if (head_sectors != 0)
+                ok = ReadSectorsDirect(lba, out_ptr + offset, head_sectors);
+            if (ok && !temp_buf)
+                ok = (temp_buf = AllocateIoBuffer(temp_size)) != nullptr;
+            if (ok)
+                ok = dev_->Read(lba + head_sectors, temp_buf, sectors - head_sectors);
+            if (ok)
+                memcpy(out_ptr + offset + head_sectors * 512, temp_buf,
+                       copy_len - head_sectors * 512);
+        }
+
+        offset += copy_len;
+        bytes_remaining -= copy_len;
+        current_cluster = next_cluster;
+    }
+
+    if (temp_buf)
+        MemoryManager::Free(temp_buf, temp_size);
+    // 読めなかった部分や、チェーンが途中で切れている場合は中身を返さない
+    if (!ok || bytes_remaining > 0)
+    {
+        kprintf(" Failed.\n");
+        kprintf("[FAT32] Error: Could not read %s.\n", name);
+        return 0;
+    }
+    kprintf(" Done.\n");
+    return entry.file_size;
+}
+
+bool FAT32Driver::OpenFile(const char *path, FileHandle *handle, bool create,
+                           uint32_t base_cluster)
+{
+    // 親ディレクトリとファイル名に分ける
+    const char *name = path;
+    const char *last_slash = nullptr;
+    for (const char *p = path; *p; ++p)
+    {
+        if (*p == '/')
+            last_slash = p;
+    }
+
+    uint32_t parent_cluster = (base_cluster == 0) ? root_clus_ : base_cluster;
+    if (last_slash)
+    {
+        char dir_part[128];
+        size_t len = last_slash - path;
+        if (len >= sizeof(dir_part))
+            return false;
+        memcpy(dir_part, path, len);
+        dir_part[len] = '\0';
+        parent_cluster = (len == 0) ? root_clus_
+                                    : GetDirectoryCluster(dir_part, base_cluster);
+        if (parent_cluster == 0xFFFFFFFF)
+            return false;
+        name = last_slash + 1;
+    }
+    if (*name == '\0')
+        return false;
+
+    DirectoryEntry entry;
+    if (!LookupEntry(name, parent_cluster, handle, &entry))
+    {
+        if (!create)
+            return false;
+
+        if (!AddDirectoryEntry(name, 0, 0, 0x20, parent_cluster) ||
+            !LookupEntry(name, parent_cluster, handle, &entry))
+            return false;
     }
 
-    return current_cluster;
+    if (entry.attr & 0x10)
+        return false; // ディレクトリは開けない
+    return true;
 }
 
-void FAT32Driver::ListDirectory(uint32_t cluster)
+bool FAT32Driver::LookupEntry(const char *name, uint32_t dir_cluster,
+                              FileHandle *handle, DirectoryEntry *entry)
 {
-    uint32_t current_cluster = (cluster == 0) ? root_clus_ : cluster;
-    uint32_t cluster_bytes = sec_per_clus_ * 512;
-    uint8_t *buf =
-        static_cast<uint8_t *>(MemoryManager::Allocate(cluster_bytes, 4096));
+    if (!FindDirectoryEntry(name, dir_cluster, entry, &handle->entry_lba,
+                            &handle->entry_index))
+        return false;
 
-    kprintf("Type     Size       Name\n");
-    kprintf("----     ----       ----\n");
+    handle->first_cluster = (entry->fst_clus_hi << 16) | entry->fst_clus_lo;
+    handle->size = entry->file_size;
+    handle->cursor_index = 0;
+    handle->cursor_cluster = handle->first_cluster;
+    return true;
+}
+
+bool FAT32Driver::ReadDirectoryEntry(uint32_t dir_cluster, uint32_t index,
+                                     DirectoryEntry *entry, char *name,
+                                     DirPosition *pos)
+{
+    DirCursor cursor;
+    OpenDirectory(dir_cluster, &cursor);
+    DirRecord record;
+    uint32_t found = 0;
+
+    // 順に読んでいるなら、前回返したエントリの次のスロットから続ける
+    if (pos && pos->index != 0 && pos->index <= index)
+    {
+        cursor.cluster = pos->cluster;
+        cursor.last = pos->cluster;
+        cursor.sector = pos->sector;
+        cursor.index = pos->slot;
+        cursor.steps = pos->steps;
+        found = pos->index;
+    }
 
-    while (current_cluster < 0x0FFFFFF8)
+    while (NextRecord(&cursor, &record, nullptr, name != nullptr))
     {
-        dev_->Read(ClusterToLBA(current_cluster), buf, sec_per_clus_);
-        DirectoryEntry *entries = reinterpret_cast<DirectoryEntry *>(buf);
-        int num_entries = cluster_bytes / 32;
+        if (record.entry.name[0] == '.')
+            continue; // "." と ".."
 
-        for (int i = 0; i < num_entries; ++i)
+        if (found++ == index)
         {
-            if (entries[i].name[0] == 0x00)
-                break;
-            if ((unsigned char)entries[i].name[0] == 0xE5)
-                continue;
-            if (entries[i].attr == 0x0F)
-                continue; // LFNスキップ
-
-            // 名前を整形 ("KERNEL  ELF" -> "KERNEL.ELF")
-            char name_buf[13];
-            int idx = 0;
-            // Base
-            for (int k = 0; k < 8; ++k)
+            *entry = record.entry;
+            if (name)
+                memcpy(name, record.name, strlen(record.name) + 1);
+            if (pos)
             {
-                if (entries[i].name[k] != ' ')
-                    name_buf[idx++] = entries[i].name[k];
+                pos->index = index + 1;
+                pos->cluster = cursor.cluster;
+                pos->sector = cursor.sector;
+                pos->slot = cursor.index;
+                pos->steps = cursor.steps;
             }
-            // Ext (ディレクトリ以外なら)
-            if (!(entries[i].attr & 0x10) && entries[i].name[8] != ' ')
-            {
-                name_buf[idx++] = '.';
-                for (int k = 8; k < 11; ++k)
-                {
-                    if (entries[i].name[k] != ' ')
-                        name_buf[idx++] = entries[i].name[k];
-                }
-            }
-            name_buf[idx] = '\0';
-
-            if (entries[i].attr & 0x10)
-                kprintf("DIR      ");
-            else
-                kprintf("FILE     ");
-
-            // サイズ表示 (簡易整列)
-            char size_str[16];
-            // ※sprintfがないので簡易表示
-            kprintf("%d ", entries[i].file_size);
-
-            // 位置合わせのためのスペース
-            if (entries[i].file_size < 1000000)
-                kprintf(" ");
-            if (entries[i].file_size < 1000)
-                kprintf("   ");
-
-            kprintf("%s\n", name_buf);
+            return true;
         }
-        current_cluster = GetNextCluster(current_cluster);
     }
-    MemoryManager::Free(buf, cluster_bytes);
+    if (pos)
+        pos->index = 0;
+    return false;
 }
 
-uint32_t FAT32Driver::GetDirectoryCluster(const char *path,
-                                          uint32_t base_cluster)
+void FAT32Driver::FormatName(const DirectoryEntry &entry, char *out)
 {
-    DirectoryEntry entry;
-    if (strcmp(path, "/") == 0)
-        return root_clus_;
-    if (path[0] == 0 || strcmp(path, ".") == 0)
-        return base_cluster == 0 ? root_clus_ : base_cluster;
-
-    if (GetFileEntry(path, &entry, base_cluster))
+    // "KERNEL  ELF" -> "KERNEL.ELF"
+    // nt_res の 0x08 / 0x10 はベース名・拡張子が小文字であることを表す
+    char base_case = (entry.nt_res & 0x08) ? 32 : 0;
+    char ext_case = (entry.nt_res & 0x10) ? 32 : 0;
+    int idx = 0;
+    for (int k = 0; k < 8; ++k)
     {
-        if (entry.attr & 0x10)
+        char c = entry.name[k];
+        if (c != ' ')
+            out[idx++] = (c >= 'A' && c <= 'Z') ? c + base_case : c;
+    }
+    // 拡張子 (ディレクトリ以外なら)
+    if (!(entry.attr & 0x10) && entry.name[8] != ' ')
+    {
+        out[idx++] = '.';
+        for (int k = 8; k < 11; ++k)
         {
-            uint32_t clus = (entry.fst_clus_hi << 16) | entry.fst_clus_lo;
-            return (clus == 0) ? root_clus_ : clus;
+            char c = entry.name[k];
+            if (c != ' ')
+                out[idx++] = (c >= 'A' && c <= 'Z') ? c + ext_case : c;
         }
     }
-    return 0xFFFFFFFF;
+    out[idx] = '\0';
 }
 
-bool FAT32Driver::GetFileEntry(const char *path, DirectoryEntry *ret_entry,
-                               uint32_t base_cluster)
+uint32_t FAT32Driver::SeekCluster(FileHandle *handle, uint32_t index)
 {
-    uint32_t current_cluster = base_cluster;
-    const char *p = path;
-
-    if (*p == '/')
+    // カーソルより前なら先頭から辿り直す
+    if (handle->cursor_cluster < 2 || index < handle->cursor_index)
     {
-        current_cluster = root_clus_;
-        p++;
+        handle->cursor_index = 0;
+        handle->cursor_cluster = handle->first_cluster;
     }
-    else if (current_cluster == 0)
+
+    uint32_t cluster = handle->cursor_cluster;
+    uint32_t i = handle->cursor_index;
+    while (i < index)
     {
-        current_cluster = root_clus_;
+        if (cluster < 2 || cluster >= 0x0FFFFFF8)
+            return 0;
+        cluster = GetNextCluster(cluster);
+        i++;
     }
+    if (cluster < 2 || cluster >= 0x0FFFFFF8)
+        return 0;
 
-    char name_buf[16];
+    handle->cursor_index = i;
+    handle->cursor_cluster = cluster;
+    return cluster;
+}
 
-    while (*p)
+uint32_t FAT32Driver::ReadAt(FileHandle *handle, uint32_t offset, void *buffer,
+                             uint32_t len)
+{
+    if (offset >= handle->size || len == 0)
+        return 0;
+    if (len > handle->size - offset)
+        len = handle->size - offset;
+
+    uint32_t cluster_bytes = sec_per_clus_ * 512;
+    uint32_t span = (offset % cluster_bytes + len + cluster_bytes - 1) / cluster_bytes;
+    uint32_t buf_clusters = (span < io_clusters_) ? span : io_clusters_;
+    uint32_t buf_bytes = buf_clusters * cluster_bytes;
+    uint8_t *io_buf = AllocateIoBuffer(buf_bytes);
+    if (!io_buf)
+        return 0;
+
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    uint32_t done = 0;
+    while (done < len)
     {
-        int i = 0;
-        while (*p && *p != '/' && i < 15)
-        {
-            name_buf[i++] = *p++;
-        }
-        name_buf[i] = 0;
+        uint32_t pos = offset + done;
+        uint32_t index = pos / cluster_bytes;
+        uint32_t in_cluster = pos % cluster_bytes;
+        uint32_t cluster = SeekCluster(handle, index);
+        if (cluster == 0)
+            break;
 
-        DirectoryEntry entry;
-        if (!FindDirectoryEntry(name_buf, current_cluster, &entry))
-        {
-            return false;
-        }
+        // 番号が連続しているクラスタは1回のコマンドでまとめて読む
+        uint32_t want = (in_cluster + len - done + cluster_bytes - 1) / cluster_bytes;
+        if (want > buf_clusters)
+            want = buf_clusters;
+        uint32_t next_cluster;
+        uint32_t run = GetExtent(cluster, want, &next_cluster);
+
+        uint32_t bytes = run * cluster_bytes - in_cluster;
+        if (bytes > len - done)
+            bytes = len - done;
+
+        // 必要なセクタだけを読む
+        uint32_t first_sector = in_cluster / 512;
+        uint32_t end_sector = (in_cluster + bytes + 511) / 512;
+        if (!dev_->Read(ClusterToLBA(cluster) + first_sector, io_buf,
+                        end_sector - first_sector))
+            break;
+        memcpy(out + done, io_buf + in_cluster % 512, bytes);
+        done += bytes;
 
-        if (*p == 0)
+        handle->cursor_index = index + run - 1;
+        handle->cursor_cluster = cluster + run - 1;
+    }
+
+    MemoryManager::Free(io_buf, buf_bytes);
+    return done;
+}
+
+bool FAT32Driver::ExtendFile(FileHandle *handle, uint32_t clusters)
+{
+    uint32_t count = 0;
+    uint32_t last = 0;
+    if (handle->first_cluster != 0)
+    {
+        // カーソルから末尾まで辿る
+        if (handle->cursor_cluster < 2)
         {
-            *ret_entry = entry;
-            return true;
+            handle->cursor_index = 0;
+            handle->cursor_cluster = handle->first_cluster;
         }
-
-        if (!(entry.attr & 0x10))
+        last = handle->cursor_cluster;
+        count = handle->cursor_index + 1;
+        while (true)
         {
-            return false;
+            uint32_t next = GetNextCluster(last);
+            if (next < 2 || next >= 0x0FFFFFF8)
+                break;
+            last = next;
+            count++;
         }
-        current_cluster = (entry.fst_clus_hi << 16) | entry.fst_clus_lo;
-        if (current_cluster == 0)
-            current_cluster = root_clus_;
-
-        if (*p == '/')
-            p++;
+        handle->cursor_index = count - 1;
+        handle->cursor_cluster = last;
     }
-    return false;
-}
 
-uint32_t FAT32Driver::GetFileSize(const char *path)
-{
-    DirectoryEntry entry;
-    if (GetFileEntry(path, &entry))
+    while (count < clusters)
     {
-        return entry.file_size;
+        uint32_t got;
+        uint32_t run = AllocateClusterRun(clusters - count, &got);
+        if (run == 0)
+            return false; // 確保できた分はチェーンに残す
+
+        if (last != 0)
+            LinkCluster(last, run);
+        else
+            handle->first_cluster = run;
+        last = run + got - 1;
+        count += got;
+        handle->cursor_index = count - 1;
+        handle->cursor_cluster = last;
     }
-    return 0;
+    return true;
 }
 
-bool FAT32Driver::DeleteFile(const char *name, uint32_t parent_cluster)
+uint32_t FAT32Driver::WriteRange(FileHandle *handle, uint32_t offset,
+                                 const uint8_t *data, uint32_t len)
 {
-    kprintf("[FAT32] Deleting file: %s...\n", name);
-
-    uint32_t current_cluster =
-        (parent_cluster == 0) ? root_clus_ : parent_cluster;
-    uint8_t *buf = static_cast<uint8_t *>(
-        MemoryManager::Allocate(sec_per_clus_ * 512, 4096));
+    uint32_t cluster_bytes = sec_per_clus_ * 512;
+    uint32_t span = (offset % cluster_bytes + len + cluster_bytes - 1) / cluster_bytes;
+    uint32_t buf_clusters = (span < io_clusters_) ? span : io_clusters_;
+    uint32_t buf_bytes = buf_clusters * cluster_bytes;
+    uint8_t *io_buf = AllocateIoBuffer(buf_bytes);
+    if (!io_buf)
+        return 0;
 
-    // ディレクトリ内を検索
-    while (current_cluster < 0x0FFFFFF8)
+    uint32_t done = 0;
+    while (done < len)
     {
-        uint64_t lba = ClusterToLBA(current_cluster);
-
-        // 1クラスタ分読み込み
-        dev_->Read(lba, buf, sec_per_clus_);
-
-        DirectoryEntry *entries = reinterpret_cast<DirectoryEntry *>(buf);
-        int num_entries = (sec_per_clus_ * 512) / 32;
-        bool found = false;
-        int found_index = -1;
-
-        for (int i = 0; i < num_entries; ++i)
-        {
-            if (entries[i].name[0] == 0x00)
-                break; // これ以上なし
-            if ((unsigned char)entries[i].name[0] == 0xE5)
-                continue; // 既に削除済み
-            if (entries[i].attr == 0x0F)
-                continue; // LFN
-
-            if (IsNameEqual(entries[i].name, name))
-            {
-                found = true;
-                found_index = i;
-                break;
-            }
-        }
-
-        if (found)
-        {
-            // 1. ファイルの実体(クラスタ)を解放する
-            uint32_t fst_clus = (entries[found_index].fst_clus_hi << 16) |
-                                entries[found_index].fst_clus_lo;
-            if (fst_clus != 0)
-            {
-                FreeChain(fst_clus);
-            }
-
-            // 2. ディレクトリエントリを「削除済み(0xE5)」にマークする
-            entries[found_index].name[0] = 0xE5;
+        uint32_t pos = offset + done;
+        uint32_t index = pos / cluster_bytes;
+        uint32_t in_cluster = pos % cluster_bytes;
+        uint32_t cluster = SeekCluster(handle, index);
+        if (cluster == 0)
+            break;
 
-            // 3. ディスクに書き戻す
+        uint32_t want = (in_cluster + len - done + cluster_bytes - 1) / cluster_bytes;
+        if (want > buf_clusters)
+            want = buf_clusters;
+        uint32_t next_cluster;
+        uint32_t run = GetExtent(cluster, want, &next_cluster);
 
-            // found_index はバッファ全体の何番目か。
-            // 1セクタ=16エントリ(512/32)。
-            // 該当するセクタのオフセットを計算。
-            uint32_t sector_offset = found_index / 16;
+        uint32_t bytes = run * cluster_bytes - in_cluster;
+        if (bytes > len - done)
+            bytes = len - done;
 
-            // バッファ内の該当セクタの先頭ポインタ
-            uint8_t *sector_ptr = buf + (sector_offset * 512);
+        uint64_t lba = ClusterToLBA(cluster) + in_cluster / 512;
+        uint32_t head = in_cluster % 512;
+        uint32_t sectors = (head + bytes + 511) / 512;
 
-            // 書き込み (LBA + セクタオフセット)
-            dev_->Write(lba + sector_offset, sector_ptr, 1);
+        // セクタの一部だけを書き換える場合は、先に既存の内容を読んでおく
+        if (head != 0 && !dev_->Read(lba, io_buf, 1))
+            break;
+        if ((head + bytes) % 512 != 0 &&
+            !dev_->Read(lba + sectors - 1, io_buf + (sectors - 1) * 512, 1))
+            break;
 
-            kprintf("[FAT32] File deleted.\n");
-            MemoryManager::Free(buf, sec_per_clus_ * 512);
-            return true;
-        }
+        if (data)
+            memcpy(io_buf + head, data + done, bytes);
+        else
+            memset(io_buf + head, 0, bytes);
+        if (!dev_->Write(lba, io_buf, sectors))
+            break;
+        done += bytes;
 
-        // 次のクラスタへ
-        current_cluster = GetNextCluster(current_cluster);
+        handle->cursor_index = index + run - 1;
+        handle->cursor_cluster = cluster + run - 1;
     }
 
-    MemoryManager::Free(buf, sec_per_clus_ * 512);
-    kprintf("[FAT32] File not found.\n");
-    return false;
+    MemoryManager::Free(io_buf, buf_bytes);
+    return done;
 }
 
-uint32_t FAT32Driver::ReadFile(const char *name, void *buffer,
-                               uint32_t buffer_size, uint32_t base_cluster)
+uint32_t FAT32Driver::WriteAt(FileHandle *handle, uint32_t offset,
+                              const void *data, uint32_t len)
 {
-    DirectoryEntry entry;
-    if (!GetFileEntry(name, &entry, base_cluster))
+    if (len == 0)
         return 0;
+    // FAT32のファイルサイズは32ビットまで
+    if (offset > 0xFFFFFFFF - len)
+        len = 0xFFFFFFFF - offset;
 
-    if (entry.file_size > buffer_size)
+    uint32_t cluster_bytes = sec_per_clus_ * 512;
+    uint32_t end = offset + len;
+    if (!ExtendFile(handle, (end + cluster_bytes - 1) / cluster_bytes))
     {
-        kprintf("[FAT32] Error: Buffer too small (%d < %d)\n", buffer_size,
-                entry.file_size);
-        return 0;
+        kprintf("[FAT32] Error: Disk Full!\n");
+        // 確保できたクラスタの範囲までは書く (カーソルはチェーン末尾にある)
+        uint32_t cluster_count = (handle->first_cluster != 0)
+                                     ? handle->cursor_index + 1
+                                     : 0;
+        uint32_t capacity = cluster_count * cluster_bytes;
+        if (capacity <= offset)
+            return 0;
+        end = capacity;
+        len = end - offset;
     }
 
-    uint32_t current_cluster = (entry.fst_clus_hi << 16) | entry.fst_clus_lo;
-    uint32_t bytes_remaining = entry.file_size;
-    uint32_t offset = 0;
-    uint8_t *out_ptr = static_cast<uint8_t *>(buffer);
-    uint32_t cluster_bytes = sec_per_clus_ * 512;
-
-    // 作業用バッファ (NVMeのアライメント要件を満たすため)
-    uint8_t *temp_buf =
-        static_cast<uint8_t *>(MemoryManager::Allocate(cluster_bytes, 4096));
-
-    while (bytes_remaining > 0 && current_cluster < 0x0FFFFFF8)
+    // 元の末尾から offset までの穴を0で埋める
+    if (offset > handle->size)
     {
-        uint64_t lba = ClusterToLBA(current_cluster);
-
-        // 1クラスタ読み込み
-        dev_->Read(lba, temp_buf, sec_per_clus_);
+        uint32_t gap = offset - handle->size;
+        if (WriteRange(handle, handle->size, nullptr, gap) != gap)
+            return 0;
+        handle->size = offset;
+    }
 
-        // 必要な分だけコピー
-        uint32_t copy_len =
-            (bytes_remaining > cluster_bytes) ? cluster_bytes : bytes_remaining;
-        memcpy(out_ptr + offset, temp_buf, copy_len);
+    uint32_t written =
+        WriteRange(handle, offset, static_cast<const uint8_t *>(data), len);
+    if (offset + written > handle->size)
+        handle->size = offset + written;
+    UpdateFileEntry(handle);
+    return written;
+}
 
-        offset += copy_len;
-        bytes_remaining -= copy_len;
+bool FAT32Driver::TruncateFile(FileHandle *handle)
+{
+    // エントリを先に書き換え、そのあとでクラスタを解放する
+    uint32_t first_cluster = handle->first_cluster;
+    handle->first_cluster = 0;
+    handle->size = 0;
+    handle->cursor_index = 0;
+    handle->cursor_cluster = 0;
+    if (!UpdateFileEntry(handle))
+        return false;
+    if (first_cluster != 0)
+        FreeChain(first_cluster);
+    return true;
+}
 
-        // 次のクラスタへ
-        current_cluster = GetNextCluster(current_cluster);
-    }
+bool FAT32Driver::UpdateFileEntry(FileHandle *handle)
+{
+    uint8_t buf[512];
+    if (!ReadDirSectors(handle->entry_lba, buf, 1))
+        return false;
 
-    kprintf(" Done.\n");
-    MemoryManager::Free(temp_buf, cluster_bytes);
-    return entry.file_size;
+    DirectoryEntry *entry =
+        reinterpret_cast<DirectoryEntry *>(buf) + handle->entry_index;
+    if (entry->file_size == handle->size &&
+        entry->fst_clus_hi == ((handle->first_cluster >> 16) & 0xFFFF) &&
+        entry->fst_clus_lo == (handle->first_cluster & 0xFFFF))
+        return true;
+
+    entry->file_size = handle->size;
+    entry->fst_clus_hi = (handle->first_cluster >> 16) & 0xFFFF;
+    entry->fst_clus_lo = handle->first_cluster & 0xFFFF;
+    dcache_.InvalidateLocation(handle->entry_lba, handle->entry_index);
+    return WriteDirSector(handle->entry_lba, buf);
 }
 
 void FAT32Driver::WriteFile(const char *name, const void *data, uint32_t size,
@@ -724,73 +2021,20 @@ void FAT32Driver::WriteFile(const char *name, const void *data, uint32_t size,
 
     kprintf("[FAT32] Writing file: %s (%d bytes)...\n", name, size);
 
-    uint32_t cluster_size_bytes = sec_per_clus_ * 512;
-    uint32_t bytes_remaining = size;
-    uint32_t current_offset = 0;
-
+    // 1. クラスタを確保してデータを書き込む
     uint32_t first_cluster = 0;
-    uint32_t prev_cluster = 0;
-    uint32_t current_cluster = 0;
-
-    // データをすべて書ききるまでループ
-    while (bytes_remaining > 0)
+    if (WriteNewClusters(0, static_cast<const uint8_t *>(data), size,
+                         &first_cluster) == 0)
     {
-        // 1. 新しいクラスタを確保
-        current_cluster = AllocateCluster();
-        if (current_cluster == 0)
-        {
-            kprintf("[FAT32] Error: Disk Full!\n");
-            return;
-        }
-
-        // 最初のクラスタなら記録しておく
-        if (first_cluster == 0)
-        {
-            first_cluster = current_cluster;
-        }
-        else
-        {
-            // 2つ目以降なら、前のクラスタからこのクラスタへリンクを張る
-            // (FATチェーン)
-            LinkCluster(prev_cluster, current_cluster);
-        }
-
-        // 2. データを書き込む
-        uint64_t target_lba = ClusterToLBA(current_cluster);
-
-        // 今回書き込むサイズ (残り全部 or 1クラスタ分)
-        uint32_t write_len = (bytes_remaining > cluster_size_bytes)
-                                 ? cluster_size_bytes
-                                 : bytes_remaining;
-
-        // 書き込みデータ位置
-        const uint8_t *src_ptr =
-            static_cast<const uint8_t *>(data) + current_offset;
-
-        // NVMeドライバはセクタ単位で書き込むため、端数がある場合はバッファリングが必要
-        // しかしMemoryManagerのアライメント機能を使えば直接渡せる場合もある。
-        // 今回は安全のため、必ずアライメントされた一時バッファを経由させる
-        uint8_t *sector_buf = static_cast<uint8_t *>(
-            MemoryManager::Allocate(cluster_size_bytes, 4096));
-        memset(sector_buf, 0, cluster_size_bytes); // パディング部分は0埋め
-        memcpy(sector_buf, src_ptr, write_len);
-
-        // 1クラスタ分書き込み
-        dev_->Write(target_lba, sector_buf, sec_per_clus_);
-        MemoryManager::Free(sector_buf, cluster_size_bytes);
-
-        // 3. 変数更新
-        prev_cluster = current_cluster;
-        bytes_remaining -= write_len;
-        current_offset += write_len;
+        return;
     }
 
-    // 最後のクラスタは「終端(EOCC)」マーク
-    // AllocateClusterで既に 0x0FFFFFFF が入っているはずだが、念の為
-    LinkCluster(current_cluster, 0x0FFFFFFF);
-
-    // 4. ディレクトリエントリ作成
-    AddDirectoryEntry(name, first_cluster, size, 0x20, parent_cluster);
+    // 2. ディレクトリエントリ作成
+    if (!AddDirectoryEntry(name, first_cluster, size, 0x20, parent_cluster))
+    {
+        FreeChain(first_cluster);
+        return;
+    }
 
     kprintf("[FAT32] File Written Successfully (Start Cluster %d)\n",
             first_cluster);
@@ -805,8 +2049,10 @@ void FAT32Driver::AppendFile(const char *name, const void *data, uint32_t size,
     // 1. ファイルが既に存在するか確認
     DirectoryEntry entry;
     uint32_t target_dir = (parent_cluster == 0) ? root_clus_ : parent_cluster;
+    uint64_t entry_lba;
+    uint32_t entry_index;
 
-    if (!FindDirectoryEntry(name, target_dir, &entry))
+    if (!FindDirectoryEntry(name, target_dir, &entry, &entry_lba, &entry_index))
     {
         // ファイルが存在しない場合は新規作成
         WriteFile(name, data, size, parent_cluster);
@@ -820,51 +2066,40 @@ void FAT32Driver::AppendFile(const char *name, const void *data, uint32_t size,
     uint32_t last_cluster = first_cluster;
     uint32_t old_size = entry.file_size;
 
-    if (first_cluster == 0)
+    if (first_cluster != 0 && old_size == 0)
     {
-        // ファイルサイズ0の場合、新しいクラスタを確保して開始
-        first_cluster = AllocateCluster();
-        if (first_cluster == 0)
-        {
-            kprintf("[FAT32] Error: Disk Full!\n");
-            return;
-        }
-        last_cluster = first_cluster;
+        // サイズ0なのにクラスタを持っている場合は捨てて作り直す
+        FreeChain(first_cluster);
+        first_cluster = 0;
+        last_cluster = 0;
     }
-    else
+    else if (first_cluster != 0)
     {
         // 最後のクラスタまで辿る
         while (true)
         {
             uint32_t next = GetNextCluster(last_cluster);
-            if (next >= 0x0FFFFFF8)
+            if (next < 2 || next >= 0x0FFFFFF8)
                 break;
             last_cluster = next;
         }
     }
 
-    // 3. 最後のクラスタの未使用領域を計算
     uint32_t cluster_size_bytes = sec_per_clus_ * 512;
-    uint32_t used_in_last_cluster = old_size % cluster_size_bytes;
-    if (used_in_last_cluster == 0 && old_size > 0)
-        used_in_last_cluster = cluster_size_bytes; // 丁度埋まっている場合
-
-    uint32_t free_in_last_cluster =
-        (old_size == 0) ? cluster_size_bytes
-                        : cluster_size_bytes - used_in_last_cluster;
-
     uint32_t bytes_remaining = size;
     uint32_t current_offset = 0;
     const uint8_t *src_ptr = static_cast<const uint8_t *>(data);
 
-    // 4. 最後のクラスタの空き領域に書き込み
-    if (free_in_last_cluster > 0 && old_size > 0)
+    // 3. 最後のクラスタの空き領域に書き込み
+    uint32_t used_in_last_cluster = old_size % cluster_size_bytes;
+    if (last_cluster != 0 && used_in_last_cluster != 0)
     {
         uint64_t lba = ClusterToLBA(last_cluster);
+        uint32_t free_in_last_cluster = cluster_size_bytes - used_in_last_cluster;
 
         // 既存データを読み込む
         uint8_t *sector_buf = static_cast<uint8_t *>(
-            MemoryManager::Allocate(cluster_size_bytes, 4096));
+            MemoryManager::Allocate(cluster_size_bytes, 4096, MemoryOwner::kFileSystem));
         dev_->Read(lba, sector_buf, sec_per_clus_);
 
         // 追記するサイズ
@@ -883,129 +2118,43 @@ void FAT32Driver::AppendFile(const char *name, const void *data, uint32_t size,
         current_offset += append_len;
     }
 
-    // 5. 残りのデータを新しいクラスタに書き込む
-    uint32_t prev_cluster = last_cluster;
-
-    while (bytes_remaining > 0)
+    // 4. 残りのデータを新しいクラスタ列にまとめて書き込み、末尾につなぐ
+    if (bytes_remaining > 0)
     {
-        // 新しいクラスタを確保
-        uint32_t new_cluster = AllocateCluster();
-        if (new_cluster == 0)
+        uint32_t new_first;
+        if (WriteNewClusters(last_cluster, src_ptr + current_offset,
+                             bytes_remaining, &new_first) == 0)
         {
-            kprintf("[FAT32] Error: Disk Full!\n");
-            break;
+            return;
         }
-
-        // 前のクラスタからリンク
-        LinkCluster(prev_cluster, new_cluster);
-
-        // データを書き込む
-        uint64_t target_lba = ClusterToLBA(new_cluster);
-        uint32_t write_len = (bytes_remaining > cluster_size_bytes)
-                                 ? cluster_size_bytes
-                                 : bytes_remaining;
-
-        uint8_t *sector_buf = static_cast<uint8_t *>(
-            MemoryManager::Allocate(cluster_size_bytes, 4096));
-        memset(sector_buf, 0, cluster_size_bytes);
-        memcpy(sector_buf, src_ptr + current_offset, write_len);
-
-        dev_->Write(target_lba, sector_buf, sec_per_clus_);
-        MemoryManager::Free(sector_buf, cluster_size_bytes);
-
-        prev_cluster = new_cluster;
-        bytes_remaining -= write_len;
-        current_offset += write_len;
+        if (first_cluster == 0)
+            first_cluster = new_first;
     }
 
-    // 最後のクラスタに終端マーク
-    LinkCluster(prev_cluster, 0x0FFFFFFF);
-
-    // 6. ディレクトリエントリのファイルサイズと開始クラスタを更新
+    // 5. ディレクトリエントリのファイルサイズと開始クラスタを更新
     uint32_t new_size = old_size + size;
 
-    // ディレクトリエントリを探して更新
-    uint32_t current_cluster = target_dir;
-    uint8_t *buf = static_cast<uint8_t *>(
-        MemoryManager::Allocate(sec_per_clus_ * 512, 4096));
-
-    while (current_cluster < 0x0FFFFFF8)
+    // 見つけておいた位置のエントリを更新する
+    uint8_t buf[512];
+    if (!ReadDirSectors(entry_lba, buf, 1))
     {
-        uint64_t lba = ClusterToLBA(current_cluster);
-        dev_->Read(lba, buf, sec_per_clus_);
-
-        DirectoryEntry *entries = reinterpret_cast<DirectoryEntry *>(buf);
-        int num_entries = (sec_per_clus_ * 512) / 32;
-
-        for (int i = 0; i < num_entries; ++i)
-        {
-            if (entries[i].name[0] == 0x00)
-                break;
-            if ((unsigned char)entries[i].name[0] == 0xE5)
-                continue;
-            if (entries[i].attr == 0x0F)
-                continue;
-
-            if (IsNameEqual(entries[i].name, name))
-            {
-                // ファイルサイズを更新
-                entries[i].file_size = new_size;
-
-                // 開始クラスタも更新 (サイズ0だった場合)
-                if (old_size == 0)
-                {
-                    entries[i].fst_clus_hi = (first_cluster >> 16) & 0xFFFF;
-                    entries[i].fst_clus_lo = first_cluster & 0xFFFF;
-                }
-
-                // 該当セクタを書き戻す
-                uint32_t sector_offset = i / 16;
-                uint8_t *sector_ptr = buf + (sector_offset * 512);
-                dev_->Write(lba + sector_offset, sector_ptr, 1);
-
-                MemoryManager::Free(buf, sec_per_clus_ * 512);
-                kprintf("[FAT32] File Appended Successfully (New Size: %d)\n",
-                        new_size);
-                return;
-            }
-        }
-
-        current_cluster = GetNextCluster(current_cluster);
+        kprintf("[FAT32] Error: Could not update directory entry.\n");
+        return;
     }
+    DirectoryEntry *dir_entry =
+        reinterpret_cast<DirectoryEntry *>(buf) + entry_index;
+    dir_entry->file_size = new_size;
 
-    MemoryManager::Free(buf, sec_per_clus_ * 512);
-    kprintf("[FAT32] Error: Could not update directory entry.\n");
-}
-
-void FAT32Driver::To83Format(const char *src, char *dst)
-{
-    memset(dst, ' ', 11);
-    int src_idx = 0;
-    int dst_idx = 0;
-
-    while (src[src_idx] && src[src_idx] != '.' && dst_idx < 8)
+    // 開始クラスタも更新 (サイズ0だった場合)
+    if (old_size == 0)
     {
-        char c = src[src_idx++];
-        if (c >= 'a' && c <= 'z')
-            c -= 32;
-        dst[dst_idx++] = c;
+        dir_entry->fst_clus_hi = (first_cluster >> 16) & 0xFFFF;
+        dir_entry->fst_clus_lo = first_cluster & 0xFFFF;
     }
+    WriteDirSector(entry_lba, buf);
+    dcache_.InvalidateLocation(entry_lba, entry_index);
 
-    while (src[src_idx] && src[src_idx] != '.')
-        src_idx++;
-
-    if (src[src_idx] == '.')
-    {
-        src_idx++;
-        dst_idx = 8;
-        while (src[src_idx] && dst_idx < 11)
-        {
-            char c = src[src_idx++];
-            if (c >= 'a' && c <= 'z')
-                c -= 32;
-            dst[dst_idx++] = c;
-        }
-    }
+    kprintf("[FAT32] File Appended Successfully (New Size: %d)\n", new_size);
 }
 
 bool FAT32Driver::CopyFileFrom(FAT32Driver *src_fs, const char *src_path,
@@ -1022,8 +2171,8 @@ bool FAT32Driver::CopyFileFrom(FAT32Driver *src_fs, const char *src_path,
     kprintf("[FAT32] Copying file from %s to %s... (%d bytes)\n", src_path,
             dst_path, size);
 
-    // バッファを確保
-    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(size));
+    // バッファを確保 (ページ境界に揃えて、デバイスから直接読み込めるようにする)
+    uint8_t *buf = static_cast<uint8_t *>(MemoryManager::Allocate(size, 4096));
     if (!buf)
     {
         kprintf("[FAT32] Failed to allocate buffer for file copy.\n");
@@ -1031,7 +2180,7 @@ bool FAT32Driver::CopyFileFrom(FAT32Driver *src_fs, const char *src_path,
     }
 
     // ソースファイルを読み込み
-    if (src_fs->ReadFile(src_path, buf, size) != size)
+    if (src_fs->ReadFileDirect(src_path, buf, size) != size)
     {
         kprintf("[FAT32] Read failed.\n");
         MemoryManager::Free(buf, size);
@@ -1039,7 +2188,7 @@ bool FAT32Driver::CopyFileFrom(FAT32Driver *src_fs, const char *src_path,
     }
 
     // コピー先のディレクトリパスとファイル名を分離
-    char dir_part[64];
+    char dir_part[256];
     const char *filename_part = dst_path;
     const char *last_slash = nullptr;
 
@@ -1054,8 +2203,8 @@ bool FAT32Driver::CopyFileFrom(FAT32Driver *src_fs, const char *src_path,
     if (last_slash)
     {
         int len = last_slash - dst_path;
-        if (len > 63)
-            len = 63;
+        if (len > 255)
+            len = 255;
         for (int i = 0; i < len; ++i)
             dir_part[i] = dst_path[i];
         dir_part[len] = '\0';
@@ -1074,11 +2223,7 @@ bool FAT32Driver::CopyFileFrom(FAT32Driver *src_fs, const char *src_path,
         }
     }
 
-    // 8.3形式に変換してファイルを書き込み
-    char name83[11];
-    To83Format(filename_part, name83);
-
-    WriteFile(name83, buf, size, parent_cluster);
+    WriteFile(filename_part, buf, size, parent_cluster);
 
     MemoryManager::Free(buf, size);
     return true;
@@ -2,15 +2,32 @@
 #include <stdint.h>
 
 #include "block_device.hpp"
+#include "dentry_cache.hpp"
 #include "fat32_defs.hpp"
+#include "fat32_name.hpp"
 
 namespace FileSystem
 {
 
+// オープン中のファイル (FAT32Driver::OpenFile で初期化する)
+// ファイル全体は読み込まず、必要になった部分だけをブロックキャッシュ経由で読み書きする
+struct FileHandle
+{
+    uint32_t first_cluster; // 0ならクラスタ未割り当て
+    uint32_t size;
+    uint64_t entry_lba;   // ディレクトリエントリのあるセクタ
+    uint32_t entry_index; // セクタ内のエントリ番号 (0-15)
+
+    // 最後にアクセスしたクラスタ (順次アクセスでチェーンを先頭から辿り直さないため)
+    uint32_t cursor_index; // ファイル先頭から数えたクラスタ番号
+    uint32_t cursor_cluster;
+};
+
 class FAT32Driver
 {
   public:
     FAT32Driver(BlockDevice *dev, uint64_t partition_lba);
+    ~FAT32Driver(); // 未反映のFATを書き戻してから解放する
 
     void Initialize();
 
@@ -24,12 +41,64 @@ class FAT32Driver
     bool DeleteFile(const char *name, uint32_t parent_cluster = 0);
     uint32_t ReadFile(const char *name, void *buffer, uint32_t buffer_size,
                       uint32_t base_cluster = 0);
+    // ReadFile と同じだが、作業用バッファを通さずデバイスから buffer へ直接読み込む
+    // (アラインされていない場合やバッファに収まらない末尾のみコピーする)
+    // buffer はカーネルのストレートマップ領域であること (ユーザー空間のポインタは不可)
+    uint32_t ReadFileDirect(const char *name, void *buffer,
+                            uint32_t buffer_size, uint32_t base_cluster = 0);
     void WriteFile(const char *name, const void *data, uint32_t size,
                    uint32_t parent_cluster = 0);
     void AppendFile(const char *name, const void *data, uint32_t size,
                     uint32_t parent_cluster = 0);
 
-    static void To83Format(const char *src, char *dst);
+    // ファイルを開く (create なら存在しないときに空のファイルを作る)
+    bool OpenFile(const char *path, FileHandle *handle, bool create = false,
+                  uint32_t base_cluster = 0);
+    // offset から最大 len バイトを読む。戻り値: 読んだバイト数 (ファイル末尾で0)
+    // buffer はユーザー空間のポインタでもよい (作業用バッファからコピーする)
+    uint32_t ReadAt(FileHandle *handle, uint32_t offset, void *buffer,
+                    uint32_t len);
+    // offset に len バイトを書き、必要ならファイルを伸ばす (間の穴は0で埋める)
+    // 戻り値: 書いたバイト数 (ディスクが一杯なら len 未満)
+    uint32_t WriteAt(FileHandle *handle, uint32_t offset, const void *data,
+                     uint32_t len);
+    // ファイルをサイズ0にし、クラスタを解放する
+    bool TruncateFile(FileHandle *handle);
+
+    // dir_cluster 内の name を探し、handle と entry を埋める (ディレクトリも可)
+    bool LookupEntry(const char *name, uint32_t dir_cluster, FileHandle *handle,
+                     DirectoryEntry *entry);
+    // ReadDirectoryEntry を index の順に呼ぶときに、前回の続きから読むための位置
+    // (index を 0 にすると先頭から。ディレクトリを書き換えたら 0 に戻すこと)
+    struct DirPosition
+    {
+        uint32_t index;   // 次に返すエントリの番号
+        uint32_t cluster; // 以下は次に読むスロットの位置
+        uint32_t sector;
+        uint32_t slot;
+        uint32_t steps;
+    };
+    // dir_cluster 内の index 番目のエントリを返す ("." と ".." は数えない)
+    // name には長いファイル名 (なければ8.3形式を整形したもの) が入る
+    // (kMaxNameLength + 1 バイト以上, 不要なら nullptr)
+    // pos を渡すと、index が pos->index 以上なら先頭から数え直さずに続きから探す
+    bool ReadDirectoryEntry(uint32_t dir_cluster, uint32_t index,
+                            DirectoryEntry *entry, char *name = nullptr,
+                            DirPosition *pos = nullptr);
+    uint32_t GetRootCluster() const { return root_clus_; }
+    // 8.3形式の名前を表示用に整形する ("KERNEL  ELF" -> "KERNEL.ELF")
+    // nt_res の小文字フラグも反映する。out は13バイト以上
+    static void FormatName(const DirectoryEntry &entry, char *out);
+
+    // 溜めているメタデータの変更を順序どおりにコミットする
+    // (データ → FAT1 → ディレクトリエントリ → FSInfo)。FAT2 以降への反映は遅らせる
+    bool Sync();
+
+    // コミット待ちで解放されるクラスタも空きとして数える
+    uint32_t GetFreeClusterCount() const
+    {
+        return free_count_ + pending_free_count_;
+    }
 
     // 別のFAT32ファイルシステムからファイルをコピー
     // src_fs: コピー元ファイルシステム
@@ -40,6 +109,14 @@ class FAT32Driver
                       const char *dst_path);
 
   private:
+    static const uint32_t kFatEntriesPerSector = 128; // 512 / 4
+    static const uint32_t kFatIoSectors = 128;        // FATの読み書き1回あたりの上限
+    static const uint32_t kMaxIoSectors = 256;        // ファイルデータの読み書き1回あたりの上限
+    static const uint32_t kMetaLogSectors = 64;       // コミットまで溜めるディレクトリセクタ数
+    static const uint32_t kMirrorLagSectors = 256;    // FAT2 以降への反映を遅らせるセクタ数の上限
+    static const uint32_t kDiscardRanges = 64;        // Discard 1回で渡す範囲の数
+    static const uint32_t kFatChunkEntries = kFatIoSectors * kFatEntriesPerSector; // FATの塊1つのエントリ数
+
     BlockDevice *dev_;
 
     uint64_t part_lba_;
@@ -52,26 +129,170 @@ class FAT32Driver
     // 計算済みオフセット (LBA)
     uint64_t fat_start_lba_;
     uint64_t data_start_lba_;
+    uint64_t fs_info_lba_;
+
+    // FAT全体のメモリ上のコピー (Initialize で読み込み、Sync で書き戻す)
+    // 大きなFATは連続して確保できないので、転送単位 (kFatIoSectors) ごとの塊に分けて持つ
+    uint32_t **fat_chunks_;
+    uint32_t fat_chunk_count_;
+    uint32_t cluster_limit_;  // 有効なクラスタ番号は [2, cluster_limit_)
+    uint64_t *fat_dirty_;     // 変更のあったFATセクタのビットマップ
+    uint64_t *free_map_;      // 空きクラスタのビットマップ (1 = 空き)
+    uint32_t free_count_;     // 空きクラスタ数 (FSInfo.free_count)
+    uint32_t next_free_;      // 次に探し始めるクラスタ (FSInfo.nxt_free)
+    bool fs_info_dirty_;
+
+    // --- メタデータのトランザクション ---
+    // ディレクトリセクタの書き込みはコミットまでここに溜め、読み込み時に重ねる
+    struct MetaSector
+    {
+        uint64_t lba;
+        uint32_t slot; // meta_data_ 内の位置
+    };
+    MetaSector meta_log_[kMetaLogSectors]; // LBA順に並べておく
+    uint8_t *meta_data_;                   // kMetaLogSectors * 512
+    uint32_t meta_count_;
+    // 解放したクラスタはコミットするまで再利用しない
+    // (古いディレクトリエントリがディスク上に残っている間に上書きしないため)
+    uint64_t *pending_free_;
+    uint32_t pending_free_count_;
+    // FAT1 には書いたが、FAT2 以降にはまだ書いていないセクタ
+    uint64_t *mirror_dirty_;
+    uint32_t mirror_lag_;
+
+    uint32_t io_clusters_; // 1回のデバイスI/Oでまとめて転送するクラスタ数
+
+    // パス解決用のディレクトリエントリキャッシュ
+    // ディレクトリエントリを書き換える処理は、必ずここを無効化すること
+    DentryCache dcache_;
+
+    // ディレクトリを1エントリずつ辿る位置
+    struct DirCursor
+    {
+        uint32_t cluster; // 読んでいるクラスタ (終端に達したら0)
+        uint32_t last;    // 最後に読んだクラスタ (ディレクトリを伸ばすときに使う)
+        uint32_t sector;  // クラスタ内のセクタ
+        uint32_t index;   // 次に返すセクタ内のエントリ番号
+        uint32_t steps;   // チェーンのループ検出用
+        bool loaded;      // buf にセクタを読み込んであるか
+        uint8_t buf[512];
+    };
+
+    // ディレクトリ内のファイル1つ分 (LFN エントリの並び + 短い名前のエントリ)
+    struct DirRecord
+    {
+        DirectoryEntry entry;
+        uint64_t lba;   // 短い名前のエントリのあるセクタ
+        uint32_t index; // セクタ内のエントリ番号 (0-15)
+        // このファイルの LFN エントリの位置 (ないなら lfn_count = 0)
+        uint32_t lfn_count;
+        uint64_t lfn_lba[kMaxLongNameEntries];
+        uint8_t lfn_index[kMaxLongNameEntries];
+        char name[kMaxNameLength + 1]; // 表示用の名前 (want_name のときのみ)
+    };
 
     // ヘルパー関数
     uint64_t ClusterToLBA(uint32_t cluster);
+    // メモリ上のFATのエントリとセクタ (塊の境界はセクタの転送単位と揃えてある)
+    uint32_t &FatEntry(uint32_t cluster) const
+    {
+        return fat_chunks_[cluster / kFatChunkEntries][cluster % kFatChunkEntries];
+    }
+    uint32_t *FatSector(uint32_t sector) const
+    {
+        return fat_chunks_[sector / kFatIoSectors] + (sector % kFatIoSectors) * kFatEntriesPerSector;
+    }
+    void FreeFatChunks();
     uint32_t AllocateCluster(); // 空きクラスタを1つ確保して返す
+    // 連続した空きクラスタを最大 max_clusters 個確保し、チェーンにして先頭を返す
+    // 確保できた個数は *count に入る (末尾は終端マーク)
+    uint32_t AllocateClusterRun(uint32_t max_clusters, uint32_t *count);
+    // next_free_ 以降で最初の空きクラスタを探す (見つからなければ0)
+    uint32_t FindFreeCluster();
+    bool IsClusterFree(uint32_t cluster) const
+    {
+        return (free_map_[cluster / 64] >> (cluster % 64)) & 1;
+    }
+    // cluster から番号が連続しているクラスタ数を最大 max_clusters まで数える
+    // *next には範囲の直後に続くクラスタ番号が入る
+    uint32_t GetExtent(uint32_t cluster, uint32_t max_clusters, uint32_t *next);
+    // data を新しく確保したクラスタ列に書き込み、prev_cluster の後ろにつなぐ
+    // (prev_cluster == 0 なら新しいチェーン)。先頭クラスタは *first_cluster に入る
+    // 戻り値: 最後のクラスタ (失敗時0, 途中まで確保したクラスタは解放済み)
+    uint32_t WriteNewClusters(uint32_t prev_cluster, const uint8_t *data,
+                              uint32_t size, uint32_t *first_cluster);
+    uint32_t ReadFileImpl(const char *name, void *buffer, uint32_t buffer_size,
+                          uint32_t base_cluster, bool direct);
+    // 呼び出し元のバッファへ直接読み込む (デバイスのDMA境界で転送を分割する)
+    bool ReadSectorsDirect(uint64_t lba, uint8_t *buffer, uint32_t count);
+    // ファイル先頭から index 番目のクラスタを返す (チェーンが短ければ0)
+    uint32_t SeekCluster(FileHandle *handle, uint32_t index);
+    // ファイルのクラスタ数が clusters 以上になるまでチェーンを伸ばす
+    bool ExtendFile(FileHandle *handle, uint32_t clusters);
+    // offset から len バイトを書く (data == nullptr なら0で埋める)
+    uint32_t WriteRange(FileHandle *handle, uint32_t offset,
+                        const uint8_t *data, uint32_t len);
+    // ハンドルのサイズと開始クラスタをディレクトリエントリへ書き戻す
+    bool UpdateFileEntry(FileHandle *handle);
+    // データI/O用のバッファ (64KB境界をまたがないよう、サイズに合わせて揃える)
+    uint8_t *AllocateIoBuffer(uint32_t bytes);
     // 指定したクラスタの次のクラスタ番号をFATから読み取る
     uint32_t GetNextCluster(uint32_t current_cluster);
     void LinkCluster(uint32_t current, uint32_t next); // FATテーブルを更新
+    // FATエントリを書き換え、空きビットマップと空き数を合わせて更新する
+    void SetFatEntry(uint32_t cluster, uint32_t value);
+    // bitmap 上で *sector 以降にある最初の連続した範囲を探す (転送単位の境界は
+    // またがない)。*sector に先頭が入り、長さを返す (なければ0)
+    uint32_t NextDirtyRun(const uint64_t *bitmap, uint32_t *sector) const;
+    // 変更のあったFATセクタを、連続する範囲ごとにFAT1へ書き戻す
+    // keep_freed なら解放待ちのクラスタはディスク上の値のまま書き、
+    // そのセクタは dirty のまま残す (ディレクトリエントリを書いた後に書き直す)
+    bool FlushFat(bool keep_freed = false);
+    // セクタに解放待ちのクラスタがあるか
+    bool SectorHasPendingFree(uint32_t sector) const;
+    // FAT1 の内容を FAT2 以降へ反映する
+    bool MirrorFat();
+    bool FlushFsInfo();
+    // ディレクトリセクタの読み書き (コミット前の変更を反映する)
+    bool ReadDirSectors(uint64_t lba, void *buffer, uint32_t count);
+    bool WriteDirSector(uint64_t lba, const void *buffer);
+    // 溜めている変更をすべてデバイスへ書き出す
+    bool Commit();
+    // コミットで解放が確定したクラスタの範囲を、まとめてデバイスに Discard する
+    void DiscardFreedClusters();
     // 指定したクラスタから始まるFATチェーンを全て解放(0)にする ■■■
     void FreeChain(uint32_t start_cluster);
-    // 8.3形式のファイル名比較ヘルパー
-    // entry_name: ディレクトリエントリ内の名前 (スペース埋めあり)
-    // target_name: 比較したい名前 (ドットあり)
-    bool IsNameEqual(const char *entry_name, const char *target_name);
+    // ディレクトリの走査
+    void OpenDirectory(uint32_t dir_cluster, DirCursor *cursor);
+    // 次のエントリ (32バイト) を返し、その位置を *lba / *index に入れる
+    // (チェーンの終端なら nullptr)
+    DirectoryEntry *NextSlot(DirCursor *cursor, uint64_t *lba, uint32_t *index);
+    // 次のファイルを返す (なければ false)
+    // key を渡すと一致するファイルだけを返す。一致しないエントリは、LFN の断片数・
+    // 断片ごとの比較・8.3形式の比較のどれかで弾き、名前は組み立てない
+    bool NextRecord(DirCursor *cursor, DirRecord *record, const NameKey *key,
+                    bool want_name);
+    // dir_cluster 内で key に一致するファイルを探す (dcache は使わない)
+    bool FindRecord(const NameKey &key, uint32_t dir_cluster, DirRecord *record);
+    // 長いファイル名に付ける、ディレクトリ内で重複しない別名 ("MYDOCU~1TXT") を作る
+    bool MakeShortAlias(const char *name, uint32_t dir_cluster, char *name83);
+    // 連続した空きエントリを count 個探し、位置を lbas / indexes に入れる
+    // 足りなければディレクトリにクラスタを足す
+    bool FindFreeSlots(uint32_t dir_cluster, uint32_t count, uint64_t *lbas,
+                       uint32_t *indexes);
+    // ディレクトリの last クラスタの後ろに、0クリアしたクラスタをつなぐ
+    uint32_t ExtendDirectory(uint32_t last);
+    // entries[i] を (lbas[i], indexes[i]) の位置に書き込む
+    bool WriteSlots(const DirectoryEntry *entries, const uint64_t *lbas,
+                    const uint32_t *indexes, uint32_t count);
     // ディレクトリエントリを追加する
-    // name: ファイル名 (8.3形式, 例: "KERNEL  ELF")
+    // name: ファイル名 (例: "kernel.elf", "My Document.txt")
+    //   8.3形式で表せない名前は LFN エントリと別名を付けて保存する
     // start_cluster: ファイルの開始クラスタ
     // size: ファイルサイズ
     // attr: ファイル属性 (例: 0x20=ファイル, 0x10=ディレクトリ)
     // parent_cluster: 親ディレクトリのクラスタ番号 (0=ルートディレクトリ)
-    void AddDirectoryEntry(const char *name, uint32_t start_cluster,
+    bool AddDirectoryEntry(const char *name, uint32_t start_cluster,
                            uint32_t size, uint8_t attr,
                            uint32_t parent_cluster);
     // ファイル名からディレクトリエントリを探す内部関数
@@ -79,8 +300,11 @@ class FAT32Driver
     // parent_cluster: 検索対象のディレクトリ (0=ルート)
     // found_entry: 見つかったエントリのコピーを格納する先
     // return: 見つかったらtrue
+    // entry_lba / entry_index: エントリのあるセクタとセクタ内の番号 (不要ならnullptr)
     bool FindDirectoryEntry(const char *name, uint32_t parent_cluster,
-                            DirectoryEntry *found_entry);
+                            DirectoryEntry *found_entry,
+                            uint64_t *entry_lba = nullptr,
+                            uint32_t *entry_index = nullptr);
 };
 
 extern FAT32Driver *g_fat32_driver;
@@ -0,0 +1,250 @@
+#include "fat32_name.hpp"
+#include "cxx.hpp"
+#include <std/string.hpp>
+
+namespace FileSystem
+{
+
+namespace
+{
+char ToUpper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 32 : c;
+}
+
+// 8.3形式に使える文字か (英字は大文字・小文字のどちらでもよい)
+bool IsShortNameChar(char c)
+{
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+        (c >= '0' && c <= '9'))
+        return true;
+    return c != '\0' && strchr("$%'-_@~`!(){}^#&", c) != nullptr;
+}
+
+// 8.3形式の1つの部分 (ベース名か拡張子) を大文字にしてコピーし、大文字小文字を調べる
+bool CopyShortPart(char *dst, const char *src, size_t len, bool *has_lower,
+                   bool *has_upper)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        char c = src[i];
+        if (!IsShortNameChar(c))
+            return false;
+        if (c >= 'a' && c <= 'z')
+            *has_lower = true;
+        else if (c >= 'A' && c <= 'Z')
+            *has_upper = true;
+        dst[i] = ToUpper(c);
+    }
+    return true;
+}
+
+// 別名用に1文字変換する (8.3形式に使えない文字は '_')
+char ToShortChar(char c)
+{
+    return IsShortNameChar(c) ? ToUpper(c) : '_';
+}
+
+uint16_t GetLongNameChar(const LongNameEntry &entry, uint32_t i)
+{
+    if (i < 5)
+        return entry.name1[i];
+    if (i < 11)
+        return entry.name2[i - 5];
+    return entry.name3[i - 11];
+}
+
+void SetLongNameChar(LongNameEntry *entry, uint32_t i, uint16_t c)
+{
+    if (i < 5)
+        entry->name1[i] = c;
+    else if (i < 11)
+        entry->name2[i - 5] = c;
+    else
+        entry->name3[i - 11] = c;
+}
+} // namespace
+
+bool MakeNameKey(const char *name, NameKey *key)
+{
+    size_t len = strnlen(name, kMaxNameLength + 1);
+    if (len == 0 || len > kMaxNameLength)
+        return false;
+
+    for (size_t i = 0; i < len; ++i)
+        key->upper[i] = ToUpper(name[i]);
+    key->upper[len] = '\0';
+    key->length = len;
+    key->lfn_entries = (len + kLongNameChars - 1) / kLongNameChars;
+    key->has_short = ParseShortName(name, key->name83, nullptr, nullptr);
+    return true;
+}
+
+bool ParseShortName(const char *name, char *name83, uint8_t *nt_res,
+                    bool *mixed_case)
+{
+    memset(name83, ' ', 11);
+    if (nt_res)
+        *nt_res = 0;
+    if (mixed_case)
+        *mixed_case = false;
+
+    // "." と ".." はそのままの名前でエントリがある
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+    {
+        memcpy(name83, name, strlen(name));
+        return true;
+    }
+
+    size_t len = strnlen(name, 13);
+    const char *dot = static_cast<const char *>(memchr(name, '.', len));
+    size_t base_len = dot ? static_cast<size_t>(dot - name) : len;
+    size_t ext_len = dot ? len - base_len - 1 : 0;
+    if (len > 12 || base_len == 0 || base_len > 8 || ext_len > 3 ||
+        (dot && ext_len == 0))
+        return false;
+
+    bool base_lower = false, base_upper = false;
+    bool ext_lower = false, ext_upper = false;
+    if (!CopyShortPart(name83, name, base_len, &base_lower, &base_upper) ||
+        (dot && !CopyShortPart(name83 + 8, dot + 1, ext_len, &ext_lower,
+                               &ext_upper)))
+        return false;
+
+    if (nt_res)
+        *nt_res = (base_lower ? 0x08 : 0) | (ext_lower ? 0x10 : 0);
+    if (mixed_case)
+        *mixed_case = (base_lower && base_upper) || (ext_lower && ext_upper);
+    return true;
+}
+
+bool IsValidLongName(const char *name)
+{
+    size_t len = strnlen(name, kMaxNameLength + 1);
+    if (len == 0 || len > kMaxNameLength)
+        return false;
+    // 末尾のドットとスペースは他の実装が取り除いてしまう
+    if (name[len - 1] == '.' || name[len - 1] == ' ')
+        return false;
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = name[i];
+        if (c < 0x20 || strchr("\"*/:<>?\\|", c) != nullptr)
+            return false;
+    }
+    return true;
+}
+
+void MakeShortBasis(const char *name, char *name83)
+{
+    memset(name83, ' ', 11);
+
+    // 先頭のドットは飛ばし、最後のドットより後ろを拡張子にする
+    while (*name == '.')
+        name++;
+    size_t len = strlen(name);
+    const char *dot = static_cast<const char *>(memrchr(name, '.', len));
+    const char *base_end = dot ? dot : name + len;
+
+    // スペースとドットは取り除く
+    int n = 0;
+    for (const char *p = name; p < base_end && n < 8; ++p)
+    {
+        if (*p != ' ' && *p != '.')
+            name83[n++] = ToShortChar(*p);
+    }
+    if (n == 0)
+        name83[0] = '_';
+
+    if (dot)
+    {
+        n = 0;
+        for (const char *p = dot + 1; *p && n < 3; ++p)
+        {
+            if (*p != ' ')
+                name83[8 + n++] = ToShortChar(*p);
+        }
+    }
+}
+
+uint16_t NameHash(const char *name)
+{
+    // FNV-1a を16ビットに畳む
+    uint32_t hash = 2166136261u;
+    for (; *name; ++name)
+    {
+        hash ^= static_cast<uint8_t>(*name);
+        hash *= 16777619u;
+    }
+    return static_cast<uint16_t>(hash ^ (hash >> 16));
+}
+
+uint8_t ShortNameChecksum(const char *name83)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; ++i)
+        sum = ((sum & 1) << 7) + (sum >> 1) + static_cast<uint8_t>(name83[i]);
+    return sum;
+}
+
+bool MatchLongNameEntry(const LongNameEntry &entry, const NameKey &key)
+{
+    uint32_t base = ((entry.ord & 0x1F) - 1) * kLongNameChars;
+    for (uint32_t i = 0; i < kLongNameChars; ++i)
+    {
+        uint32_t pos = base + i;
+        uint16_t c = GetLongNameChar(entry, i);
+        if (pos > key.length)
+            break; // 終端より後ろは埋め草 (0xFFFF)
+        if (pos == key.length)
+            return c == 0x0000;
+        if (c > 0xFF || ToUpper(static_cast<char>(c)) != key.upper[pos])
+            return false;
+    }
+    return true;
+}
+
+void DecodeLongNameEntry(const LongNameEntry &entry, char *name,
+                         uint32_t *length)
+{
+    uint32_t base = ((entry.ord & 0x1F) - 1) * kLongNameChars;
+    for (uint32_t i = 0; i < kLongNameChars; ++i)
+    {
+        uint32_t pos = base + i;
+        if (pos >= *length)
+            break;
+        uint16_t c = GetLongNameChar(entry, i);
+        if (c == 0x0000)
+        {
+            *length = pos;
+            break;
+        }
+        // 表せない文字は '?' にする
+        name[pos] = (c <= 0xFF) ? static_cast<char>(c) : '?';
+    }
+}
+
+void EncodeLongNameEntry(const char *name, uint32_t length, uint32_t ord,
+                         uint32_t count, uint8_t checksum, LongNameEntry *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->ord = ord | (ord == count ? 0x40 : 0);
+    entry->attr = 0x0F;
+    entry->chksum = checksum;
+
+    uint32_t base = (ord - 1) * kLongNameChars;
+    for (uint32_t i = 0; i < kLongNameChars; ++i)
+    {
+        uint32_t pos = base + i;
+        uint16_t c;
+        if (pos < length)
+            c = static_cast<uint8_t>(name[pos]);
+        else if (pos == length)
+            c = 0x0000;
+        else
+            c = 0xFFFF;
+        SetLongNameChar(entry, i, c);
+    }
+}
+
+} // namespace FileSystem
@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fat32_defs.hpp"
+
+namespace FileSystem
+{
+
+// FAT32 のファイル名 (8.3形式と VFAT の長いファイル名) の変換と比較
+// 名前は ASCII を想定する (0x80 以上のバイトは U+0080-U+00FF として1文字ずつ扱う)
+
+const uint32_t kMaxNameLength = 255;     // 長いファイル名の最大文字数
+const uint32_t kLongNameChars = 13;      // LFN エントリ1つに入る文字数
+const uint32_t kMaxLongNameEntries = 20; // 255文字を入れるのに必要な LFN エントリ数
+
+// 探している名前を、ディレクトリを走査する前に一度だけ整えたもの
+// エントリごとに名前を組み立てて比べるのではなく、断片の数・断片ごとの比較・
+// 8.3形式の11バイト比較で一致しないエントリを早く弾くために使う
+struct NameKey
+{
+    char upper[kMaxNameLength + 1]; // 大文字にした名前
+    uint32_t length;
+    uint32_t lfn_entries; // この名前を LFN で持つ場合のエントリ数
+    bool has_short;       // 8.3形式として解釈できる名前か
+    char name83[11];      // has_short のときの8.3形式
+};
+
+// 探す名前から NameKey を作る (空または長すぎる名前は false)
+bool MakeNameKey(const char *name, NameKey *key);
+
+// 8.3形式で表せる名前なら name83 にして true を返す
+// nt_res: 全部小文字のベース名・拡張子を表すフラグ (0x08 / 0x10)
+// mixed_case: 大文字と小文字が混ざっていて、8.3形式だけでは元に戻せないとき true
+// (nt_res と mixed_case は不要なら nullptr)
+bool ParseShortName(const char *name, char *name83, uint8_t *nt_res,
+                    bool *mixed_case);
+// 長いファイル名として保存できる名前か
+bool IsValidLongName(const char *name);
+// 別名 ("MYDOCU~1.TXT") のもとにする8.3形式 ("MYDOCUMETXT") を作る
+void MakeShortBasis(const char *name, char *name83);
+// 名前から求めるハッシュ (別名の衝突が多いときに使う)
+uint16_t NameHash(const char *name);
+
+// 短い名前のチェックサム (LFN エントリが同じファイルのものか確かめる)
+uint8_t ShortNameChecksum(const char *name83);
+// LFN エントリの断片が key の同じ位置と一致するか (大文字小文字は区別しない)
+bool MatchLongNameEntry(const LongNameEntry &entry, const NameKey &key);
+// LFN エントリの断片を name の該当位置に書き込む
+// *length は名前の長さの上限で、終端が見つかればそこまで縮める
+void DecodeLongNameEntry(const LongNameEntry &entry, char *name,
+                         uint32_t *length);
+// name の ord 番目 (1始まり) の断片を LFN エントリにする
+void EncodeLongNameEntry(const char *name, uint32_t length, uint32_t ord,
+                         uint32_t count, uint8_t checksum, LongNameEntry *entry);
+
+} // namespace FileSystem
@@ -0,0 +1,232 @@
+#include "fs/fat32/fat32_vfs.hpp"
+#include "cxx.hpp"
+#include "printk.hpp"
+#include <std/string.hpp>
+
+namespace FileSystem
+{
+
+// ---------------------------------------------------------
+// FAT32Inode
+// ---------------------------------------------------------
+
+FAT32Inode::FAT32Inode(FAT32SuperBlock *sb, const FileHandle &handle)
+    : Inode(sb, InodeType::kFile), handle_(handle), cluster_(0),
+      is_root_(false), next_(nullptr)
+{
+    readdir_pos_.index = 0;
+}
+
+FAT32Inode::FAT32Inode(FAT32SuperBlock *sb, uint32_t cluster,
+                       const FileHandle *location)
+    : Inode(sb, InodeType::kDirectory), cluster_(cluster),
+      is_root_(location == nullptr), next_(nullptr)
+{
+    readdir_pos_.index = 0;
+    memset(&handle_, 0, sizeof(handle_));
+    if (location)
+        handle_ = *location;
+}
+
+FAT32Driver *FAT32Inode::Driver() const
+{
+    return static_cast<FAT32SuperBlock *>(sb_)->driver_;
+}
+
+int64_t FAT32Inode::Read(uint64_t offset, void *buffer, uint64_t len)
+{
+    if (IsDirectory())
+        return -1;
+    if (offset >= handle_.size)
+        return 0;
+    if (len > handle_.size - offset)
+        len = handle_.size - offset;
+    return Driver()->ReadAt(&handle_, static_cast<uint32_t>(offset), buffer,
+                            static_cast<uint32_t>(len));
+}
+
+int64_t FAT32Inode::Write(uint64_t offset, const void *data, uint64_t len)
+{
+    // FAT32のファイルサイズは32ビットまで
+    if (IsDirectory() || offset > 0xFFFFFFFF)
+        return -1;
+    if (len > 0xFFFFFFFF - offset)
+        len = 0xFFFFFFFF - offset;
+
+    uint32_t written = Driver()->WriteAt(&handle_, static_cast<uint32_t>(offset),
+                                         data, static_cast<uint32_t>(len));
+    if (written == 0 && len != 0)
+        return -1;
+    return written;
+}
+
+bool FAT32Inode::Truncate()
+{
+    if (IsDirectory())
+        return false;
+    if (handle_.size == 0 && handle_.first_cluster == 0)
+        return true;
+    return Driver()->TruncateFile(&handle_);
+}
+
+Inode *FAT32Inode::Lookup(const char *name)
+{
+    if (!IsDirectory())
+        return nullptr;
+    return static_cast<FAT32SuperBlock *>(sb_)->GetInode(cluster_, name);
+}
+
+Inode *FAT32Inode::Create(const char *name, InodeType type)
+{
+    if (!IsDirectory())
+        return nullptr;
+
+    Inode *existing = Lookup(name);
+    if (existing)
+    {
+        if (existing->GetType() == type)
+            return existing;
+        existing->Release();
+        return nullptr;
+    }
+
+    // 空いたスロットに入ると ReadDir の番号がずれるので、続きの位置を捨てる
+    readdir_pos_.index = 0;
+    if (type == InodeType::kDirectory)
+    {
+        // ".." はルートを0で指す決まりなので、ルートの場合は0を渡す
+        if (Driver()->CreateDirectory(name, is_root_ ? 0 : cluster_) == 0)
+            return nullptr;
+    }
+    else
+    {
+        FileHandle handle;
+        if (!Driver()->OpenFile(name, &handle, true, cluster_))
+            return nullptr;
+    }
+    return Lookup(name);
+}
+
+bool FAT32Inode::Unlink(const char *name)
+{
+    if (!IsDirectory())
+        return false;
+
+    FAT32SuperBlock *sb = static_cast<FAT32SuperBlock *>(sb_);
+    FileHandle handle;
+    DirectoryEntry entry;
+    if (!Driver()->LookupEntry(name, cluster_, &handle, &entry))
+        return false;
+
+    // 開いているファイルのクラスタを解放すると、後の書き込みで他のファイルを壊す
+    if (sb->FindOpen(handle.entry_lba, handle.entry_index))
+    {
+        kprintf("[FAT32] %s is busy.\n", name);
+        return false;
+    }
+    readdir_pos_.index = 0;
+    return Driver()->DeleteFile(name, cluster_);
+}
+
+bool FAT32Inode::ReadDir(uint32_t index, DirEntry *entry)
+{
+    if (!IsDirectory())
+        return false;
+
+    DirectoryEntry dir_entry;
+    char name[kMaxNameLength + 1];
+    // VFS::ListDirectory のように index を順に増やす場合は、前回の続きから読む
+    if (!Driver()->ReadDirectoryEntry(cluster_, index, &dir_entry, name,
+                                      &readdir_pos_))
+        return false;
+
+    strlcpy(entry->name, name, sizeof(entry->name));
+    entry->type = (dir_entry.attr & 0x10) ? InodeType::kDirectory
+                                          : InodeType::kFile;
+    entry->size = dir_entry.file_size;
+    return true;
+}
+
+// ---------------------------------------------------------
+// FAT32SuperBlock
+// ---------------------------------------------------------
+
+FAT32SuperBlock::FAT32SuperBlock(FAT32Driver *driver)
+    : driver_(driver), root_(nullptr), open_list_(nullptr)
+{
+    root_ = new FAT32Inode(this, driver_->GetRootCluster(), nullptr);
+}
+
+FAT32SuperBlock::~FAT32SuperBlock()
+{
+    if (open_list_)
+        kprintf("[FAT32] Warning: unmounted with open files.\n");
+    delete root_;
+}
+
+Inode *FAT32SuperBlock::GetRoot()
+{
+    root_->Ref();
+    return root_;
+}
+
+FAT32Inode *FAT32SuperBlock::FindOpen(uint64_t entry_lba, uint32_t entry_index)
+{
+    for (FAT32Inode *inode = open_list_; inode; inode = inode->next_)
+    {
+        if (inode->handle_.entry_lba == entry_lba &&
+            inode->handle_.entry_index == entry_index)
+            return inode;
+    }
+    return nullptr;
+}
+
+Inode *FAT32SuperBlock::GetInode(uint32_t dir_cluster, const char *name)
+{
+    FileHandle handle;
+    DirectoryEntry entry;
+    if (!driver_->LookupEntry(name, dir_cluster, &handle, &entry))
+        return nullptr;
+
+    FAT32Inode *inode = FindOpen(handle.entry_lba, handle.entry_index);
+    if (inode)
+    {
+        inode->Ref();
+        return inode;
+    }
+
+    if (entry.attr & 0x10)
+    {
+        uint32_t cluster = handle.first_cluster;
+        if (cluster == 0)
+            cluster = driver_->GetRootCluster(); // ".." がルートを指す場合
+        inode = new FAT32Inode(this, cluster, &handle);
+    }
+    else
+    {
+        inode = new FAT32Inode(this, handle);
+    }
+
+    inode->next_ = open_list_;
+    open_list_ = inode;
+    return inode;
+}
+
+void FAT32SuperBlock::EvictInode(Inode *inode)
+{
+    // ルートは常に保持しておく
+    if (inode == root_)
+    {
+        root_->Ref();
+        return;
+    }
+
+    FAT32Inode **link = &open_list_;
+    while (*link && *link != inode)
+        link = &(*link)->next_;
+    if (*link)
+        *link = (*link)->next_;
+    delete inode;
+}
+
+} // namespace FileSystem
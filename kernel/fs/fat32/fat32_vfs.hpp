@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+
+#include "fat32_driver.hpp"
+#include "fs/vfs.hpp"
+
+namespace FileSystem
+{
+
+class FAT32SuperBlock;
+
+// FAT32上のファイル・ディレクトリ
+class FAT32Inode : public Inode
+{
+  public:
+    // ファイル: handle の位置にあるエントリ
+    FAT32Inode(FAT32SuperBlock *sb, const FileHandle &handle);
+    // ディレクトリ: cluster から始まるディレクトリ (location はエントリの位置, ルートはnullptr)
+    FAT32Inode(FAT32SuperBlock *sb, uint32_t cluster, const FileHandle *location);
+
+    int64_t Read(uint64_t offset, void *buffer, uint64_t len) override;
+    int64_t Write(uint64_t offset, const void *data, uint64_t len) override;
+    bool Truncate() override;
+    uint64_t GetSize() const override { return handle_.size; }
+
+    Inode *Lookup(const char *name) override;
+    Inode *Create(const char *name, InodeType type) override;
+    bool Unlink(const char *name) override;
+    bool ReadDir(uint32_t index, DirEntry *entry) override;
+
+  private:
+    friend class FAT32SuperBlock;
+
+    FAT32Driver *Driver() const;
+
+    FileHandle handle_;  // ファイルならデータの位置とカーソル、どちらもエントリの位置を持つ
+    uint32_t cluster_;   // ディレクトリの開始クラスタ
+    bool is_root_;
+    FAT32Inode *next_;   // FAT32SuperBlock の使用中リスト
+    // ReadDir を順に呼ぶときの続きの位置 (このディレクトリを書き換えたら先頭に戻す)
+    FAT32Driver::DirPosition readdir_pos_;
+};
+
+// FAT32Driver を VFS にマウントするためのアダプタ
+// 同じエントリに対する Inode は1つだけ作り、開いている間は共有する
+// (複数のFDが同じファイルを開いても、サイズやクラスタの情報がずれない)
+class FAT32SuperBlock : public SuperBlock
+{
+  public:
+    // driver の所有権は持たない
+    explicit FAT32SuperBlock(FAT32Driver *driver);
+    ~FAT32SuperBlock() override;
+
+    const char *GetName() const override { return "fat32"; }
+    Inode *GetRoot() override;
+    bool Sync() override { return driver_->Sync(); }
+    void EvictInode(Inode *inode) override;
+
+    FAT32Driver *GetDriver() const { return driver_; }
+
+  private:
+    friend class FAT32Inode;
+
+    // ディレクトリ dir_cluster 内の name の Inode を返す (使用中ならそれを共有する)
+    Inode *GetInode(uint32_t dir_cluster, const char *name);
+    FAT32Inode *FindOpen(uint64_t entry_lba, uint32_t entry_index);
+
+    FAT32Driver *driver_;
+    FAT32Inode *root_;
+    FAT32Inode *open_list_;
+};
+
+} // namespace FileSystem
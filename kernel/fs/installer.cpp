@@ -3,7 +3,9 @@
 #include "driver/nvme/nvme_driver.hpp"
 #include "driver/usb/mass_storage/mass_storage.hpp"
 #include "fs/fat32/fat32_driver.hpp"
+#include "fs/fat32/fat32_vfs.hpp"
 #include "fs/gpt.hpp"
+#include "fs/vfs.hpp"
 #include "memory/memory_manager.hpp"
 #include "printk.hpp"
 
@@ -145,7 +147,7 @@ void FormatDiskGPT(uint64_t total_blocks)
     MemoryManager::Free(entry_buf, entry_array_size);
 }
 
-void RunInstaller(FAT32Driver *nvme_fs, bool already_installed)
+void RunInstaller(bool already_installed)
 {
     if (!USB::g_mass_storage)
     {
@@ -179,37 +181,48 @@ void RunInstaller(FAT32Driver *nvme_fs, bool already_installed)
     }
     MemoryManager::Free(buf, 512);
 
-    FAT32Driver *usb_fs = new FAT32Driver(USB::g_mass_storage, usb_part_lba);
+    BlockCache *usb_cache = new BlockCache(USB::g_mass_storage);
+    FAT32Driver *usb_fs = new FAT32Driver(usb_cache, usb_part_lba);
     usb_fs->Initialize();
+    VFS::Mount("/usb", new FAT32SuperBlock(usb_fs));
 
     if (!already_installed)
     {
         kprintf("[Installer] Performing initial file copy...\n");
 
         // システムディレクトリ作成
-        nvme_fs->EnsureDirectory("sys");
-        nvme_fs->EnsureDirectory("sys/bin");
-        nvme_fs->EnsureDirectory("home");
-
-        // ファイルコピー
-        nvme_fs->CopyFileFrom(usb_fs, "EFI/BOOT/BOOTX64.EFI",
-                              "EFI/BOOT/BOOTX64.EFI");
-        nvme_fs->CopyFileFrom(usb_fs, "apps/shell.elf", "sys/bin/shell.elf");
-        nvme_fs->CopyFileFrom(usb_fs, "apps/stdio.elf", "sys/bin/stdio.elf");
-        nvme_fs->CopyFileFrom(usb_fs, "apps/test.elf", "sys/bin/test.elf");
-        nvme_fs->CopyFileFrom(usb_fs, "kernel.elf", "kernel.elf");
+        VFS::MakeDirectory("/sys/bin");
+        VFS::MakeDirectory("/home");
+
+        // ファイルコピー (コピー先のディレクトリは CopyFile が作る)
+        VFS::CopyFile("/usb/EFI/BOOT/BOOTX64.EFI", "/EFI/BOOT/BOOTX64.EFI");
+        VFS::CopyFile("/usb/apps/shell.elf", "/sys/bin/shell.elf");
+        VFS::CopyFile("/usb/apps/stdio.elf", "/sys/bin/stdio.elf");
+        VFS::CopyFile("/usb/apps/test.elf", "/sys/bin/test.elf");
+        VFS::CopyFile("/usb/kernel.elf", "/kernel.elf");
 
         kprintf("[Installer] Update process finished.\n");
 
         // スタートアップスクリプト作成
         const char *startup_script = "\\EFI\\BOOT\\BOOTX64.EFI";
-        nvme_fs->WriteFile("STARTUP NSH", startup_script, 21, 0);
-        kprintf("[Installer] startup.nsh created.\n");
+        Inode *startup = VFS::Open("/startup.nsh", true);
+        if (startup && startup->Truncate() &&
+            startup->Write(0, startup_script, 21) == 21)
+            kprintf("[Installer] startup.nsh created.\n");
+        else
+            kprintf("[Installer] Failed to create startup.nsh.\n");
+        if (startup)
+            startup->Release();
 
         kprintf("[Installer] Installation Complete!\n");
     }
 
+    // コピーした内容をNVMeに書き出し、USBを外す
+    VFS::Sync();
+    delete VFS::Unmount("/usb");
+
     delete usb_fs;
+    delete usb_cache;
 }
 
 } // namespace FileSystem
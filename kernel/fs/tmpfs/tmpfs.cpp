@@ -0,0 +1,394 @@
+#include "fs/tmpfs/tmpfs.hpp"
+#include "cxx.hpp"
+#include "memory/memory_manager.hpp"
+#include "printk.hpp"
+#include <std/string.hpp>
+
+namespace FileSystem
+{
+
+// ---------------------------------------------------------
+// TmpFSInode
+// ---------------------------------------------------------
+
+TmpFSInode::TmpFSInode(TmpFSSuperBlock *sb, InodeType type, TmpFSInode *parent)
+    : Inode(sb, type), pages_(nullptr), page_capacity_(0), size_(0),
+      parent_(parent), buckets_(nullptr), bucket_count_(0), child_count_(0),
+      list_head_(nullptr), list_tail_(nullptr), readdir_cursor_(nullptr),
+      readdir_index_(0)
+{
+    if (type == InodeType::kDirectory)
+    {
+        buckets_ = new Child *[kInitialBuckets];
+        bucket_count_ = kInitialBuckets;
+        for (uint32_t i = 0; i < bucket_count_; ++i)
+            buckets_[i] = nullptr;
+    }
+}
+
+TmpFSInode::~TmpFSInode()
+{
+    FreePages();
+
+    // 子への参照を手放す (開かれていなければそこで破棄される)
+    Child *child = list_head_;
+    while (child)
+    {
+        Child *next = child->list_next;
+        child->inode->parent_ = nullptr;
+        child->inode->Release();
+        delete child;
+        child = next;
+    }
+    delete[] buckets_;
+}
+
+TmpFSSuperBlock *TmpFSInode::TmpSB() const
+{
+    return static_cast<TmpFSSuperBlock *>(sb_);
+}
+
+bool TmpFSInode::ReservePages(uint64_t pages)
+{
+    if (pages <= page_capacity_)
+        return true;
+
+    uint64_t new_capacity = page_capacity_ ? page_capacity_ * 2 : 8;
+    while (new_capacity < pages)
+        new_capacity *= 2;
+
+    uint8_t **new_pages = new uint8_t *[new_capacity];
+    if (!new_pages)
+        return false;
+    for (uint64_t i = 0; i < page_capacity_; ++i)
+        new_pages[i] = pages_[i];
+    for (uint64_t i = page_capacity_; i < new_capacity; ++i)
+        new_pages[i] = nullptr;
+
+    delete[] pages_;
+    pages_ = new_pages;
+    page_capacity_ = new_capacity;
+    return true;
+}
+
+void TmpFSInode::FreePages()
+{
+    for (uint64_t i = 0; i < page_capacity_; ++i)
+    {
+        if (pages_[i])
+            TmpSB()->FreePage(pages_[i]);
+    }
+    delete[] pages_;
+    pages_ = nullptr;
+    page_capacity_ = 0;
+}
+
+int64_t TmpFSInode::Read(uint64_t offset, void *buffer, uint64_t len)
+{
+    if (IsDirectory())
+        return -1;
+    if (offset >= size_)
+        return 0;
+    if (len > size_ - offset)
+        len = size_ - offset;
+
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    uint64_t pos = offset;
+    uint64_t end = offset + len;
+    while (pos < end)
+    {
+        uint64_t index = pos / kPageSize;
+        uint64_t in_page = pos % kPageSize;
+        uint64_t chunk = kPageSize - in_page;
+        if (chunk > end - pos)
+            chunk = end - pos;
+
+        // ページのない穴は0として読む
+        if (pages_[index])
+            memcpy(out, pages_[index] + in_page, chunk);
+        else
+            memset(out, 0, chunk);
+
+        out += chunk;
+        pos += chunk;
+    }
+    return static_cast<int64_t>(len);
+}
+
+int64_t TmpFSInode::Write(uint64_t offset, const void *data, uint64_t len)
+{
+    if (IsDirectory())
+        return -1;
+    if (len == 0)
+        return 0;
+
+    uint64_t end = offset + len;
+    if (end < offset || !ReservePages((end - 1) / kPageSize + 1))
+        return -1;
+
+    // ページは0埋めで確保し、縮めるときはすべて解放するので、
+    // size_ より後ろの部分は常に0になっている
+    const uint8_t *in = static_cast<const uint8_t *>(data);
+    uint64_t pos = offset;
+    while (pos < end)
+    {
+        uint64_t index = pos / kPageSize;
+        uint64_t in_page = pos % kPageSize;
+        uint64_t chunk = kPageSize - in_page;
+        if (chunk > end - pos)
+            chunk = end - pos;
+
+        if (!pages_[index] && !(pages_[index] = TmpSB()->AllocatePage()))
+            break;
+        memcpy(pages_[index] + in_page, in, chunk);
+
+        in += chunk;
+        pos += chunk;
+    }
+
+    if (pos > size_)
+        size_ = pos;
+    if (pos == offset)
+    {
+        kprintf("[TmpFS] Error: Out of space.\n");
+        return -1;
+    }
+    return static_cast<int64_t>(pos - offset);
+}
+
+bool TmpFSInode::Truncate()
+{
+    if (IsDirectory())
+        return false;
+    FreePages();
+    size_ = 0;
+    return true;
+}
+
+uint32_t TmpFSInode::HashOf(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *name; ++name)
+    {
+        hash ^= static_cast<uint8_t>(*name);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+TmpFSInode::Child *TmpFSInode::FindChild(const char *name, uint32_t hash) const
+{
+    for (Child *child = buckets_[hash & (bucket_count_ - 1)]; child;
+         child = child->hash_next)
+    {
+        if (child->hash == hash && strcmp(child->name, name) == 0)
+            return child;
+    }
+    return nullptr;
+}
+
+void TmpFSInode::InsertChild(Child *child)
+{
+    Child **bucket = &buckets_[child->hash & (bucket_count_ - 1)];
+    child->hash_next = *bucket;
+    *bucket = child;
+
+    // 末尾に足すだけなので、ReadDir の位置はそのまま使える
+    child->list_prev = list_tail_;
+    child->list_next = nullptr;
+    if (list_tail_)
+        list_tail_->list_next = child;
+    else
+        list_head_ = child;
+    list_tail_ = child;
+    child_count_++;
+}
+
+void TmpFSInode::RemoveChild(Child *child)
+{
+    Child **link = &buckets_[child->hash & (bucket_count_ - 1)];
+    while (*link && *link != child)
+        link = &(*link)->hash_next;
+    if (*link)
+        *link = child->hash_next;
+
+    if (child->list_prev)
+        child->list_prev->list_next = child->list_next;
+    else
+        list_head_ = child->list_next;
+    if (child->list_next)
+        child->list_next->list_prev = child->list_prev;
+    else
+        list_tail_ = child->list_prev;
+
+    child_count_--;
+    readdir_cursor_ = nullptr;
+}
+
+bool TmpFSInode::GrowBuckets()
+{
+    uint32_t new_count = bucket_count_ * 2;
+    Child **new_buckets = new Child *[new_count];
+    if (!new_buckets)
+        return false;
+    for (uint32_t i = 0; i < new_count; ++i)
+        new_buckets[i] = nullptr;
+
+    for (Child *child = list_head_; child; child = child->list_next)
+    {
+        Child **bucket = &new_buckets[child->hash & (new_count - 1)];
+        child->hash_next = *bucket;
+        *bucket = child;
+    }
+
+    delete[] buckets_;
+    buckets_ = new_buckets;
+    bucket_count_ = new_count;
+    return true;
+}
+
+Inode *TmpFSInode::Lookup(const char *name)
+{
+    if (!IsDirectory())
+        return nullptr;
+
+    if (strcmp(name, "..") == 0)
+    {
+        if (!parent_)
+            return nullptr;
+        parent_->Ref();
+        return parent_;
+    }
+
+    Child *child = FindChild(name, HashOf(name));
+    if (!child)
+        return nullptr;
+    child->inode->Ref();
+    return child->inode;
+}
+
+Inode *TmpFSInode::Create(const char *name, InodeType type)
+{
+    if (!IsDirectory() || name[0] == '\0' || strcmp(name, ".") == 0 ||
+        strcmp(name, "..") == 0 || strnlen(name, VFS::kMaxName) >= VFS::kMaxName)
+        return nullptr;
+
+    uint32_t hash = HashOf(name);
+    Child *child = FindChild(name, hash);
+    if (child)
+    {
+        if (child->inode->GetType() != type)
+            return nullptr;
+        child->inode->Ref();
+        return child->inode;
+    }
+
+    child = new Child;
+    strlcpy(child->name, name, sizeof(child->name));
+    child->hash = hash;
+    // コンストラクタで持つ参照は、このディレクトリからのリンクの分
+    child->inode = new TmpFSInode(TmpSB(), type, this);
+    InsertChild(child);
+
+    // 1エントリあたりのバケット数が1を超えたら広げる
+    if (child_count_ > bucket_count_)
+        GrowBuckets();
+
+    child->inode->Ref();
+    return child->inode;
+}
+
+bool TmpFSInode::Unlink(const char *name)
+{
+    if (!IsDirectory())
+        return false;
+
+    Child *child = FindChild(name, HashOf(name));
+    if (!child)
+        return false;
+
+    TmpFSInode *inode = child->inode;
+    if (inode->IsDirectory() && inode->child_count_ != 0)
+    {
+        kprintf("[TmpFS] %s is not empty.\n", name);
+        return false;
+    }
+
+    RemoveChild(child);
+    delete child;
+
+    // 開いている FD があれば、データはそれが閉じられるまで残る
+    inode->parent_ = nullptr;
+    inode->Release();
+    return true;
+}
+
+bool TmpFSInode::ReadDir(uint32_t index, DirEntry *entry)
+{
+    if (!IsDirectory())
+        return false;
+
+    Child *child = list_head_;
+    uint32_t i = 0;
+    if (readdir_cursor_ && readdir_index_ <= index)
+    {
+        child = readdir_cursor_;
+        i = readdir_index_;
+    }
+    for (; child && i < index; ++i)
+        child = child->list_next;
+    if (!child)
+        return false;
+
+    readdir_cursor_ = child;
+    readdir_index_ = index;
+
+    strlcpy(entry->name, child->name, sizeof(entry->name));
+    entry->type = child->inode->GetType();
+    entry->size = child->inode->size_;
+    return true;
+}
+
+// ---------------------------------------------------------
+// TmpFSSuperBlock
+// ---------------------------------------------------------
+
+TmpFSSuperBlock::TmpFSSuperBlock(uint64_t max_pages)
+    : root_(nullptr), max_pages_(max_pages), used_pages_(0)
+{
+    root_ = new TmpFSInode(this, InodeType::kDirectory, nullptr);
+}
+
+TmpFSSuperBlock::~TmpFSSuperBlock()
+{
+    if (root_->GetRefCount() > 1)
+        kprintf("[TmpFS] Warning: unmounted with open files.\n");
+    root_->Release();
+}
+
+Inode *TmpFSSuperBlock::GetRoot()
+{
+    root_->Ref();
+    return root_;
+}
+
+uint8_t *TmpFSSuperBlock::AllocatePage()
+{
+    if (max_pages_ != 0 && used_pages_ >= max_pages_)
+        return nullptr;
+
+    uint8_t *page = static_cast<uint8_t *>(
+        MemoryManager::AllocateZeroedFrame(MemoryOwner::kFileSystem));
+    if (page)
+        used_pages_++;
+    return page;
+}
+
+void TmpFSSuperBlock::FreePage(uint8_t *page)
+{
+    MemoryManager::FreeFrame(page);
+    used_pages_--;
+}
+
+} // namespace FileSystem
@@ -0,0 +1,101 @@
+#pragma once
+#include <stdint.h>
+
+#include "fs/vfs.hpp"
+
+namespace FileSystem
+{
+
+class TmpFSSuperBlock;
+
+// tmpfs のファイル・ディレクトリ
+// ファイルのデータは4KBページ単位で持ち、ページ表 (ページへのポインタ配列) を
+// 倍々に伸ばすので、末尾への追記は償却O(1)。書いていない穴はページを持たない。
+// ディレクトリは名前のハッシュ表と、ReadDir 用の作成順リストを持つ。
+class TmpFSInode : public Inode
+{
+  public:
+    static const uint64_t kPageSize = 4096;
+
+    TmpFSInode(TmpFSSuperBlock *sb, InodeType type, TmpFSInode *parent);
+    ~TmpFSInode() override;
+
+    int64_t Read(uint64_t offset, void *buffer, uint64_t len) override;
+    int64_t Write(uint64_t offset, const void *data, uint64_t len) override;
+    bool Truncate() override;
+    uint64_t GetSize() const override { return size_; }
+
+    Inode *Lookup(const char *name) override;
+    Inode *Create(const char *name, InodeType type) override;
+    bool Unlink(const char *name) override;
+    bool ReadDir(uint32_t index, DirEntry *entry) override;
+
+  private:
+    // ディレクトリ内の1エントリ (子の Inode への参照を1つ持つ)
+    struct Child
+    {
+        char name[VFS::kMaxName];
+        uint32_t hash;
+        TmpFSInode *inode;
+        Child *hash_next;
+        Child *list_prev; // 作成順のリスト
+        Child *list_next;
+    };
+
+    static const uint32_t kInitialBuckets = 16;
+
+    static uint32_t HashOf(const char *name);
+    Child *FindChild(const char *name, uint32_t hash) const;
+    void InsertChild(Child *child);
+    void RemoveChild(Child *child);
+    bool GrowBuckets();
+    // ページ表を pages 個以上に伸ばす
+    bool ReservePages(uint64_t pages);
+    void FreePages();
+
+    TmpFSSuperBlock *TmpSB() const;
+
+    // --- ファイル ---
+    uint8_t **pages_;
+    uint64_t page_capacity_; // pages_ の要素数
+    uint64_t size_;
+
+    // --- ディレクトリ ---
+    TmpFSInode *parent_; // ".." 用 (参照は持たない。Unlink されたら nullptr)
+    Child **buckets_;
+    uint32_t bucket_count_;
+    uint32_t child_count_;
+    Child *list_head_;
+    Child *list_tail_;
+    // ReadDir を index 順に呼ぶときに先頭から辿り直さないための位置
+    Child *readdir_cursor_;
+    uint32_t readdir_index_;
+};
+
+// RAM 上のファイルシステム
+// 一時ファイルやシェルのパイプラインの中間データ用。Sync は何もしない。
+class TmpFSSuperBlock : public SuperBlock
+{
+  public:
+    // max_pages: データに使える最大ページ数 (0なら制限なし)
+    explicit TmpFSSuperBlock(uint64_t max_pages = 0);
+    ~TmpFSSuperBlock() override;
+
+    const char *GetName() const override { return "tmpfs"; }
+    Inode *GetRoot() override;
+
+    uint64_t GetUsedPages() const { return used_pages_; }
+
+  private:
+    friend class TmpFSInode;
+
+    // データページを1枚確保する (ゼロ埋め済み, 上限を超えたら nullptr)
+    uint8_t *AllocatePage();
+    void FreePage(uint8_t *page);
+
+    TmpFSInode *root_;
+    uint64_t max_pages_;
+    uint64_t used_pages_;
+};
+
+} // namespace FileSystem
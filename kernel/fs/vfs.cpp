@@ -0,0 +1,373 @@
+#include "fs/vfs.hpp"
+#include "cxx.hpp"
+#include "memory/memory_manager.hpp"
+#include "printk.hpp"
+#include <std/string.hpp>
+
+namespace FileSystem
+{
+
+VFS::MountPoint VFS::mounts_[VFS::kMaxMounts];
+int VFS::mount_count_ = 0;
+
+namespace
+{
+// パスから次の要素を取り出す (区切りの '/' と "." は読み飛ばす)
+// 戻り値: 要素の長さ (0なら終端)。長すぎる要素は kMaxName - 1 文字で切る
+size_t NextComponent(const char **path, char *name)
+{
+    const char *p = *path;
+    while (true)
+    {
+        while (*p == '/')
+            p++;
+        if (p[0] == '.' && (p[1] == '/' || p[1] == '\0'))
+        {
+            p++;
+            continue;
+        }
+        break;
+    }
+
+    size_t len = 0;
+    while (p[len] && p[len] != '/')
+        len++;
+
+    size_t copy = (len < VFS::kMaxName) ? len : VFS::kMaxName - 1;
+    memcpy(name, p, copy);
+    name[copy] = '\0';
+    *path = p + len;
+    return copy;
+}
+
+// マウントポイントのパスを前後の '/' を除いた形にする ("/tmp/" -> "tmp", "/" -> "")
+const char *TrimPath(const char *path, size_t *len)
+{
+    while (*path == '/')
+        path++;
+    size_t n = strnlen(path, VFS::kMaxName);
+    while (n > 0 && path[n - 1] == '/')
+        n--;
+    *len = n;
+    return path;
+}
+} // namespace
+
+void Inode::Release()
+{
+    if (--ref_count_ == 0)
+        sb_->EvictInode(this);
+}
+
+bool VFS::Mount(const char *path, SuperBlock *sb)
+{
+    if (mount_count_ >= kMaxMounts)
+    {
+        kprintf("[VFS] Mount table full.\n");
+        return false;
+    }
+
+    size_t len;
+    path = TrimPath(path, &len);
+    if (len >= kMaxName)
+        return false;
+
+    for (int i = 0; i < mount_count_; ++i)
+    {
+        if (mounts_[i].length == len && memcmp(mounts_[i].path, path, len) == 0)
+        {
+            kprintf("[VFS] /%s is already mounted.\n", mounts_[i].path);
+            return false;
+        }
+    }
+
+    MountPoint &mount = mounts_[mount_count_++];
+    memcpy(mount.path, path, len);
+    mount.path[len] = '\0';
+    mount.length = len;
+    mount.sb = sb;
+    kprintf("[VFS] Mounted %s at /%s\n", sb->GetName(), mount.path);
+    return true;
+}
+
+SuperBlock *VFS::Unmount(const char *path)
+{
+    size_t len;
+    path = TrimPath(path, &len);
+
+    for (int i = 0; i < mount_count_; ++i)
+    {
+        if (mounts_[i].length != len || memcmp(mounts_[i].path, path, len) != 0)
+            continue;
+
+        SuperBlock *sb = mounts_[i].sb;
+        sb->Sync();
+        mounts_[i] = mounts_[--mount_count_];
+        return sb;
+    }
+    return nullptr;
+}
+
+SuperBlock *VFS::FindMount(const char *path, const char **rest)
+{
+    while (*path == '/')
+        path++;
+
+    // 要素の区切りで一致するもののうち、最も長いマウントポイントを選ぶ
+    MountPoint *best = nullptr;
+    for (int i = 0; i < mount_count_; ++i)
+    {
+        MountPoint &mount = mounts_[i];
+        if (mount.length != 0 &&
+            (strncmp(path, mount.path, mount.length) != 0 ||
+             (path[mount.length] != '/' && path[mount.length] != '\0')))
+            continue;
+        if (!best || mount.length > best->length)
+            best = &mount;
+    }
+
+    if (!best)
+        return nullptr;
+    *rest = path + best->length;
+    return best->sb;
+}
+
+Inode *VFS::Resolve(const char *path)
+{
+    const char *rest;
+    SuperBlock *sb = FindMount(path, &rest);
+    if (!sb)
+        return nullptr;
+
+    Inode *inode = sb->GetRoot();
+    char name[kMaxName];
+    while (inode && NextComponent(&rest, name) != 0)
+    {
+        Inode *next = inode->IsDirectory() ? inode->Lookup(name) : nullptr;
+        inode->Release();
+        inode = next;
+    }
+    return inode;
+}
+
+Inode *VFS::ResolveParent(const char *path, char *name)
+{
+    // 最後の要素を切り離す (末尾の '/' は無視する)
+    size_t len = strnlen(path, kMaxPath);
+    if (len >= kMaxPath)
+        return nullptr;
+    while (len > 0 && path[len - 1] == '/')
+        len--;
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/')
+        start--;
+    if (start == len || len - start >= kMaxName)
+        return nullptr;
+
+    memcpy(name, path + start, len - start);
+    name[len - start] = '\0';
+
+    char parent[kMaxPath];
+    memcpy(parent, path, start);
+    parent[start] = '\0';
+
+    Inode *dir = Resolve(parent);
+    if (dir && !dir->IsDirectory())
+    {
+        dir->Release();
+        return nullptr;
+    }
+    return dir;
+}
+
+Inode *VFS::Open(const char *path, bool create)
+{
+    if (!create)
+        return Resolve(path);
+
+    char name[kMaxName];
+    Inode *dir = ResolveParent(path, name);
+    if (!dir)
+        return nullptr;
+
+    Inode *inode = dir->Lookup(name);
+    if (!inode)
+        inode = dir->Create(name, InodeType::kFile);
+    dir->Release();
+    return inode;
+}
+
+bool VFS::MakeDirectory(const char *path)
+{
+    const char *rest;
+    SuperBlock *sb = FindMount(path, &rest);
+    if (!sb)
+        return false;
+
+    Inode *dir = sb->GetRoot();
+    char name[kMaxName];
+    while (dir && NextComponent(&rest, name) != 0)
+    {
+        Inode *next = dir->Lookup(name);
+        if (!next)
+            next = dir->Create(name, InodeType::kDirectory);
+        dir->Release();
+        if (next && !next->IsDirectory())
+        {
+            next->Release();
+            next = nullptr;
+        }
+        dir = next;
+    }
+
+    if (!dir)
+    {
+        kprintf("[VFS] Failed to create directory: %s\n", path);
+        return false;
+    }
+    dir->Release();
+    return true;
+}
+
+bool VFS::Unlink(const char *path)
+{
+    char name[kMaxName];
+    Inode *dir = ResolveParent(path, name);
+    if (!dir)
+        return false;
+
+    bool ok = dir->Unlink(name);
+    dir->Release();
+    return ok;
+}
+
+uint64_t VFS::ReadFile(const char *path, void *buffer, uint64_t buffer_size)
+{
+    Inode *inode = Resolve(path);
+    if (!inode)
+        return 0;
+
+    uint64_t size = inode->GetSize();
+    uint64_t result = 0;
+    if (inode->IsDirectory())
+    {
+        kprintf("[VFS] %s is a directory.\n", path);
+    }
+    else if (size > buffer_size)
+    {
+        kprintf("[VFS] Error: Buffer too small (%lu < %lu)\n", buffer_size, size);
+    }
+    else if (inode->Read(0, buffer, size) == static_cast<int64_t>(size))
+    {
+        result = size;
+    }
+    inode->Release();
+    return result;
+}
+
+bool VFS::CopyFile(const char *src_path, const char *dst_path)
+{
+    Inode *src = Resolve(src_path);
+    if (!src || src->IsDirectory())
+    {
+        kprintf("[VFS] File not found: %s\n", src_path);
+        if (src)
+            src->Release();
+        return false;
+    }
+
+    // コピー先のディレクトリを用意する
+    char parent[kMaxPath];
+    size_t len = strlcpy(parent, dst_path, sizeof(parent));
+    if (len >= sizeof(parent))
+    {
+        src->Release();
+        return false;
+    }
+    while (len > 0 && parent[len - 1] != '/')
+        len--;
+    parent[len] = '\0';
+    if (len > 0 && !MakeDirectory(parent))
+    {
+        src->Release();
+        return false;
+    }
+
+    Inode *dst = Open(dst_path, true);
+    if (!dst || dst->IsDirectory() || !dst->Truncate())
+    {
+        kprintf("[VFS] Cannot create %s\n", dst_path);
+        if (dst)
+            dst->Release();
+        src->Release();
+        return false;
+    }
+
+    uint64_t size = src->GetSize();
+    kprintf("[VFS] Copying %s to %s (%lu bytes)\n", src_path, dst_path, size);
+
+    // 64KBずつ読み書きする (ファイル全体をメモリに置かない)
+    const uint64_t kChunkSize = 64 * 1024;
+    uint8_t *buf = static_cast<uint8_t *>(
+        MemoryManager::Allocate(kChunkSize, 4096, MemoryOwner::kFileSystem));
+    bool ok = buf != nullptr;
+    for (uint64_t offset = 0; ok && offset < size; offset += kChunkSize)
+    {
+        uint64_t chunk = size - offset;
+        if (chunk > kChunkSize)
+            chunk = kChunkSize;
+        ok = src->Read(offset, buf, chunk) == static_cast<int64_t>(chunk) &&
+             dst->Write(offset, buf, chunk) == static_cast<int64_t>(chunk);
+    }
+    if (buf)
+        MemoryManager::Free(buf, kChunkSize);
+    if (!ok)
+        kprintf("[VFS] Copy failed: %s\n", src_path);
+
+    dst->Release();
+    src->Release();
+    return ok;
+}
+
+void VFS::ListDirectory(const char *path)
+{
+    Inode *dir = Resolve(path);
+    if (!dir || !dir->IsDirectory())
+    {
+        kprintf("Error: %s is not a directory.\n", path);
+        if (dir)
+            dir->Release();
+        return;
+    }
+
+    kprintf("Type     Size       Name\n");
+    kprintf("----     ----       ----\n");
+
+    DirEntry entry;
+    for (uint32_t i = 0; dir->ReadDir(i, &entry); ++i)
+    {
+        if (entry.type == InodeType::kDirectory)
+            kprintf("DIR      ");
+        else
+            kprintf("FILE     ");
+
+        kprintf("%lu ", entry.size);
+        // 位置合わせのためのスペース
+        if (entry.size < 1000000)
+            kprintf(" ");
+        if (entry.size < 1000)
+            kprintf("   ");
+        kprintf("%s\n", entry.name);
+    }
+    dir->Release();
+}
+
+bool VFS::Sync()
+{
+    bool ok = true;
+    for (int i = 0; i < mount_count_; ++i)
+        ok &= mounts_[i].sb->Sync();
+    return ok;
+}
+
+} // namespace FileSystem
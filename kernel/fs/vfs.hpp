@@ -0,0 +1,136 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace FileSystem
+{
+
+enum class InodeType : uint8_t
+{
+    kFile,
+    kDirectory,
+};
+
+// ReadDir で返すディレクトリエントリ
+struct DirEntry
+{
+    char name[256];
+    InodeType type;
+    uint64_t size;
+};
+
+class SuperBlock;
+
+// ファイル・ディレクトリ1つを表すオブジェクト
+// 各ファイルシステムが派生クラスで操作を実装する (対応しない操作は失敗を返す)
+// 参照カウントで管理し、最後の Release で SuperBlock::EvictInode に渡す
+class Inode
+{
+  public:
+    Inode(SuperBlock *sb, InodeType type)
+        : sb_(sb), type_(type), ref_count_(1)
+    {
+    }
+    virtual ~Inode() = default;
+
+    // --- ファイル操作 ---
+    // 戻り値: 転送したバイト数 (失敗時 -1)
+    virtual int64_t Read(uint64_t offset, void *buffer, uint64_t len)
+    {
+        return -1;
+    }
+    virtual int64_t Write(uint64_t offset, const void *data, uint64_t len)
+    {
+        return -1;
+    }
+    // サイズを0にする
+    virtual bool Truncate() { return false; }
+    virtual uint64_t GetSize() const { return 0; }
+
+    // --- ディレクトリ操作 ---
+    // Lookup / Create は参照を1つ持った Inode を返す (失敗時 nullptr)
+    virtual Inode *Lookup(const char *name) { return nullptr; }
+    // 既に存在する場合は、種類が同じならそれを返す
+    virtual Inode *Create(const char *name, InodeType type) { return nullptr; }
+    virtual bool Unlink(const char *name) { return false; }
+    // index 番目のエントリを返す (なければ false)
+    virtual bool ReadDir(uint32_t index, DirEntry *entry) { return false; }
+
+    void Ref() { ref_count_++; }
+    void Release();
+
+    SuperBlock *GetSuperBlock() const { return sb_; }
+    InodeType GetType() const { return type_; }
+    bool IsDirectory() const { return type_ == InodeType::kDirectory; }
+    uint32_t GetRefCount() const { return ref_count_; }
+
+  protected:
+    SuperBlock *sb_;
+    InodeType type_;
+    uint32_t ref_count_;
+};
+
+// マウントされたファイルシステム1つ分
+class SuperBlock
+{
+  public:
+    virtual ~SuperBlock() = default;
+
+    virtual const char *GetName() const = 0;
+    // ルートディレクトリ (参照付き)
+    virtual Inode *GetRoot() = 0;
+    // 溜めている変更をデバイスへ書き出す
+    virtual bool Sync() { return true; }
+    // 参照がなくなった Inode を破棄する
+    virtual void EvictInode(Inode *inode) { delete inode; }
+};
+
+// マウントテーブルとパス解決
+// パスは "/" 始まりの絶対パス ("/" がなくてもルートからとみなす)。
+// 最も長く一致するマウントポイントのファイルシステムで残りを辿る。
+class VFS
+{
+  public:
+    static const int kMaxMounts = 8;
+    static const size_t kMaxPath = 256;
+    static const size_t kMaxName = 256;
+
+    static bool Mount(const char *path, SuperBlock *sb);
+    // 外した SuperBlock を返す (破棄は呼び出し元)
+    static SuperBlock *Unmount(const char *path);
+
+    // パスの Inode を参照付きで返す (見つからなければ nullptr)
+    static Inode *Resolve(const char *path);
+    // ファイルを開く (create なら存在しないときに作る)。ディレクトリも返す
+    static Inode *Open(const char *path, bool create);
+    // 途中のディレクトリも含めて作る
+    static bool MakeDirectory(const char *path);
+    static bool Unlink(const char *path);
+
+    // ファイル全体を buffer に読み込む (戻り値: サイズ, 失敗時0)
+    static uint64_t ReadFile(const char *path, void *buffer, uint64_t buffer_size);
+    // ファイルをコピーする (コピー先のディレクトリは作る)
+    static bool CopyFile(const char *src_path, const char *dst_path);
+    static void ListDirectory(const char *path);
+
+    // すべてのマウントを Sync する
+    static bool Sync();
+
+  private:
+    struct MountPoint
+    {
+        char path[kMaxName]; // 前後の '/' を除いたもの (ルートは "")
+        size_t length;
+        SuperBlock *sb;
+    };
+
+    // path を担当するマウントを探し、マウントポイント以降のパスを *rest に返す
+    static SuperBlock *FindMount(const char *path, const char **rest);
+    // 親ディレクトリを参照付きで返し、最後の要素の名前を name に入れる
+    static Inode *ResolveParent(const char *path, char *name);
+
+    static MountPoint mounts_[kMaxMounts];
+    static int mount_count_;
+};
+
+} // namespace FileSystem
@@ -1,6 +1,7 @@
 #include "interrupt.hpp"
 #include "apic.hpp"
 #include "console.hpp"
+#include "driver/nvme/nvme_driver.hpp"
 #include "driver/usb/keyboard/keyboard.hpp"
 #include "io.hpp"
 #include "keyboard_layout.hpp"
@@ -207,6 +208,35 @@ __attribute__((interrupt)) void UsbInterruptHandler(InterruptFrame *frame)
     }
 }
 
+// NVMe 完了割り込み (キューごとにベクタを分け、ハンドラはキューIDごとに作る)
+template <int kQueueId>
+__attribute__((interrupt)) void NVMeInterruptHandler(InterruptFrame *frame)
+{
+    if (NVMe::g_nvme)
+    {
+        NVMe::g_nvme->HandleInterrupt(kQueueId);
+    }
+    if (g_lapic)
+    {
+        g_lapic->EndOfInterrupt();
+    }
+}
+
+// キューID 0 (Admin) から kQueueId までのハンドラを登録する
+template <int kQueueId>
+void SetNVMeInterruptEntries()
+{
+    SetIDTEntry(NVMe::kInterruptVectorBase + kQueueId,
+                (uint64_t)NVMeInterruptHandler<kQueueId>, 0x08,
+                IDT_TYPE_INTERRUPT_GATE);
+    SetNVMeInterruptEntries<kQueueId - 1>();
+}
+
+template <>
+void SetNVMeInterruptEntries<-1>()
+{
+}
+
 __attribute__((interrupt)) void TimerHandler(InterruptFrame *frame)
 {
     // EOIを先に送信（コンテキストスイッチ前に送信することが重要）
@@ -251,5 +281,8 @@ void SetupInterrupts()
     SetIDTEntry(0x50, (uint64_t)UsbInterruptHandler, 0x08,
                 IDT_TYPE_INTERRUPT_GATE);
 
+    // NVMe 完了割り込み (Vector 0x60 から I/O キューの数 + 1 個)
+    SetNVMeInterruptEntries<NVMe::kMaxIOQueues>();
+
     LoadIDT(sizeof(idt) - 1, (uint64_t)&idt[0]);
 }
\ No newline at end of file
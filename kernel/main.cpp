@@ -5,7 +5,10 @@
 #include "driver/nvme/nvme_driver.hpp"
 #include "fs/fat32/fat32.hpp"
 #include "fs/fat32/fat32_driver.hpp"
+#include "fs/fat32/fat32_vfs.hpp"
 #include "fs/installer.hpp"
+#include "fs/tmpfs/tmpfs.hpp"
+#include "fs/vfs.hpp"
 #include "graphics.hpp"
 #include "ioapic.hpp"
 #include "memory/memory_manager.hpp"
@@ -76,21 +79,30 @@ KernelMain(const FrameBufferConfig &config, const MemoryMap &memmap)
 
         MemoryManager::Free(check_buf, 512);
 
+        // FATやディレクトリの小さな読み書きはブロックキャッシュを経由させる
+        // キャッシュからの書き戻しは要求キューでまとめ、LBA順に流す
+        BlockCache *nvme_cache =
+            new BlockCache(new RequestQueue(NVMe::g_nvme));
         FileSystem::FAT32Driver *nvme_fs =
-            new FileSystem::FAT32Driver(NVMe::g_nvme, 2048);
+            new FileSystem::FAT32Driver(nvme_cache, 2048);
         nvme_fs->Initialize();
 
         FileSystem::g_system_fs = nvme_fs;
         FileSystem::g_fat32_driver = nvme_fs;
+        FileSystem::VFS::Mount("/", new FileSystem::FAT32SuperBlock(nvme_fs));
 
         // USBからのインストール処理
-        FileSystem::RunInstaller(nvme_fs, already_installed);
+        FileSystem::RunInstaller(already_installed);
     }
     else
     {
         kprintf("NVMe Controller not found.\n");
     }
 
+    // 一時ファイル用のRAMファイルシステム (空きメモリの1/4まで使う)
+    FileSystem::VFS::Mount("/tmp", new FileSystem::TmpFSSuperBlock(
+                                       MemoryManager::GetFreeFrames() / 4));
+
     // 6. APIC設定
     static LocalAPIC lapic;
     g_lapic = &lapic;
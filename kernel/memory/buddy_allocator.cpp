@@ -0,0 +1,212 @@
+#include "memory/buddy_allocator.hpp"
+#include "cxx.hpp"
+
+void BuddyAllocator::Initialize(uint8_t *order_map, size_t total_frames)
+{
+    order_map_ = order_map;
+    total_frames_ = total_frames;
+    free_frames_ = 0;
+    for (int i = 0; i <= kMaxOrder; ++i)
+    {
+        free_lists_[i] = nullptr;
+        free_counts_[i] = 0;
+    }
+    // 最初はすべて使用中扱い
+    memset(order_map_, kNotFree, total_frames_);
+}
+
+int BuddyAllocator::OrderForFrames(size_t num_frames)
+{
+    int order = 0;
+    while ((static_cast<size_t>(1) << order) < num_frames)
+        order++;
+    return order;
+}
+
+void BuddyAllocator::PushFree(size_t frame, int order)
+{
+    FreeNode *node = FrameToNode(frame);
+    node->prev = nullptr;
+    node->next = free_lists_[order];
+    if (free_lists_[order])
+        free_lists_[order]->prev = node;
+    free_lists_[order] = node;
+    free_counts_[order]++;
+    order_map_[frame] = order;
+}
+
+void BuddyAllocator::RemoveFree(size_t frame, int order)
+{
+    FreeNode *node = FrameToNode(frame);
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        free_lists_[order] = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    free_counts_[order]--;
+    order_map_[frame] = kNotFree;
+}
+
+void BuddyAllocator::FreeRange(size_t start_frame, size_t num_frames)
+{
+    size_t frame = start_frame;
+    size_t end = start_frame + num_frames;
+    if (end > total_frames_)
+        end = total_frames_;
+
+    // 境界に揃った最大のブロックに分解して解放する
+    while (frame < end)
+    {
+        int order = kMaxOrder;
+        while (order > 0 &&
+               ((frame & ((static_cast<size_t>(1) << order) - 1)) != 0 ||
+                frame + (static_cast<size_t>(1) << order) > end))
+        {
+            order--;
+        }
+        FreeBlock(frame, order);
+        frame += static_cast<size_t>(1) << order;
+    }
+}
+
+long BuddyAllocator::AllocateBlock(int order)
+{
+    if (order > kMaxOrder)
+        return -1;
+
+    // 要求次数以上で空きのある最小のリストを探す
+    int current = order;
+    while (current <= kMaxOrder && !free_lists_[current])
+        current++;
+    if (current > kMaxOrder)
+        return -1;
+
+    size_t frame = (reinterpret_cast<uintptr_t>(free_lists_[current])) / 4096;
+    RemoveFree(frame, current);
+
+    // 大きすぎるブロックは半分ずつに分割し、後半をリストに戻す
+    while (current > order)
+    {
+        current--;
+        PushFree(frame + (static_cast<size_t>(1) << current), current);
+    }
+
+    free_frames_ -= static_cast<size_t>(1) << order;
+    return static_cast<long>(frame);
+}
+
+void BuddyAllocator::FreeBlock(size_t frame, int order)
+{
+    free_frames_ += static_cast<size_t>(1) << order;
+
+    // バディが同じ次数で空いている限り結合を続ける
+    while (order < kMaxOrder)
+    {
+        size_t buddy = frame ^ (static_cast<size_t>(1) << order);
+        if (buddy >= total_frames_ || order_map_[buddy] != order)
+            break;
+        RemoveFree(buddy, order);
+        if (buddy < frame)
+            frame = buddy;
+        order++;
+    }
+    PushFree(frame, order);
+}
+
+long BuddyAllocator::Allocate(size_t num_frames, int min_order)
+{
+    if (num_frames == 0)
+        return -1;
+
+    int order = OrderForFrames(num_frames);
+    if (order < min_order)
+        order = min_order;
+    // 最大次数を超える要求は、隣り合う空きブロックをつないで満たす
+    if (order > kMaxOrder)
+        return AllocateRun(num_frames, min_order);
+    long frame = AllocateBlock(order);
+    if (frame < 0)
+        return -1;
+
+    // 切り上げで余った末尾を返却する
+    size_t block_frames = static_cast<size_t>(1) << order;
+    if (block_frames > num_frames)
+        FreeRange(frame + num_frames, block_frames - num_frames);
+    return frame;
+}
+
+long BuddyAllocator::AllocateRun(size_t num_frames, int min_order)
+{
+    size_t align = static_cast<size_t>(1) << min_order;
+
+    // order_map_ を先頭からたどり、連続した空きブロックの並びを探す
+    // (空きブロックの途中のフレームは kNotFree なので、ブロック単位で読み飛ばす)
+    size_t run_start = 0;
+    size_t run_frames = 0;
+    size_t frame = 0;
+    while (frame < total_frames_ && run_frames < num_frames)
+    {
+        if (order_map_[frame] == kNotFree)
+        {
+            run_frames = 0;
+            frame++;
+            continue;
+        }
+        size_t block_frames = static_cast<size_t>(1) << order_map_[frame];
+        if (run_frames == 0)
+        {
+            // 並びの先頭はアライメント境界に揃える
+            if ((frame & (align - 1)) != 0)
+            {
+                frame += block_frames;
+                continue;
+            }
+            run_start = frame;
+        }
+        run_frames += block_frames;
+        frame += block_frames;
+    }
+    if (run_frames < num_frames)
+        return -1;
+
+    // 並びを構成するブロックをすべて取り出し、余った末尾を返却する
+    for (frame = run_start; frame < run_start + run_frames;)
+    {
+        int order = order_map_[frame];
+        RemoveFree(frame, order);
+        frame += static_cast<size_t>(1) << order;
+    }
+    free_frames_ -= run_frames;
+    if (run_frames > num_frames)
+        FreeRange(run_start + num_frames, run_frames - num_frames);
+    return static_cast<long>(run_start);
+}
+
+size_t BuddyAllocator::GetFreeBlockCount(int order) const
+{
+    if (order < 0 || order > kMaxOrder)
+        return 0;
+    return free_counts_[order];
+}
+
+size_t BuddyAllocator::CountFreeFramesIn(size_t start_frame, size_t end_frame) const
+{
+    size_t count = 0;
+    for (int order = 0; order <= kMaxOrder; ++order)
+    {
+        size_t block_frames = static_cast<size_t>(1) << order;
+        for (FreeNode *node = free_lists_[order]; node; node = node->next)
+        {
+            size_t begin = reinterpret_cast<uintptr_t>(node) / 4096;
+            size_t end = begin + block_frames;
+            if (begin < start_frame)
+                begin = start_frame;
+            if (end > end_frame)
+                end = end_frame;
+            if (begin < end)
+                count += end - begin;
+        }
+    }
+    return count;
+}
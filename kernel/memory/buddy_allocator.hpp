@@ -0,0 +1,67 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// 2のべき乗単位でフレームを管理するバディアロケータ
+// 空きブロックはそのフレーム自体に埋め込んだ双方向リストで管理し、
+// フレームごとの order_map_ で「そのフレームから始まる空きブロックの次数」を記録する。
+// (物理アドレス == 仮想アドレスのストレートマップが前提)
+class BuddyAllocator
+{
+public:
+    // order 0 = 4KB, order 9 = 2MB, order 12 = 16MB
+    static const int kMaxOrder = 12;
+
+    // order_map: フレーム数ぶんのバイト配列 (呼び出し側で用意する)
+    void Initialize(uint8_t *order_map, size_t total_frames);
+
+    // [start_frame, start_frame + num_frames) を空きとして登録する
+    void FreeRange(size_t start_frame, size_t num_frames);
+
+    // 2^order フレームのブロックを確保し、先頭フレーム番号を返す (なければ -1)
+    long AllocateBlock(int order);
+
+    // 2^order フレームのブロックを解放し、バディと結合する
+    void FreeBlock(size_t frame, int order);
+
+    // num_frames フレームの連続領域を確保する
+    // 2^order に切り上げて確保し、余った末尾はすぐに返却する
+    // min_order を指定すると、先頭が 2^min_order フレーム境界に揃う
+    // 2^kMaxOrder フレームを超える要求は AllocateRun で探す
+    long Allocate(size_t num_frames, int min_order = 0);
+
+    size_t GetFreeFrames() const { return free_frames_; }
+    size_t GetTotalFrames() const { return total_frames_; }
+    size_t GetFreeBlockCount(int order) const;
+
+    // [start_frame, end_frame) に含まれる空きフレーム数 (空きリストを走査するので統計用)
+    size_t CountFreeFramesIn(size_t start_frame, size_t end_frame) const;
+
+    // num_frames を収められる最小の次数
+    static int OrderForFrames(size_t num_frames);
+
+private:
+    struct FreeNode
+    {
+        FreeNode *next;
+        FreeNode *prev;
+    };
+
+    static const uint8_t kNotFree = 0xFF;
+
+    void PushFree(size_t frame, int order);
+    // 最大次数を超える要求用。隣り合う空きブロックを線形に探してつなぐ (遅い)
+    long AllocateRun(size_t num_frames, int min_order);
+    void RemoveFree(size_t frame, int order);
+
+    static FreeNode *FrameToNode(size_t frame)
+    {
+        return reinterpret_cast<FreeNode *>(frame * 4096);
+    }
+
+    FreeNode *free_lists_[kMaxOrder + 1] = {};
+    size_t free_counts_[kMaxOrder + 1] = {};
+    uint8_t *order_map_ = nullptr;
+    size_t total_frames_ = 0;
+    size_t free_frames_ = 0;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// デバイスとCPUで DMA のメモリの見え方を揃えるための操作
+// x86 の PCI/PCIe DMA はキャッシュとコヒーレントなので、キャッシュの書き戻しや
+// 無効化 (wbinvd / clflush) はいらない。必要なのはアクセスの順序を守ることだけ。
+// (キャッシュがコヒーレントでない環境では、ここで範囲を書き戻す・無効化する)
+
+// CPU が書いたデータ (コマンド・TRB・書き込むバッファ) をデバイスに渡す前に呼ぶ
+static inline void DmaSyncForDevice(const volatile void *addr, size_t size)
+{
+    // WB メモリへの書き込みは後の MMIO 書き込みを追い越さないので、
+    // コンパイラに並び替えをさせなければよい
+    __asm__ volatile("" : : : "memory");
+}
+
+// デバイスが書いたデータ (完了エントリ・イベント・読み込んだバッファ) を CPU が読む前に呼ぶ
+static inline void DmaSyncForCpu(const volatile void *addr, size_t size)
+{
+    // x86 では読み出し同士は入れ替わらないので、完了ビットを読んだ後の
+    // 読み出しをコンパイラが前に出さないようにするだけでよい
+    __asm__ volatile("" : : : "memory");
+}
+
+// ドアベルなど、デバイスに処理の開始を知らせる MMIO レジスタに書く
+// それまでのメモリへの書き込み (Write-Combining や non-temporal を含む) を先に見せる
+static inline void WriteDoorbell(volatile uint32_t *reg, uint32_t value)
+{
+    __asm__ volatile("sfence" : : : "memory");
+    *reg = value;
+}
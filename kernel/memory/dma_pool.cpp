@@ -0,0 +1,149 @@
+#include "memory/dma_pool.hpp"
+#include "cxx.hpp"
+#include "memory/memory_manager.hpp"
+#include "printk.hpp"
+
+namespace
+{
+    size_t AlignUp(size_t value, size_t align)
+    {
+        return (value + align - 1) & ~(align - 1);
+    }
+} // namespace
+
+DmaPool::DmaPool(const char *name, size_t object_size, size_t alignment, size_t boundary)
+    : name_(name), boundary_(boundary), pages_(nullptr), page_count_(0), objects_in_use_(0)
+{
+    if (alignment < sizeof(FreeObject))
+        alignment = sizeof(FreeObject);
+    alignment_ = alignment;
+    object_size_ = AlignUp(object_size, alignment_);
+
+    // 1フレームに収まらないオブジェクトは、2のべき乗フレームをページとする
+    page_size_ = MemoryManager::kFrameSize;
+    while (page_size_ < object_size_)
+        page_size_ <<= 1;
+
+    if (boundary_ != 0 && boundary_ < object_size_)
+    {
+        kprintf("[DMA] Pool '%s': boundary %lu is smaller than object size %lu\n",
+                name_, boundary_, object_size_);
+        boundary_ = 0;
+    }
+}
+
+DmaPool::~DmaPool()
+{
+    if (objects_in_use_ != 0)
+        kprintf("[DMA] Pool '%s' destroyed with %lu objects in use\n", name_, objects_in_use_);
+
+    while (pages_)
+    {
+        Page *next = pages_->next;
+        MemoryManager::Free(reinterpret_cast<void *>(pages_->base), page_size_);
+        delete pages_;
+        pages_ = next;
+    }
+}
+
+DmaPool::Page *DmaPool::CreatePage()
+{
+    void *mem = MemoryManager::Allocate(page_size_, page_size_, MemoryOwner::kDMA);
+    if (!mem)
+        return nullptr;
+
+    Page *page = new Page;
+    page->base = reinterpret_cast<uintptr_t>(mem);
+    page->in_use = 0;
+    page->capacity = 0;
+    page->free_list = nullptr;
+
+    // 境界をまたがないようにオブジェクトを配置していく
+    FreeObject **tail = &page->free_list;
+    size_t offset = 0;
+    while (offset + object_size_ <= page_size_)
+    {
+        if (boundary_ != 0 && (offset / boundary_) != ((offset + object_size_ - 1) / boundary_))
+        {
+            offset = AlignUp(offset + 1, boundary_);
+            continue;
+        }
+
+        FreeObject *obj = reinterpret_cast<FreeObject *>(page->base + offset);
+        obj->next = nullptr;
+        *tail = obj;
+        tail = &obj->next;
+        page->capacity++;
+        offset += object_size_;
+    }
+
+    page->next = pages_;
+    pages_ = page;
+    page_count_++;
+    return page;
+}
+
+void DmaPool::ReleasePage(Page *page)
+{
+    Page **link = &pages_;
+    while (*link && *link != page)
+        link = &(*link)->next;
+    if (*link)
+        *link = page->next;
+
+    MemoryManager::Free(reinterpret_cast<void *>(page->base), page_size_);
+    delete page;
+    page_count_--;
+}
+
+void *DmaPool::Allocate()
+{
+    SpinLockGuard guard(lock_);
+    Page *page = pages_;
+    while (page && !page->free_list)
+        page = page->next;
+
+    if (!page)
+    {
+        page = CreatePage();
+        if (!page)
+        {
+            kprintf("[DMA] Pool '%s': out of memory\n", name_);
+            return nullptr;
+        }
+    }
+
+    FreeObject *obj = page->free_list;
+    page->free_list = obj->next;
+    page->in_use++;
+    objects_in_use_++;
+
+    memset(obj, 0, object_size_);
+    return obj;
+}
+
+bool DmaPool::Free(void *ptr)
+{
+    if (!ptr)
+        return false;
+
+    SpinLockGuard guard(lock_);
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    for (Page *page = pages_; page; page = page->next)
+    {
+        if (addr < page->base || addr >= page->base + page_size_)
+            continue;
+
+        FreeObject *obj = static_cast<FreeObject *>(ptr);
+        obj->next = page->free_list;
+        page->free_list = obj;
+        page->in_use--;
+        objects_in_use_--;
+
+        // 空いたページは1枚だけ残し、それ以外はフレームアロケータへ返す
+        if (page->in_use == 0 && page_count_ > 1)
+            ReleasePage(page);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "sync/spinlock.hpp"
+
+// デバイスに渡す小さな固定長バッファ(リング・コンテキスト・PRPリスト等)用のプール
+// 1ページを複数のオブジェクトで共有し、アライメントと境界(boundary)の制約を守って切り出す。
+// (物理アドレス == 仮想アドレスのストレートマップが前提)
+class DmaPool
+{
+public:
+    // object_size: オブジェクト1個のサイズ
+    // alignment:   先頭アドレスのアライメント (2のべき乗)
+    // boundary:    オブジェクトがまたいではいけない境界 (2のべき乗, 0なら制約なし)
+    DmaPool(const char *name, size_t object_size, size_t alignment, size_t boundary = 0);
+    ~DmaPool();
+
+    // ゼロクリア済みのオブジェクトを1個確保する (失敗時 nullptr)
+    void *Allocate();
+
+    // このプールから確保したオブジェクトを返却する
+    // プールのものでなければ何もせず false を返す
+    bool Free(void *ptr);
+
+    const char *GetName() const { return name_; }
+    size_t GetObjectSize() const { return object_size_; }
+    size_t GetPageCount() const { return page_count_; }
+    size_t GetObjectsInUse() const { return objects_in_use_; }
+
+private:
+    struct FreeObject
+    {
+        FreeObject *next;
+    };
+
+    struct Page
+    {
+        uintptr_t base;
+        uint16_t in_use;
+        uint16_t capacity;
+        FreeObject *free_list;
+        Page *next;
+    };
+
+    Page *CreatePage();
+    void ReleasePage(Page *page);
+
+    const char *name_;
+    size_t object_size_;
+    size_t alignment_;
+    size_t boundary_;
+    size_t page_size_; // 1ページ(確保単位)のサイズ
+
+    SpinLock lock_;
+    Page *pages_;
+    size_t page_count_;
+    size_t objects_in_use_;
+};
@@ -0,0 +1,237 @@
+#include "memory/kernel_heap.hpp"
+#include "memory/memory_manager.hpp"
+#include "printk.hpp"
+
+namespace
+{
+    const uint32_t kSlabMagic = 0x534C4142;  // 'SLAB'
+    const uint32_t kLargeMagic = 0x4C524745; // 'LRGE'
+
+    // ヘッダ(64B)を除いた4032Bをぴったり割り切れるよう、上位2クラスは 1008B/2016B とする
+    const size_t kClassSizes[KernelHeap::kNumSizeClasses] = {
+        16, 32, 64, 128, 256, 512, 1008, 2016};
+} // namespace
+
+SpinLock KernelHeap::lock_;
+KernelHeap::SizeClass KernelHeap::classes_[KernelHeap::kNumSizeClasses];
+HeapLargeStats KernelHeap::large_stats_;
+
+int KernelHeap::SizeToClass(size_t size)
+{
+    for (int i = 0; i < kNumSizeClasses; ++i)
+    {
+        if (size <= kClassSizes[i])
+            return i;
+    }
+    return -1;
+}
+
+void KernelHeap::ListRemove(SizeClass &sc, Slab *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        sc.partial = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->next = nullptr;
+    slab->prev = nullptr;
+}
+
+void KernelHeap::ListPush(SizeClass &sc, Slab *slab)
+{
+    slab->prev = nullptr;
+    slab->next = sc.partial;
+    if (sc.partial)
+        sc.partial->prev = slab;
+    sc.partial = slab;
+}
+
+// 1フレームをスラブとして初期化し、空きリストを構築する
+KernelHeap::Slab *KernelHeap::CreateSlab(int class_index)
+{
+    void *frame = MemoryManager::AllocateFrame(MemoryOwner::kKernelHeap);
+    if (!frame)
+        return nullptr;
+
+    Slab *slab = static_cast<Slab *>(frame);
+    size_t object_size = kClassSizes[class_index];
+    uint16_t capacity = (MemoryManager::kFrameSize - sizeof(Slab)) / object_size;
+
+    slab->magic = kSlabMagic;
+    slab->class_index = class_index;
+    slab->in_use = 0;
+    slab->capacity = capacity;
+    slab->next = nullptr;
+    slab->prev = nullptr;
+
+    // 先頭から順に払い出されるよう、後ろから連結する
+    uint8_t *base = reinterpret_cast<uint8_t *>(slab) + sizeof(Slab);
+    FreeObject *head = nullptr;
+    for (int i = capacity - 1; i >= 0; --i)
+    {
+        FreeObject *obj = reinterpret_cast<FreeObject *>(base + i * object_size);
+        obj->next = head;
+        head = obj;
+    }
+    slab->free_list = head;
+
+    classes_[class_index].stats.slabs++;
+    classes_[class_index].stats.objects_free += capacity;
+    return slab;
+}
+
+void *KernelHeap::Allocate(size_t size)
+{
+    if (size == 0)
+        size = 1;
+
+    int class_index = SizeToClass(size);
+    if (class_index < 0)
+    {
+        // 大きな確保はフレームアロケータに任せる
+        size_t total_size = size + sizeof(LargeHeader);
+        LargeHeader *header = static_cast<LargeHeader *>(MemoryManager::Allocate(total_size, 16, MemoryOwner::kKernelHeap));
+        if (!header)
+            return nullptr;
+
+        header->magic = kLargeMagic;
+        header->size = total_size;
+
+        SpinLockGuard guard(lock_);
+        large_stats_.allocations++;
+        large_stats_.bytes += total_size;
+        large_stats_.alloc_count++;
+        return header + 1;
+    }
+
+    SpinLockGuard guard(lock_);
+    SizeClass &sc = classes_[class_index];
+    Slab *slab = sc.partial;
+    if (!slab)
+    {
+        // 予備の空きスラブがあればそれを使い、なければ新しく作る
+        if (sc.empty)
+        {
+            slab = sc.empty;
+            sc.empty = nullptr;
+        }
+        else
+        {
+            slab = CreateSlab(class_index);
+            if (!slab)
+                return nullptr;
+        }
+        ListPush(sc, slab);
+    }
+
+    FreeObject *obj = slab->free_list;
+    slab->free_list = obj->next;
+    slab->in_use++;
+
+    // 満杯になったスラブはリストから外す (解放時に戻す)
+    if (slab->in_use == slab->capacity)
+        ListRemove(sc, slab);
+
+    sc.stats.objects_in_use++;
+    sc.stats.objects_free--;
+    sc.stats.alloc_count++;
+    return obj;
+}
+
+void KernelHeap::Free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    // スラブのオブジェクトも大きな確保も、フレーム先頭にヘッダがある
+    uintptr_t frame = reinterpret_cast<uintptr_t>(ptr) & ~(MemoryManager::kFrameSize - 1);
+    uint32_t magic = *reinterpret_cast<uint32_t *>(frame);
+
+    if (magic == kLargeMagic)
+    {
+        LargeHeader *header = reinterpret_cast<LargeHeader *>(frame);
+        size_t total_size = header->size;
+        header->magic = 0;
+
+        {
+            SpinLockGuard guard(lock_);
+            large_stats_.allocations--;
+            large_stats_.bytes -= total_size;
+            large_stats_.free_count++;
+        }
+        MemoryManager::Free(header, total_size);
+        return;
+    }
+
+    if (magic != kSlabMagic)
+    {
+        kprintf("[Heap] Free: invalid pointer %p\n", ptr);
+        return;
+    }
+
+    SpinLockGuard guard(lock_);
+    Slab *slab = reinterpret_cast<Slab *>(frame);
+    SizeClass &sc = classes_[slab->class_index];
+
+    bool was_full = (slab->in_use == slab->capacity);
+
+    FreeObject *obj = static_cast<FreeObject *>(ptr);
+    obj->next = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+
+    sc.stats.objects_in_use--;
+    sc.stats.objects_free++;
+    sc.stats.free_count++;
+
+    if (was_full)
+        ListPush(sc, slab);
+
+    if (slab->in_use == 0)
+    {
+        ListRemove(sc, slab);
+        if (!sc.empty)
+        {
+            // 確保と解放の繰り返しでフレームを往復させないよう1枚は手元に残す
+            sc.empty = slab;
+        }
+        else
+        {
+            sc.stats.slabs--;
+            sc.stats.objects_free -= slab->capacity;
+            slab->magic = 0;
+            MemoryManager::FreeFrame(slab);
+        }
+    }
+}
+
+bool KernelHeap::GetClassStats(int index, HeapClassStats *out)
+{
+    if (index < 0 || index >= kNumSizeClasses || !out)
+        return false;
+    *out = classes_[index].stats;
+    out->object_size = kClassSizes[index];
+    return true;
+}
+
+void KernelHeap::GetLargeStats(HeapLargeStats *out)
+{
+    if (out)
+        *out = large_stats_;
+}
+
+void KernelHeap::DumpStats()
+{
+    kprintf(" Class  Slabs   InUse    Free      Allocs       Frees\n");
+    for (int i = 0; i < kNumSizeClasses; ++i)
+    {
+        HeapClassStats s;
+        GetClassStats(i, &s);
+        kprintf("%6lu %6lu %7lu %7lu %11lu %11lu\n", s.object_size, s.slabs,
+                s.objects_in_use, s.objects_free, s.alloc_count, s.free_count);
+    }
+    kprintf(" Large: %lu allocations, %lu KB (allocs=%lu, frees=%lu)\n",
+            large_stats_.allocations, large_stats_.bytes / 1024,
+            large_stats_.alloc_count, large_stats_.free_count);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "sync/spinlock.hpp"
+
+// サイズクラスごとの使用状況
+struct HeapClassStats
+{
+    size_t object_size;    // オブジェクト1個のサイズ
+    size_t slabs;          // 確保済みスラブ(フレーム)数
+    size_t objects_in_use; // 使用中オブジェクト数
+    size_t objects_free;   // スラブ内の空きオブジェクト数
+    uint64_t alloc_count;  // 累計確保回数
+    uint64_t free_count;   // 累計解放回数
+};
+
+// サイズクラスに収まらない大きな確保の使用状況
+struct HeapLargeStats
+{
+    size_t allocations; // 使用中の確保数
+    size_t bytes;       // 使用中のバイト数 (ヘッダ込み)
+    uint64_t alloc_count;
+    uint64_t free_count;
+};
+
+// カーネルヒープ
+// 16B〜2KBの小さな確保はサイズクラスごとのスラブ(1フレーム)から切り出し、
+// それより大きな確保は MemoryManager のフレーム確保にフォールバックする。
+class KernelHeap
+{
+public:
+    static const int kNumSizeClasses = 8;
+
+    // size バイトを確保する (16バイト境界)
+    static void *Allocate(size_t size);
+
+    // Allocate で確保した領域を解放する (サイズ不要)
+    static void Free(void *ptr);
+
+    // 統計情報の取得
+    static bool GetClassStats(int index, HeapClassStats *out);
+    static void GetLargeStats(HeapLargeStats *out);
+
+    // 統計情報をコンソールに出力する
+    static void DumpStats();
+
+private:
+    struct FreeObject
+    {
+        FreeObject *next;
+    };
+
+    // スラブ(フレーム)の先頭に置くヘッダ
+    struct Slab
+    {
+        uint32_t magic;
+        uint16_t class_index;
+        uint16_t in_use;
+        uint16_t capacity;
+        uint16_t reserved[3];
+        FreeObject *free_list;
+        Slab *next; // 空きのあるスラブのリスト
+        Slab *prev;
+        uint8_t padding[24];
+    };
+    static_assert(sizeof(Slab) == 64, "Slab header must be 64 bytes");
+
+    // 大きな確保の先頭に置くヘッダ
+    struct LargeHeader
+    {
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t size; // ヘッダ込みのサイズ
+    };
+    static_assert(sizeof(LargeHeader) == 16, "LargeHeader must be 16 bytes");
+
+    struct SizeClass
+    {
+        Slab *partial; // 空きオブジェクトを持つスラブ
+        Slab *empty;   // 完全に空いたスラブを1枚だけ保持しておく
+        HeapClassStats stats;
+    };
+
+    static int SizeToClass(size_t size);
+    static Slab *CreateSlab(int class_index);
+    static void ListRemove(SizeClass &sc, Slab *slab);
+    static void ListPush(SizeClass &sc, Slab *slab);
+
+    static SpinLock lock_; // スラブのリストと統計を保護する
+    static SizeClass classes_[kNumSizeClasses];
+    static HeapLargeStats large_stats_;
+};
@@ -1,4 +1,5 @@
 #include "memory/memory_manager.hpp"
+#include "cpu.hpp"
 #include "cxx.hpp"
 #include "graphics.hpp"
 #include "printk.hpp"
@@ -6,10 +7,59 @@
 extern "C" char __kernel_start;
 extern "C" char __kernel_end;
 
-Bitmap MemoryManager::bitmap_;
+BuddyAllocator MemoryManager::buddy_;
+SpinLock MemoryManager::lock_;
+MemoryManager::FrameMagazine MemoryManager::magazines_[kMaxCPUs];
+SpinLock MemoryManager::zero_lock_;
+void *MemoryManager::zero_frames_[kZeroFramePoolSize];
+size_t MemoryManager::zero_frame_count_ = 0;
+void *MemoryManager::zero_blocks_[kZeroBlockPoolSize];
+size_t MemoryManager::zero_block_count_ = 0;
+uint8_t *MemoryManager::owner_map_ = nullptr;
+uint64_t MemoryManager::owner_frames_[static_cast<int>(MemoryOwner::kCount)];
+uint64_t MemoryManager::usable_frames_ = 0;
+uint64_t MemoryManager::region_count_ = 0;
+uint64_t MemoryManager::region_start_[MemoryStats::kMaxRegions];
+uint64_t MemoryManager::region_frames_[MemoryStats::kMaxRegions];
+
+static_assert(static_cast<int>(MemoryOwner::kCount) <= 8, "MemoryStats::owner_frames is too small");
+static_assert(BuddyAllocator::kMaxOrder < MemoryStats::kMaxOrders, "MemoryStats::free_blocks is too small");
 uintptr_t MemoryManager::range_begin_ = 0;
 uintptr_t MemoryManager::range_end_ = 0;
 
+namespace
+{
+    // 空きとして登録してはいけないフレーム範囲 [start, end)
+    struct ReservedRange
+    {
+        size_t start;
+        size_t end;
+    };
+
+    const int kNumReserved = 3;
+    ReservedRange g_reserved[kNumReserved];
+} // namespace
+
+void MemoryManager::FreeUsableRange(size_t start_frame, size_t end_frame)
+{
+    // 予約範囲と重なる部分を切り取りながら登録する
+    for (int i = 0; i < kNumReserved; ++i)
+    {
+        const ReservedRange &r = g_reserved[i];
+        if (r.start < end_frame && start_frame < r.end)
+        {
+            if (start_frame < r.start)
+                FreeUsableRange(start_frame, r.start);
+            if (r.end < end_frame)
+                FreeUsableRange(r.end, end_frame);
+            return;
+        }
+    }
+
+    if (start_frame < end_frame)
+        buddy_.FreeRange(start_frame, end_frame - start_frame);
+}
+
 void MemoryManager::Initialize(const MemoryMap &memmap)
 {
     uintptr_t iter = reinterpret_cast<uintptr_t>(memmap.buffer);
@@ -25,35 +75,45 @@ void MemoryManager::Initialize(const MemoryMap &memmap)
     }
 
     size_t total_frames = range_end_ / kFrameSize;
-    size_t bitmap_size = (total_frames + 7) / 8; // 切り上げ
+    // フレームごとに1バイトの次数マップと、1バイトの所有者マップを続けて置く
+    size_t map_size = total_frames * 2;
 
-    uintptr_t bitmap_base = 0;
+    uintptr_t map_base = 0;
     iter = reinterpret_cast<uintptr_t>(memmap.buffer);
     for (unsigned int i = 0; i < memmap.map_size / memmap.descriptor_size; ++i)
     {
         auto *desc = reinterpret_cast<const MemoryDescriptor *>(iter);
-        if (static_cast<MemoryType>(desc->type) == MemoryType::kEfiConventionalMemory)
+        if (static_cast<MemoryType>(desc->type) == MemoryType::kEfiConventionalMemory &&
+            desc->physical_start != 0)
         {
             size_t region_size = desc->number_of_pages * kFrameSize;
-            if (region_size >= bitmap_size)
+            if (region_size >= map_size)
             {
-                bitmap_base = desc->physical_start;
+                map_base = desc->physical_start;
                 break;
             }
         }
         iter += memmap.descriptor_size;
     }
 
-    if (bitmap_base == 0)
+    if (map_base == 0)
     {
-        kprintf("Error: No suitable memory region found for bitmap.\n");
+        kprintf("Error: No suitable memory region found for buddy order map.\n");
         while (1)
             __asm__ volatile("hlt");
     }
 
-    bitmap_.SetBuffer(reinterpret_cast<uint8_t *>(bitmap_base), bitmap_size);
+    buddy_.Initialize(reinterpret_cast<uint8_t *>(map_base), total_frames);
+    owner_map_ = reinterpret_cast<uint8_t *>(map_base + total_frames);
+    memset(owner_map_, static_cast<int>(MemoryOwner::kFree), total_frames);
+
+    uintptr_t k_start = reinterpret_cast<uintptr_t>(&__kernel_start);
+    uintptr_t k_end = reinterpret_cast<uintptr_t>(&__kernel_end);
 
-    memset(reinterpret_cast<void *>(bitmap_base), 0xFF, bitmap_size);
+    // フレーム0・次数マップ・カーネルイメージは空きにしない
+    g_reserved[0] = {0, 1};
+    g_reserved[1] = {map_base / kFrameSize, (map_base + map_size + kFrameSize - 1) / kFrameSize};
+    g_reserved[2] = {k_start / kFrameSize, (k_end + kFrameSize - 1) / kFrameSize};
 
     iter = reinterpret_cast<uintptr_t>(memmap.buffer);
     for (unsigned int i = 0; i < memmap.map_size / memmap.descriptor_size; ++i)
@@ -61,47 +121,91 @@ void MemoryManager::Initialize(const MemoryMap &memmap)
         auto *desc = reinterpret_cast<const MemoryDescriptor *>(iter);
         if (static_cast<MemoryType>(desc->type) == MemoryType::kEfiConventionalMemory)
         {
-            // この領域に含まれるフレームをすべて「空き」にする
+            // この領域に含まれるフレームをバディアロケータに登録する
             uintptr_t start_frame = desc->physical_start / kFrameSize;
             uintptr_t end_frame = (desc->physical_start + desc->number_of_pages * kFrameSize) / kFrameSize;
+            FreeUsableRange(start_frame, end_frame);
 
-            for (size_t f = start_frame; f < end_frame; ++f)
+            // 統計用に領域を記録する (隣接する領域はまとめる)
+            usable_frames_ += end_frame - start_frame;
+            if (region_count_ > 0 &&
+                region_start_[region_count_ - 1] + region_frames_[region_count_ - 1] == start_frame)
             {
-                bitmap_.Set(f, false); // 0 = 空き
+                region_frames_[region_count_ - 1] += end_frame - start_frame;
+            }
+            else if (region_count_ < MemoryStats::kMaxRegions)
+            {
+                region_start_[region_count_] = start_frame;
+                region_frames_[region_count_] = end_frame - start_frame;
+                region_count_++;
             }
         }
         iter += memmap.descriptor_size;
     }
+}
 
-    uintptr_t bitmap_start_frame = bitmap_base / kFrameSize;
-    uintptr_t bitmap_end_frame = (bitmap_base + bitmap_size + kFrameSize - 1) / kFrameSize;
-    for (size_t f = bitmap_start_frame; f < bitmap_end_frame; ++f)
+// per-CPUキャッシュが空になったら、グローバルアロケータからまとめて補充する
+bool MemoryManager::RefillMagazine(FrameMagazine &mag)
+{
+    lock_.Lock();
+    while (mag.count < kMagazineBatch)
     {
-        bitmap_.Set(f, true); // 使用中
+        long frame = buddy_.AllocateBlock(0);
+        if (frame < 0)
+            break;
+        mag.frames[mag.count++] = static_cast<size_t>(frame);
     }
+    lock_.Unlock();
+    return mag.count > 0;
+}
 
-    uintptr_t k_start = reinterpret_cast<uintptr_t>(&__kernel_start);
-    uintptr_t k_end = reinterpret_cast<uintptr_t>(&__kernel_end);
+// per-CPUキャッシュが溢れたら、半分をまとめてグローバルアロケータへ返す
+void MemoryManager::DrainMagazine(FrameMagazine &mag, size_t keep)
+{
+    lock_.Lock();
+    while (mag.count > keep)
+        buddy_.FreeBlock(mag.frames[--mag.count], 0);
+    lock_.Unlock();
+}
 
-    size_t k_start_frame = k_start / kFrameSize;
-    size_t k_end_frame = (k_end + kFrameSize - 1) / kFrameSize;
+// 1フレーム(4KB)だけ確保する
+// 通常は自CPUのキャッシュから取り出すだけで、グローバルのロックは取らない
+MemoryOwner MemoryManager::GetOwner(uintptr_t addr)
+{
+    size_t frame = addr / kFrameSize;
+    if (!owner_map_ || frame >= buddy_.GetTotalFrames())
+        return MemoryOwner::kOther;
+    return static_cast<MemoryOwner>(owner_map_[frame]);
+}
 
-    for (size_t f = k_start_frame; f < k_end_frame; ++f)
+void MemoryManager::SetOwner(size_t frame, size_t count, MemoryOwner owner)
+{
+    size_t total_frames = buddy_.GetTotalFrames();
+    for (size_t i = 0; i < count && frame + i < total_frames; ++i)
     {
-        bitmap_.Set(f, true); // 使用中(1)にマーク
+        uint8_t old_owner = owner_map_[frame + i];
+        if (old_owner != static_cast<uint8_t>(MemoryOwner::kFree))
+            __atomic_fetch_sub(&owner_frames_[old_owner], 1, __ATOMIC_RELAXED);
+        owner_map_[frame + i] = static_cast<uint8_t>(owner);
     }
-
-    bitmap_.Set(0, true);
+    if (owner != MemoryOwner::kFree)
+        __atomic_fetch_add(&owner_frames_[static_cast<int>(owner)], count, __ATOMIC_RELAXED);
 }
 
-// 1フレーム(4KB)だけ確保する
-void *MemoryManager::AllocateFrame()
+void *MemoryManager::AllocateFrame(MemoryOwner owner)
 {
-    long frame = bitmap_.FindFreeFrame();
-    if (frame < 0)
+    uint64_t flags = SaveAndDisableInterrupts();
+    FrameMagazine &mag = magazines_[GetCurrentCPUIndex()];
+
+    if (mag.count == 0 && !RefillMagazine(mag))
+    {
+        RestoreInterrupts(flags);
         return nullptr; // 空きなし
+    }
 
-    bitmap_.Set(frame, true); // 使用中にマーク
+    size_t frame = mag.frames[--mag.count];
+    RestoreInterrupts(flags);
+    SetOwner(frame, 1, owner);
     return reinterpret_cast<void *>(frame * kFrameSize);
 }
 
@@ -109,12 +213,19 @@ void MemoryManager::FreeFrame(void *ptr)
 {
     uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
     size_t frame = addr / kFrameSize;
-    bitmap_.Set(frame, false); // 空きに戻す
+    SetOwner(frame, 1, MemoryOwner::kFree);
+
+    uint64_t flags = SaveAndDisableInterrupts();
+    FrameMagazine &mag = magazines_[GetCurrentCPUIndex()];
+
+    if (mag.count == kMagazineSize)
+        DrainMagazine(mag, kMagazineSize - kMagazineBatch);
+    mag.frames[mag.count++] = frame;
+    RestoreInterrupts(flags);
 }
 
 // 複数ページ(連続領域)の確保
-// 簡易的に「連続した空きビット」を探す (First Fit)
-void *MemoryManager::Allocate(size_t size, size_t alignment)
+void *MemoryManager::Allocate(size_t size, size_t alignment, MemoryOwner owner)
 {
     if (size == 0)
         return nullptr;
@@ -122,56 +233,190 @@ void *MemoryManager::Allocate(size_t size, size_t alignment)
     // 必要なフレーム数
     size_t num_frames = (size + kFrameSize - 1) / kFrameSize;
 
+    // フレーム境界より大きなアライメントは、その大きさのバディブロックから切り出して満たす
+    // (2^order フレームのブロックは 2^order フレーム境界に揃っている)
+    size_t align_frames = (alignment + kFrameSize - 1) / kFrameSize;
+
     // 1フレームなら高速版を使う
+    if (num_frames == 1 && align_frames <= 1)
+        return AllocateFrame(owner);
+
+    int order = BuddyAllocator::OrderForFrames(align_frames);
+    uint64_t flags = lock_.LockIrqSave();
+    long frame = buddy_.Allocate(num_frames, order);
+    lock_.UnlockIrqRestore(flags);
+    if (frame < 0)
+        return nullptr;
+
+    SetOwner(frame, num_frames, owner);
+    return reinterpret_cast<void *>(frame * kFrameSize);
+}
+
+void MemoryManager::Free(void *ptr, size_t size)
+{
+    if (!ptr || size == 0)
+        return;
+
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    size_t start_frame = addr / kFrameSize;
+    size_t num_frames = (size + kFrameSize - 1) / kFrameSize;
+
     if (num_frames == 1)
-        return AllocateFrame();
+    {
+        FreeFrame(ptr);
+        return;
+    }
 
-    // 連続領域の探索
-    // ※効率は悪いが、単純な線形探索を行う
-    size_t total_frames = range_end_ / kFrameSize;
+    SetOwner(start_frame, num_frames, MemoryOwner::kFree);
 
-    // FindFreeFrameで見つけた場所からチェックを始めると少し速い
-    long start_search = bitmap_.FindFreeFrame();
-    if (start_search < 0)
-        return nullptr;
+    uint64_t flags = lock_.LockIrqSave();
+    buddy_.FreeRange(start_frame, num_frames);
+    lock_.UnlockIrqRestore(flags);
+}
+
+void *MemoryManager::AllocateZeroedFrame(MemoryOwner owner)
+{
+    void *frame = nullptr;
+    {
+        SpinLockGuard guard(zero_lock_);
+        if (zero_frame_count_ > 0)
+            frame = zero_frames_[--zero_frame_count_];
+    }
+    if (frame)
+    {
+        SetOwner(reinterpret_cast<uintptr_t>(frame) / kFrameSize, 1, owner);
+        return frame;
+    }
 
-    for (size_t i = start_search; i < total_frames; ++i)
+    // プールが空なら同期的にクリアする
+    frame = AllocateFrame(owner);
+    if (frame)
+        memset(frame, 0, kFrameSize);
+    return frame;
+}
+
+void *MemoryManager::AllocateZeroed(size_t size, MemoryOwner owner)
+{
+    size_t num_frames = (size + kFrameSize - 1) / kFrameSize;
+    if (num_frames == 1)
+        return AllocateZeroedFrame(owner);
+
+    if (num_frames == kZeroBlockFrames)
     {
-        // ここから num_frames 分空いているか確認
-        bool found = true;
-        for (size_t j = 0; j < num_frames; ++j)
+        void *block = nullptr;
         {
-            if (i + j >= total_frames || bitmap_.Get(i + j))
+            SpinLockGuard guard(zero_lock_);
+            if (zero_block_count_ > 0)
+                block = zero_blocks_[--zero_block_count_];
+        }
+        if (block)
+        {
+            SetOwner(reinterpret_cast<uintptr_t>(block) / kFrameSize, num_frames, owner);
+            return block;
+        }
+    }
+
+    void *ptr = Allocate(size, 16, owner);
+    if (ptr)
+        memset(ptr, 0, num_frames * kFrameSize);
+    return ptr;
+}
+
+void MemoryManager::RefillZeroPool(size_t budget)
+{
+    // クリアはロックの外で行い、できたものだけをプールに積む
+    while (budget > 0)
+    {
+        bool need_frame;
+        bool need_block;
+        {
+            SpinLockGuard guard(zero_lock_);
+            need_frame = zero_frame_count_ < kZeroFramePoolSize;
+            need_block = zero_block_count_ < kZeroBlockPoolSize;
+        }
+
+        if (need_block && budget >= kZeroBlockFrames)
+        {
+            void *block = Allocate(kZeroBlockFrames * kFrameSize, 16, MemoryOwner::kFree);
+            if (!block)
+                return;
+            memset(block, 0, kZeroBlockFrames * kFrameSize);
+
+            SpinLockGuard guard(zero_lock_);
+            if (zero_block_count_ < kZeroBlockPoolSize)
             {
-                found = false;
-                // 次の探索は j 分飛ばせる
-                i += j;
-                break;
+                zero_blocks_[zero_block_count_++] = block;
+                block = nullptr;
             }
+            if (block)
+                Free(block, kZeroBlockFrames * kFrameSize);
+            budget -= kZeroBlockFrames;
         }
-
-        if (found)
+        else if (need_frame)
         {
-            // 見つかったので確保
-            for (size_t j = 0; j < num_frames; ++j)
+            void *frame = AllocateFrame(MemoryOwner::kFree);
+            if (!frame)
+                return;
+            memset(frame, 0, kFrameSize);
+
+            SpinLockGuard guard(zero_lock_);
+            if (zero_frame_count_ < kZeroFramePoolSize)
             {
-                bitmap_.Set(i + j, true);
+                zero_frames_[zero_frame_count_++] = frame;
+                frame = nullptr;
             }
-            return reinterpret_cast<void *>(i * kFrameSize);
+            if (frame)
+                FreeFrame(frame);
+            budget--;
+        }
+        else
+        {
+            return; // 両方とも満杯
         }
     }
+}
 
-    return nullptr;
+size_t MemoryManager::GetFreeFrames()
+{
+    // per-CPUキャッシュに溜まっているフレームも空きとして数える
+    uint64_t flags = lock_.LockIrqSave();
+    size_t free_frames = buddy_.GetFreeFrames();
+    lock_.UnlockIrqRestore(flags);
+
+    for (int i = 0; i < kMaxCPUs; ++i)
+        free_frames += magazines_[i].count;
+
+    // ゼロ済みプールのフレームも、すぐに払い出せる空きとして数える
+    SpinLockGuard guard(zero_lock_);
+    free_frames += zero_frame_count_ + zero_block_count_ * kZeroBlockFrames;
+    return free_frames;
 }
 
-void MemoryManager::Free(void *ptr, size_t size)
+void MemoryManager::GetStats(MemoryStats *out)
 {
-    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
-    size_t start_frame = addr / kFrameSize;
-    size_t num_frames = (size + kFrameSize - 1) / kFrameSize;
+    memset(out, 0, sizeof(MemoryStats));
+    out->total_frames = buddy_.GetTotalFrames();
+    out->usable_frames = usable_frames_;
+    out->free_frames = GetFreeFrames();
+
+    for (int i = 0; i < static_cast<int>(MemoryOwner::kCount); ++i)
+        out->owner_frames[i] = __atomic_load_n(&owner_frames_[i], __ATOMIC_RELAXED);
+
+    uint64_t flags = lock_.LockIrqSave();
+    for (int order = 0; order <= BuddyAllocator::kMaxOrder; ++order)
+    {
+        out->free_blocks[order] = buddy_.GetFreeBlockCount(order);
+        if (out->free_blocks[order] > 0)
+            out->largest_free_block = static_cast<uint64_t>(1) << order;
+    }
 
-    for (size_t i = 0; i < num_frames; ++i)
+    out->region_count = region_count_;
+    for (uint64_t i = 0; i < region_count_; ++i)
     {
-        bitmap_.Set(start_frame + i, false);
+        out->regions[i].start = region_start_[i] * kFrameSize;
+        out->regions[i].frames = region_frames_[i];
+        out->regions[i].free_frames =
+            buddy_.CountFreeFramesIn(region_start_[i], region_start_[i] + region_frames_[i]);
     }
-}
\ No newline at end of file
+    lock_.UnlockIrqRestore(flags);
+}
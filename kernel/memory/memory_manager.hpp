@@ -1,62 +1,45 @@
 #pragma once
 #include <stddef.h>
 #include <stdint.h>
+#include "memory/buddy_allocator.hpp"
 #include "memory/memory.hpp"
+#include "cpu.hpp"
+#include "sync/spinlock.hpp"
 
-class Bitmap
+// フレームの所有者(用途)。メモリ使用量の内訳の集計に使う
+enum class MemoryOwner : uint8_t
 {
-public:
-    void SetBuffer(uint8_t *buffer, size_t size)
-    {
-        buffer_ = buffer;
-        bitmap_size_ = size; // バイト単位のサイズ
-    }
+    kFree = 0,   // 未使用 (キャッシュ・ゼロ済みプール内を含む)
+    kOther,      // 分類なし
+    kKernelHeap, // KernelHeap (new/delete)
+    kPageTable,  // ページテーブル
+    kStack,      // カーネルスタック
+    kDMA,        // デバイスとの共有バッファ
+    kUser,       // ユーザープロセスのページ
+    kFileSystem, // ファイルシステムのバッファ・キャッシュ
+    kCount,
+};
 
-    // 指定したビット(フレーム番号)が使用中かどうか
-    bool Get(size_t index) const
-    {
-        if (index / 8 >= bitmap_size_)
-            return true; // 範囲外は使用中扱い
-        return (buffer_[index / 8] & (1 << (index % 8))) != 0;
-    }
+// MemoryManager::GetStats の結果
+// apps/_header/syscall.hpp の MemInfo とレイアウトを合わせること
+struct MemoryStats
+{
+    static const int kMaxOrders = 16;
+    static const int kMaxRegions = 16;
 
-    // 指定したビットを使用中(true)または空き(false)にする
-    void Set(size_t index, bool allocated)
-    {
-        if (index / 8 >= bitmap_size_)
-            return;
-        if (allocated)
-        {
-            buffer_[index / 8] |= (1 << (index % 8));
-        }
-        else
-        {
-            buffer_[index / 8] &= ~(1 << (index % 8));
-        }
-    }
-
-    // 最初に見つかった空きビットのインデックスを返す (なければ -1)
-    long FindFreeFrame() const
+    uint64_t total_frames;  // 管理対象の総フレーム数 (アドレス範囲)
+    uint64_t usable_frames; // UEFIが使用可能と報告したフレーム数
+    uint64_t free_frames;
+    uint64_t owner_frames[8]; // MemoryOwner ごとの使用フレーム数
+    uint64_t free_blocks[kMaxOrders]; // 次数ごとの空きブロック数
+    uint64_t largest_free_block;      // 最大の空きブロック (フレーム数)
+    uint64_t region_count;
+    struct
     {
-        for (size_t i = 0; i < bitmap_size_; ++i)
-        {
-            if (buffer_[i] != 0xFF) // 全部埋まっていなければ探す
-            {
-                for (int bit = 0; bit < 8; ++bit)
-                {
-                    if (!((buffer_[i] >> bit) & 1))
-                    {
-                        return i * 8 + bit;
-                    }
-                }
-            }
-        }
-        return -1;
-    }
-
-private:
-    uint8_t *buffer_ = nullptr;
-    size_t bitmap_size_ = 0;
+        uint64_t start; // 物理アドレス
+        uint64_t frames;
+        uint64_t free_frames;
+    } regions[kMaxRegions];
 };
 
 class MemoryManager
@@ -65,22 +48,84 @@ public:
     // フレーム(4KB)単位の定数
     static const size_t kFrameSize = 4096;
 
-    // メモリマップを受け取り、ビットマップを初期化する
+    // メモリマップを受け取り、バディアロケータを初期化する
     static void Initialize(const MemoryMap &memmap);
 
-    // 指定バイト数を確保 (簡易的にページ単位で切り上げ)
-    // alignmentは互換性のための引数で、現状は無視される
-    static void *Allocate(size_t size, size_t alignment = 16);
+    // 指定バイト数を確保 (ページ単位で切り上げ)
+    // 戻り値は常にフレーム境界に揃い、alignment がそれより大きければ alignment 境界に揃う
+    // 1フレームに満たない小さなDMAバッファは DmaPool を使うこと
+    // 16MB (バディの最大ブロック) を超える要求は全フレームを線形に走査するので遅い
+    static void *Allocate(size_t size, size_t alignment = 16,
+                          MemoryOwner owner = MemoryOwner::kOther);
 
-    // メモリを解放する (ビットマップを0に戻す)
+    // メモリを解放する (バディと結合しながら空きリストに戻す)
     static void Free(void *ptr, size_t size); // サイズが必要になります
 
     // ページ単位での確保・解放 (内部用兼、将来のページング用)
-    static void *AllocateFrame();
+    // CPUごとのキャッシュ(マガジン)を経由し、グローバルアロケータへはまとめてアクセスする
+    static void *AllocateFrame(MemoryOwner owner = MemoryOwner::kOther);
     static void FreeFrame(void *ptr);
 
+    // ゼロクリア済みの領域を確保する
+    // アイドル時に用意しておいたプールから取り出せれば memset を省略できる
+    static void *AllocateZeroedFrame(MemoryOwner owner = MemoryOwner::kOther);
+    static void *AllocateZeroed(size_t size, MemoryOwner owner = MemoryOwner::kOther);
+
+    // ゼロ済みプールを最大 budget フレームぶん補充する (アイドルタスクから呼ぶ)
+    static void RefillZeroPool(size_t budget);
+
+    // 空きフレーム数 / 管理対象の総フレーム数
+    static size_t GetFreeFrames();
+    static size_t GetTotalFrames() { return buddy_.GetTotalFrames(); }
+
+    // 用途別の使用量や断片化の状況を集計する
+    static void GetStats(MemoryStats *out);
+
+    // addr を含むフレームの所有者 (管理範囲外なら kOther)
+    static MemoryOwner GetOwner(uintptr_t addr);
+
 private:
-    static Bitmap bitmap_;
+    // CPUごとに手元に置いておくフレームの数と、補充・返却の単位
+    static const size_t kMagazineSize = 64;
+    static const size_t kMagazineBatch = 32;
+
+    struct FrameMagazine
+    {
+        size_t count;
+        size_t frames[kMagazineSize];
+    };
+
+    // ゼロ済みプールの容量 (4KBフレームと、カーネルスタック用の16KBブロック)
+    static const size_t kZeroFramePoolSize = 64;
+    static const size_t kZeroBlockPoolSize = 8;
+    static const size_t kZeroBlockFrames = 4;
+
+    static bool RefillMagazine(FrameMagazine &mag);
+    static void DrainMagazine(FrameMagazine &mag, size_t keep);
+
+    // 予約領域(カーネル・管理用配列など)を除いて空きとして登録する
+    static void FreeUsableRange(size_t start_frame, size_t end_frame);
+
+    // フレームの所有者を付け替え、用途別カウンタを更新する
+    static void SetOwner(size_t frame, size_t count, MemoryOwner owner);
+
+    static BuddyAllocator buddy_;
+    static SpinLock lock_; // buddy_ を保護する
+    static FrameMagazine magazines_[kMaxCPUs];
+
+    static SpinLock zero_lock_; // 以下のゼロ済みプールを保護する
+    static void *zero_frames_[kZeroFramePoolSize];
+    static size_t zero_frame_count_;
+    static void *zero_blocks_[kZeroBlockPoolSize];
+    static size_t zero_block_count_;
+
+    static uint8_t *owner_map_; // フレームごとの MemoryOwner
+    static uint64_t owner_frames_[static_cast<int>(MemoryOwner::kCount)];
+    static uint64_t usable_frames_;
+    static uint64_t region_count_;
+    static uint64_t region_start_[MemoryStats::kMaxRegions]; // フレーム番号
+    static uint64_t region_frames_[MemoryStats::kMaxRegions];
+
     static uintptr_t range_begin_; // 管理するメモリ領域の開始アドレス(物理)
     static uintptr_t range_end_;   // 管理するメモリ領域の終了アドレス(物理)
 };
\ No newline at end of file
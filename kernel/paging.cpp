@@ -8,18 +8,16 @@ PML4Table *PageManager::pml4_table_ = nullptr;
 
 PageTable *PageManager::AllocateTable()
 {
-    // メモリマネージャから1フレーム(4KB)もらう
-    void *ptr = MemoryManager::AllocateFrame();
+    // ページテーブルは必ず0クリアされている必要があるので、ゼロ済みフレームをもらう
+    void *ptr = MemoryManager::AllocateZeroedFrame(MemoryOwner::kPageTable);
     if (!ptr)
         return nullptr;
 
-    // 必ず0クリアする
-    memset(ptr, 0, 4096);
     return static_cast<PageTable *>(ptr);
 }
 
 bool PageManager::AllocateVirtual(uint64_t virtual_addr, size_t size,
-                                  uint64_t flags)
+                                  uint64_t flags, MemoryOwner owner)
 {
     // 4KBアライメントチェック
     if (virtual_addr % kPageSize4K != 0)
@@ -32,18 +30,15 @@ bool PageManager::AllocateVirtual(uint64_t virtual_addr, size_t size,
         uint64_t vaddr = virtual_addr + (i * kPageSize4K);
 
         // 1. 物理フレームを確保
-        void *frame = MemoryManager::AllocateFrame();
+        // 中身は必ずクリア済み (セキュリティ対策)。アイドル時に用意したプールから取る
+        void *frame = MemoryManager::AllocateZeroedFrame(owner);
         if (frame == nullptr)
         {
             // メモリ不足 (本来はここでロールバックが必要)
             return false;
         }
 
-        // 2. 物理フレームの中身をクリア (セキュリティ対策)
-        // ここでは物理アドレス(identity map)経由で書き込む
-        memset(frame, 0, kPageSize4K);
-
-        // 3. マッピング
+        // 2. マッピング
         uint64_t paddr = reinterpret_cast<uint64_t>(frame);
         MapPage(vaddr, paddr, 1, flags);
     }
@@ -51,6 +46,34 @@ bool PageManager::AllocateVirtual(uint64_t virtual_addr, size_t size,
     return true;
 }
 
+bool PageManager::LookupUserWritable(uint64_t virtual_addr,
+                                     uint64_t *physical_addr)
+{
+    PageTable *table = reinterpret_cast<PageTable *>(GetCR3() & ~0xFFFULL);
+    for (int level = 4; level >= 1; --level)
+    {
+        uint64_t idx = (virtual_addr >> (12 + 9 * (level - 1))) & 0x1FF;
+        PageTableEntry &entry = table->entries[idx];
+        if (!entry.bits.present || !entry.bits.read_write ||
+            !entry.bits.user_supervisor)
+            return false;
+
+        // 2MBページはPDで終わる
+        if (level == 2 && entry.bits.huge_page)
+        {
+            *physical_addr = entry.GetAddress() + (virtual_addr & (kPageSize2M - 1));
+            return true;
+        }
+        if (level == 1)
+        {
+            *physical_addr = entry.GetAddress() + (virtual_addr & (kPageSize4K - 1));
+            return true;
+        }
+        table = reinterpret_cast<PageTable *>(entry.GetAddress());
+    }
+    return false;
+}
+
 void PageManager::MapPage(uint64_t virtual_addr, uint64_t physical_addr,
                           size_t count, uint64_t flags)
 {
@@ -185,7 +208,7 @@ void PageManager::Initialize()
         1; // ユーザーモードからもアクセス可
 
     // 64個のPDテーブルを作成して、64GB分 (64 * 1GB) をマップする
-    for (int i_pdp = 0; i_pdp < 64; ++i_pdp)
+    for (uint64_t i_pdp = 0; i_pdp < kIdentityMapEnd / kPageSize1G; ++i_pdp)
     {
         PageTable *pd_table = AllocateTable();
         pdp_table->entries[i_pdp].SetAddress(
@@ -427,7 +450,7 @@ void PageManager::FreeProcessPageTable(uint64_t cr3_value)
 
 bool PageManager::AllocateVirtualForProcess(uint64_t target_cr3,
                                             uint64_t virtual_addr, size_t size,
-                                            uint64_t flags)
+                                            uint64_t flags, MemoryOwner owner)
 {
     // 現在のCR3を保存
     uint64_t current_cr3 = GetCR3();
@@ -443,7 +466,7 @@ bool PageManager::AllocateVirtualForProcess(uint64_t target_cr3,
     pml4_table_ = reinterpret_cast<PML4Table *>(target_cr3);
 
     // 通常のAllocateVirtualを呼び出す
-    bool result = AllocateVirtual(virtual_addr, size, flags);
+    bool result = AllocateVirtual(virtual_addr, size, flags, owner);
 
     // pml4_table_を元に戻す
     pml4_table_ = original_pml4;
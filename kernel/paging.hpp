@@ -1,6 +1,7 @@
 #pragma once
 #include <stddef.h>
 #include <stdint.h>
+#include "memory/memory_manager.hpp"
 
 // ページサイズ
 const uint64_t kPageSize4K = 4096;
@@ -74,6 +75,10 @@ class PageManager
     static const uint64_t kWritable = 1 << 1;
     static const uint64_t kUser = 1 << 2;
 
+    // Initialize でアイデンティティマップする範囲 (0 - 64GB)
+    // これより上にある物理アドレス (64bit BAR など) は MapPage してから触ること
+    static const uint64_t kIdentityMapEnd = 64 * kPageSize1G;
+
     // ページングの初期化 (PML4の作成とアイデンティティマッピング)
     static void Initialize();
 
@@ -86,9 +91,15 @@ class PageManager
                         uint64_t flags = kPresent | kWritable);
 
     // 指定された仮想アドレス領域に、新しい物理フレームを割り当ててマップする
+    // owner: 割り当てるフレームの用途 (メモリ使用量の内訳に使う)
     // 成功したらtrue、メモリ不足などで失敗したらfalse
     static bool AllocateVirtual(uint64_t virtual_addr, size_t size,
-                                uint64_t flags = kPresent | kWritable | kUser);
+                                uint64_t flags = kPresent | kWritable | kUser,
+                                MemoryOwner owner = MemoryOwner::kUser);
+
+    // 現在のページテーブルで virtual_addr を引き、ユーザーが書き込めるページなら
+    // 対応する物理アドレスを physical_addr に入れて true を返す
+    static bool LookupUserWritable(uint64_t virtual_addr, uint64_t *physical_addr);
 
     // 新しいページテーブル領域を確保して初期化するヘルパー
     static PageTable *AllocateTable();
@@ -120,7 +131,8 @@ class PageManager
     static bool AllocateVirtualForProcess(uint64_t target_cr3,
                                           uint64_t virtual_addr, size_t size,
                                           uint64_t flags = kPresent |
-                                                           kWritable | kUser);
+                                                           kWritable | kUser,
+                                          MemoryOwner owner = MemoryOwner::kUser);
 
     // ページテーブルをディープコピーする（指定階層のみ）
     // src: コピー元テーブル
@@ -2,6 +2,7 @@
 #include "driver/nvme/nvme_driver.hpp"
 #include "driver/usb/xhci.hpp"
 #include "io.hpp"
+#include "paging.hpp"
 #include "printk.hpp"
 
 namespace PCI
@@ -19,8 +20,14 @@ uint32_t MakeAddress(uint8_t bus, uint8_t device, uint8_t function,
 
 uintptr_t ReadBar0(const Device &dev)
 {
-    // BAR0 はレジスタオフセット 0x10
-    uint32_t bar0 = ReadConfReg(dev, 0x10);
+    return ReadBar(dev, 0);
+}
+
+uintptr_t ReadBar(const Device &dev, int index)
+{
+    // BAR0 はレジスタオフセット 0x10、以降4バイトずつ
+    uint8_t reg = static_cast<uint8_t>(0x10 + index * 4);
+    uint32_t bar = ReadConfReg(dev, reg);
 
     // 下位4ビットはフラグなのでマスクする
     // bit 0: Memory Space Indicator (0=Memory, 1=I/O)
@@ -28,21 +35,21 @@ uintptr_t ReadBar0(const Device &dev)
     // bit 3: Prefetchable
 
     // 64bit BARかどうかチェック (Type == 2)
-    uint32_t type = (bar0 >> 1) & 0x03;
+    uint32_t type = (bar >> 1) & 0x03;
 
     if (type == 0x02)
     { // 64bit
-        // BAR1 (オフセット 0x14) から上位32bitを読む
-        uint32_t bar1 = ReadConfReg(dev, 0x14);
+        // 次のBARから上位32bitを読む
+        uint32_t upper = ReadConfReg(dev, reg + 4);
 
         // 結合して返す (下位4bitのフラグは消す: & ~0xF)
-        uintptr_t addr = (static_cast<uintptr_t>(bar1) << 32) | (bar0 & ~0xF);
+        uintptr_t addr = (static_cast<uintptr_t>(upper) << 32) | (bar & ~0xF);
         return addr;
     }
     else
     {
         // 32bit
-        return static_cast<uintptr_t>(bar0 & ~0xF);
+        return static_cast<uintptr_t>(bar & ~0xF);
     }
 }
 
@@ -133,99 +140,158 @@ void ScanAllBus()
     kprintf("PCI Scan Done.\n");
 }
 
-bool SetupMSI(const Device &dev, uint8_t vector)
+// Capability List から cap_id のものを探す (見つからなければ0)
+uint8_t FindCapability(const Device &dev, uint8_t cap_id)
 {
-    kprintf("[PCI MSI] Setting up MSI for device %d:%d.%d with vector 0x%x\n",
-            dev.bus, dev.device, dev.function, vector);
-
-    // Status Register (0x06) でCapability List存在を確認
+    // Status Register (0x06) の Bit 4: Capabilities List
     uint32_t status_cmd = ReadConfReg(dev, 0x04);
-    uint16_t status = (status_cmd >> 16) & 0xFFFF;
+    if (!((status_cmd >> 16) & (1 << 4)))
+        return 0;
 
-    if (!(status & (1 << 4))) // Bit 4: Capabilities List
+    uint8_t cap_ptr = ReadConfReg(dev, 0x34) & 0xFF;
+    while (cap_ptr != 0)
     {
-        kprintf("[PCI MSI] Device does not support Capabilities List\n");
-        return false;
+        uint32_t cap_reg = ReadConfReg(dev, cap_ptr);
+        if ((cap_reg & 0xFF) == cap_id)
+            return cap_ptr;
+        cap_ptr = (cap_reg >> 8) & 0xFF;
     }
+    return 0;
+}
 
-    // Capabilities Pointer (0x34) を読む
-    uint32_t cap_ptr_reg = ReadConfReg(dev, 0x34);
-    uint8_t cap_ptr = cap_ptr_reg & 0xFF;
+bool SetupMSI(const Device &dev, uint8_t vector)
+{
+    kprintf("[PCI MSI] Setting up MSI for device %d:%d.%d with vector 0x%x\n",
+            dev.bus, dev.device, dev.function, vector);
 
-    // Capability Listを走査
-    while (cap_ptr != 0)
+    // MSI-X (0x11) をまず探す
+    uint8_t cap_ptr = FindCapability(dev, 0x11);
+    if (cap_ptr != 0)
     {
+        kprintf("[PCI MSI] Found MSI-X capability at offset 0x%x\n", cap_ptr);
+
+        // MSI-X Message Control (cap_ptr + 0x02)
         uint32_t cap_reg = ReadConfReg(dev, cap_ptr);
-        uint8_t cap_id = cap_reg & 0xFF;
-        uint8_t next_ptr = (cap_reg >> 8) & 0xFF;
+        uint16_t msg_ctrl = (cap_reg >> 16) & 0xFFFF;
 
-        // MSI-X (0x11) をまず探す
-        if (cap_id == 0x11)
-        {
-            kprintf("[PCI MSI] Found MSI-X capability at offset 0x%x\n",
-                    cap_ptr);
+        // MSI-X Enable (bit 15) と Function Mask (bit 14)
+        msg_ctrl |= (1 << 15);  // MSI-X Enable
+        msg_ctrl &= ~(1 << 14); // Clear Function Mask
 
-            // MSI-X Message Control (cap_ptr + 0x02)
-            uint32_t msg_ctrl_reg = ReadConfReg(dev, cap_ptr);
-            uint16_t msg_ctrl = (msg_ctrl_reg >> 16) & 0xFFFF;
+        // Message Control を書き戻し
+        uint32_t new_ctrl_reg = (cap_reg & 0xFFFF) | (msg_ctrl << 16);
+        WriteConfReg(dev, cap_ptr, new_ctrl_reg);
 
-            // MSI-X Enable (bit 15) と Function Mask (bit 14)
-            msg_ctrl |= (1 << 15);  // MSI-X Enable
-            msg_ctrl &= ~(1 << 14); // Clear Function Mask
+        kprintf("[PCI MSI] MSI-X enabled successfully (simplified setup)\n");
+        return true;
+    }
 
-            // Message Control を書き戻し
-            uint32_t new_ctrl_reg = (cap_reg & 0xFFFF) | (msg_ctrl << 16);
-            WriteConfReg(dev, cap_ptr, new_ctrl_reg);
+    // MSI (0x05)
+    cap_ptr = FindCapability(dev, 0x05);
+    if (cap_ptr == 0)
+    {
+        kprintf("[PCI MSI] No MSI or MSI-X capability found\n");
+        return false;
+    }
 
-            kprintf(
-                "[PCI MSI] MSI-X enabled successfully (simplified setup)\n");
-            return true;
-        }
-        // MSI (0x05)
-        else if (cap_id == 0x05)
-        {
-            kprintf("[PCI MSI] Found MSI capability at offset 0x%x\n", cap_ptr);
+    kprintf("[PCI MSI] Found MSI capability at offset 0x%x\n", cap_ptr);
 
-            // MSI Message Control (cap_ptr + 0x02)
-            uint32_t msg_ctrl_reg = ReadConfReg(dev, cap_ptr);
-            uint16_t msg_ctrl = (msg_ctrl_reg >> 16) & 0xFFFF;
-            bool is_64bit = (msg_ctrl & (1 << 7)) != 0;
+    // MSI Message Control (cap_ptr + 0x02)
+    uint32_t cap_reg = ReadConfReg(dev, cap_ptr);
+    uint16_t msg_ctrl = (cap_reg >> 16) & 0xFFFF;
+    bool is_64bit = (msg_ctrl & (1 << 7)) != 0;
 
-            kprintf("[PCI MSI] MSI is %s\n", is_64bit ? "64-bit" : "32-bit");
+    kprintf("[PCI MSI] MSI is %s\n", is_64bit ? "64-bit" : "32-bit");
 
-            // MSI Address (LAPIC base address)
-            // Local APIC default address: 0xFEE00000
-            // Format: 0xFEE + Destination ID (8bit) + Reserved (12bit)
-            uint32_t msi_address = 0xFEE00000;
-            WriteConfReg(dev, cap_ptr + 0x04, msi_address);
+    // MSI Address (LAPIC base address)
+    // Local APIC default address: 0xFEE00000
+    // Format: 0xFEE + Destination ID (8bit) + Reserved (12bit)
+    uint32_t msi_address = 0xFEE00000;
+    WriteConfReg(dev, cap_ptr + 0x04, msi_address);
 
-            if (is_64bit)
-            {
-                WriteConfReg(dev, cap_ptr + 0x08, 0); // Upper 32-bit = 0
-                // MSI Data at offset 0x0C for 64-bit
-                WriteConfReg(dev, cap_ptr + 0x0C, vector);
-            }
-            else
-            {
-                // MSI Data at offset 0x08 for 32-bit
-                WriteConfReg(dev, cap_ptr + 0x08, vector);
-            }
+    if (is_64bit)
+    {
+        WriteConfReg(dev, cap_ptr + 0x08, 0); // Upper 32-bit = 0
+        // MSI Data at offset 0x0C for 64-bit
+        WriteConfReg(dev, cap_ptr + 0x0C, vector);
+    }
+    else
+    {
+        // MSI Data at offset 0x08 for 32-bit
+        WriteConfReg(dev, cap_ptr + 0x08, vector);
+    }
 
-            // MSI Enable (bit 0 of Message Control)
-            msg_ctrl |= (1 << 0);
-            uint32_t new_ctrl_reg = (cap_reg & 0xFFFF) | (msg_ctrl << 16);
-            WriteConfReg(dev, cap_ptr, new_ctrl_reg);
+    // MSI Enable (bit 0 of Message Control)
+    msg_ctrl |= (1 << 0);
+    uint32_t new_ctrl_reg = (cap_reg & 0xFFFF) | (msg_ctrl << 16);
+    WriteConfReg(dev, cap_ptr, new_ctrl_reg);
 
-            kprintf("[PCI MSI] MSI enabled successfully with vector 0x%x\n",
-                    vector);
-            return true;
-        }
+    kprintf("[PCI MSI] MSI enabled successfully with vector 0x%x\n", vector);
+    return true;
+}
+
+int SetupMSIX(const Device &dev, const uint8_t *vectors, int count)
+{
+    uint8_t cap_ptr = FindCapability(dev, 0x11);
+    if (cap_ptr == 0)
+    {
+        kprintf("[PCI MSI-X] No MSI-X capability found\n");
+        return 0;
+    }
+
+    // Message Control (cap_ptr + 0x02)
+    // bit 10:0 = Table Size - 1, bit 14 = Function Mask, bit 15 = Enable
+    uint32_t cap_reg = ReadConfReg(dev, cap_ptr);
+    uint16_t msg_ctrl = (cap_reg >> 16) & 0xFFFF;
+    int table_size = (msg_ctrl & 0x7FF) + 1;
+    if (count > table_size)
+        count = table_size;
+
+    // Table Offset/BIR (cap_ptr + 0x04): テーブルは BIR 番目のBARの Offset から
+    uint32_t table_reg = ReadConfReg(dev, cap_ptr + 0x04);
+    int bir = table_reg & 0x7;
+    uintptr_t bar = (bir <= 5) ? ReadBar(dev, bir) : 0;
+    if (bar == 0)
+    {
+        kprintf("[PCI MSI-X] %d:%d.%d: table BAR%d is not assigned\n", dev.bus,
+                dev.device, dev.function, bir);
+        return 0;
+    }
+    uintptr_t table = bar + (table_reg & ~0x7U);
+
+    // 64bit BAR はアイデンティティマップの外に置かれることがあるので、その分はマップしておく
+    uintptr_t table_end = table + count * 16;
+    if (table_end > PageManager::kIdentityMapEnd)
+    {
+        uintptr_t page = table & ~(kPageSize4K - 1);
+        size_t pages = (table_end - page + kPageSize4K - 1) / kPageSize4K;
+        PageManager::MapPage(page, page, pages);
+    }
+    volatile uint32_t *entries = reinterpret_cast<volatile uint32_t *>(table);
+
+    // 設定中は全体をマスクしておく
+    msg_ctrl |= (1 << 15) | (1 << 14);
+    WriteConfReg(dev, cap_ptr, (cap_reg & 0xFFFF) | (msg_ctrl << 16));
 
-        cap_ptr = next_ptr;
+    for (int i = 0; i < count; ++i)
+    {
+        // エントリ (16 bytes): Address Low, Address High, Data, Vector Control
+        volatile uint32_t *entry = entries + i * 4;
+        entry[0] = 0xFEE00000; // Local APIC (Destination ID 0 = BSP)
+        entry[1] = 0;
+        entry[2] = vectors[i];
+        entry[3] = 0; // bit 0: Mask を外す
     }
 
-    kprintf("[PCI MSI] No MSI or MSI-X capability found\n");
-    return false;
+    // Function Mask を外して有効化し、INTx は止める (Command Register bit 10)
+    msg_ctrl &= ~(1 << 14);
+    WriteConfReg(dev, cap_ptr, (cap_reg & 0xFFFF) | (msg_ctrl << 16));
+    uint32_t status_cmd = ReadConfReg(dev, 0x04);
+    WriteConfReg(dev, 0x04, (status_cmd & 0xFFFF) | (1 << 10));
+
+    kprintf("[PCI MSI-X] %d:%d.%d: %d of %d vectors enabled\n", dev.bus,
+            dev.device, dev.function, count, table_size);
+    return count;
 }
 
 void SetupPCI()
@@ -274,6 +340,8 @@ void SetupPCI()
                     NVMe::g_nvme = new NVMe::Driver(bar0);
                     NVMe::g_nvme->Initialize();
                     NVMe::g_nvme->IdentifyController();
+                    // 完了を割り込みで受け取る (I/Oキューの作成より前に設定する)
+                    NVMe::g_nvme->SetupInterrupts(d);
                     NVMe::g_nvme->CreateIOQueues();
                 }
             }
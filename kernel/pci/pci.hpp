@@ -22,6 +22,8 @@ struct Device
 };
 
 uintptr_t ReadBar0(const Device &dev);
+// index 番目のBARのアドレスを返す (64bit BARは次のBARと組にして読む)
+uintptr_t ReadBar(const Device &dev, int index);
 uint32_t ReadConfReg(const Device &dev, uint8_t reg_addr);
 void WriteConfReg(const Device &dev, uint8_t reg_addr, uint32_t value);
 
@@ -33,4 +35,8 @@ void SetupPCI();
 // MSI/MSI-X割り込み設定
 bool SetupMSI(const Device &dev, uint8_t vector);
 
+// MSI-X テーブルの先頭 count 個のエントリに vectors[i] を割り当てる (宛先はBSP)
+// 戻り値: 設定できたエントリ数 (MSI-X がなければ 0)
+int SetupMSIX(const Device &dev, const uint8_t *vectors, int count);
+
 } // namespace PCI
\ No newline at end of file
@@ -1,10 +1,14 @@
 #include "shell/shell.hpp"
 #include "app/elf/elf_loader.hpp"
 #include "console.hpp"
+#include "cxx.hpp"
 #include "driver/usb/keyboard/keyboard.hpp"
 #include "fs/fat32/fat32_driver.hpp"
+#include "fs/vfs.hpp"
+#include "memory/kernel_heap.hpp"
 #include "memory/memory_manager.hpp"
 #include "printk.hpp"
+#include "sys/bench/mem_bench.hpp"
 #include "sys/logger/logger.hpp"
 #include "sys/std/file_descriptor.hpp"
 #include "sys/sys.hpp"
@@ -13,13 +17,11 @@
 
 Shell *g_shell = nullptr;
 
-// 簡易memset
-void memset(void *dest, int val, int len)
+namespace
 {
-    unsigned char *ptr = (unsigned char *)dest;
-    while (len-- > 0)
-        *ptr++ = val;
-}
+// パイプラインの中間データを置くファイル
+const char *const kPipeFile = "/tmp/.pipe";
+} // namespace
 
 Shell::Shell() : cursor_pos_(0), current_cluster_(0)
 {
@@ -76,21 +78,22 @@ void Shell::ExecuteCommand()
         return;
 
     // パイプ処理 (|)
-    char *pipe_pos = nullptr;
-    for (int i = 0; i < cursor_pos_; ++i)
-    {
-        if (buffer_[i] == '|')
-        {
-            buffer_[i] = 0;
-            pipe_pos = &buffer_[i + 1];
-            break;
-        }
-    }
+    char *pipe_pos = static_cast<char *>(memchr(buffer_, '|', cursor_pos_));
+    if (pipe_pos)
+        *pipe_pos++ = 0;
 
     if (pipe_pos)
     {
         // パイプあり: コマンドA | コマンドB
-        PipeFD *pipe = new PipeFD();
+        // コマンドAの出力は /tmp のファイルに溜める (PipeFD の4KBで切れないように)
+        // /tmp が使えなければ PipeFD に戻す
+        FileDescriptor *pipe = new FileFD(kPipeFile, kOpenWrite | kOpenCreate |
+                                                          kOpenTruncate);
+        if (!static_cast<FileFD *>(pipe)->IsValid())
+        {
+            delete pipe;
+            pipe = new PipeFD();
+        }
 
         // Stdout(1) をパイプに退避/差し替え
         FileDescriptor *original_stdout = g_fds[1];
@@ -100,15 +103,19 @@ void Shell::ExecuteCommand()
 
         g_fds[1] = original_stdout;
 
-        // Stdin(0) をパイプに退避/差し替え
+        // Stdin(0) をパイプに退避/差し替え (ファイルなら先頭から読み直す)
         FileDescriptor *original_stdin = g_fds[0];
         g_fds[0] = pipe;
+        pipe->Seek(0, kSeekSet);
 
         ExecuteSingleCommand(pipe_pos);
 
         g_fds[0] = original_stdin;
 
+        bool is_file = pipe->GetType() == FD_FILE;
         delete pipe;
+        if (is_file)
+            FileSystem::VFS::Unlink(kPipeFile);
     }
     else
     {
@@ -156,16 +163,11 @@ void Shell::ExecuteSingleCommand(char *cmd_line)
         else
         {
             char *filename = argv[1];
-            if (!FileSystem::g_fat32_driver)
-            {
-                kprintf("Error: File System not initialized.\n");
-                return;
-            }
             uint32_t buf_size = 4096;
             char *buf = static_cast<char *>(MemoryManager::Allocate(buf_size));
             memset(buf, 0, buf_size);
             uint32_t bytes_read =
-                FileSystem::g_fat32_driver->ReadFile(filename, buf, buf_size);
+                FileSystem::VFS::ReadFile(filename, buf, buf_size);
             if (bytes_read > 0)
             {
                 g_fds[1]->Write(buf, bytes_read);
@@ -195,32 +197,28 @@ void Shell::ExecuteSingleCommand(char *cmd_line)
     }
     else if (strcmp(argv[0], "ls") == 0)
     {
-        if (FileSystem::g_fat32_driver)
-        {
-            FileSystem::g_fat32_driver->ListDirectory();
-        }
-        else
-        {
-            kprintf("Error: File System not initialized.\n");
-        }
+        FileSystem::VFS::ListDirectory(argc > 1 ? argv[1] : "/");
+    }
+    else if (strcmp(argv[0], "sync") == 0)
+    {
+        if (!FileSystem::VFS::Sync())
+            kprintf("Error: Sync failed.\n");
     }
     else if (strcmp(argv[0], "rm") == 0)
     {
         char *filename = argv[1];
-        if (FileSystem::g_fat32_driver)
+        if (argc < 2)
         {
-            if (FileSystem::g_fat32_driver->DeleteFile(filename))
-            {
-                kprintf("Deleted %s\n", filename);
-            }
-            else
-            {
-                kprintf("Could not delete %s\n", filename);
-            }
+            kprintf("Usage: rm <path>\n");
+        }
+        else if (FileSystem::VFS::Unlink(filename))
+        {
+            FileSystem::VFS::Sync();
+            kprintf("Deleted %s\n", filename);
         }
         else
         {
-            kprintf("File System not initialized.\n");
+            kprintf("Could not delete %s\n", filename);
         }
     }
     else if (strcmp(argv[0], "logger") == 0)
@@ -457,6 +455,46 @@ void Shell::ExecuteSingleCommand(char *cmd_line)
             }
         }
     }
+    else if (strcmp(argv[0], "meminfo") == 0)
+    {
+        static const char *kOwnerNames[] = {"free",  "other", "heap", "pagetable",
+                                            "stack", "dma",   "user", "fs"};
+        MemoryStats stats;
+        MemoryManager::GetStats(&stats);
+
+        kprintf("Total: %lu KB  Usable: %lu KB  Free: %lu KB\n",
+                stats.total_frames * 4, stats.usable_frames * 4,
+                stats.free_frames * 4);
+        kprintf("Largest free block: %lu KB\n", stats.largest_free_block * 4);
+
+        kprintf("-- Usage by owner --\n");
+        for (int i = 1; i < static_cast<int>(MemoryOwner::kCount); ++i)
+        {
+            kprintf("  %s: %lu KB\n", kOwnerNames[i], stats.owner_frames[i] * 4);
+        }
+
+        kprintf("-- Free blocks by order --\n");
+        for (int order = 0; order <= BuddyAllocator::kMaxOrder; ++order)
+        {
+            if (stats.free_blocks[order] > 0)
+                kprintf("  %6lu KB x %lu\n", (1UL << order) * 4, stats.free_blocks[order]);
+        }
+
+        kprintf("-- Regions --\n");
+        for (uint64_t i = 0; i < stats.region_count; ++i)
+        {
+            kprintf("  %016lx %8lu KB (free %lu KB)\n", stats.regions[i].start,
+                    stats.regions[i].frames * 4, stats.regions[i].free_frames * 4);
+        }
+    }
+    else if (strcmp(argv[0], "membench") == 0)
+    {
+        Sys::Bench::RunMemoryBenchmark();
+    }
+    else if (strcmp(argv[0], "heap") == 0)
+    {
+        KernelHeap::DumpStats();
+    }
     else if (strcmp(argv[0], "sys") == 0)
     {
         kprintf("=============== Sylphia-OS ZERO ===============\n");
@@ -475,8 +513,12 @@ void Shell::ExecuteSingleCommand(char *cmd_line)
         }
         g_usb_keyboard->ForceSendTRB();
         char path[64];
-        strcpy(path, "/sys/bin/");
-        strcat(path, argv[0]);
+        strlcpy(path, "/sys/bin/", sizeof(path));
+        if (strlcat(path, argv[0], sizeof(path)) >= sizeof(path))
+        {
+            kprintf("Unknown command: %s\n", argv[0]);
+            return;
+        }
 
         // 新しい非同期実行API（マルチタスク対応）
         Task *task = ElfLoader::CreateProcess(path, argc, argv);
@@ -0,0 +1,69 @@
+#pragma once
+#include <stdint.h>
+
+// 割り込みフラグ(RFLAGS.IF)を保存してから割り込みを禁止する
+static inline uint64_t SaveAndDisableInterrupts()
+{
+    uint64_t rflags;
+    __asm__ volatile("pushfq\n\tpopq %0\n\tcli" : "=r"(rflags) : : "memory");
+    return rflags;
+}
+
+// SaveAndDisableInterrupts で保存した状態に戻す
+static inline void RestoreInterrupts(uint64_t rflags)
+{
+    if (rflags & (1 << 9))
+        __asm__ volatile("sti" : : : "memory");
+}
+
+// 単純なテスト&セット方式のスピンロック
+// 割り込みハンドラからも取られるロックは LockIrqSave を使うこと
+class SpinLock
+{
+public:
+    void Lock()
+    {
+        while (__atomic_exchange_n(&locked_, 1, __ATOMIC_ACQUIRE))
+        {
+            // 取れるまではキャッシュラインを書き換えずに読むだけにする
+            while (__atomic_load_n(&locked_, __ATOMIC_RELAXED))
+                __asm__ volatile("pause");
+        }
+    }
+
+    void Unlock()
+    {
+        __atomic_store_n(&locked_, 0, __ATOMIC_RELEASE);
+    }
+
+    uint64_t LockIrqSave()
+    {
+        uint64_t flags = SaveAndDisableInterrupts();
+        Lock();
+        return flags;
+    }
+
+    void UnlockIrqRestore(uint64_t flags)
+    {
+        Unlock();
+        RestoreInterrupts(flags);
+    }
+
+private:
+    volatile uint32_t locked_ = 0;
+};
+
+// スコープを抜けると解放されるロック (割り込み禁止付き)
+class SpinLockGuard
+{
+public:
+    explicit SpinLockGuard(SpinLock &lock) : lock_(lock), flags_(lock.LockIrqSave()) {}
+    ~SpinLockGuard() { lock_.UnlockIrqRestore(flags_); }
+
+    SpinLockGuard(const SpinLockGuard &) = delete;
+    SpinLockGuard &operator=(const SpinLockGuard &) = delete;
+
+private:
+    SpinLock &lock_;
+    uint64_t flags_;
+};
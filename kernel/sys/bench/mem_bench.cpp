@@ -0,0 +1,130 @@
+#include "sys/bench/mem_bench.hpp"
+#include "cxx.hpp"
+#include "io.hpp"
+#include "memory/memory_manager.hpp"
+#include "printk.hpp"
+#include <stdint.h>
+
+namespace Sys
+{
+namespace Bench
+{
+
+namespace
+{
+
+const size_t kBufferSize = 2 * 1024 * 1024;
+// 1サイズあたりに処理する総バイト数
+const uint64_t kBytesPerRun = 64ULL * 1024 * 1024;
+
+inline uint64_t ReadTSC()
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+// PIT(8254)のチャンネル2で10msを計り、TSCの周波数を求める
+uint64_t CalibrateTSC()
+{
+    const uint16_t kPitLatch = 11932; // 1.193182MHz * 10ms
+
+    // ゲートをON、スピーカー出力はOFF
+    IoOut8(0x61, (IoIn8(0x61) & ~0x02) | 0x01);
+    // チャンネル2, Lo/Hi, モード0 (カウント終了でOUTがHigh)
+    IoOut8(0x43, 0xB0);
+    IoOut8(0x42, kPitLatch & 0xFF);
+    IoOut8(0x42, kPitLatch >> 8);
+
+    uint64_t start = ReadTSC();
+    while ((IoIn8(0x61) & 0x20) == 0)
+        ;
+    uint64_t end = ReadTSC();
+
+    return (end - start) * 100;
+}
+
+// bytes を cycles で処理したときの速度を "x.yy GB/s" で表示する
+void PrintRate(const char *name, size_t size, uint64_t bytes, uint64_t cycles,
+               uint64_t tsc_hz)
+{
+    if (cycles == 0)
+        cycles = 1;
+    // MB/s = bytes * hz / cycles / 10^6 (オーバーフローしないよう先に割る)
+    uint64_t mb_per_sec = (bytes / 1000) * (tsc_hz / 1000) / cycles;
+    kprintf("  %s %7lu B: %lu.%02lu GB/s\n", name, size, mb_per_sec / 1000,
+            (mb_per_sec % 1000) / 10);
+}
+
+} // namespace
+
+void RunMemoryBenchmark()
+{
+    static const size_t kSizes[] = {16, 64, 256, 1024, 4096, 65536, 1024 * 1024};
+    static const int kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+
+    uint8_t *src = static_cast<uint8_t *>(MemoryManager::Allocate(kBufferSize));
+    uint8_t *dst = static_cast<uint8_t *>(MemoryManager::Allocate(kBufferSize));
+    if (!src || !dst)
+    {
+        kprintf("[Bench] Failed to allocate buffers.\n");
+        if (src)
+            MemoryManager::Free(src, kBufferSize);
+        if (dst)
+            MemoryManager::Free(dst, kBufferSize);
+        return;
+    }
+
+    uint64_t tsc_hz = CalibrateTSC();
+    kprintf("[Bench] TSC: %lu MHz, ERMS: %s\n", tsc_hz / 1000000,
+            HasERMS() ? "yes" : "no");
+
+    memset(src, 0x5A, kBufferSize);
+    memset(dst, 0x5A, kBufferSize);
+
+    for (int i = 0; i < kNumSizes; ++i)
+    {
+        size_t size = kSizes[i];
+        uint64_t iterations = kBytesPerRun / size;
+        // バッファ内をずらしながら使い、同じキャッシュラインだけを叩かないようにする
+        size_t slots = kBufferSize / size;
+
+        uint64_t start = ReadTSC();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            size_t off = (n % slots) * size;
+            memcpy(dst + off, src + off, size);
+        }
+        PrintRate("memcpy ", size, iterations * size, ReadTSC() - start, tsc_hz);
+
+        start = ReadTSC();
+        for (uint64_t n = 0; n < iterations; ++n)
+            memset(dst + (n % slots) * size, static_cast<int>(n), size);
+        PrintRate("memset ", size, iterations * size, ReadTSC() - start, tsc_hz);
+
+        // 1バイトずらして重ねたコピー (後方コピーの経路)
+        start = ReadTSC();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            size_t off = (n % (slots - 1)) * size;
+            memmove(dst + off + 1, dst + off, size);
+        }
+        PrintRate("memmove", size, iterations * size, ReadTSC() - start, tsc_hz);
+
+        memcpy(dst, src, kBufferSize);
+        volatile int sink = 0;
+        start = ReadTSC();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            size_t off = (n % slots) * size;
+            sink = sink + memcmp(dst + off, src + off, size);
+        }
+        PrintRate("memcmp ", size, iterations * size, ReadTSC() - start, tsc_hz);
+    }
+
+    MemoryManager::Free(src, kBufferSize);
+    MemoryManager::Free(dst, kBufferSize);
+}
+
+} // namespace Bench
+} // namespace Sys
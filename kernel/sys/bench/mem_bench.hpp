@@ -0,0 +1,12 @@
+#pragma once
+
+namespace Sys
+{
+namespace Bench
+{
+
+// memcpy/memset/memmove/memcmp をサイズごとに計測し、GB/s を表示する
+void RunMemoryBenchmark();
+
+} // namespace Bench
+} // namespace Sys
@@ -1,5 +1,6 @@
 #include "sys/init/init.hpp"
 #include "console.hpp"
+#include "cxx.hpp"
 #include "driver/usb/keyboard/keyboard.hpp"
 #include "interrupt.hpp"
 #include "memory/memory.hpp"
@@ -28,11 +29,12 @@ void InitializeCore(const MemoryMap &memmap)
     SetupInterrupts();
     DisablePIC();
     EnableSSE();
+    InitializeMemoryFunctions();
 
     MemoryManager::Initialize(memmap);
 
     const size_t kKernelStackSize = 1024 * 16; // 16KB
-    void *kernel_stack = MemoryManager::Allocate(kKernelStackSize);
+    void *kernel_stack = MemoryManager::Allocate(kKernelStackSize, 16, MemoryOwner::kStack);
     uint64_t kernel_stack_end =
         reinterpret_cast<uint64_t>(kernel_stack) + kKernelStackSize;
     SetKernelStack(kernel_stack_end);
@@ -1,6 +1,8 @@
 #include "sys/logger/logger.hpp"
+#include "cxx.hpp"
 #include "fs/fat32/fat32_driver.hpp"
 #include "memory/memory_manager.hpp"
+#include <std/string.hpp>
 
 namespace Sys
 {
@@ -10,28 +12,8 @@ namespace Logger
 // グローバルロガーインスタンス
 EventLogger *g_event_logger = nullptr;
 
-// 簡易的なstrlen
-static int str_len(const char *s)
-{
-    int len = 0;
-    while (*s++)
-        len++;
-    return len;
-}
-
-// 簡易的なstrcpy
-static void str_copy(char *dst, const char *src, int max_len)
-{
-    int i = 0;
-    while (src[i] && i < max_len - 1)
-    {
-        dst[i] = src[i];
-        i++;
-    }
-    dst[i] = '\0';
-}
-
 // 部分文字列検索
+// 先頭文字を memchr で探し、見つかった位置だけを memcmp で照合する
 static bool str_contains(const char *haystack, const char *needle)
 {
     if (!needle || !needle[0])
@@ -39,24 +21,21 @@ static bool str_contains(const char *haystack, const char *needle)
     if (!haystack)
         return false;
 
-    int h_len = str_len(haystack);
-    int n_len = str_len(needle);
+    size_t h_len = strlen(haystack);
+    size_t n_len = strlen(needle);
     if (n_len > h_len)
         return false;
 
-    for (int i = 0; i <= h_len - n_len; i++)
+    const char *p = haystack;
+    const char *last = haystack + h_len - n_len;
+    while (p <= last)
     {
-        bool match = true;
-        for (int j = 0; j < n_len; j++)
-        {
-            if (haystack[i + j] != needle[j])
-            {
-                match = false;
-                break;
-            }
-        }
-        if (match)
+        p = static_cast<const char *>(memchr(p, needle[0], last - p + 1));
+        if (!p)
+            return false;
+        if (memcmp(p, needle, n_len) == 0)
             return true;
+        p++;
     }
     return false;
 }
@@ -81,7 +60,7 @@ void EventLogger::Log(LogLevel level, LogType type, const char *message)
     entry.timestamp = tick_counter_++;
     entry.level = level;
     entry.type = type;
-    str_copy(entry.message, message, sizeof(entry.message));
+    strlcpy(entry.message, message, sizeof(entry.message));
     entry.is_flushed = false;
 
     head_ = (head_ + 1) % kLogBufferSize;
@@ -199,8 +178,7 @@ void EventLogger::Flush()
 
     // ログファイルが存在するかチェックし、なければヘッダーを書き込む
     // GetFileSize は存在しないファイルに対して 0 を返す
-    uint32_t existing_size =
-        FileSystem::g_system_fs->GetFileSize("SYSTEM  LOG");
+    uint32_t existing_size = FileSystem::g_system_fs->GetFileSize(kLogFileName);
 
     if (existing_size == 0)
     {
@@ -214,7 +192,7 @@ void EventLogger::Flush()
         for (int i = 0; i < 52; i++)
             header.reserved[i] = 0;
 
-        FileSystem::g_system_fs->WriteFile("SYSTEM  LOG", &header,
+        FileSystem::g_system_fs->WriteFile(kLogFileName, &header,
                                            sizeof(LogFileHeader), 0);
     }
 
@@ -249,7 +227,7 @@ void EventLogger::Flush()
         bin.timestamp = entry.timestamp;
         bin.level = static_cast<uint8_t>(entry.level);
         bin.type = static_cast<uint8_t>(entry.type);
-        bin.message_len = static_cast<uint16_t>(str_len(entry.message));
+        bin.message_len = static_cast<uint16_t>(strnlen(entry.message, sizeof(entry.message)));
 
         // メッセージをコピー
         for (int j = 0; j < 128; j++)
@@ -261,8 +239,9 @@ void EventLogger::Flush()
     }
 
     // ファイルに追記
-    FileSystem::g_system_fs->AppendFile("SYSTEM  LOG", bin_entries,
+    FileSystem::g_system_fs->AppendFile(kLogFileName, bin_entries,
                                         sizeof(LogEntryBinary) * bin_idx, 0);
+    FileSystem::g_system_fs->Sync();
 
     MemoryManager::Free(bin_entries, buf_size);
 }
@@ -36,6 +36,8 @@ struct LogEntry
 
 // バイナリログファイルのマジックナンバー
 constexpr uint32_t kLogFileMagic = 0x474F4C53; // "SLOG" in little-endian
+// ログファイルの名前 (システムドライブのルート)
+constexpr const char *kLogFileName = "SYSTEM.LOG";
 
 // Binary log file header (written once at the beginning of the file)
 struct LogFileHeader
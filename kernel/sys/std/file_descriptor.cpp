@@ -1,9 +1,7 @@
 #include "sys/std/file_descriptor.hpp"
 #include "cxx.hpp"
 #include "driver/usb/keyboard/keyboard.hpp"
-#include "fs/fat32/fat32_driver.hpp"
-#include "memory/memory_manager.hpp"
-#include <std/string.hpp>
+#include "fs/vfs.hpp"
 
 extern USB::Keyboard *g_usb_keyboard;
 
@@ -36,89 +34,138 @@ int KeyboardFD::Read(void *buf, size_t len)
 // FileFD 実装
 // ---------------------------------------------------------
 
-FileFD::FileFD(const char *path)
-    : buffer_(nullptr), file_size_(0), read_pos_(0), valid_(false)
+FileFD::FileFD(const char *path, int flags)
+    : inode_(nullptr), pos_(0), flags_(flags), dirty_(false)
 {
-    // パスをコピー
-    int len = strlen(path);
-    if (len > 127)
-        len = 127;
-    memcpy(path_, path, len);
-    path_[len] = '\0';
-
-    // ファイルシステムが初期化されているか確認
-    if (!FileSystem::g_fat32_driver)
+    bool writable = (flags_ & kOpenWrite) != 0;
+    FileSystem::Inode *inode =
+        FileSystem::VFS::Open(path, writable && (flags_ & kOpenCreate));
+    if (!inode)
     {
         return;
     }
 
-    // ファイルサイズを取得
-    file_size_ = FileSystem::g_fat32_driver->GetFileSize(path);
-    if (file_size_ == 0)
+    // ディレクトリは FileFD では開けない
+    if (inode->IsDirectory())
     {
-        return; // ファイルが存在しないか空
+        inode->Release();
+        return;
     }
 
-    // サイズ制限
-    if (file_size_ > kMaxFileSize)
+    if (writable && (flags_ & kOpenTruncate) && inode->GetSize() != 0)
     {
-        file_size_ = kMaxFileSize;
+        if (!inode->Truncate())
+        {
+            inode->Release();
+            return;
+        }
+        dirty_ = true;
     }
+    inode_ = inode;
+}
 
-    // バッファを確保してファイルを読み込み
-    buffer_ = static_cast<char *>(MemoryManager::Allocate(file_size_));
-    if (!buffer_)
+FileFD::~FileFD()
+{
+    if (!inode_)
     {
-        file_size_ = 0;
         return;
     }
+    if (dirty_)
+    {
+        inode_->GetSuperBlock()->Sync();
+    }
+    inode_->Release();
+}
+
+int FileFD::Read(void *buf, size_t len)
+{
+    int ret = PRead(buf, len, pos_);
+    if (ret > 0)
+    {
+        pos_ += ret;
+    }
+    return ret;
+}
 
-    uint32_t read_bytes =
-        FileSystem::g_fat32_driver->ReadFile(path, buffer_, file_size_);
-    if (read_bytes > 0)
+int FileFD::Write(const void *buf, size_t len)
+{
+    if (inode_ && (flags_ & kOpenAppend))
     {
-        file_size_ = read_bytes;
-        valid_ = true;
+        pos_ = inode_->GetSize();
     }
-    else
+
+    int ret = PWrite(buf, len, pos_);
+    if (ret > 0)
     {
-        MemoryManager::Free(buffer_, file_size_);
-        buffer_ = nullptr;
-        file_size_ = 0;
+        pos_ += ret;
     }
+    return ret;
 }
 
-FileFD::~FileFD()
+int FileFD::PRead(void *buf, size_t len, uint64_t offset)
 {
-    if (buffer_)
+    if (!inode_)
+    {
+        return -1;
+    }
+
+    // 戻り値が int なので、1回で読むのは 1GB まで
+    if (len > 0x40000000)
     {
-        MemoryManager::Free(buffer_, file_size_);
+        len = 0x40000000;
     }
+    return static_cast<int>(inode_->Read(offset, buf, len));
 }
 
-int FileFD::Read(void *buf, size_t len)
+int FileFD::PWrite(const void *buf, size_t len, uint64_t offset)
 {
-    if (!valid_ || !buffer_)
+    if (!inode_ || !(flags_ & kOpenWrite))
     {
         return -1;
     }
 
-    // 残りのデータ量
-    uint32_t remaining = file_size_ - read_pos_;
-    if (remaining == 0)
+    if (len > 0x40000000)
+    {
+        len = 0x40000000;
+    }
+    int64_t written = inode_->Write(offset, buf, len);
+    if (written > 0)
     {
-        return 0; // EOF
+        dirty_ = true;
     }
+    return static_cast<int>(written);
+}
 
-    // 読み取るバイト数
-    size_t to_read = len;
-    if (to_read > remaining)
+int64_t FileFD::Seek(int64_t offset, int whence)
+{
+    if (!inode_)
     {
-        to_read = remaining;
+        return -1;
     }
 
-    memcpy(buf, buffer_ + read_pos_, to_read);
-    read_pos_ += to_read;
+    int64_t base;
+    switch (whence)
+    {
+        case kSeekSet:
+            base = 0;
+            break;
+        case kSeekCur:
+            base = static_cast<int64_t>(pos_);
+            break;
+        case kSeekEnd:
+            base = static_cast<int64_t>(inode_->GetSize());
+            break;
+        default:
+            return -1;
+    }
 
-    return static_cast<int>(to_read);
+    int64_t new_pos = base + offset;
+    if (new_pos < 0)
+    {
+        return -1;
+    }
+    // 末尾より先へのシークは許し、そこへ書き込んだときに穴を0で埋める
+    // (ファイルシステムが扱えない位置なら、書き込み時に失敗する)
+    pos_ = static_cast<uint64_t>(new_pos);
+    return new_pos;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../../console.hpp"
+#include "../../fs/vfs.hpp"
 #include "../../printk.hpp"
 #include <stddef.h>
 #include <stdint.h>
@@ -28,8 +29,24 @@ class FileDescriptor
     virtual int Write(const void *buf, size_t len) = 0;
     virtual void Flush() {} // Default empty implementation
     virtual FDType GetType() const = 0;
+
+    // 位置を指定した読み書き・シーク (対応しないFDは-1を返す)
+    virtual int PRead(void *buf, size_t len, uint64_t offset) { return -1; }
+    virtual int PWrite(const void *buf, size_t len, uint64_t offset) { return -1; }
+    virtual int64_t Seek(int64_t offset, int whence) { return -1; }
 };
 
+// Open のフラグ (apps/_header/syscall.hpp と合わせる)
+const int kOpenWrite = 1 << 0;    // 書き込みを許可する
+const int kOpenCreate = 1 << 1;   // 存在しなければ作る
+const int kOpenTruncate = 1 << 2; // サイズ0にしてから開く
+const int kOpenAppend = 1 << 3;   // 書き込みは常に末尾へ
+
+// Seek の基準位置
+const int kSeekSet = 0;
+const int kSeekCur = 1;
+const int kSeekEnd = 2;
+
 // ---------------------------------------------------------
 // Console File Descriptor (Stdout / Stderr)
 // ---------------------------------------------------------
@@ -190,40 +207,32 @@ class PipeFD : public FileDescriptor
 };
 
 // ---------------------------------------------------------
-// File Descriptor (FAT32 File)
+// File Descriptor (VFS File)
 // ---------------------------------------------------------
-namespace FileSystem
-{
-class FAT32Driver;
-extern FAT32Driver *g_fat32_driver;
-} // namespace FileSystem
-
+// オープン時には VFS でパスを解決して Inode を掴むだけで、データは読み書きの
+// たびにファイルシステムへ必要な分だけ要求する
 class FileFD : public FileDescriptor
 {
   private:
-    static const uint32_t kMaxFileSize = 64 * 1024; // 最大64KB
-    char *buffer_;
-    uint32_t file_size_;
-    uint32_t read_pos_;
-    bool valid_;
-    char path_[128];
+    FileSystem::Inode *inode_;
+    uint64_t pos_;
+    int flags_;
+    bool dirty_; // 書き込みがあれば Close 時に Sync する
 
   public:
-    FileFD(const char *path);
+    FileFD(const char *path, int flags = 0);
     ~FileFD();
 
     bool IsValid() const
     {
-        return valid_;
+        return inode_ != nullptr;
     }
 
     int Read(void *buf, size_t len) override;
-
-    int Write(const void *buf, size_t len) override
-    {
-        // 現在は読み取り専用
-        return -1;
-    }
+    int Write(const void *buf, size_t len) override;
+    int PRead(void *buf, size_t len, uint64_t offset) override;
+    int PWrite(const void *buf, size_t len, uint64_t offset) override;
+    int64_t Seek(int64_t offset, int whence) override;
 
     FDType GetType() const override
     {
@@ -1,6 +1,8 @@
 #include "syscall.hpp"
 #include "app/elf/elf_loader.hpp"
+#include "cxx.hpp"
 #include "fs/fat32/fat32_driver.hpp"
+#include "fs/vfs.hpp"
 #include "memory/memory_manager.hpp"
 #include "paging.hpp"
 #include "printk.hpp"
@@ -29,6 +31,39 @@ extern "C" void SyscallEntry();
 // コンテキストの実体
 SyscallContext *g_syscall_context = nullptr;
 
+// ユーザー空間の文字列を size バイトのバッファにコピーする
+// src は size バイトまでしか読まない。収まらない場合は切り詰めて false を返す
+static bool CopyStringFromUser(char *dst, const char *src, size_t size)
+{
+    size_t len = strnlen(src, size);
+    bool fits = len < size;
+    if (!fits)
+        len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return fits;
+}
+
+// カーネルからユーザー空間の [ptr, ptr + size) に書き込んでよいか
+// すべてのページがユーザー書き込み可でマップされ、ユーザープロセスのフレームであることを確かめる
+// (カーネル領域もユーザー権限でアイデンティティマップされているので、所有者まで見る)
+static bool IsUserWritableRange(const void *ptr, size_t size)
+{
+    uint64_t begin = reinterpret_cast<uint64_t>(ptr);
+    uint64_t end = begin + size;
+    if (!ptr || size == 0 || end < begin)
+        return false;
+
+    for (uint64_t page = begin & ~(kPageSize4K - 1); page < end; page += kPageSize4K)
+    {
+        uint64_t paddr;
+        if (!PageManager::LookupUserWritable(page, &paddr) ||
+            MemoryManager::GetOwner(paddr) != MemoryOwner::kUser)
+            return false;
+    }
+    return true;
+}
+
 // ■ C++側システムコールハンドラ
 // アセンブリ側から呼び出される
 extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
@@ -129,14 +164,16 @@ extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
             // arg2: buffer (void*)
             // arg3: buffer_size (uint32_t)
             // 戻り値: 読み込んだバイト数 (uint64_t)
-            if (FileSystem::g_fat32_driver)
             {
-                const char *name = reinterpret_cast<const char *>(arg1);
+                const char *user_name = reinterpret_cast<const char *>(arg1);
                 void *buf = reinterpret_cast<void *>(arg2);
                 uint32_t len = static_cast<uint32_t>(arg3);
-                return FileSystem::g_fat32_driver->ReadFile(name, buf, len);
+                char name[256];
+                if (!user_name ||
+                    !CopyStringFromUser(name, user_name, sizeof(name)))
+                    return 0;
+                return FileSystem::VFS::ReadFile(name, buf, len);
             }
-            return 0;
 
         case 5: // Read (fd, buf, len)
         {
@@ -159,20 +196,44 @@ extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
 
             if (fd >= 0 && fd < 16 && g_fds[fd])
             {
-                char kernel_buf[256];
-                const char *user_buf = static_cast<const char *>(buf);
-                for (size_t i = 0; i < len && i < 255; ++i)
-                {
-                    kernel_buf[i] = user_buf[i];
-                }
-                kernel_buf[len < 255 ? len : 255] = '\0';
-                int ret = g_fds[fd]->Write(kernel_buf, len);
-                // delete[] kernel_buf;
-                return ret;
+                // 各FDの Write は buf から len バイトをコピーして使う
+                return g_fds[fd]->Write(buf, len);
             }
             return -1;
         }
 
+        case 7: // Seek (fd, offset, whence)
+        {
+            // 戻り値: 新しい位置 (失敗時 -1)
+            int fd = static_cast<int>(arg1);
+            int64_t offset = static_cast<int64_t>(arg2);
+            int whence = static_cast<int>(arg3);
+            if (fd >= 0 && fd < 16 && g_fds[fd])
+                return g_fds[fd]->Seek(offset, whence);
+            return -1;
+        }
+
+        case 8: // PRead (fd, buf, len, offset)
+        {
+            // 現在位置は変えずに offset から読む
+            int fd = static_cast<int>(arg1);
+            void *buf = reinterpret_cast<void *>(arg2);
+            size_t len = static_cast<size_t>(arg3);
+            if (fd >= 0 && fd < 16 && g_fds[fd])
+                return g_fds[fd]->PRead(buf, len, arg4);
+            return -1;
+        }
+
+        case 9: // PWrite (fd, buf, len, offset)
+        {
+            int fd = static_cast<int>(arg1);
+            const void *buf = reinterpret_cast<const void *>(arg2);
+            size_t len = static_cast<size_t>(arg3);
+            if (fd >= 0 && fd < 16 && g_fds[fd])
+                return g_fds[fd]->PWrite(buf, len, arg4);
+            return -1;
+        }
+
         case 10: // Yield (自発的にCPUを手放す)
             Scheduler::Yield();
             return 0;
@@ -205,9 +266,13 @@ extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
             int argc = static_cast<int>(arg2);
             char **user_argv = reinterpret_cast<char **>(arg3);
 
-            // pathをカーネル空間にコピー
+            // pathをカーネル空間にコピー (バッファに収まらなければ失敗)
             char kernel_path[256];
-            strcpy(kernel_path, user_path);
+            if (!user_path ||
+                !CopyStringFromUser(kernel_path, user_path, sizeof(kernel_path)))
+            {
+                return 0;
+            }
 
             // argvをカーネル空間にコピー
             char *kernel_argv[32];
@@ -220,7 +285,9 @@ extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
             {
                 if (user_argv[i])
                 {
-                    strcpy(argv_buffer[i], user_argv[i]);
+                    // 長すぎる引数は切り詰める
+                    CopyStringFromUser(argv_buffer[i], user_argv[i],
+                                       sizeof(argv_buffer[i]));
                     kernel_argv[i] = argv_buffer[i];
                 }
                 else
@@ -244,9 +311,12 @@ extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
         case 21: // Open (ファイルオープン)
         {
             // arg1: path (char*)
-            // arg2: flags (int) - 現在は未使用
+            // arg2: flags (int) - kOpenWrite などの組み合わせ
             // 戻り値: fd (成功) または -1 (失敗)
-            const char *path = reinterpret_cast<const char *>(arg1);
+            const char *user_path = reinterpret_cast<const char *>(arg1);
+            char path[256];
+            if (!user_path || !CopyStringFromUser(path, user_path, sizeof(path)))
+                return -1;
 
             // 空きfdを探す (3以降を使用、0-2は標準I/O)
             for (int fd = 3; fd < 16; ++fd)
@@ -254,7 +324,7 @@ extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
                 if (g_fds[fd] == nullptr)
                 {
                     // FileFDを作成
-                    FileFD *file_fd = new FileFD(path);
+                    FileFD *file_fd = new FileFD(path, static_cast<int>(arg2));
                     if (file_fd->IsValid())
                     {
                         g_fds[fd] = file_fd;
@@ -285,17 +355,35 @@ extern "C" uint64_t SyscallHandler(uint64_t syscall_number, uint64_t arg1,
         {
             // arg1: path (char*)
             // 戻り値: 0 (成功) または -1 (失敗)
-            const char *path = reinterpret_cast<const char *>(arg1);
-            if (FileSystem::g_fat32_driver)
+            const char *user_path = reinterpret_cast<const char *>(arg1);
+            char path[256];
+            if (!user_path || !CopyStringFromUser(path, user_path, sizeof(path)))
+                return -1;
+            if (FileSystem::VFS::Unlink(path))
             {
-                if (FileSystem::g_fat32_driver->DeleteFile(path))
-                {
-                    return 0;
-                }
+                FileSystem::VFS::Sync();
+                return 0;
             }
             return -1;
         }
 
+        case 30: // MemInfo (メモリ使用状況の取得)
+        {
+            // arg1: MemInfo構造体へのポインタ (ユーザー空間)
+            // arg2: 構造体のサイズ
+            // 戻り値: 0 (成功) または -1 (失敗)
+            void *user_buf = reinterpret_cast<void *>(arg1);
+            size_t size = static_cast<size_t>(arg2);
+            if (size < sizeof(MemoryStats) ||
+                !IsUserWritableRange(user_buf, sizeof(MemoryStats)))
+                return -1;
+
+            MemoryStats stats;
+            MemoryManager::GetStats(&stats);
+            memcpy(user_buf, &stats, sizeof(MemoryStats));
+            return 0;
+        }
+
         default:
             kprintf("Unknown Syscall: %ld\n", syscall_number);
             return 0;
@@ -316,7 +404,7 @@ void InitializeSyscall()
 
     // 2. システムコール専用カーネルスタックの確保 (16KB)
     const size_t kStackSize = 16 * 1024;
-    void *stack_mem = MemoryManager::Allocate(kStackSize);
+    void *stack_mem = MemoryManager::Allocate(kStackSize, 16, MemoryOwner::kStack);
 
     // スタックは高位アドレスから低位へ伸びるため、末尾をセット
     g_syscall_context->kernel_stack_ptr =
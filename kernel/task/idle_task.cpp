@@ -1,6 +1,7 @@
 #include "idle_task.hpp"
 #include "app/elf/elf_loader.hpp"
 #include "io.hpp"
+#include "memory/memory_manager.hpp"
 #include "printk.hpp"
 #include "sys/logger/logger.hpp"
 #include "sys/std/file_descriptor.hpp"
@@ -43,6 +44,9 @@ static void poll_serial_input()
 
 Task *g_idle_task = nullptr;
 
+// アイドルループ1周あたりにゼロクリアするフレーム数
+static const size_t kIdleZeroBudget = 16;
+
 // 必須プロセスの管理
 namespace EssentialProcesses
 {
@@ -130,6 +134,10 @@ void IdleTaskEntry()
         poll_serial_input();
 #endif
 
+        // 手が空いている間にゼロ済みフレームを用意しておく
+        // 1回あたりの量は抑え、次の割り込みまでに hlt へ戻れるようにする
+        MemoryManager::RefillZeroPool(kIdleZeroBudget);
+
         __asm__ volatile("hlt"); // CPUを停止して割り込み待ち
     }
 }
@@ -37,15 +37,14 @@ Task *TaskManager::CreateTask(uint64_t entry_point)
     }
     memset(task, 0, sizeof(Task));
 
-    // カーネルスタックを割り当て
-    void *stack = MemoryManager::Allocate(kKernelStackSize);
+    // カーネルスタックを割り当て (ゼロ済みプールから取れればクリア不要)
+    void *stack = MemoryManager::AllocateZeroed(kKernelStackSize, MemoryOwner::kStack);
     if (!stack)
     {
         kprintf("[TaskManager] Failed to allocate kernel stack.\n");
         MemoryManager::Free(task, sizeof(Task));
         return nullptr;
     }
-    memset(stack, 0, kKernelStackSize);
 
     // タスクの基本情報を設定
     task->task_id = next_task_id_++;
@@ -129,7 +128,8 @@ Task *TaskManager::CreateAppTask(uint64_t wrapper_entry, uint64_t app_entry)
     if (!PageManager::AllocateVirtualForProcess(
             process_cr3, kUserStackBase, kUserStackSize,
             PageManager::kPresent | PageManager::kWritable |
-                PageManager::kUser))
+                PageManager::kUser,
+            MemoryOwner::kUser))
     {
         kprintf("[TaskManager] Failed to allocate user stack\n");
         PageManager::FreeProcessPageTable(process_cr3);
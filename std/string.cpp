@@ -1,7 +1,97 @@
 #include "string.hpp"
+#include "cxx.hpp"
+#include <stdint.h>
+
+namespace
+{
+    // 8バイト単位で走査するためのワード型
+    // アラインされたワードは必ず同じページに収まるので、終端の先を読んでもフォルトしない
+    typedef uint64_t __attribute__((may_alias)) Word;
+
+    const size_t kWordSize = sizeof(Word);
+    const Word kOnes = 0x0101010101010101ULL;
+    const Word kHighs = 0x8080808080808080ULL;
+
+    // ワード内に 0 のバイトがあれば非ゼロ
+    inline Word HasZero(Word w)
+    {
+        return (w - kOnes) & ~w & kHighs;
+    }
+
+    inline bool IsAligned(const void *p)
+    {
+        return (reinterpret_cast<uintptr_t>(p) & (kWordSize - 1)) == 0;
+    }
+
+    inline Word LoadWord(const void *p)
+    {
+        return *static_cast<const Word *>(p);
+    }
+} // namespace
+
+size_t strlen(const char *s)
+{
+    const char *p = s;
+    while (!IsAligned(p))
+    {
+        if (*p == 0)
+            return p - s;
+        p++;
+    }
+    while (!HasZero(LoadWord(p)))
+        p += kWordSize;
+    while (*p)
+        p++;
+    return p - s;
+}
+
+size_t strnlen(const char *s, size_t maxlen)
+{
+    const char *p = s;
+    size_t n = maxlen;
+    while (n && !IsAligned(p))
+    {
+        if (*p == 0)
+            return p - s;
+        p++;
+        n--;
+    }
+    while (n >= kWordSize && !HasZero(LoadWord(p)))
+    {
+        p += kWordSize;
+        n -= kWordSize;
+    }
+    while (n && *p)
+    {
+        p++;
+        n--;
+    }
+    return p - s;
+}
 
 int strcmp(const char *s1, const char *s2)
 {
+    // 両方を同時にアラインできるときだけワード単位で比較する
+    if (((reinterpret_cast<uintptr_t>(s1) ^ reinterpret_cast<uintptr_t>(s2)) &
+         (kWordSize - 1)) == 0)
+    {
+        while (!IsAligned(s1))
+        {
+            if (*s1 == 0 || *s1 != *s2)
+                return *(const unsigned char *)s1 - *(const unsigned char *)s2;
+            s1++;
+            s2++;
+        }
+        while (true)
+        {
+            Word w1 = LoadWord(s1);
+            if (w1 != LoadWord(s2) || HasZero(w1))
+                break;
+            s1 += kWordSize;
+            s2 += kWordSize;
+        }
+    }
+
     while (*s1 && (*s1 == *s2))
     {
         s1++;
@@ -10,9 +100,31 @@ int strcmp(const char *s1, const char *s2)
     return *(const unsigned char *)s1 - *(const unsigned char *)s2;
 }
 
-int strncmp(const char *s1, const char *s2, int n)
+int strncmp(const char *s1, const char *s2, size_t n)
 {
-    for (int i = 0; i < n; i++)
+    if (((reinterpret_cast<uintptr_t>(s1) ^ reinterpret_cast<uintptr_t>(s2)) &
+         (kWordSize - 1)) == 0)
+    {
+        while (n && !IsAligned(s1))
+        {
+            if (*s1 == 0 || *s1 != *s2)
+                return *(const unsigned char *)s1 - *(const unsigned char *)s2;
+            s1++;
+            s2++;
+            n--;
+        }
+        while (n >= kWordSize)
+        {
+            Word w1 = LoadWord(s1);
+            if (w1 != LoadWord(s2) || HasZero(w1))
+                break;
+            s1 += kWordSize;
+            s2 += kWordSize;
+            n -= kWordSize;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++)
     {
         if (s1[i] != s2[i])
             return (unsigned char)s1[i] - (unsigned char)s2[i];
@@ -22,38 +134,131 @@ int strncmp(const char *s1, const char *s2, int n)
     return 0;
 }
 
-int strlen(const char *s)
+char *strcpy(char *dest, const char *src)
 {
-    int len = 0;
-    while (s[len])
+    memcpy(dest, src, strlen(src) + 1);
+    return dest;
+}
+
+char *strncpy(char *dest, const char *src, size_t n)
+{
+    size_t len = strnlen(src, n);
+    memcpy(dest, src, len);
+    if (len < n)
+        memset(dest + len, 0, n - len);
+    return dest;
+}
+
+char *strcat(char *dest, const char *src)
+{
+    strcpy(dest + strlen(dest), src);
+    return dest;
+}
+
+size_t strlcpy(char *dest, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size != 0)
     {
-        len++;
+        size_t copy = (len < size) ? len : size - 1;
+        memcpy(dest, src, copy);
+        dest[copy] = 0;
     }
     return len;
 }
 
-char *strcat(char *dest, const char *src)
+size_t strlcat(char *dest, const char *src, size_t size)
 {
-    char *d = dest;
-    while (*d)
+    size_t dest_len = strnlen(dest, size);
+    if (dest_len == size)
+        return size + strlen(src);
+    return dest_len + strlcpy(dest + dest_len, src, size - dest_len);
+}
+
+char *strchr(const char *s, int c)
+{
+    const char ch = static_cast<char>(c);
+    while (!IsAligned(s))
     {
-        d++;
+        if (*s == ch)
+            return const_cast<char *>(s);
+        if (*s == 0)
+            return nullptr;
+        s++;
     }
-    while (*src)
+
+    const Word pattern = kOnes * static_cast<unsigned char>(ch);
+    while (true)
     {
-        *d++ = *src++;
+        Word w = LoadWord(s);
+        if (HasZero(w) || HasZero(w ^ pattern))
+            break;
+        s += kWordSize;
     }
-    *d = 0;
-    return dest;
+
+    while (*s != ch)
+    {
+        if (*s == 0)
+            return nullptr;
+        s++;
+    }
+    return const_cast<char *>(s);
 }
 
-char *strcpy(char *dest, const char *src)
+void *memchr(const void *s, int c, size_t n)
 {
-    char *d = dest;
-    while (*src)
+    const unsigned char *p = static_cast<const unsigned char *>(s);
+    const unsigned char ch = static_cast<unsigned char>(c);
+    while (n && !IsAligned(p))
     {
-        *d++ = *src++;
+        if (*p == ch)
+            return const_cast<unsigned char *>(p);
+        p++;
+        n--;
     }
-    *d = 0;
-    return dest;
-}
\ No newline at end of file
+
+    const Word pattern = kOnes * ch;
+    while (n >= kWordSize && !HasZero(LoadWord(p) ^ pattern))
+    {
+        p += kWordSize;
+        n -= kWordSize;
+    }
+
+    while (n)
+    {
+        if (*p == ch)
+            return const_cast<unsigned char *>(p);
+        p++;
+        n--;
+    }
+    return nullptr;
+}
+
+void *memrchr(const void *s, int c, size_t n)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(s) + n;
+    const unsigned char ch = static_cast<unsigned char>(c);
+    while (n && !IsAligned(p))
+    {
+        p--;
+        n--;
+        if (*p == ch)
+            return const_cast<unsigned char *>(p);
+    }
+
+    const Word pattern = kOnes * ch;
+    while (n >= kWordSize && !HasZero(LoadWord(p - kWordSize) ^ pattern))
+    {
+        p -= kWordSize;
+        n -= kWordSize;
+    }
+
+    while (n)
+    {
+        p--;
+        n--;
+        if (*p == ch)
+            return const_cast<unsigned char *>(p);
+    }
+    return nullptr;
+}
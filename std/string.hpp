@@ -1,7 +1,25 @@
 #pragma once
 
+#include <stddef.h>
+
+// 長さ・比較
+size_t strlen(const char *s);
+// 先頭 maxlen バイトより先は読まない
+size_t strnlen(const char *s, size_t maxlen);
 int strcmp(const char *s1, const char *s2);
-int strncmp(const char *s1, const char *s2, int n);
-int strlen(const char *s);
+int strncmp(const char *s1, const char *s2, size_t n);
+
+// コピー・連結
+char *strcpy(char *dest, const char *src);
+// src が n 未満なら残りを 0 で埋める (n 以上なら終端されない)
+char *strncpy(char *dest, const char *src, size_t n);
 char *strcat(char *dest, const char *src);
-char *strcpy(char *dest, const char *src);
\ No newline at end of file
+// 常に終端し、作ろうとした文字列の長さを返す (戻り値 >= size なら切り詰め)
+size_t strlcpy(char *dest, const char *src, size_t size);
+size_t strlcat(char *dest, const char *src, size_t size);
+
+// 検索
+char *strchr(const char *s, int c);
+void *memchr(const void *s, int c, size_t n);
+// 末尾から探す
+void *memrchr(const void *s, int c, size_t n);